@@ -25,14 +25,18 @@
     #include <unistd.h> // For access()
 #else
     // Linux platform
+    #define _GNU_SOURCE
     #include <X11/Xlib.h>
+    #include <X11/Xlib-xcb.h>
     #include <X11/Xutil.h>
     #include <X11/Xatom.h>
     #include <X11/keysym.h>
     #include <X11/extensions/XShm.h>
     #include <X11/extensions/Xrender.h>
+    #include <xcb/xcb.h>
     #include <sys/types.h>
     #include <sys/stat.h>
+    #include <sys/sysmacros.h>
     #include <dirent.h>
     #include <unistd.h>
     #include <fcntl.h>
@@ -41,6 +45,27 @@
     #include <string.h>
     #include <ctype.h>
     #include <time.h>
+    #include <stdint.h>
+    #include <pthread.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+    #include <limits.h>
+    #include <poll.h>
+    #include <setjmp.h>
+    #include <png.h>
+    #include <jpeglib.h>
+    #include <math.h>
+    #include <sys/ipc.h>
+    #include <sys/shm.h>
+    #include <zlib.h>
+    #include <signal.h>
+    #include <ftw.h>
+    #include <spawn.h>
+    #include <sys/wait.h>
+    #include <sys/ioctl.h>
+    #include <sys/file.h>
+    #include <linux/fs.h>
 #endif
 
 #include <stdio.h>
@@ -48,6 +73,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <errno.h>
+#include <stdint.h>
 
 #define MAX_FILES 2048
 #define MAX_PATH_LEN 32767
@@ -75,6 +102,365 @@ int stricmp_cross(const char *s1, const char *s2) {
 #endif
 }
 
+// ============ CASE-INSENSITIVE MATCHING ============
+// Filters and name sorting compare under Unicode simple case folding. Pure-ASCII
+// names (the common case) are scanned 32 bytes at a time with AVX2, or 16 with SSE2;
+// names with multibyte characters go through the code point path.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define HAVE_AVX2 1
+    #ifdef __SSE2__
+        #define HAVE_SSE2 1
+    #endif
+#endif
+
+// Decode one UTF-8 code point and advance *s past it (invalid bytes decode as themselves)
+unsigned utf8_decode(const unsigned char **s) {
+    const unsigned char *p = *s;
+    unsigned cp = p[0];
+    int n = 1;
+    if ((p[0] & 0xE0) == 0xC0 && (p[1] & 0xC0) == 0x80) {
+        cp = ((unsigned)(p[0] & 0x1F) << 6) | (p[1] & 0x3F);
+        n = 2;
+    } else if ((p[0] & 0xF0) == 0xE0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80) {
+        cp = ((unsigned)(p[0] & 0x0F) << 12) | ((unsigned)(p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+        n = 3;
+    } else if ((p[0] & 0xF8) == 0xF0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+        cp = ((unsigned)(p[0] & 0x07) << 18) | ((unsigned)(p[1] & 0x3F) << 12) |
+             ((unsigned)(p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+        n = 4;
+    }
+    *s = p + n;
+    return cp;
+}
+
+// Encode a code point as UTF-8 into out (at least 5 bytes, NUL-terminated); returns the byte count
+int utf8_encode(unsigned cp, char *out) {
+    int n;
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        out[0] = (char)(0xF0 | ((cp >> 18) & 0x07));
+        out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// Simple case folding (CaseFolding.txt, status C and S) for the scripts that show up
+// in file names. A range with step 2 alternates upper/lower starting at lo.
+typedef struct {
+    unsigned lo, hi;
+    int delta;
+    int step;
+} FoldRange;
+
+const FoldRange g_fold_ranges[] = {
+    { 0x00B5, 0x00B5,   775, 1 },   // micro sign -> Greek mu
+    { 0x00C0, 0x00D6,    32, 1 },
+    { 0x00D8, 0x00DE,    32, 1 },
+    { 0x0100, 0x012F,     1, 2 },
+    { 0x0132, 0x0137,     1, 2 },
+    { 0x0139, 0x0148,     1, 2 },
+    { 0x014A, 0x0177,     1, 2 },
+    { 0x0178, 0x0178,  -121, 1 },
+    { 0x0179, 0x017E,     1, 2 },
+    { 0x017F, 0x017F,  -268, 1 },   // long s -> s
+    { 0x01CD, 0x01DC,     1, 2 },
+    { 0x01DE, 0x01EF,     1, 2 },
+    { 0x01F8, 0x021F,     1, 2 },
+    { 0x0222, 0x0233,     1, 2 },
+    { 0x0386, 0x0386,    38, 1 },
+    { 0x0388, 0x038A,    37, 1 },
+    { 0x038C, 0x038C,    64, 1 },
+    { 0x038E, 0x038F,    63, 1 },
+    { 0x0391, 0x03A1,    32, 1 },
+    { 0x03A3, 0x03AB,    32, 1 },
+    { 0x03C2, 0x03C2,     1, 1 },   // final sigma
+    { 0x03D8, 0x03EF,     1, 2 },
+    { 0x0400, 0x040F,    80, 1 },
+    { 0x0410, 0x042F,    32, 1 },
+    { 0x0460, 0x0481,     1, 2 },
+    { 0x048A, 0x04BF,     1, 2 },
+    { 0x04C0, 0x04C0,    15, 1 },
+    { 0x04C1, 0x04CE,     1, 2 },
+    { 0x04D0, 0x052F,     1, 2 },
+    { 0x0531, 0x0556,    48, 1 },
+    { 0x10A0, 0x10C5,  7264, 1 },
+    { 0x1E00, 0x1E95,     1, 2 },
+    { 0x1E9E, 0x1E9E, -7615, 1 },   // capital sharp s
+    { 0x1EA0, 0x1EFF,     1, 2 },
+    { 0x2126, 0x2126, -7517, 1 },   // ohm sign
+    { 0x212A, 0x212A, -8383, 1 },   // kelvin sign
+    { 0x212B, 0x212B, -8262, 1 },   // angstrom sign
+    { 0x2160, 0x216F,    16, 1 },
+    { 0x24B6, 0x24CF,    26, 1 },
+    { 0x2C00, 0x2C2F,    48, 1 },
+    { 0xFF21, 0xFF3A,    32, 1 },
+    { 0x10400, 0x10427,  40, 1 },
+};
+
+unsigned fold_ascii(unsigned c) {
+    return c - 'A' < 26u ? c + 32 : c;
+}
+
+unsigned fold_codepoint(unsigned cp) {
+    if (cp < 0x80) return fold_ascii(cp);
+    int lo = 0, hi = (int)(sizeof(g_fold_ranges) / sizeof(g_fold_ranges[0])) - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const FoldRange *r = &g_fold_ranges[mid];
+        if (cp < r->lo) hi = mid - 1;
+        else if (cp > r->hi) lo = mid + 1;
+        else return (r->step == 1 || (cp - r->lo) % 2 == 0) ? cp + r->delta : cp;
+    }
+    return cp;
+}
+
+// Case-insensitive ordering of two UTF-8 strings by folded code point
+int utf8_casecmp(const char *a, const char *b) {
+    const unsigned char *p = (const unsigned char *)a, *q = (const unsigned char *)b;
+    for (;;) {
+        unsigned ca = *p, cb = *q;
+        if ((ca | cb) < 0x80) {
+            ca = fold_ascii(ca);
+            cb = fold_ascii(cb);
+            if (ca != cb) return ca < cb ? -1 : 1;
+            if (ca == 0) return 0;
+            p++;
+            q++;
+            continue;
+        }
+        ca = fold_codepoint(utf8_decode(&p));
+        cb = fold_codepoint(utf8_decode(&q));
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+}
+
+int ascii_equal_folded(const unsigned char *a, const unsigned char *b, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        if (fold_ascii(a[i]) != fold_ascii(b[i])) return 0;
+    return 1;
+}
+
+// Bit that makes a byte compare case-insensitively against c: for a letter, b | 0x20
+// equals the lowercase letter only when b is that letter in either case
+unsigned ascii_case_bit(unsigned c) {
+    return (c | 0x20) - 'a' < 26u ? 0x20 : 0;
+}
+
+// Only two non-ASCII letters fold into ASCII: the kelvin sign (E2 84 AA, to k) and
+// long s (C5 BF, to s). Any other multibyte character can never be part of a match
+// for an ASCII needle, so only those lead bytes send a name to the code point path.
+#define FOLD_LEAD_KELVIN 0xE2
+#define FOLD_LEAD_LONG_S 0xC5
+
+// Byte-at-a-time search from offset i, for CPUs without SIMD and near page ends
+int ascii_casestr_scalar(const unsigned char *hay, size_t i, const unsigned char *needle, size_t nlen,
+                         unsigned foldLeads) {
+    for (; hay[i]; i++) {
+        foldLeads |= hay[i] == FOLD_LEAD_KELVIN || hay[i] == FOLD_LEAD_LONG_S;
+        if (ascii_equal_folded(hay + i, needle, nlen)) return 1;
+    }
+    return foldLeads ? -1 : 0;
+}
+
+// The vector searches below work the same way. Candidates must match the first and
+// the last needle byte; only those are verified. Blocks may read past the terminator,
+// but only while both loads stay in the page the block starts in: that page holds
+// unscanned hay, while the one after it may not be mapped even if the needle's last
+// byte would fall there. Verification stops at the terminator because it never equals
+// a needle byte.
+
+#ifdef HAVE_AVX2
+__attribute__((target("avx2")))
+int ascii_casestr_avx2(const unsigned char *hay, const unsigned char *needle, size_t nlen) {
+    const __m256i firstBit = _mm256_set1_epi8((char)ascii_case_bit(needle[0]));
+    const __m256i lastBit = _mm256_set1_epi8((char)ascii_case_bit(needle[nlen - 1]));
+    const __m256i first = _mm256_set1_epi8((char)fold_ascii(needle[0]));
+    const __m256i last = _mm256_set1_epi8((char)fold_ascii(needle[nlen - 1]));
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i kelvin = _mm256_set1_epi8((char)FOLD_LEAD_KELVIN);
+    const __m256i longS = _mm256_set1_epi8((char)FOLD_LEAD_LONG_S);
+    size_t i = 0;
+    unsigned foldLeads = 0;
+    for (;;) {
+        const unsigned char *pa = hay + i, *pb = hay + i + nlen - 1;
+        if (((uintptr_t)pa & 4095) + (nlen - 1) + 32 > 4096) break;
+        __m256i a = _mm256_loadu_si256((const __m256i *)pa);
+        __m256i b = _mm256_loadu_si256((const __m256i *)pb);
+        unsigned ends = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero));
+        unsigned valid = ends ? (ends & -ends) - 1 : 0xFFFFFFFFu;
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(a, firstBit), first),
+                             _mm256_cmpeq_epi8(_mm256_or_si256(b, lastBit), last))) & valid;
+        foldLeads |= (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(a, kelvin),
+                                                                    _mm256_cmpeq_epi8(a, longS))) & valid;
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (nlen <= 2 || ascii_equal_folded(pa + bit + 1, needle + 1, nlen - 2)) return 1;
+            mask &= mask - 1;
+        }
+        if (ends) return foldLeads ? -1 : 0;
+        i += 32;
+    }
+    return ascii_casestr_scalar(hay, i, needle, nlen, foldLeads);
+}
+#endif
+
+#ifdef HAVE_SSE2
+int ascii_casestr_sse2(const unsigned char *hay, const unsigned char *needle, size_t nlen) {
+    const __m128i firstBit = _mm_set1_epi8((char)ascii_case_bit(needle[0]));
+    const __m128i lastBit = _mm_set1_epi8((char)ascii_case_bit(needle[nlen - 1]));
+    const __m128i first = _mm_set1_epi8((char)fold_ascii(needle[0]));
+    const __m128i last = _mm_set1_epi8((char)fold_ascii(needle[nlen - 1]));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i kelvin = _mm_set1_epi8((char)FOLD_LEAD_KELVIN);
+    const __m128i longS = _mm_set1_epi8((char)FOLD_LEAD_LONG_S);
+    size_t i = 0;
+    unsigned foldLeads = 0;
+    for (;;) {
+        const unsigned char *pa = hay + i, *pb = hay + i + nlen - 1;
+        if (((uintptr_t)pa & 4095) + (nlen - 1) + 16 > 4096) break;
+        __m128i a = _mm_loadu_si128((const __m128i *)pa);
+        __m128i b = _mm_loadu_si128((const __m128i *)pb);
+        unsigned ends = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero));
+        unsigned valid = ends ? (ends & -ends) - 1 : 0xFFFFu;
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(a, firstBit), first),
+                                                                  _mm_cmpeq_epi8(_mm_or_si128(b, lastBit), last))) & valid;
+        foldLeads |= (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(a, kelvin),
+                                                              _mm_cmpeq_epi8(a, longS))) & valid;
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (nlen <= 2 || ascii_equal_folded(pa + bit + 1, needle + 1, nlen - 2)) return 1;
+            mask &= mask - 1;
+        }
+        if (ends) return foldLeads ? -1 : 0;
+        i += 16;
+    }
+    return ascii_casestr_scalar(hay, i, needle, nlen, foldLeads);
+}
+#endif
+
+// Find an ASCII needle in hay ignoring case, in one pass without measuring hay first.
+// Returns 1 or 0, or -1 when there was no match but hay may contain one of the two
+// letters above. wide selects the AVX2 search (see fold_needle_init).
+int ascii_casestr(const unsigned char *hay, const unsigned char *needle, size_t nlen, int wide) {
+    (void)wide;
+#ifdef HAVE_AVX2
+    if (wide) return ascii_casestr_avx2(hay, needle, nlen);
+#endif
+#ifdef HAVE_SSE2
+    return ascii_casestr_sse2(hay, needle, nlen);
+#else
+    return ascii_casestr_scalar(hay, 0, needle, nlen, 0);
+#endif
+}
+
+// Fold a UTF-8 string into code points; returns the count
+size_t utf8_fold_codepoints(const unsigned char *s, unsigned *out) {
+    size_t n = 0;
+    while (*s) out[n++] = fold_codepoint(utf8_decode(&s));
+    return n;
+}
+
+// Code point search: fold both strings once, then compare folded code points
+int utf8_casestr_slow(const unsigned char *hay, size_t hlen, const unsigned char *needle, size_t nlen) {
+    unsigned stackBuf[512];
+    unsigned *buf = stackBuf;
+    if (hlen + nlen > sizeof(stackBuf) / sizeof(stackBuf[0])) {
+        buf = (unsigned *)malloc((hlen + nlen) * sizeof(unsigned));
+        if (!buf) return 0;
+    }
+    unsigned *n = buf;
+    size_t nn = utf8_fold_codepoints(needle, n);
+    unsigned *h = buf + nn;
+    size_t hn = utf8_fold_codepoints(hay, h);
+
+    int found = 0;
+    for (size_t i = 0; !found && i + nn <= hn; i++) {
+        if (h[i] != n[0]) continue;
+        size_t k = 1;
+        while (k < nn && h[i + k] == n[k]) k++;
+        found = k == nn;
+    }
+    if (buf != stackBuf) free(buf);
+    return found;
+}
+
+// Length of the kelvin sign or long s at p, or 0
+int utf8_ascii_folding_char(const unsigned char *p) {
+    if (p[0] == FOLD_LEAD_KELVIN && p[1] == 0x84 && p[2] == 0xAA) return 3;
+    if (p[0] == FOLD_LEAD_LONG_S && p[1] == 0xBF) return 2;
+    return 0;
+}
+
+// A search string analysed once, for matching against many names
+typedef struct {
+    const unsigned char *text;
+    size_t len;
+    int ascii;
+    int wide;   // CPU has AVX2
+} FoldNeedle;
+
+void fold_needle_init(FoldNeedle *fn, const char *needle) {
+    unsigned high = 0;
+    fn->text = (const unsigned char *)needle;
+    for (fn->len = 0; fn->text[fn->len]; fn->len++) high |= fn->text[fn->len];
+    fn->ascii = high < 0x80;
+#ifdef HAVE_AVX2
+    fn->wide = __builtin_cpu_supports("avx2");
+#else
+    fn->wide = 0;
+#endif
+}
+
+// Case-insensitive substring test of a UTF-8 name against a prepared needle
+int fold_needle_match(const FoldNeedle *fn, const char *hay) {
+    const unsigned char *h = (const unsigned char *)hay, *n = fn->text;
+    if (fn->len == 0) return 1;
+    if (fn->ascii) {
+        int found = ascii_casestr(h, n, fn->len, fn->wide);
+        if (found >= 0) return found;
+    }
+    size_t hlen = strlen(hay);
+    if (!fn->ascii) {
+        // Pure-ASCII text can only match if every multibyte needle character folds into ASCII
+        unsigned hayHigh = 0;
+        for (size_t i = 0; i < hlen; i++) hayHigh |= h[i];
+        if (hayHigh < 0x80) {
+            for (size_t i = 0; i < fn->len; ) {
+                if (n[i] < 0x80) { i++; continue; }
+                int len = utf8_ascii_folding_char(n + i);
+                if (!len) return 0;
+                i += len;
+            }
+        }
+    }
+    return utf8_casestr_slow(h, hlen, n, fn->len);
+}
+
+// Case-insensitive substring test for UTF-8 strings
+int utf8_casestr(const char *hay, const char *needle) {
+    FoldNeedle fn;
+    fold_needle_init(&fn, needle);
+    return fold_needle_match(&fn, hay);
+}
+
 // Platform-independent functions
 int IS_CLI() {
     if (access("CLI_MODE", F_OK) == 0) {
@@ -99,11 +485,38 @@ int is_directory(const char *path) {
 #endif
 }
 
-// Check if filename matches filters
+// Check if filename matches filters (case-insensitive)
 int matches_filters(const char *filename, int argc, char *argv[], int startIndex) {
     if (argc - startIndex <= 0) return 1; // no filters
     for (int i = startIndex; i < argc; i++)
-        if (strstr(filename, argv[i]) != NULL)
+        if (utf8_casestr(filename, argv[i]))
+            return 1;
+    return 0;
+}
+
+// Filters prepared once per directory scan, same rules as matches_filters()
+typedef struct {
+    FoldNeedle *needles;
+    int count;
+} FilterSet;
+
+void filter_set_init(FilterSet *fs, int argc, char *argv[], int startIndex) {
+    fs->count = argc - startIndex > 0 ? argc - startIndex : 0;
+    fs->needles = fs->count ? (FoldNeedle *)malloc((size_t)fs->count * sizeof(FoldNeedle)) : NULL;
+    if (!fs->needles) fs->count = 0;
+    for (int i = 0; i < fs->count; i++) fold_needle_init(&fs->needles[i], argv[startIndex + i]);
+}
+
+void filter_set_free(FilterSet *fs) {
+    free(fs->needles);
+    fs->needles = NULL;
+    fs->count = 0;
+}
+
+int filter_set_match(const FilterSet *fs, const char *filename) {
+    if (fs->count == 0) return 1;
+    for (int i = 0; i < fs->count; i++)
+        if (fold_needle_match(&fs->needles[i], filename))
             return 1;
     return 0;
 }
@@ -125,6 +538,25 @@ void clear_console() {
 #endif
 }
 
+#ifndef _WIN32
+// Open a file with the default application. The path is an argument of xdg-open, never
+// part of a shell command, so no character in a file name can run anything. Returns 0
+// or an errno value.
+int open_with_default_app(const char *path) {
+    // Earlier launches that have exited
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+
+    char *args[] = { (char *)"xdg-open", (char *)path, NULL };
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+    pid_t pid;
+    int rc = posix_spawnp(&pid, args[0], NULL, &attr, args, environ);
+    posix_spawnattr_destroy(&attr);
+    return rc;
+}
+#endif
+
 // Remove trailing slashes from a path
 void remove_trailing_slash(char *path) {
     size_t len = strlen(path);
@@ -150,8 +582,19 @@ int set_cur_dir(const char *path) {
     return 0;
 }
 
-// Scan directory and fill file list
-int scan_directory(const char *dirpath, char *files[], int argc, char *argv[], int filterStart) {
+// Entry types reported by for_each_entry (taken from the directory record, no stat)
+#define ENTRY_TYPE_UNKNOWN 0
+#define ENTRY_TYPE_FILE    1
+#define ENTRY_TYPE_DIR     2
+#define ENTRY_TYPE_LINK    3
+#define ENTRY_TYPE_OTHER   4
+
+// Called once per matching entry; return nonzero to stop the scan
+typedef int (*entry_callback)(const char *name, int entryType, void *ctx);
+
+// Stream the entries of a directory that pass the filters to a callback.
+// Nothing is allocated per entry. Returns -1 if the directory cannot be opened.
+int for_each_entry(const char *dirpath, int argc, char *argv[], int filterStart, entry_callback cb, void *ctx) {
 #ifdef _WIN32
     WIN32_FIND_DATAW fd;
     wchar_t searchPath[MAX_PATH_LEN];
@@ -161,40 +604,606 @@ int scan_directory(const char *dirpath, char *files[], int argc, char *argv[], i
     _snwprintf(searchPath, MAX_PATH_LEN, L"%s\\*", wdirpath);
 
     HANDLE hFind = FindFirstFileW(searchPath, &fd);
-    if (hFind == INVALID_HANDLE_VALUE) return 0;
+    if (hFind == INVALID_HANDLE_VALUE) return -1;
 
-    int count = 0;
+    FilterSet filters;
+    filter_set_init(&filters, argc, argv, filterStart);
+    char name[MAX_PATH_LEN];
     do {
         const wchar_t *wname = fd.cFileName;
         if (wcscmp(wname, L".") == 0 || wcscmp(wname, L"..") == 0) continue;
 
-        char name[MAX_PATH_LEN];
         WideCharToMultiByte(CP_UTF8, 0, wname, -1, name, MAX_PATH_LEN, NULL, NULL);
+        if (!filter_set_match(&filters, name)) continue;
 
-        if (matches_filters(name, argc, argv, filterStart) && count < MAX_FILES)
-            files[count++] = strdup(name);
+        int type = ENTRY_TYPE_FILE;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) type = ENTRY_TYPE_LINK;
+        else if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) type = ENTRY_TYPE_DIR;
 
+        if (cb(name, type, ctx)) break;
     } while (FindNextFileW(hFind, &fd));
 
     FindClose(hFind);
-    return count;
+    filter_set_free(&filters);
+    return 0;
 #else
     DIR *dir = opendir(dirpath);
-    if (!dir) return 0;
+    if (!dir) return -1;
 
+    FilterSet filters;
+    filter_set_init(&filters, argc, argv, filterStart);
     struct dirent *entry;
-    int count = 0;
-
     while ((entry = readdir(dir)) != NULL) {
         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (!filter_set_match(&filters, entry->d_name)) continue;
+
+        int type;
+        switch (entry->d_type) {
+            case DT_REG: type = ENTRY_TYPE_FILE; break;
+            case DT_DIR: type = ENTRY_TYPE_DIR; break;
+            case DT_LNK: type = ENTRY_TYPE_LINK; break;
+            case DT_UNKNOWN: type = ENTRY_TYPE_UNKNOWN; break;
+            default: type = ENTRY_TYPE_OTHER; break;
+        }
 
-        if (matches_filters(entry->d_name, argc, argv, filterStart) && count < MAX_FILES)
-            files[count++] = strdup(entry->d_name);
+        if (cb(entry->d_name, type, ctx)) break;
     }
 
     closedir(dir);
+    filter_set_free(&filters);
+    return 0;
+#endif
+}
+
+// Collector used by scan_directory
+typedef struct {
+    char **files;
+    int count;
+} ScanCollector;
+
+int collect_entry(const char *name, int entryType, void *ctx) {
+    (void)entryType;
+    ScanCollector *c = (ScanCollector *)ctx;
+    if (c->count >= MAX_FILES) return 1;
+    c->files[c->count++] = strdup(name);
+    return 0;
+}
+
+// Scan directory and fill file list
+int scan_directory(const char *dirpath, char *files[], int argc, char *argv[], int filterStart) {
+    ScanCollector c = { files, 0 };
+    if (for_each_entry(dirpath, argc, argv, filterStart, collect_entry, &c) < 0) return 0;
+    return c.count;
+}
+
+// Resolve the starting directory from argv[1] the same way the CLI does.
+// Sets filterStart to 2 when argv[1] was consumed as the directory.
+void resolve_start_dir(int argc, char *argv[], char *dirpath, int *filterStart) {
+    *filterStart = 1;
+    dirpath[0] = '\0';
+
+    if (argc >= 2) {
+        char candidatePath[MAX_PATH_LEN];
+        strncpy(candidatePath, argv[1], MAX_PATH_LEN - 1);
+        candidatePath[MAX_PATH_LEN - 1] = '\0';
+        remove_trailing_slash(candidatePath);
+
+        if (is_directory(candidatePath) && set_cur_dir(candidatePath))
+            *filterStart = 2;
+    }
+
+#ifdef _WIN32
+    wchar_t wdirpath[MAX_PATH_LEN];
+    GetCurrentDirectoryW(MAX_PATH_LEN, wdirpath);
+    WideCharToMultiByte(CP_UTF8, 0, wdirpath, -1, dirpath, MAX_PATH_LEN, NULL, NULL);
+#else
+    if (!getcwd(dirpath, MAX_PATH_LEN)) strcpy(dirpath, ".");
+#endif
+    remove_trailing_slash(dirpath);
+}
+
+// ---- several folders at once ----
+
+// "better-toolbar ~/bin + ~/tools + /opt/apps .desktop" lists the matching entries of all three
+// folders as one sorted list. Each folder is scanned on its own thread, so a listing takes
+// as long as the slowest folder rather than the sum of them.
+
+#define MAX_ROOTS 16
+
+// The leading folder arguments
+typedef struct {
+    char *paths[MAX_ROOTS];         // absolute
+    const char *labels[MAX_ROOTS];  // as typed; shown as the source of each row
+    int failed[MAX_ROOTS];          // could not be listed by the last scan
+    int count;
+    int filterStart;                // first argument after the last root
+} RootSet;
+
+typedef struct {
+    char *name;
+    int root;
+    int type;
+} RootEntry;
+
+int g_dedup_roots = 0;   // --dedup: a name found in several folders is listed once, from the first of them
+int g_apps_mode = 0;     // --apps (linux): list the installed applications instead of a folder
+int g_recent_mode = 0;   // --recent (linux): list the recently used files instead of a folder
+
+void roots_free(RootSet *roots) {
+    for (int i = 0; i < roots->count; i++) free(roots->paths[i]);
+    roots->count = 0;
+}
+
+// A copy with its own path strings; returns -1 (and an empty set) when out of memory
+int roots_copy(RootSet *dst, const RootSet *src) {
+    *dst = *src;
+    for (int i = 0; i < src->count; i++) {
+        if (!(dst->paths[i] = strdup(src->paths[i]))) {
+            dst->count = i;
+            roots_free(dst);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Roots are folders joined by "+" arguments: `dir1 + dir2 + dir3 filters...` (up to
+// MAX_ROOTS). A folder alone is one root, so a filter that happens to name a folder in
+// the current directory never turns into a second root. Returns the number of roots;
+// filters start at roots->filterStart.
+int collect_roots(int argc, char *argv[], RootSet *roots) {
+    roots->count = 0;
+    roots->filterStart = 1;
+    for (int i = 1; i < argc && roots->count < MAX_ROOTS; i += 2) {
+        if (!is_directory(argv[i])) break;
+        char *path;
+#ifdef _WIN32
+        wchar_t wrel[MAX_PATH_LEN], wabs[MAX_PATH_LEN];
+        MultiByteToWideChar(CP_UTF8, 0, argv[i], -1, wrel, MAX_PATH_LEN);
+        if (!GetFullPathNameW(wrel, MAX_PATH_LEN, wabs, NULL)) break;
+        int size = WideCharToMultiByte(CP_UTF8, 0, wabs, -1, NULL, 0, NULL, NULL);
+        path = (char *)malloc((size_t)size);
+        if (path) WideCharToMultiByte(CP_UTF8, 0, wabs, -1, path, size, NULL, NULL);
+#else
+        path = realpath(argv[i], NULL);
+#endif
+        if (!path) break;
+        remove_trailing_slash(path);
+        if (path[0] == '\0') strcpy(path, "/");   // the root folder itself
+        roots->paths[roots->count] = path;
+        roots->labels[roots->count] = argv[i];
+        roots->failed[roots->count] = 0;
+        roots->count++;
+        roots->filterStart = i + 1;
+        if (i + 1 >= argc || strcmp(argv[i + 1], "+") != 0) break;
+    }
+    return roots->count;
+}
+
+typedef void (*concurrent_fn)(void *ctx, int index);
+
+typedef struct {
+    concurrent_fn fn;
+    void *ctx;
+    int index;
+} ConcurrentItem;
+
+#ifdef _WIN32
+DWORD WINAPI concurrent_item_main(LPVOID arg) {
+    ConcurrentItem *item = (ConcurrentItem *)arg;
+    item->fn(item->ctx, item->index);
+    return 0;
+}
+#else
+void *concurrent_item_main(void *arg) {
+    ConcurrentItem *item = (ConcurrentItem *)arg;
+    item->fn(item->ctx, item->index);
+    return NULL;
+}
+#endif
+
+// Run fn(ctx, i) for each i in [0, count <= MAX_ROOTS), each on its own thread. The
+// caller's thread takes item 0 and any item whose thread could not be started.
+void run_concurrently(int count, concurrent_fn fn, void *ctx) {
+    ConcurrentItem items[MAX_ROOTS];
+    int started[MAX_ROOTS] = {0};
+#ifdef _WIN32
+    HANDLE threads[MAX_ROOTS];
+#else
+    pthread_t threads[MAX_ROOTS];
+#endif
+    if (count > MAX_ROOTS) count = MAX_ROOTS;
+    for (int i = 1; i < count; i++) {
+        items[i].fn = fn;
+        items[i].ctx = ctx;
+        items[i].index = i;
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, concurrent_item_main, &items[i], 0, NULL);
+        started[i] = threads[i] != NULL;
+#else
+        started[i] = pthread_create(&threads[i], NULL, concurrent_item_main, &items[i]) == 0;
+#endif
+    }
+    if (count > 0) fn(ctx, 0);
+    for (int i = 1; i < count; i++) {
+        if (!started[i]) {
+            fn(ctx, i);
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+}
+
+// Rows collected from one root
+typedef struct {
+    RootEntry *entries;
+    int count;
+    int capacity;
+    int root;
+    int outOfMemory;
+} RootCollector;
+
+int collect_root_entry(const char *name, int entryType, void *ctx) {
+    RootCollector *c = (RootCollector *)ctx;
+    if (c->count == c->capacity) {
+        int cap = c->capacity ? c->capacity * 2 : 256;
+        RootEntry *grown = (RootEntry *)realloc(c->entries, (size_t)cap * sizeof(RootEntry));
+        if (!grown) { c->outOfMemory = 1; return 1; }
+        c->entries = grown;
+        c->capacity = cap;
+    }
+    char *copy = strdup(name);
+    if (!copy) { c->outOfMemory = 1; return 1; }
+    c->entries[c->count].name = copy;
+    c->entries[c->count].root = c->root;
+    c->entries[c->count].type = entryType;
+    c->count++;
+    return 0;
+}
+
+typedef struct {
+    RootSet *roots;
+    RootCollector parts[MAX_ROOTS];
+    int argc;
+    char **argv;
+    int filterStart;
+} RootScanJob;
+
+void scan_root_item(void *ctx, int index) {
+    RootScanJob *job = (RootScanJob *)ctx;
+    RootCollector *c = &job->parts[index];
+    c->root = index;
+    job->roots->failed[index] = for_each_entry(job->roots->paths[index], job->argc, job->argv,
+                                               job->filterStart, collect_root_entry, c) < 0;
+}
+
+// Folders first, then by name; equal names stay in root order
+int compare_root_entries(const void *a, const void *b) {
+    const RootEntry *ea = (const RootEntry *)a, *eb = (const RootEntry *)b;
+    int da = ea->type == ENTRY_TYPE_DIR, db = eb->type == ENTRY_TYPE_DIR;
+    if (da != db) return db - da;
+    int c = utf8_casecmp(ea->name, eb->name);
+    if (!c) c = strcmp(ea->name, eb->name);
+    return c ? c : ea->root - eb->root;
+}
+
+void root_entries_free(RootEntry *entries, int count) {
+    for (int i = 0; i < count; i++) free(entries[i].name);
+    free(entries);
+}
+
+// Scan every root concurrently and merge the rows into one sorted array, which the caller
+// frees with root_entries_free. Sets roots->failed for folders that could not be read.
+// With dedup, an entry whose name (and kind) appeared in an earlier root is dropped.
+// Returns the row count, or -1 when out of memory.
+int scan_roots(RootSet *roots, int argc, char *argv[], int filterStart, int dedup, RootEntry **out) {
+    RootScanJob *job = (RootScanJob *)calloc(1, sizeof(RootScanJob));
+    if (!job) return -1;
+    job->roots = roots;
+    job->argc = argc;
+    job->argv = argv;
+    job->filterStart = filterStart;
+    run_concurrently(roots->count, scan_root_item, job);
+
+    int total = 0, outOfMemory = 0;
+    for (int r = 0; r < roots->count; r++) {
+        total += job->parts[r].count;
+        outOfMemory |= job->parts[r].outOfMemory;
+    }
+    RootEntry *merged = outOfMemory ? NULL : (RootEntry *)malloc((size_t)(total ? total : 1) * sizeof(RootEntry));
+    if (!merged) {
+        for (int r = 0; r < roots->count; r++) root_entries_free(job->parts[r].entries, job->parts[r].count);
+        free(job);
+        return -1;
+    }
+    int count = 0;
+    for (int r = 0; r < roots->count; r++) {
+        memcpy(merged + count, job->parts[r].entries, (size_t)job->parts[r].count * sizeof(RootEntry));
+        count += job->parts[r].count;
+        free(job->parts[r].entries);
+    }
+    free(job);
+
+    qsort(merged, (size_t)count, sizeof(RootEntry), compare_root_entries);
+    if (dedup && count > 1) {
+        int kept = 1;
+        for (int i = 1; i < count; i++) {
+            RootEntry *prev = &merged[kept - 1];
+            if (strcmp(prev->name, merged[i].name) == 0 &&
+                (prev->type == ENTRY_TYPE_DIR) == (merged[i].type == ENTRY_TYPE_DIR)) {
+                free(merged[i].name);
+                continue;
+            }
+            merged[kept++] = merged[i];
+        }
+        count = kept;
+    }
+    *out = merged;
     return count;
+}
+
+// Scan several folders concurrently into the CLI's file list, merged and sorted;
+// sources[i] is the root files[i] came from
+int scan_merged(RootSet *roots, char *files[], int sources[], int argc, char *argv[], int filterStart) {
+    RootEntry *entries;
+    int count = scan_roots(roots, argc, argv, filterStart, g_dedup_roots, &entries);
+    if (count < 0) return 0;
+    int kept = count < MAX_FILES ? count : MAX_FILES;
+    for (int i = 0; i < kept; i++) {
+        files[i] = entries[i].name;
+        sources[i] = entries[i].root;
+        entries[i].name = NULL;
+    }
+    root_entries_free(entries, count);
+    return kept;
+}
+
+// ============ NON-INTERACTIVE LIST MODE ============
+
+#define LIST_FMT_LINES 0
+#define LIST_FMT_NUL   1
+#define LIST_FMT_JSON  2
+
+#define LIST_BUFFER_SIZE (1 << 20)
+
+// Output state for --list; one fixed buffer, flushed with large writes
+typedef struct {
+    char buf[LIST_BUFFER_SIZE];
+    size_t len;
+    int format;
+    int failed;
+    const char *dirpath;
+    size_t dirLen;
+    unsigned long long count;
+} ListOutput;
+
+static ListOutput g_list_out;
+
+// Write the buffered output to stdout
+void list_flush(ListOutput *out) {
+    size_t off = 0;
+    while (off < out->len && !out->failed) {
+#ifdef _WIN32
+        DWORD written = 0;
+        if (!WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), out->buf + off, (DWORD)(out->len - off), &written, NULL) || written == 0) {
+            out->failed = 1;
+            break;
+        }
+        off += written;
+#else
+        ssize_t n = write(STDOUT_FILENO, out->buf + off, out->len - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            out->failed = 1;
+            break;
+        }
+        off += (size_t)n;
 #endif
+    }
+    out->len = 0;
+}
+
+// Append bytes to the output buffer, flushing when it fills up
+void list_put(ListOutput *out, const char *data, size_t len) {
+    while (len > 0 && !out->failed) {
+        size_t room = LIST_BUFFER_SIZE - out->len;
+        if (room == 0) {
+            list_flush(out);
+            continue;
+        }
+        size_t n = len < room ? len : room;
+        memcpy(out->buf + out->len, data, n);
+        out->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// Length of the well-formed UTF-8 sequence at p (no overlong forms, surrogates or code
+// points past U+10FFFF), or 0 if the bytes there are not one
+int utf8_valid_length(const unsigned char *p) {
+    if (p[0] < 0x80) return 1;
+    if (p[0] >= 0xC2 && p[0] <= 0xDF) return (p[1] & 0xC0) == 0x80 ? 2 : 0;
+    if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+        unsigned lo = p[0] == 0xE0 ? 0xA0 : 0x80, hi = p[0] == 0xED ? 0x9F : 0xBF;
+        return p[1] >= lo && p[1] <= hi && (p[2] & 0xC0) == 0x80 ? 3 : 0;
+    }
+    if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+        unsigned lo = p[0] == 0xF0 ? 0x90 : 0x80, hi = p[0] == 0xF4 ? 0x8F : 0xBF;
+        return p[1] >= lo && p[1] <= hi && (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80 ? 4 : 0;
+    }
+    return 0;
+}
+
+// Append a JSON string body (without quotes), escaping quotes, backslashes and control
+// bytes. Names are raw bytes on Linux; a byte that is not part of valid UTF-8 becomes
+// U+FFFD, so the output always parses (the lines and NUL formats keep the exact bytes).
+void list_put_json_string(ListOutput *out, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x80) {
+            int n = utf8_valid_length((const unsigned char *)s);
+            if (n > 0) {
+                s += n - 1;
+                continue;
+            }
+            list_put(out, run, (size_t)(s - run));
+            list_put(out, "\\ufffd", 6);
+            run = s + 1;
+            continue;
+        }
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        list_put(out, run, (size_t)(s - run));
+        char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+        switch (c) {
+            case '"':  list_put(out, "\\\"", 2); break;
+            case '\\': list_put(out, "\\\\", 2); break;
+            case '\n': list_put(out, "\\n", 2); break;
+            case '\t': list_put(out, "\\t", 2); break;
+            default:   list_put(out, esc, 6); break;
+        }
+        run = s + 1;
+    }
+    list_put(out, run, (size_t)(s - run));
+}
+
+// Emit one entry in the selected format
+int list_entry(const char *name, int entryType, void *ctx) {
+    static const char *typeNames[] = { "unknown", "file", "dir", "link", "other" };
+    ListOutput *out = (ListOutput *)ctx;
+    char sep = PATH_SEP;
+
+    if (out->format == LIST_FMT_JSON) {
+        list_put(out, "{\"name\":\"", 9);
+        list_put_json_string(out, name);
+        list_put(out, "\",\"path\":\"", 10);
+        list_put_json_string(out, out->dirpath);
+        list_put_json_string(out, PATH_SEP == '/' ? "/" : "\\");
+        list_put_json_string(out, name);
+        list_put(out, "\",\"type\":\"", 10);
+        list_put(out, typeNames[entryType], strlen(typeNames[entryType]));
+        list_put(out, "\"}\n", 3);
+    } else {
+        list_put(out, out->dirpath, out->dirLen);
+        list_put(out, &sep, 1);
+        list_put(out, name, strlen(name));
+        list_put(out, out->format == LIST_FMT_NUL ? "\0" : "\n", 1);
+    }
+
+    out->count++;
+    return out->failed;
+}
+
+// Parse "--list", "--list=lines", "--list=nul" or "--list=json"; returns -1 if arg is not a list option
+int parse_list_option(const char *arg) {
+    if (strcmp(arg, "--list") == 0 || strcmp(arg, "--list=lines") == 0) return LIST_FMT_LINES;
+    if (strcmp(arg, "--list=nul") == 0) return LIST_FMT_NUL;
+    if (strcmp(arg, "--list=json") == 0) return LIST_FMT_JSON;
+    return -1;
+}
+
+// Find a list option in argv and move it past the new argc so the remaining
+// arguments keep their usual [folder] [filters...] meaning. Returns the format or -1.
+int take_list_option(int *argc, char *argv[]) {
+    int format = -1;
+    int out = 1;
+    for (int i = 1; i < *argc; i++) {
+        int f = parse_list_option(argv[i]);
+        if (f >= 0) {
+            format = f;
+            // Rotate the option to the end; argv keeps every pointer for cleanup
+            char *opt = argv[i];
+            memmove(&argv[i], &argv[i + 1], (size_t)(*argc - i - 1) * sizeof(char *));
+            argv[*argc - 1] = opt;
+            (*argc)--;
+            i--;
+            continue;
+        }
+        out++;
+    }
+    *argc = out;
+    return format;
+}
+
+// Remove a plain flag such as "--dedup" from argv the same way; returns 1 if it was there
+int take_flag_option(int *argc, char *argv[], const char *flag) {
+    int found = 0;
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], flag) != 0) continue;
+        char *opt = argv[i];
+        memmove(&argv[i], &argv[i + 1], (size_t)(*argc - i - 1) * sizeof(char *));
+        argv[*argc - 1] = opt;
+        (*argc)--;
+        i--;
+        found = 1;
+    }
+    return found;
+}
+
+// Several folders: one merged, sorted list; each line carries its own folder
+int list_roots(RootSet *roots, int argc, char *argv[]) {
+    ListOutput *out = &g_list_out;
+    RootEntry *entries;
+    int count = scan_roots(roots, argc, argv, roots->filterStart, g_dedup_roots, &entries);
+    if (count < 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < count && !out->failed; i++) {
+        out->dirpath = roots->paths[entries[i].root];
+        out->dirLen = strlen(out->dirpath);
+        list_entry(entries[i].name, entries[i].type, out);
+    }
+    list_flush(out);
+    root_entries_free(entries, count);
+
+    int rc = out->failed ? 1 : 0;
+    for (int r = 0; r < roots->count; r++) {
+        if (!roots->failed[r]) continue;
+        fprintf(stderr, "Error: Cannot access directory '%s'\n", roots->paths[r]);
+        rc = 1;
+    }
+    return rc;
+}
+
+// Non-interactive mode: stream matching entries to stdout and exit
+int main_list_function(int argc, char *argv[], int format) {
+    ListOutput *out = &g_list_out;
+    out->len = 0;
+    out->failed = 0;
+    out->format = format;
+    out->count = 0;
+
+    RootSet roots;
+    if (collect_roots(argc, argv, &roots) >= 2) {
+        int rc = list_roots(&roots, argc, argv);
+        roots_free(&roots);
+        return rc;
+    }
+    roots_free(&roots);
+
+    char dirpath[MAX_PATH_LEN];
+    int filterStart;
+    resolve_start_dir(argc, argv, dirpath, &filterStart);
+    out->dirpath = dirpath;
+    out->dirLen = strlen(dirpath);
+
+    int rc = for_each_entry(dirpath, argc, argv, filterStart, list_entry, out);
+    list_flush(out);
+
+    if (rc < 0) {
+        fprintf(stderr, "Error: Cannot access directory '%s'\n", dirpath);
+        return 1;
+    }
+    return out->failed ? 1 : 0;
 }
 
 // Print documentation
@@ -207,7 +1216,12 @@ void print_documentation() {
     printf("Examples:\n");
     printf("  better-toolbar.exe /home/user/Documents\n");
     printf("  better-toolbar.exe . .txt .pdf\n");
-    printf("  better-toolbar.exe /home/user/Projects .cpp .h\n");
+    printf("  better-toolbar.exe /home/user/Projects .cpp .h\n\n");
+    printf("Several folders are listed together (--dedup lists each name once):\n");
+    printf("  better-toolbar.exe [--dedup] folder1 + folder2 + ... [filters...]\n\n");
+    printf("Non-interactive listing (one entry per line, NUL-separated or JSON lines):\n");
+    printf("  better-toolbar.exe --list[=lines|nul|json] [folder] [filters...]\n");
+    printf("  better-toolbar.exe --list=nul ~/Pictures png | xargs -0 ls -l\n");
 }
 
 // CLI mode function
@@ -219,8 +1233,15 @@ int main_cli_function(int argc, char *argv[]) {
     char dirpath[MAX_PATH_LEN];
     int filterStart = 1;
 
+    // Several leading folders are shown merged until one of their subfolders is opened
+    RootSet roots;
+    int merged = collect_roots(argc, argv, &roots) >= 2;
+
     // Determine scanning directory
-    if (argc >= 2) {
+    if (merged) {
+        dirpath[0] = '\0';
+        filterStart = roots.filterStart;
+    } else if (argc >= 2) {
         char candidatePath[MAX_PATH_LEN];
         
         // Copy the argument
@@ -281,22 +1302,31 @@ int main_cli_function(int argc, char *argv[]) {
     }
 
     char *files[MAX_FILES];
+    int sources[MAX_FILES];
     int fileCount = 0;
 
     while (1) {
         // Cleanup previous scan results
         for (int i = 0; i < fileCount; i++) free(files[i]);
-        fileCount = scan_directory(dirpath, files, argc, argv, filterStart);
-
         clear_console();
-        printf("Current directory: %s\n", dirpath);
+        if (merged) {
+            fileCount = scan_merged(&roots, files, sources, argc, argv, filterStart);
+            printf("Current directories:\n");
+            for (int r = 0; r < roots.count; r++)
+                printf("  %s%s\n", roots.paths[r], roots.failed[r] ? " (cannot access)" : "");
+        } else {
+            fileCount = scan_directory(dirpath, files, argc, argv, filterStart);
+            printf("Current directory: %s\n", dirpath);
+        }
 
         if (fileCount == 0)
             printf("No matching files found.\n");
         else {
             printf("Found files:\n");
-            for (int i = 0; i < fileCount; i++)
-                printf("[%d] %s\n", i, files[i]);
+            for (int i = 0; i < fileCount; i++) {
+                if (merged) printf("[%d] %s  (%s)\n", i, files[i], roots.labels[sources[i]]);
+                else printf("[%d] %s\n", i, files[i]);
+            }
         }
 
         printf("\nEnter index, 'up' to go up, d/D for docs, q/Q to quit: ");
@@ -315,6 +1345,7 @@ int main_cli_function(int argc, char *argv[]) {
         }
 
         if (stricmp_cross(input, "up") == 0) {
+            if (merged) continue;   // the merged folders have no common parent
             char tempPath[MAX_PATH_LEN];
             strcpy(tempPath, dirpath);
             
@@ -354,11 +1385,12 @@ int main_cli_function(int argc, char *argv[]) {
         }
 
         char fullPath[MAX_PATH_LEN];
-        snprintf(fullPath, MAX_PATH_LEN, "%s%c%s", dirpath, PATH_SEP, files[index]);
+        snprintf(fullPath, MAX_PATH_LEN, "%s%c%s", merged ? roots.paths[sources[index]] : dirpath, PATH_SEP, files[index]);
 
         if (is_directory(fullPath)) {
             // Change scanning directory to subdirectory
             if (set_cur_dir(fullPath)) {
+                merged = 0;
 #ifdef _WIN32
                 wchar_t wdirpath[MAX_PATH_LEN];
                 GetCurrentDirectoryW(MAX_PATH_LEN, wdirpath);
@@ -377,14 +1409,13 @@ int main_cli_function(int argc, char *argv[]) {
         MultiByteToWideChar(CP_UTF8, 0, fullPath, -1, wfullPath, MAX_PATH_LEN);
         ShellExecuteW(NULL, L"open", wfullPath, NULL, NULL, SW_SHOWNORMAL);
 #else
-        char cmd[MAX_PATH_LEN * 2];
-        snprintf(cmd, sizeof(cmd), "xdg-open '%s' &", fullPath);
-        system(cmd);
+        open_with_default_app(fullPath);
 #endif
     }
 
     // Final cleanup
     for (int i = 0; i < fileCount; i++) free(files[i]);
+    roots_free(&roots);
     printf("Exiting.\n");
     return 0;
 }
@@ -905,8 +1936,20 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     }
 
     int result = 0;
-
-    if (IS_CLI() == 0) {
+    int argcAll = argc;
+    g_dedup_roots = take_flag_option(&argc, argv, "--dedup");
+    int listFormat = take_list_option(&argc, argv);
+
+    if (listFormat >= 0) {
+        // Output goes to the inherited handle when piped, otherwise to the parent console
+        HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+        if ((hOut == NULL || hOut == INVALID_HANDLE_VALUE) && AttachConsole(ATTACH_PARENT_PROCESS)) {
+            hOut = CreateFileW(L"CONOUT$", GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+            SetStdHandle(STD_OUTPUT_HANDLE, hOut);
+            SetStdHandle(STD_ERROR_HANDLE, hOut);
+        }
+        result = main_list_function(argc, argv, listFormat);
+    } else if (IS_CLI() == 0) {
         // Allocate a console for CLI mode (needed when compiled with -mwindows)
         AllocConsole();
         
@@ -926,7 +1969,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
     // Cleanup
     LocalFree(argvW);
-    for (int i = 0; i < argc; ++i) free(argv[i]);
+    for (int i = 0; i < argcAll; ++i) free(argv[i]);
     free(argv);
 
     return result;
@@ -937,34 +1980,9363 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 // ============ LINUX X11 IMPLEMENTATION ============
 #ifndef _WIN32
 
-// X11 state structure
-typedef struct {
+// ============ LINUX ENTRY METADATA ============
+
+// Metadata states for a listing row
+#define META_NONE    0
+#define META_PENDING 1
+#define META_READY   2
+#define META_FAILED  3
+
+// Per-row metadata, stored in a column array parallel to the row names
+typedef struct {
+    long long size;
+    long long mtime;
+    unsigned int mode;
+    unsigned char state;
+    unsigned char type;    // ENTRY_TYPE_* from the directory record
+    unsigned char root;    // merged listings: index into g_roots of the folder the row is in
+} EntryMeta;
+
+// Names are packed into large chunks so a listing costs one allocation per chunk, not per entry
+#define NAME_CHUNK_SIZE (256 * 1024)
+
+typedef struct NameChunk {
+    struct NameChunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} NameChunk;
+
+typedef struct {
+    char **names;
+    EntryMeta *meta;
+    int count;
+    int capacity;
+    NameChunk *chunks;
+} Listing;
+
+// Copy len bytes of name plus a terminator into chunk storage
+char *chunk_store(NameChunk **chunks, const char *name, size_t len) {
+    NameChunk *c = *chunks;
+    if (!c || c->size - c->used < len + 1) {
+        size_t size = len + 1 > NAME_CHUNK_SIZE ? len + 1 : NAME_CHUNK_SIZE;
+        c = (NameChunk *)malloc(sizeof(NameChunk) + size);
+        if (!c) return NULL;
+        c->next = *chunks;
+        c->used = 0;
+        c->size = size;
+        *chunks = c;
+    }
+    char *dst = c->data + c->used;
+    memcpy(dst, name, len);
+    dst[len] = '\0';
+    c->used += len + 1;
+    return dst;
+}
+
+void chunks_free(NameChunk **chunks) {
+    while (*chunks) {
+        NameChunk *next = (*chunks)->next;
+        free(*chunks);
+        *chunks = next;
+    }
+}
+
+// Copy a name into the listing's chunk storage
+char *listing_store_name(Listing *l, const char *name) {
+    return chunk_store(&l->chunks, name, strlen(name));
+}
+
+// Append a row; grows the name and metadata columns together
+int listing_append(Listing *l, const char *name, int entryType) {
+    if (l->count == l->capacity) {
+        int cap = l->capacity ? l->capacity * 2 : 256;
+        char **names = (char **)realloc(l->names, (size_t)cap * sizeof(char *));
+        if (!names) return -1;
+        l->names = names;
+        EntryMeta *meta = (EntryMeta *)realloc(l->meta, (size_t)cap * sizeof(EntryMeta));
+        if (!meta) return -1;
+        l->meta = meta;
+        l->capacity = cap;
+    }
+    char *stored = listing_store_name(l, name);
+    if (!stored) return -1;
+    l->names[l->count] = stored;
+    memset(&l->meta[l->count], 0, sizeof(EntryMeta));
+    l->meta[l->count].type = (unsigned char)entryType;
+    l->count++;
+    return 0;
+}
+
+// Drop all rows but keep the column arrays for the next scan
+void listing_clear(Listing *l) {
+    chunks_free(&l->chunks);
+    l->count = 0;
+}
+
+void listing_free(Listing *l) {
+    listing_clear(l);
+    free(l->names);
+    free(l->meta);
+    memset(l, 0, sizeof(*l));
+}
+
+int listing_collect_entry(const char *name, int entryType, void *ctx) {
+    return listing_append((Listing *)ctx, name, entryType) < 0;
+}
+
+// Scan a directory into a listing (no MAX_FILES cap). Returns -1 if it cannot be opened.
+int scan_listing(const char *dirpath, Listing *l, int argc, char *argv[], int filterStart) {
+    listing_clear(l);
+    return for_each_entry(dirpath, argc, argv, filterStart, listing_collect_entry, l);
+}
+
+// Fill one metadata slot from a statx result
+void meta_from_statx(EntryMeta *m, const struct statx *stx) {
+    m->size = (long long)stx->stx_size;
+    m->mtime = (long long)stx->stx_mtime.tv_sec;
+    m->mode = stx->stx_mode;
+    m->state = META_READY;
+}
+
+// ---- io_uring statx batches (raw syscalls, no liburing dependency) ----
+
+#define URING_ENTRIES 256
+#define STATX_WANTED (STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME)
+
+typedef struct {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    int singleMmap;
+} UringQueue;
+
+void uring_close(UringQueue *q) {
+    if (q->sqes) munmap(q->sqes, q->sqesSize);
+    if (q->cqRing && !q->singleMmap) munmap(q->cqRing, q->cqRingSize);
+    if (q->sqRing) munmap(q->sqRing, q->sqRingSize);
+    if (q->fd >= 0) close(q->fd);
+    memset(q, 0, sizeof(*q));
+    q->fd = -1;
+}
+
+// Set up a ring; returns 0 on success, -1 if io_uring is unavailable
+int uring_open(UringQueue *q, unsigned entries) {
+    memset(q, 0, sizeof(*q));
+    q->fd = -1;
+    if (getenv("BT_NO_IO_URING")) return -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) return -1;
+    q->fd = fd;
+
+    q->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    q->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    q->singleMmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (q->singleMmap) {
+        if (q->cqRingSize > q->sqRingSize) q->sqRingSize = q->cqRingSize;
+        q->cqRingSize = q->sqRingSize;
+    }
+
+    q->sqRing = mmap(NULL, q->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (q->sqRing == MAP_FAILED) { q->sqRing = NULL; uring_close(q); return -1; }
+    if (q->singleMmap) {
+        q->cqRing = q->sqRing;
+    } else {
+        q->cqRing = mmap(NULL, q->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (q->cqRing == MAP_FAILED) { q->cqRing = NULL; uring_close(q); return -1; }
+    }
+    q->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    q->sqes = (struct io_uring_sqe *)mmap(NULL, q->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (q->sqes == MAP_FAILED) { q->sqes = NULL; uring_close(q); return -1; }
+
+    char *sq = (char *)q->sqRing;
+    char *cq = (char *)q->cqRing;
+    q->sqHead  = (unsigned *)(sq + p.sq_off.head);
+    q->sqTail  = (unsigned *)(sq + p.sq_off.tail);
+    q->sqMask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    q->sqArray = (unsigned *)(sq + p.sq_off.array);
+    q->cqHead  = (unsigned *)(cq + p.cq_off.head);
+    q->cqTail  = (unsigned *)(cq + p.cq_off.tail);
+    q->cqMask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    q->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+// Queue one statx of name relative to dirfd; the kernel sees it on the next uring_enter
+void uring_queue_statx(UringQueue *q, int dirfd, const char *name, struct statx *buf, unsigned long long userData) {
+    unsigned tail = *q->sqTail;
+    unsigned idx = tail & *q->sqMask;
+    struct io_uring_sqe *sqe = &q->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dirfd;
+    sqe->addr = (unsigned long long)(uintptr_t)name;
+    sqe->len = STATX_WANTED;
+    sqe->off = (unsigned long long)(uintptr_t)buf;
+    sqe->statx_flags = 0;
+    sqe->user_data = userData;
+    q->sqArray[idx] = idx;
+    __atomic_store_n(q->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int uring_enter(UringQueue *q, unsigned toSubmit, unsigned minComplete) {
+    for (;;) {
+        int r = (int)syscall(__NR_io_uring_enter, q->fd, toSubmit, minComplete, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (r >= 0 || errno != EINTR) return r;
+    }
+}
+
+// Collect metadata for rows [first, last) with io_uring. Returns the number of rows
+// it could not handle (the caller falls back for those), or -1 if io_uring is unusable.
+int collect_metadata_uring(int dirfd, Listing *l, int first, int last) {
+    UringQueue q;
+    if (uring_open(&q, URING_ENTRIES) < 0) return -1;
+
+    struct statx *slots = (struct statx *)malloc(URING_ENTRIES * sizeof(struct statx));
+    if (!slots) {
+        uring_close(&q);
+        return -1;
+    }
+    int freeSlots[URING_ENTRIES];
+    int freeCount = URING_ENTRIES;
+    for (int i = 0; i < URING_ENTRIES; i++) freeSlots[i] = URING_ENTRIES - 1 - i;
+
+    int next = first;
+    int inFlight = 0;
+    int unsupported = 0;
+
+    while (next < last || inFlight > 0) {
+        unsigned queued = 0;
+        while (next < last && freeCount > 0 && !unsupported) {
+            int slot = freeSlots[--freeCount];
+            l->meta[next].state = META_PENDING;
+            uring_queue_statx(&q, dirfd, l->names[next], &slots[slot],
+                              ((unsigned long long)slot << 32) | (unsigned)next);
+            next++;
+            queued++;
+        }
+        if (inFlight + (int)queued == 0) break;
+
+        if (uring_enter(&q, queued, 1) < 0) {
+            // Submission failed outright: leave the rest to the fallback
+            for (int i = first; i < last; i++)
+                if (l->meta[i].state == META_PENDING) l->meta[i].state = META_NONE;
+            uring_close(&q);
+            free(slots);
+            return last - first;
+        }
+        inFlight += (int)queued;
+
+        unsigned head = *q.cqHead;
+        unsigned tail = __atomic_load_n(q.cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &q.cqes[head & *q.cqMask];
+            int slot = (int)(cqe->user_data >> 32);
+            int row = (int)(cqe->user_data & 0xFFFFFFFFu);
+            if (cqe->res == 0) {
+                meta_from_statx(&l->meta[row], &slots[slot]);
+            } else if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+                // Kernel without IORING_OP_STATX: stop queueing, fall back for the rest
+                l->meta[row].state = META_NONE;
+                unsupported = 1;
+            } else {
+                l->meta[row].state = META_FAILED;
+            }
+            freeSlots[freeCount++] = slot;
+            inFlight--;
+            head++;
+        }
+        __atomic_store_n(q.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    uring_close(&q);
+    free(slots);
+
+    int remaining = 0;
+    for (int i = first; i < last; i++)
+        if (l->meta[i].state == META_NONE || l->meta[i].state == META_PENDING) {
+            l->meta[i].state = META_NONE;
+            remaining++;
+        }
+    return remaining;
+}
+
+// ---- thread-pool fallback ----
+
+// Run fn(ctx, i) for i in [0, count) on up to `threads` threads, handing out indices atomically
+typedef void (*parallel_fn)(void *ctx, int index);
+
+typedef struct {
+    parallel_fn fn;
+    void *ctx;
+    int count;
+    int next;
+} ParallelJob;
+
+void *parallel_for_worker(void *arg) {
+    ParallelJob *job = (ParallelJob *)arg;
+    for (;;) {
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) break;
+        job->fn(job->ctx, i);
+    }
+    return NULL;
+}
+
+void parallel_for(int count, int threads, parallel_fn fn, void *ctx) {
+    ParallelJob job = { fn, ctx, count, 0 };
+    if (threads > count) threads = count;
+    if (threads <= 1) {
+        parallel_for_worker(&job);
+        return;
+    }
+    pthread_t tids[64];
+    if (threads > 64) threads = 64;
+    int started = 0;
+    for (int i = 0; i < threads - 1; i++)
+        if (pthread_create(&tids[started], NULL, parallel_for_worker, &job) == 0) started++;
+    parallel_for_worker(&job);
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+}
+
+// Metadata fetches wait on the filesystem, not the CPU, so use more threads than cores
+int metadata_thread_count() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = (int)(cores > 0 ? cores * 4 : 8);
+    return n < 8 ? 8 : (n > 32 ? 32 : n);
+}
+
+typedef struct {
+    int dirfd;
+    Listing *listing;
+    int first;
+} StatxPoolCtx;
+
+void statx_pool_item(void *ctx, int index) {
+    StatxPoolCtx *c = (StatxPoolCtx *)ctx;
+    int row = c->first + index;
+    EntryMeta *m = &c->listing->meta[row];
+    if (m->state == META_READY) return;
+    struct statx stx;
+    if (statx(c->dirfd, c->listing->names[row], 0, STATX_WANTED, &stx) == 0)
+        meta_from_statx(m, &stx);
+    else
+        m->state = META_FAILED;
+}
+
+// Collect metadata for rows [first, last) of a listing of dirpath.
+// Uses io_uring batches when available and a thread pool otherwise.
+void collect_metadata(const char *dirpath, Listing *l, int first, int last) {
+    if (first >= last) return;
+    int dirfd = open(dirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return;
+
+    if (collect_metadata_uring(dirfd, l, first, last) != 0) {
+        StatxPoolCtx ctx = { dirfd, l, first };
+        parallel_for(last - first, metadata_thread_count(), statx_pool_item, &ctx);
+    }
+    close(dirfd);
+}
+
+double monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// --bench-stat DIR: compare a serial stat loop with the io_uring and thread-pool collectors
+int bench_stat(const char *dirpath) {
+    Listing l = {0};
+    if (scan_listing(dirpath, &l, 0, NULL, 0) < 0) {
+        fprintf(stderr, "Error: Cannot access directory '%s'\n", dirpath);
+        return 1;
+    }
+    printf("%d entries in %s\n", l.count, dirpath);
+
+    char path[MAX_PATH_LEN];
+    double t0 = monotonic_seconds();
+    int dirs = 0;
+    for (int i = 0; i < l.count; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dirpath, l.names[i]);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) dirs++;
+    }
+    double serial = monotonic_seconds() - t0;
+    printf("  serial stat loop : %9.3f ms (%d dirs)\n", serial * 1e3, dirs);
+
+    int dirfd = open(dirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd >= 0) {
+        for (int i = 0; i < l.count; i++) l.meta[i].state = META_NONE;
+        t0 = monotonic_seconds();
+        int rest = collect_metadata_uring(dirfd, &l, 0, l.count);
+        double uring = monotonic_seconds() - t0;
+        if (rest < 0)
+            printf("  io_uring statx   :   unavailable\n");
+        else
+            printf("  io_uring statx   : %9.3f ms (%.1fx, %d left for fallback)\n", uring * 1e3, serial / uring, rest);
+
+        for (int i = 0; i < l.count; i++) l.meta[i].state = META_NONE;
+        int threads = metadata_thread_count();
+        t0 = monotonic_seconds();
+        StatxPoolCtx ctx = { dirfd, &l, 0 };
+        parallel_for(l.count, threads, statx_pool_item, &ctx);
+        double pool = monotonic_seconds() - t0;
+        printf("  thread pool (%2d) : %9.3f ms (%.1fx)\n", threads, pool * 1e3, serial / pool);
+        close(dirfd);
+    }
+
+    listing_free(&l);
+    return 0;
+}
+
+// --bench-match [COUNT]: time the filter matcher against plain strstr on generated
+// names shaped like a downloads/photos folder (about one in eight non-ASCII)
+int bench_match(int count) {
+    const char *words[] = { "report", "Invoice", "backup", "IMG", "notes", "Screenshot", "draft", "final",
+                            "setup", "README", "photo", "Documents", "archive", "libpng", "config", "Data" };
+    const char *exts[] = { ".jpg", ".png", ".pdf", ".txt", ".tar.gz", ".mp4", ".docx", ".c", "" };
+    const char *wide[] = { "Документ", "Фото отпуск", "Café menu", "Übersicht", "Ελληνικά", "résumé" };
+    char **names = (char **)malloc((size_t)count * sizeof(char *));
+    char *arena = (char *)malloc((size_t)count * 64);
+    if (!names || !arena) {
+        free(names); free(arena);
+        return 1;
+    }
+
+    unsigned seed = 12345;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned r = seed >> 8;
+        names[i] = arena + (size_t)i * 64;
+        if (r % 8 == 0)
+            snprintf(names[i], 64, "%s %u%s", wide[r % 6], r % 1000, exts[(r >> 4) % 9]);
+        else if (r % 8 < 3)
+            snprintf(names[i], 64, "IMG_2024%04u_%06u%s", r % 1231, r % 999999, exts[(r >> 5) % 2]);
+        else
+            snprintf(names[i], 64, "%s_%s-%u%s", words[r % 16], words[(r >> 4) % 16], r % 100, exts[(r >> 8) % 9]);
+    }
+
+    const char *needles[] = { "png", "IMG_2024", "final", "zzz", "документ" };
+    printf("%d names\n", count);
+    for (int n = 0; n < 5; n++) {
+        // Prepared once, as a directory scan does; best of three runs each
+        FoldNeedle fn;
+        fold_needle_init(&fn, needles[n]);
+        double tPlain = 1e9, tFolded = 1e9;
+        int plain = 0, folded = 0;
+        for (int rep = 0; rep < 3; rep++) {
+            double t0 = monotonic_seconds();
+            plain = 0;
+            for (int i = 0; i < count; i++) plain += strstr(names[i], needles[n]) != NULL;
+            double t = monotonic_seconds() - t0;
+            if (t < tPlain) tPlain = t;
+
+            t0 = monotonic_seconds();
+            folded = 0;
+            for (int i = 0; i < count; i++) folded += fold_needle_match(&fn, names[i]);
+            t = monotonic_seconds() - t0;
+            if (t < tFolded) tFolded = t;
+        }
+
+        printf("  %-10s strstr %8.3f ms (%7d hits)   folded %8.3f ms (%7d hits)\n",
+               needles[n], tPlain * 1e3, plain, tFolded * 1e3, folded);
+    }
+
+    free(names);
+    free(arena);
+    return 0;
+}
+
+// ---- sorting ----
+
+#define SORT_NAME  0
+#define SORT_SIZE  1
+#define SORT_MTIME 2
+
+// Sorting runs on I/O worker threads too, so the comparator gets its state as an argument
+typedef struct {
+    const Listing *listing;
+    int mode;
+} SortContext;
+
+int listing_row_is_dir(const Listing *l, int row) {
+    const EntryMeta *m = &l->meta[row];
+    if (m->state == META_READY) return S_ISDIR(m->mode);
+    return m->type == ENTRY_TYPE_DIR;
+}
+
+int compare_rows(const void *a, const void *b, void *arg) {
+    int ra = *(const int *)a, rb = *(const int *)b;
+    const SortContext *ctx = (const SortContext *)arg;
+    const Listing *l = ctx->listing;
+
+    // Folders first in every mode
+    int da = listing_row_is_dir(l, ra), db = listing_row_is_dir(l, rb);
+    if (da != db) return db - da;
+
+    if (ctx->mode == SORT_SIZE && l->meta[ra].size != l->meta[rb].size)
+        return l->meta[ra].size < l->meta[rb].size ? 1 : -1;
+    if (ctx->mode == SORT_MTIME && l->meta[ra].mtime != l->meta[rb].mtime)
+        return l->meta[ra].mtime < l->meta[rb].mtime ? 1 : -1;
+
+    int c = utf8_casecmp(l->names[ra], l->names[rb]);
+    if (!c) c = strcmp(l->names[ra], l->names[rb]);
+    return c ? c : l->meta[ra].root - l->meta[rb].root;
+}
+
+// Sort rows (names and metadata together) by the given mode
+void sort_listing(Listing *l, int mode) {
+    if (l->count < 2) return;
+    int *order = (int *)malloc((size_t)l->count * sizeof(int));
+    char **names = (char **)malloc((size_t)l->count * sizeof(char *));
+    EntryMeta *meta = (EntryMeta *)malloc((size_t)l->count * sizeof(EntryMeta));
+    if (!order || !names || !meta) {
+        free(order); free(names); free(meta);
+        return;
+    }
+    for (int i = 0; i < l->count; i++) order[i] = i;
+
+    SortContext ctx = { l, mode };
+    qsort_r(order, (size_t)l->count, sizeof(int), compare_rows, &ctx);
+
+    for (int i = 0; i < l->count; i++) {
+        names[i] = l->names[order[i]];
+        meta[i] = l->meta[order[i]];
+    }
+    memcpy(l->names, names, (size_t)l->count * sizeof(char *));
+    memcpy(l->meta, meta, (size_t)l->count * sizeof(EntryMeta));
+    free(order); free(names); free(meta);
+}
+
+// ---- UI wake-up pipe ----
+
+// Worker threads write a byte here; the X11 event loop polls it next to the X connection
+int g_wake_pipe[2] = { -1, -1 };
+
+void wake_ui() {
+    if (g_wake_pipe[1] < 0) return;
+    char b = 1;
+    while (write(g_wake_pipe[1], &b, 1) < 0 && errno == EINTR) {}
+}
+
+void drain_wake_pipe() {
+    char buf[256];
+    while (read(g_wake_pipe[0], buf, sizeof(buf)) > 0) {}
+}
+
+int init_wake_pipe() {
+    if (pipe(g_wake_pipe) < 0) return -1;
+    for (int i = 0; i < 2; i++) {
+        fcntl(g_wake_pipe[i], F_SETFL, fcntl(g_wake_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(g_wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    return 0;
+}
+
+// ---- demand loading of metadata for rows near the viewport ----
+
+#define META_QUEUE_SIZE 512
+#define META_MAX_THREADS 32
+
+// Directory fd shared by in-flight requests; closed when retired and unused
+typedef struct {
+    int fd;
+    int refs;
+    int retired;
+} DirHandle;
+
+typedef struct {
+    unsigned gen;
+    int row;
+    char name[NAME_MAX + 1];
+} MetaRequest;
+
+typedef struct {
+    unsigned gen;
+    int row;
+    EntryMeta meta;
+} MetaResult;
+
+// Requests are popped from the end of the queue, so the UI pushes the most
+// important rows last. Results are handed back to the UI thread, which is the
+// only writer of the listing's metadata column.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t threads[META_MAX_THREADS];
+    int threadCount;
+    int shutdown;
+    unsigned gen;
+    DirHandle *dir;
+    MetaRequest queue[META_QUEUE_SIZE];
+    int queued;
+    MetaResult *results;
+    int resultCount;
+    int resultCapacity;
+    int dropped;  // a result was lost to a failed allocation; its row is still META_PENDING
+} MetaLoader;
+
+MetaLoader g_meta_loader = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+void dir_handle_release(DirHandle *d) {
+    if (--d->refs == 0 && d->retired) {
+        close(d->fd);
+        free(d);
+    }
+}
+
+void io_inject_latency();
+int join_with_timeout(pthread_t tid, double seconds);
+
+void *meta_worker(void *arg) {
+    MetaLoader *ml = (MetaLoader *)arg;
+    pthread_mutex_lock(&ml->lock);
+    for (;;) {
+        while (!ml->shutdown && (ml->queued == 0 || !ml->dir))
+            pthread_cond_wait(&ml->cond, &ml->lock);
+        if (ml->shutdown) break;
+
+        MetaRequest req = ml->queue[--ml->queued];
+        DirHandle *dir = ml->dir;
+        dir->refs++;
+        pthread_mutex_unlock(&ml->lock);
+
+        MetaResult res = { req.gen, req.row, { 0 } };
+        io_inject_latency();
+        struct statx stx;
+        if (statx(dir->fd, req.name, 0, STATX_WANTED, &stx) == 0)
+            meta_from_statx(&res.meta, &stx);
+        else
+            res.meta.state = META_FAILED;
+
+        pthread_mutex_lock(&ml->lock);
+        dir_handle_release(dir);
+        if (ml->resultCount == ml->resultCapacity) {
+            int cap = ml->resultCapacity ? ml->resultCapacity * 2 : 256;
+            MetaResult *grown = (MetaResult *)realloc(ml->results, (size_t)cap * sizeof(MetaResult));
+            if (!grown) {
+                ml->dropped = 1;
+                wake_ui();
+                continue;
+            }
+            ml->results = grown;
+            ml->resultCapacity = cap;
+        }
+        ml->results[ml->resultCount++] = res;
+        wake_ui();
+    }
+    pthread_mutex_unlock(&ml->lock);
+    return NULL;
+}
+
+// Start over for a new listing whose directory is open as dirfd (the loader takes
+// ownership; -1 keeps the current directory): drops queued requests and makes results
+// of the previous generation stale
+void meta_loader_reset(int dirfd) {
+    MetaLoader *ml = &g_meta_loader;
+    int fd = dirfd;
+
+    pthread_mutex_lock(&ml->lock);
+    ml->gen++;
+    ml->queued = 0;
+    ml->resultCount = 0;
+    ml->dropped = 0;
+    if (dirfd >= 0) {
+        if (ml->dir) {
+            ml->dir->retired = 1;
+            ml->dir->refs++;
+            dir_handle_release(ml->dir);
+        }
+        ml->dir = NULL;
+        if (fd >= 0) {
+            ml->dir = (DirHandle *)calloc(1, sizeof(DirHandle));
+            if (ml->dir) ml->dir->fd = fd;
+            else close(fd);
+        }
+    }
+    if (ml->threadCount == 0) {
+        int n = metadata_thread_count();
+        if (n > META_MAX_THREADS) n = META_MAX_THREADS;
+        for (int i = 0; i < n; i++)
+            if (pthread_create(&ml->threads[ml->threadCount], NULL, meta_worker, ml) == 0)
+                ml->threadCount++;
+    }
+    pthread_mutex_unlock(&ml->lock);
+}
+
+void meta_loader_shutdown() {
+    MetaLoader *ml = &g_meta_loader;
+    pthread_mutex_lock(&ml->lock);
+    ml->shutdown = 1;
+    pthread_cond_broadcast(&ml->cond);
+    pthread_mutex_unlock(&ml->lock);
+    int stuck = 0;
+    for (int i = 0; i < ml->threadCount; i++)
+        if (join_with_timeout(ml->threads[i], 0.2) != 0) stuck = 1;
+    ml->threadCount = 0;
+    if (stuck) return;  // a worker is blocked in statx and still uses the shared state
+    if (ml->dir) {
+        close(ml->dir->fd);
+        free(ml->dir);
+        ml->dir = NULL;
+    }
+    free(ml->results);
+    ml->results = NULL;
+    ml->resultCount = ml->resultCapacity = 0;
+}
+
+void meta_push_request(MetaLoader *ml, Listing *l, int row) {
+    EntryMeta *m = &l->meta[row];
+    if (m->state != META_NONE || ml->queued == META_QUEUE_SIZE) return;
+    if (strlen(l->names[row]) > NAME_MAX) return;
+
+    MetaRequest *req = &ml->queue[ml->queued++];
+    req->gen = ml->gen;
+    req->row = row;
+    strcpy(req->name, l->names[row]);
+    m->state = META_PENDING;
+}
+
+// Called from draw_window() with the visible rows [first, last). Requests
+// metadata for them plus one screen of look-ahead on both sides, and cancels
+// queued requests for rows that scrolled out of that range.
+void meta_request_viewport(Listing *l, int first, int last) {
+    MetaLoader *ml = &g_meta_loader;
+    int margin = last - first;
+    int lo = first - margin < 0 ? 0 : first - margin;
+    int hi = last + margin > l->count ? l->count : last + margin;
+
+    pthread_mutex_lock(&ml->lock);
+    int kept = 0;
+    for (int i = 0; i < ml->queued; i++) {
+        int row = ml->queue[i].row;
+        if (row >= lo && row < hi) {
+            ml->queue[kept++] = ml->queue[i];
+        } else if (row < l->count) {
+            l->meta[row].state = META_NONE;
+        }
+    }
+    ml->queued = kept;
+
+    // Pushed last = served first: look-ahead below, look-behind above, then visible rows top-down
+    for (int row = hi - 1; row >= last; row--) meta_push_request(ml, l, row);
+    for (int row = lo; row < first; row++) meta_push_request(ml, l, row);
+    for (int row = last - 1; row >= first; row--) meta_push_request(ml, l, row);
+
+    if (ml->queued > 0) pthread_cond_broadcast(&ml->cond);
+    pthread_mutex_unlock(&ml->lock);
+}
+
+// Copy finished results into the listing. Returns 1 if any row in [first, last) changed.
+int meta_apply_results(Listing *l, int first, int last) {
+    MetaLoader *ml = &g_meta_loader;
+    int changed = 0;
+
+    pthread_mutex_lock(&ml->lock);
+    for (int i = 0; i < ml->resultCount; i++) {
+        MetaResult *r = &ml->results[i];
+        if (r->gen != ml->gen || r->row >= l->count) continue;
+        EntryMeta *m = &l->meta[r->row];
+        if (m->state == META_READY) continue;
+        unsigned char type = m->type;
+        *m = r->meta;
+        m->type = type;
+        if (r->row >= first && r->row < last) changed = 1;
+    }
+    ml->resultCount = 0;
+    if (ml->dropped) {
+        // Rows whose results were dropped go back to META_NONE so the next
+        // viewport pass requests them again; rows still queued stay pending
+        ml->dropped = 0;
+        for (int i = 0; i < l->count; i++)
+            if (l->meta[i].state == META_PENDING) l->meta[i].state = META_NONE;
+        for (int i = 0; i < ml->queued; i++)
+            if (ml->queue[i].gen == ml->gen && ml->queue[i].row < l->count)
+                l->meta[ml->queue[i].row].state = META_PENDING;
+        changed = 1;
+    }
+    pthread_mutex_unlock(&ml->lock);
+    return changed;
+}
+
+// ============ LINUX ARCHIVE BROWSING ============
+
+// Zip and tar files open as read-only virtual folders: "/home/me/src.zip/lib" lists the
+// lib/ members of src.zip. The member index is parsed straight from an mmap of the archive
+// (the zip central directory, or the chain of tar headers), with no extraction and no
+// external process, and is cached per archive mtime so moving around inside an archive
+// does not reparse it. Opening a member streams just that member to a private temp folder.
+// Parsing and extraction read the mapping under guarded_scan, so an archive rewritten or
+// truncated in place while it is browsed fails the navigation instead of the process.
+
+#define ARCHIVE_ZIP 1
+#define ARCHIVE_TAR 2
+
+#define ARCHIVE_STORED       0
+#define ARCHIVE_DEFLATE      8
+#define ARCHIVE_UNSUPPORTED  (-1)   // encrypted, links, unknown compression: listed but not opened
+
+#define ARCHIVE_CACHE_SIZE 4
+
+typedef struct {
+    const char *name;       // full path inside the archive, no leading or trailing '/'
+    const char *base;       // last component of name
+    long long size;
+    long long mtime;
+    long long offset;       // zip: local header; tar: start of the data
+    long long packedSize;
+    unsigned int mode;
+    unsigned int hash;
+    uint32_t crc;
+    int method;
+    int firstChild;         // folders: their children form a linked list
+    int nextSibling;
+} ArchiveMember;
+
+typedef struct {
+    char *path;
+    long long mtimeNs;
+    long long fileSize;
+    int kind;
+    const unsigned char *map;
+    size_t mapSize;
+
+    ArchiveMember *members;
+    int count;
+    int capacity;
+    int rootChild;
+    int *table;             // open-addressed name hash -> member index
+    int tableSize;
+    NameChunk *names;
+
+    int refs;               // under g_archives.lock
+    int cached;
+    unsigned long lastUse;
+} Archive;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Archive *slots[ARCHIVE_CACHE_SIZE];
+    unsigned long clock;
+} ArchiveCache;
+
+ArchiveCache g_archives = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static inline unsigned rd16(const unsigned char *p) { return p[0] | (unsigned)p[1] << 8; }
+static inline uint32_t rd32(const unsigned char *p) { return rd16(p) | (uint32_t)rd16(p + 2) << 16; }
+static inline uint64_t rd64(const unsigned char *p) { return rd32(p) | (uint64_t)rd32(p + 4) << 32; }
+
+int guarded_scan(void (*scan)(void *), void *ctx);
+
+unsigned archive_hash(const char *s, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+// Only these extensions are looked into; .docx, .jar and friends still open in their app
+int is_archive_name(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot && (stricmp_cross(dot + 1, "zip") == 0 || stricmp_cross(dot + 1, "tar") == 0);
+}
+
+// Member index, or -1
+int archive_find(const Archive *ax, const char *name, size_t len) {
+    if (!ax->tableSize) return -1;
+    unsigned h = archive_hash(name, len);
+    for (unsigned i = h & (ax->tableSize - 1);; i = (i + 1) & (ax->tableSize - 1)) {
+        int idx = ax->table[i];
+        if (idx < 0) return -1;
+        const ArchiveMember *m = &ax->members[idx];
+        if (m->hash == h && strncmp(m->name, name, len) == 0 && m->name[len] == '\0') return idx;
+    }
+}
+
+int archive_grow_table(Archive *ax) {
+    int size = ax->tableSize ? ax->tableSize * 2 : 1024;
+    int *table = (int *)malloc((size_t)size * sizeof(int));
+    if (!table) return -1;
+    memset(table, 0xff, (size_t)size * sizeof(int));
+    for (int idx = 0; idx < ax->count; idx++) {
+        unsigned i = ax->members[idx].hash & (size - 1);
+        while (table[i] >= 0) i = (i + 1) & (size - 1);
+        table[i] = idx;
+    }
+    free(ax->table);
+    ax->table = table;
+    ax->tableSize = size;
+    return 0;
+}
+
+// Index of the member called name, adding it (and any parent folders the archive never
+// listed on their own) if it is new. A later entry with the same name replaces the earlier
+// one, as tar does on extraction.
+int archive_add(Archive *ax, const char *name, size_t len, int isDir) {
+    int idx = archive_find(ax, name, len);
+    if (idx >= 0) {
+        if (isDir && !S_ISDIR(ax->members[idx].mode)) ax->members[idx].mode = S_IFDIR | 0755;
+        return idx;
+    }
+
+    const char *slash = NULL;
+    for (size_t i = len; i-- > 0;) {
+        if (name[i] == '/') { slash = name + i; break; }
+    }
+    int parent = slash ? archive_add(ax, name, (size_t)(slash - name), 1) : -1;
+    if (slash && parent < 0) return -1;
+
+    if ((ax->count + 1) * 2 > ax->tableSize && archive_grow_table(ax) < 0) return -1;
+    if (ax->count == ax->capacity) {
+        int cap = ax->capacity ? ax->capacity * 2 : 256;
+        ArchiveMember *grown = (ArchiveMember *)realloc(ax->members, (size_t)cap * sizeof(ArchiveMember));
+        if (!grown) return -1;
+        ax->members = grown;
+        ax->capacity = cap;
+    }
+    const char *stored = chunk_store(&ax->names, name, len);
+    if (!stored) return -1;
+
+    idx = ax->count++;
+    ArchiveMember *m = &ax->members[idx];
+    memset(m, 0, sizeof(*m));
+    m->name = stored;
+    m->base = slash ? stored + (slash - name) + 1 : stored;
+    m->hash = archive_hash(name, len);
+    m->mode = isDir ? S_IFDIR | 0755 : S_IFREG | 0644;
+    m->mtime = ax->mtimeNs / 1000000000LL;
+    m->method = ARCHIVE_UNSUPPORTED;
+    m->firstChild = -1;
+    int *head = parent >= 0 ? &ax->members[parent].firstChild : &ax->rootChild;
+    m->nextSibling = *head;
+    *head = idx;
+
+    unsigned i = m->hash & (ax->tableSize - 1);
+    while (ax->table[i] >= 0) i = (i + 1) & (ax->tableSize - 1);
+    ax->table[i] = idx;
+    return idx;
+}
+
+// Clean a raw member name into buf: no leading '/', no empty or "." components. Returns
+// the length (0 for the archive root itself), or -1 for names that climb out with "..".
+int archive_clean_name(const unsigned char *raw, size_t len, char *buf, size_t bufLen, int *isDir) {
+    size_t out = 0;
+    *isDir = len > 0 && raw[len - 1] == '/';
+    for (size_t i = 0; i < len;) {
+        size_t j = i;
+        while (j < len && raw[j] != '/') j++;
+        size_t n = j - i;
+        if (n == 2 && raw[i] == '.' && raw[i + 1] == '.') return -1;
+        if (n > 0 && !(n == 1 && raw[i] == '.')) {
+            if (out + n + 2 > bufLen || memchr(raw + i, '\0', n)) return -1;
+            if (out) buf[out++] = '/';
+            memcpy(buf + out, raw + i, n);
+            out += n;
+        }
+        i = j + 1;
+    }
+    buf[out] = '\0';
+    return (int)out;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+long long days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+// ---- zip ----
+
+int archive_parse_zip(Archive *ax) {
+    const unsigned char *map = ax->map;
+    size_t n = ax->mapSize;
+    if (n < 22) return -1;
+
+    // The end-of-central-directory record sits before an optional comment of up to 64K
+    size_t lo = n > 22 + 65535 ? n - 22 - 65535 : 0;
+    size_t eocd = 0;
+    int found = 0;
+    for (size_t i = n - 22 + 1; i-- > lo;) {
+        if (map[i] == 'P' && rd32(map + i) == 0x06054b50) { eocd = i; found = 1; break; }
+    }
+    if (!found) return -1;
+
+    uint64_t cdSize = rd32(map + eocd + 12), cdOffset = rd32(map + eocd + 16);
+    if ((cdSize == 0xFFFFFFFF || cdOffset == 0xFFFFFFFF || rd16(map + eocd + 10) == 0xFFFF) &&
+        eocd >= 20 && rd32(map + eocd - 20) == 0x07064b50) {
+        uint64_t z = rd64(map + eocd - 20 + 8);
+        if (z + 56 <= n && rd32(map + z) == 0x06064b50) {
+            cdSize = rd64(map + z + 40);
+            cdOffset = rd64(map + z + 48);
+        }
+    }
+    if (cdOffset > n || cdSize > n - cdOffset) return -1;
+
+    // DOS timestamps are local time; one offset for the whole archive is close enough
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    long long tzOffset = local.tm_gmtoff;
+
+    char name[MAX_PATH_LEN];
+    const unsigned char *p = map + cdOffset, *end = p + cdSize;
+    while (end - p >= 46 && rd32(p) == 0x02014b50) {
+        unsigned nameLen = rd16(p + 28), extraLen = rd16(p + 30), commentLen = rd16(p + 32);
+        size_t recLen = 46 + (size_t)nameLen + extraLen + commentLen;
+        if ((size_t)(end - p) < recLen) break;
+
+        uint64_t packed = rd32(p + 20), size = rd32(p + 24), offset = rd32(p + 42);
+        unsigned dosTime = rd16(p + 12), dosDate = rd16(p + 14);
+        long long mtime = (days_from_civil((dosDate >> 9) + 1980, (dosDate >> 5) & 15, dosDate & 31) * 86400 +
+                           (dosTime >> 11) * 3600 + ((dosTime >> 5) & 63) * 60 + (dosTime & 31) * 2) - tzOffset;
+
+        // Extra fields: zip64 sizes and offset, and the UTC "extended timestamp"
+        const unsigned char *x = p + 46 + nameLen, *xend = x + extraLen;
+        while (xend - x >= 4) {
+            unsigned id = rd16(x), len = rd16(x + 2);
+            const unsigned char *f = x + 4, *fend = f + len;
+            if (fend > xend) break;
+            if (id == 0x0001) {
+                if (size == 0xFFFFFFFF && fend - f >= 8) { size = rd64(f); f += 8; }
+                if (packed == 0xFFFFFFFF && fend - f >= 8) { packed = rd64(f); f += 8; }
+                if (offset == 0xFFFFFFFF && fend - f >= 8) { offset = rd64(f); f += 8; }
+            } else if (id == 0x5455 && len >= 5 && (f[0] & 1)) {
+                mtime = (int32_t)rd32(f + 1);
+            }
+            x = fend;
+        }
+
+        int isDir;
+        int len = archive_clean_name(p + 46, nameLen, name, sizeof(name), &isDir);
+        if (len > 0) {
+            int idx = archive_add(ax, name, (size_t)len, isDir);
+            if (idx < 0) return -1;
+            ArchiveMember *m = &ax->members[idx];
+            unsigned int mode = p[5] == 3 ? rd32(p + 38) >> 16 : 0;   // made on Unix: st_mode in the high half
+            if (isDir || S_ISDIR(m->mode)) mode = S_IFDIR | (mode ? mode & 07777 : 0755);
+            else if (!(mode & S_IFMT)) mode = S_IFREG | (mode ? mode & 07777 : 0644);
+            m->mode = mode;
+            m->mtime = mtime;
+            m->size = S_ISDIR(mode) ? 0 : (long long)size;
+            m->packedSize = (long long)packed;
+            m->offset = (long long)offset;
+            m->crc = rd32(p + 16);
+            m->method = rd16(p + 10);
+            if ((rd16(p + 8) & 1) || !S_ISREG(mode) ||
+                (m->method != ARCHIVE_STORED && m->method != ARCHIVE_DEFLATE)) {
+                m->method = ARCHIVE_UNSUPPORTED;
+            }
+        }
+        p += recLen;
+    }
+    return 0;
+}
+
+// ---- tar ----
+
+// Octal header field, or GNU base-256 when the high bit of the first byte is set
+long long tar_number(const unsigned char *f, int len) {
+    long long v = 0;
+    if (f[0] & 0x80) {
+        v = f[0] & 0x3f;
+        for (int i = 1; i < len; i++) v = (v << 8) | f[i];
+        return v;
+    }
+    int i = 0;
+    while (i < len && (f[i] == ' ' || f[i] == '\0')) i++;
+    for (; i < len && f[i] >= '0' && f[i] <= '7'; i++) v = v * 8 + (f[i] - '0');
+    return v;
+}
+
+// The checksum counts its own field as spaces; a plain sum over the block vectorizes
+int tar_header_valid(const unsigned char *h) {
+    unsigned sum = 0;
+    for (int i = 0; i < 512; i++) sum += h[i];
+    for (int i = 148; i < 156; i++) sum += ' ' - h[i];
+    return (long long)sum == tar_number(h + 148, 8);
+}
+
+// "path" and "size" records of a pax extended header
+void tar_parse_pax(const unsigned char *p, size_t len, char *path, size_t pathLen, long long *size) {
+    const unsigned char *end = p + len;
+    while (p < end) {
+        // "<length> <key>=<value>\n", the length counting the whole record
+        size_t recLen = 0;
+        const unsigned char *q = p;
+        while (q < end && *q >= '0' && *q <= '9') recLen = recLen * 10 + (size_t)(*q++ - '0');
+        if (recLen == 0 || recLen > (size_t)(end - p) || q >= end || *q != ' ') return;
+        const unsigned char *key = q + 1, *rec = p + recLen - 1;   // rec: the trailing '\n'
+        if (rec - key > 5 && memcmp(key, "path=", 5) == 0 && (size_t)(rec - key - 5) < pathLen) {
+            memcpy(path, key + 5, (size_t)(rec - key - 5));
+            path[rec - key - 5] = '\0';
+        } else if (rec - key > 5 && memcmp(key, "size=", 5) == 0) {
+            long long v = 0;
+            for (const unsigned char *d = key + 5; d < rec && *d >= '0' && *d <= '9'; d++) v = v * 10 + (*d - '0');
+            *size = v;
+        }
+        p += recLen;
+    }
+}
+
+int archive_parse_tar(Archive *ax) {
+    const unsigned char *map = ax->map;
+    size_t n = ax->mapSize;
+    char longName[MAX_PATH_LEN], name[MAX_PATH_LEN], raw[MAX_PATH_LEN];
+    longName[0] = '\0';
+    long long paxSize = -1;
+
+    for (size_t off = 0; n - off >= 512;) {
+        const unsigned char *h = map + off;
+        if (h[0] == '\0') break;                       // end-of-archive block
+        if (!tar_header_valid(h)) return off == 0 ? -1 : 0;
+
+        long long size = paxSize >= 0 ? paxSize : tar_number(h + 124, 12);
+        size_t data = off + 512;
+        if (size < 0 || (unsigned long long)size > n - data) break;   // truncated archive
+        off = data + (((size_t)size + 511) & ~(size_t)511);
+        if (off > n) off = n;
+
+        char type = (char)h[156];
+        if (type == 'L') {                             // GNU long name for the next header
+            size_t len = (size_t)size < sizeof(longName) - 1 ? (size_t)size : sizeof(longName) - 1;
+            memcpy(longName, map + data, len);
+            longName[len] = '\0';
+            continue;
+        }
+        if (type == 'x') {
+            tar_parse_pax(map + data, (size_t)size, longName, sizeof(longName), &paxSize);
+            continue;
+        }
+        if (type == 'g' || type == 'K') continue;
+        paxSize = -1;
+
+        size_t rawLen;
+        if (longName[0]) {
+            rawLen = strlen(longName);
+            memcpy(raw, longName, rawLen);
+            longName[0] = '\0';
+        } else {
+            size_t prefixLen = memcmp(h + 257, "ustar", 5) == 0 ? strnlen((const char *)h + 345, 155) : 0;
+            size_t nameLen = strnlen((const char *)h, 100);
+            memcpy(raw, h + 345, prefixLen);
+            rawLen = prefixLen;
+            if (prefixLen) raw[rawLen++] = '/';
+            memcpy(raw + rawLen, h, nameLen);
+            rawLen += nameLen;
+        }
+
+        // Regular files, folders and links; devices and fifos are left out
+        int isDir = type == '5';
+        int isLink = type == '1' || type == '2';
+        if (!isDir && !isLink && type != '0' && type != '\0' && type != '7') continue;
+
+        int slash;
+        int len = archive_clean_name((const unsigned char *)raw, rawLen, name, sizeof(name), &slash);
+        if (len <= 0) continue;
+        isDir |= slash;
+        int idx = archive_add(ax, name, (size_t)len, isDir);
+        if (idx < 0) return -1;
+        ArchiveMember *m = &ax->members[idx];
+        unsigned int perm = (unsigned int)tar_number(h + 100, 8) & 07777;
+        m->mode = (isDir || S_ISDIR(m->mode) ? S_IFDIR : isLink ? S_IFLNK : S_IFREG) | perm;
+        m->mtime = tar_number(h + 136, 12);
+        m->size = S_ISREG(m->mode) ? size : 0;
+        m->packedSize = m->size;
+        m->offset = (long long)data;
+        m->method = S_ISREG(m->mode) ? ARCHIVE_STORED : ARCHIVE_UNSUPPORTED;
+    }
+    return 0;
+}
+
+// ---- index cache ----
+
+void archive_free(Archive *ax) {
+    if (ax->map) munmap((void *)ax->map, ax->mapSize);
+    chunks_free(&ax->names);
+    free(ax->members);
+    free(ax->table);
+    free(ax->path);
+    free(ax);
+}
+
+typedef struct {
+    Archive *ax;
+    int rc;
+} ArchiveParse;
+
+// Sniff the content rather than trusting the extension. What the parser allocates hangs
+// off the archive, so archive_free() releases it after a fault too.
+void archive_parse_scan(void *ctx) {
+    ArchiveParse *p = (ArchiveParse *)ctx;
+    Archive *ax = p->ax;
+    if (ax->mapSize >= 512 && memcmp(ax->map + 257, "ustar", 5) == 0) {
+        ax->kind = ARCHIVE_TAR;
+        p->rc = archive_parse_tar(ax);
+    } else if (memcmp(ax->map, "PK", 2) == 0) {
+        ax->kind = ARCHIVE_ZIP;
+        p->rc = archive_parse_zip(ax);
+    }
+}
+
+// Map the archive and build its member index; NULL if it is not a zip or tar file
+Archive *archive_load(const char *path, const struct stat *st) {
+    if (st->st_size < 22) return NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    void *map = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    Archive *ax = (Archive *)calloc(1, sizeof(Archive));
+    if (!ax) {
+        munmap(map, (size_t)st->st_size);
+        return NULL;
+    }
+    ax->map = (const unsigned char *)map;
+    ax->mapSize = (size_t)st->st_size;
+    ax->path = strdup(path);
+    ax->mtimeNs = (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+    ax->fileSize = (long long)st->st_size;
+    ax->rootChild = -1;
+
+    ArchiveParse parse = { ax, -1 };
+    if (guarded_scan(archive_parse_scan, &parse) < 0) parse.rc = -1;
+    if (parse.rc < 0 || !ax->path) {
+        archive_free(ax);
+        return NULL;
+    }
+    return ax;
+}
+
+// The indexed archive at path (a resolved path), from the cache while the file's mtime and
+// size are unchanged. Pair with archive_release().
+Archive *archive_get(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) return NULL;
+    long long mtimeNs = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    pthread_mutex_lock(&g_archives.lock);
+    for (int i = 0; i < ARCHIVE_CACHE_SIZE; i++) {
+        Archive *ax = g_archives.slots[i];
+        if (ax && ax->mtimeNs == mtimeNs && ax->fileSize == (long long)st.st_size && strcmp(ax->path, path) == 0) {
+            ax->refs++;
+            ax->lastUse = ++g_archives.clock;
+            pthread_mutex_unlock(&g_archives.lock);
+            return ax;
+        }
+    }
+    pthread_mutex_unlock(&g_archives.lock);
+
+    Archive *ax = archive_load(path, &st);
+    if (!ax) return NULL;
+
+    // Take a free slot, else evict the least recently used index nobody is reading.
+    // If every slot is busy the index is used once and dropped.
+    pthread_mutex_lock(&g_archives.lock);
+    ax->refs = 1;
+    ax->lastUse = ++g_archives.clock;
+    int victim = -1;
+    for (int i = 0; i < ARCHIVE_CACHE_SIZE; i++) {
+        Archive *old = g_archives.slots[i];
+        if (!old) { victim = i; break; }
+        if (old->refs == 0 && (victim < 0 || old->lastUse < g_archives.slots[victim]->lastUse)) victim = i;
+    }
+    if (victim >= 0) {
+        if (g_archives.slots[victim]) archive_free(g_archives.slots[victim]);
+        g_archives.slots[victim] = ax;
+        ax->cached = 1;
+    }
+    pthread_mutex_unlock(&g_archives.lock);
+    return ax;
+}
+
+void archive_release(Archive *ax) {
+    pthread_mutex_lock(&g_archives.lock);
+    int drop = --ax->refs == 0 && !ax->cached;
+    pthread_mutex_unlock(&g_archives.lock);
+    if (drop) archive_free(ax);
+}
+
+void archive_cache_free() {
+    pthread_mutex_lock(&g_archives.lock);
+    for (int i = 0; i < ARCHIVE_CACHE_SIZE; i++) {
+        Archive *ax = g_archives.slots[i];
+        g_archives.slots[i] = NULL;
+        if (!ax) continue;
+        if (ax->refs == 0) archive_free(ax);
+        else ax->cached = 0;
+    }
+    pthread_mutex_unlock(&g_archives.lock);
+}
+
+// ---- virtual paths ----
+
+// Split a path that runs through an archive file into the archive's resolved path and the
+// member path inside it: "/a/src.zip/lib/" -> "/a/src.zip", "lib". Returns 0 if no
+// component of the path is an archive file.
+int archive_split_path(const char *path, char *archivePath, char *inner) {
+    char buf[MAX_PATH_LEN];
+    snprintf(buf, sizeof(buf), "%s", path);
+    size_t len = strlen(buf);
+    for (size_t i = 1; i <= len; i++) {
+        if (buf[i] != '/' && buf[i] != '\0') continue;
+        char saved = buf[i];
+        buf[i] = '\0';
+        const char *component = strrchr(buf, '/');
+        struct stat st;
+        int hit = is_archive_name(component ? component + 1 : buf) && stat(buf, &st) == 0 && S_ISREG(st.st_mode) &&
+                  realpath(buf, archivePath) != NULL;
+        buf[i] = saved;
+        if (hit) {
+            const char *rest = buf + i;
+            while (*rest == '/') rest++;
+            snprintf(inner, MAX_PATH_LEN, "%s", rest);
+            remove_trailing_slash(inner);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// List the folder `inner` ("" for the top) of an archive, applying the same filters as
+// a directory scan. Rows come with their metadata already loaded.
+int archive_list(const Archive *ax, const char *inner, Listing *l, int argc, char *argv[], int filterStart) {
+    int first = ax->rootChild;
+    if (inner[0]) {
+        int dir = archive_find(ax, inner, strlen(inner));
+        if (dir < 0 || !S_ISDIR(ax->members[dir].mode)) {
+            errno = dir < 0 ? ENOENT : ENOTDIR;
+            return -1;
+        }
+        first = ax->members[dir].firstChild;
+    }
+
+    listing_clear(l);
+    FilterSet filters;
+    filter_set_init(&filters, argc, argv, filterStart);
+    int rc = 0;
+    for (int i = first; i >= 0; i = ax->members[i].nextSibling) {
+        const ArchiveMember *m = &ax->members[i];
+        if (!filter_set_match(&filters, m->base)) continue;
+        int type = S_ISDIR(m->mode) ? ENTRY_TYPE_DIR : S_ISLNK(m->mode) ? ENTRY_TYPE_LINK : ENTRY_TYPE_FILE;
+        if (listing_append(l, m->base, type) < 0) {
+            rc = -1;
+            break;
+        }
+        EntryMeta *e = &l->meta[l->count - 1];
+        e->size = m->size;
+        e->mtime = m->mtime;
+        e->mode = m->mode;
+        e->state = META_READY;
+    }
+    filter_set_free(&filters);
+    return rc;
+}
+
+// ---- member extraction ----
+
+// Private folder the members are extracted into
+int archive_temp_dir(char *dir, size_t len) {
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    int n = runtime && runtime[0] ? snprintf(dir, len, "%s/better-toolbar", runtime)
+                                  : snprintf(dir, len, "/tmp/better-toolbar-%u", (unsigned)getuid());
+    if (n >= (int)len) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) return -1;
+
+    // Under /tmp someone else could have made it first
+    struct stat st;
+    if (lstat(dir, &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid()) {
+        errno = EACCES;
+        return -1;
+    }
+    return 0;
+}
+
+int write_all(int fd, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+typedef struct {
+    const Archive *ax;
+    const ArchiveMember *m;
+    int fd;
+    z_stream zs;            // ended by archive_copy_member, also after a fault
+    int inflating;
+    int error;              // 0 or an errno value
+} ArchiveCopy;
+
+// Stream a member's data into fd, inflating as it goes; checks the zip CRC
+void archive_copy_scan(void *ctx) {
+    ArchiveCopy *c = (ArchiveCopy *)ctx;
+    const Archive *ax = c->ax;
+    const ArchiveMember *m = c->m;
+    if (ax->kind == ARCHIVE_TAR) {
+        if (write_all(c->fd, ax->map + m->offset, (size_t)m->size) < 0) c->error = errno;
+        return;
+    }
+
+    // The local header's name and extra lengths can differ from the central directory's
+    const unsigned char *lh = ax->map + m->offset;
+    if ((unsigned long long)m->offset > ax->mapSize - 30 || rd32(lh) != 0x04034b50) {
+        c->error = EIO;
+        return;
+    }
+    size_t start = (size_t)m->offset + 30 + rd16(lh + 26) + rd16(lh + 28);
+    if (start > ax->mapSize || (unsigned long long)m->packedSize > ax->mapSize - start) {
+        c->error = EIO;
+        return;
+    }
+    const unsigned char *data = ax->map + start;
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    if (m->method == ARCHIVE_STORED) {
+        if (m->packedSize != m->size) {
+            c->error = m->packedSize > m->size ? EFBIG : EIO;
+            return;
+        }
+        for (size_t done = 0; done < (size_t)m->packedSize;) {
+            size_t n = (size_t)m->packedSize - done;
+            if (n > (1u << 30)) n = 1u << 30;
+            crc = crc32(crc, data + done, (uInt)n);
+            done += n;
+        }
+        if (write_all(c->fd, data, (size_t)m->packedSize) < 0) {
+            c->error = errno;
+            return;
+        }
+    } else {
+        z_stream *zs = &c->zs;
+        if (inflateInit2(zs, -MAX_WBITS) != Z_OK) {
+            c->error = ENOMEM;
+            return;
+        }
+        c->inflating = 1;
+        unsigned char out[64 * 1024];
+        size_t remaining = (size_t)m->packedSize;
+        unsigned long long written = 0;
+        int rc = Z_OK;
+        while (rc == Z_OK) {
+            if (zs->avail_in == 0 && remaining > 0) {
+                zs->next_in = (Bytef *)(data + ((size_t)m->packedSize - remaining));
+                zs->avail_in = remaining > (1u << 30) ? 1u << 30 : (uInt)remaining;
+                remaining -= zs->avail_in;
+            }
+            zs->next_out = out;
+            zs->avail_out = sizeof(out);
+            rc = inflate(zs, Z_NO_FLUSH);
+            size_t produced = sizeof(out) - zs->avail_out;
+            // Never write more than the central directory promised: a few KB of
+            // crafted deflate data can expand to gigabytes on the runtime tmpfs
+            written += produced;
+            if (written > (unsigned long long)m->size) {
+                c->error = EFBIG;
+                return;
+            }
+            crc = crc32(crc, out, (uInt)produced);
+            if (produced && write_all(c->fd, out, produced) < 0) {
+                c->error = errno;
+                return;
+            }
+            if (rc == Z_BUF_ERROR && remaining > 0) rc = Z_OK;
+        }
+        if (rc != Z_STREAM_END || written != (unsigned long long)m->size) {
+            c->error = EIO;
+            return;
+        }
+    }
+    if ((uint32_t)crc != m->crc) c->error = EIO;
+}
+
+// Extract a member into fd; -1 with errno set on failure, EIO if the archive shrank
+// under the mapping meanwhile
+int archive_copy_member(const Archive *ax, const ArchiveMember *m, int fd) {
+    ArchiveCopy copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.ax = ax;
+    copy.m = m;
+    copy.fd = fd;
+    if (guarded_scan(archive_copy_scan, &copy) < 0) copy.error = EIO;
+    if (copy.inflating) inflateEnd(&copy.zs);
+    if (copy.error == 0) return 0;
+    errno = copy.error;
+    return -1;
+}
+
+// A member's name as it is given to the opening app: control characters, quotes and
+// the other shell metacharacters become '_', and it is cut (at a character boundary) so
+// that the tag in front of it still leaves a valid file name
+void archive_safe_name(const char *base, char *out) {
+    size_t n = 0;
+    for (const unsigned char *p = (const unsigned char *)base; *p && n < NAME_MAX - 9; p++)
+        out[n++] = *p < 0x20 || *p == 0x7F || strchr("'\"`$\\", *p) ? '_' : (char)*p;
+    while (n > 0 && ((unsigned char)base[n] & 0xC0) == 0x80) n--;
+    out[n] = '\0';
+}
+
+// Extract one member into the temp folder and return its path there. An earlier
+// extraction of the same member, with the same size and mtime, is reused.
+int archive_extract(const Archive *ax, int member, char *out, size_t outLen) {
+    const ArchiveMember *m = &ax->members[member];
+    if (m->method == ARCHIVE_UNSUPPORTED) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    char dir[MAX_PATH_LEN];
+    if (archive_temp_dir(dir, sizeof(dir)) < 0) return -1;
+
+    // Keep the member's own name for the opening app; the prefix keeps same-named
+    // members of different archives or folders apart
+    unsigned tag = archive_hash(ax->path, strlen(ax->path)) ^ m->hash;
+    char name[NAME_MAX + 1];
+    archive_safe_name(m->base, name);
+    if (snprintf(out, outLen, "%s/%08x-%s", dir, tag, name) >= (int)outLen) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    struct stat st;
+    if (stat(out, &st) == 0 && st.st_size == m->size && st.st_mtime == m->mtime) return 0;
+
+    char temp[MAX_PATH_LEN];
+    if (snprintf(temp, sizeof(temp), "%s/.extract-XXXXXX", dir) >= (int)sizeof(temp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = mkstemp(temp);
+    if (fd < 0) return -1;
+    int rc = archive_copy_member(ax, m, fd);
+    if (rc == 0) {
+        struct timespec times[2] = { { 0, UTIME_OMIT }, { (time_t)m->mtime, 0 } };
+        futimens(fd, times);
+    }
+    int saved = errno;
+    close(fd);
+    if (rc == 0 && rename(temp, out) < 0) {
+        rc = -1;
+        saved = errno;
+    }
+    if (rc < 0) {
+        unlink(temp);
+        errno = saved;
+    }
+    return rc;
+}
+
+// --bench-archive ARCHIVE [FOLDER]: time building the member index, then listing a
+// folder from the cached index the way navigation does
+int bench_archive(const char *path, const char *inner) {
+    char resolved[MAX_PATH_LEN];
+    if (!realpath(path, resolved)) {
+        perror(path);
+        return 1;
+    }
+    double t0 = monotonic_seconds();
+    Archive *ax = archive_get(resolved);
+    double tIndex = monotonic_seconds() - t0;
+    if (!ax) {
+        fprintf(stderr, "%s: not a zip or tar archive\n", path);
+        return 1;
+    }
+    printf("%s: %d members (%s)\n", path, ax->count, ax->kind == ARCHIVE_ZIP ? "zip" : "tar");
+    printf("  index build : %9.3f ms\n", tIndex * 1e3);
+    archive_release(ax);
+
+    Listing l;
+    memset(&l, 0, sizeof(l));
+    double best = 1e9;
+    for (int rep = 0; rep < 5; rep++) {
+        t0 = monotonic_seconds();
+        ax = archive_get(resolved);
+        int rc = ax ? archive_list(ax, inner, &l, 0, NULL, 0) : -1;
+        if (rc == 0) sort_listing(&l, SORT_NAME);
+        if (ax) archive_release(ax);
+        double t = monotonic_seconds() - t0;
+        if (rc < 0) {
+            fprintf(stderr, "%s/%s: %s\n", path, inner, strerror(errno));
+            listing_free(&l);
+            return 1;
+        }
+        if (t < best) best = t;
+    }
+    printf("  list + sort : %9.3f ms (%d rows, cached index)\n", best * 1e3, l.count);
+    listing_free(&l);
+    archive_cache_free();
+    return 0;
+}
+
+// ============ LINUX PERFORMANCE COUNTERS ============
+
+// Always-on counters for the whole process, cheap enough to leave enabled: plain relaxed
+// atomic adds, no locks. SIGUSR1 or Ctrl+Shift+D prints them to stderr; on exit one
+// record is appended to the stats file (BT_STATS_FILE, by default
+// $XDG_STATE_HOME/better-toolbar/stats.log; an empty BT_STATS_FILE turns that off).
+// A record is a "stats" line and one line per histogram, all plain key=value text, so
+// logs from many machines can simply be concatenated.
+
+#define HIST_BUCKETS 40
+
+// Log2 histogram: bucket i counts values with i significant bits, so bucket 0 is 0,
+// bucket 1 is 1, bucket 2 is 2-3, bucket 3 is 4-7, ...
+typedef struct {
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+    unsigned long long buckets[HIST_BUCKETS];
+} Histogram;
+
+typedef struct {
+    Histogram scanUs;           // one navigation on its I/O thread, from start to result
+    Histogram scanEntries;
+    Histogram drawUs;           // one draw_window call
+    Histogram drawRequests;     // X requests issued by one draw_window call
+    Histogram launchUs;         // click on a file until its opener has been started
+    Histogram startupUs;        // connecting to the display until the window is mapped
+    unsigned long long wakeups; // event loop passes (poll returns)
+    double start;
+    volatile sig_atomic_t dumpRequested;
+} Counters;
+
+Counters g_counters;
+
+void make_dirs(const char *dir, mode_t mode);
+
+void hist_add(Histogram *h, unsigned long long v) {
+    int bucket = v ? 64 - __builtin_clzll(v) : 0;
+    if (bucket >= HIST_BUCKETS) bucket = HIST_BUCKETS - 1;
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, v, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+    unsigned long long max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (v > max && !__atomic_compare_exchange_n(&h->max, &max, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+void counters_add_us(Histogram *h, double seconds) {
+    hist_add(h, seconds > 0 ? (unsigned long long)(seconds * 1e6) : 0);
+}
+
+// Upper end of the bucket holding the given fraction of the values (capped at the maximum)
+unsigned long long hist_percentile(const Histogram *h, unsigned long long count, double fraction) {
+    unsigned long long rank = (unsigned long long)(count * fraction + 0.5), seen = 0;
+    if (rank == 0) rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (seen < rank) continue;
+        unsigned long long top = i ? (1ULL << i) - 1 : 0;
+        unsigned long long max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+        return top < max ? top : max;
+    }
+    return __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+}
+
+// name count= sum= max= p50= p90= p99= buckets=bits:count,...
+void hist_write(FILE *out, const char *name, const Histogram *h) {
+    unsigned long long count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    fprintf(out, "%s count=%llu sum=%llu max=%llu", name, count,
+            __atomic_load_n(&h->sum, __ATOMIC_RELAXED), __atomic_load_n(&h->max, __ATOMIC_RELAXED));
+    if (count) {
+        fprintf(out, " p50=%llu p90=%llu p99=%llu", hist_percentile(h, count, 0.5),
+                hist_percentile(h, count, 0.9), hist_percentile(h, count, 0.99));
+    }
+    fputs(" buckets=", out);
+    const char *sep = "";
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        unsigned long long n = __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (!n) continue;
+        fprintf(out, "%s%d:%llu", sep, i, n);
+        sep = ",";
+    }
+    fputc('\n', out);
+}
+
+void counters_write(FILE *out) {
+    time_t now = time(NULL);
+    fprintf(out, "stats pid=%d time=%lld uptime=%.1f wakeups=%llu\n", (int)getpid(), (long long)now,
+            monotonic_seconds() - g_counters.start, __atomic_load_n(&g_counters.wakeups, __ATOMIC_RELAXED));
+    hist_write(out, "scan_us", &g_counters.scanUs);
+    hist_write(out, "scan_entries", &g_counters.scanEntries);
+    hist_write(out, "draw_us", &g_counters.drawUs);
+    hist_write(out, "draw_requests", &g_counters.drawRequests);
+    hist_write(out, "launch_us", &g_counters.launchUs);
+    hist_write(out, "startup_us", &g_counters.startupUs);
+    fflush(out);
+}
+
+// Only sets a flag; the event loop prints on its next pass
+void counters_signal(int sig) {
+    (void)sig;
+    int saved = errno;
+    g_counters.dumpRequested = 1;
+    wake_ui();
+    errno = saved;
+}
+
+void counters_init() {
+    g_counters.start = monotonic_seconds();
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = counters_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+// Called from the event loop
+void counters_poll_dump() {
+    if (!g_counters.dumpRequested) return;
+    g_counters.dumpRequested = 0;
+    counters_write(stderr);
+}
+
+// Append this session's record to the stats file
+void counters_save() {
+    char path[MAX_PATH_LEN];
+    const char *file = getenv("BT_STATS_FILE");
+    if (file) {
+        if (!file[0]) return;
+        snprintf(path, sizeof(path), "%s", file);
+    } else {
+        const char *state = getenv("XDG_STATE_HOME");
+        const char *home = getenv("HOME");
+        if (state && state[0] == '/') snprintf(path, sizeof(path), "%s/better-toolbar", state);
+        else if (home) snprintf(path, sizeof(path), "%s/.local/state/better-toolbar", home);
+        else return;
+        make_dirs(path, 0700);
+        strncat(path, "/stats.log", sizeof(path) - strlen(path) - 1);
+    }
+    FILE *out = fopen(path, "a");
+    if (!out) return;
+    counters_write(out);
+    fclose(out);
+}
+
+// ============ LINUX APPLICATION MODE ============
+
+// `--apps`, or a shortcut pointing at an applications folder, lists installed applications
+// instead of .desktop file names: every .desktop file in the XDG data dirs ($XDG_DATA_HOME,
+// then $XDG_DATA_DIRS, each with /applications) under its localized Name, started from its
+// Exec line without xdg-open. The parsed entries are cached in ~/.cache/better-toolbar/apps
+// with the mtime of every folder they came from, so a launch stats those folders and maps
+// one file. Installing or removing a package changes a folder's mtime and the index is
+// rebuilt, parsing the files on several threads. Runs on an I/O thread, like a folder scan.
+
+#define APPS_MAGIC      "BTAPPIDX"
+#define APPS_VERSION    1
+#define APPS_MAX_DIRS   256     // applications folders and their subfolders
+#define APPS_MAX_FILES  16384
+#define APPS_MAX_DEPTH  4
+#define APPS_FILE_BYTES (256 * 1024)
+
+typedef struct {
+    const char *id;         // desktop file id: the path below applications/ with '-' for '/'
+    const char *name;       // localized
+    const char *exec;
+    const char *icon;
+    const char *categories;
+    const char *path;       // the .desktop file
+    const char *workdir;    // Path=, or empty
+    int terminal;
+} AppEntry;
+
+typedef struct {
+    AppEntry *entries;      // sorted by name
+    int count;
+    char *blob;             // the index file image the strings point into
+} AppIndex;
+
+// Index file: header, folder stamps, entries, then NUL-terminated strings
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t dirCount;
+    uint32_t entryCount;
+    uint32_t stringsSize;
+    uint32_t context;       // string: locale and data dirs the index was built for
+    uint32_t crc;           // zlib crc32 of everything after the header
+    uint32_t reserved;
+} AppIndexHeader;
+
+typedef struct {
+    int64_t mtimeSec;       // -1: the folder did not exist
+    uint32_t mtimeNsec;
+    uint32_t path;
+} AppDirStamp;
+
+typedef struct {
+    uint32_t id, name, exec, icon, categories, path, workdir;
+    uint32_t terminal;
+} AppRecord;
+
+typedef struct {
+    char *path;
+    char *id;
+    int precedence;         // data dir index: the lowest one wins for an id
+} AppFile;
+
+typedef struct {
+    char *name, *exec, *icon, *categories, *workdir;
+    int nameRank;           // index of the locale key that matched; lower is better
+    int terminal, hidden, noDisplay, isApp;
+} AppParse;
+
+int search_thread_count();
+int app_cache_path(const char *name, char *out, size_t outLen);
+
+#define APPS_DATA_DIRS 16
+
+// Data dirs in precedence order, each with /applications appended, as strings for the
+// caller to free with app_dirs_free. Dirs whose path does not fit are left out.
+int app_data_dirs(char *dirs[], int max) {
+    char buf[MAX_PATH_LEN];
+    int n = 0;
+    const char *home = getenv("HOME");
+    const char *dataHome = getenv("XDG_DATA_HOME");
+    int len = -1;
+    if (dataHome && dataHome[0] == '/') len = snprintf(buf, sizeof(buf), "%s/applications", dataHome);
+    else if (home) len = snprintf(buf, sizeof(buf), "%s/.local/share/applications", home);
+    if (len >= 0 && len < (int)sizeof(buf) && (dirs[n] = strdup(buf)) != NULL) n++;
+
+    const char *list = getenv("XDG_DATA_DIRS");
+    if (!list || !list[0]) list = "/usr/local/share:/usr/share";
+    while (*list && n < max) {
+        size_t part = strcspn(list, ":");
+        if (part > 0 && list[0] == '/' && part < MAX_PATH_LEN - 16) {
+            snprintf(buf, sizeof(buf), "%.*s/applications", (int)part, list);
+            if ((dirs[n] = strdup(buf)) != NULL) n++;
+        }
+        list += part;
+        if (*list == ':') list++;
+    }
+    return n;
+}
+
+void app_dirs_free(char *dirs[], int count) {
+    for (int i = 0; i < count; i++) free(dirs[i]);
+}
+
+// Is this folder one of the applications folders (a shortcut that used to list .desktop files)
+int app_is_applications_dir(const char *path) {
+    char *dirs[APPS_DATA_DIRS];
+    char *a = realpath(path, NULL);
+    if (!a) return 0;
+    int n = app_data_dirs(dirs, APPS_DATA_DIRS), found = 0;
+    for (int i = 0; i < n && !found; i++) {
+        char *b = realpath(dirs[i], NULL);
+        found = b && strcmp(a, b) == 0;
+        free(b);
+    }
+    app_dirs_free(dirs, n);
+    free(a);
+    return found;
+}
+
+// Name[...] keys to try, best first: "sr_RS.UTF-8@latin" gives sr_RS@latin, sr_RS, sr@latin, sr
+int app_locale_keys(char keys[4][64]) {
+    const char *loc = getenv("LC_ALL");
+    if (!loc || !loc[0]) loc = getenv("LC_MESSAGES");
+    if (!loc || !loc[0]) loc = getenv("LANG");
+    if (!loc || !loc[0] || strcmp(loc, "C") == 0 || strcmp(loc, "POSIX") == 0) return 0;
+    char lang[32] = "", country[32] = "", modifier[32] = "";
+    size_t l = strcspn(loc, "_.@");
+    snprintf(lang, sizeof(lang), "%.*s", (int)(l < 31 ? l : 31), loc);
+    const char *c = strchr(loc, '_');
+    if (c) snprintf(country, sizeof(country), "%.*s", (int)strcspn(c + 1, ".@"), c + 1);
+    const char *m = strchr(loc, '@');
+    if (m) snprintf(modifier, sizeof(modifier), "%s", m + 1);
+
+    int n = 0;
+    if (country[0] && modifier[0]) snprintf(keys[n++], 64, "%s_%s@%s", lang, country, modifier);
+    if (country[0]) snprintf(keys[n++], 64, "%s_%s", lang, country);
+    if (modifier[0]) snprintf(keys[n++], 64, "%s@%s", lang, modifier);
+    snprintf(keys[n++], 64, "%s", lang);
+    return n;
+}
+
+// Copy a desktop entry string value, undoing its escapes (\s \n \t \r \\)
+char *app_unescape(const char *v, size_t len) {
+    char *out = (char *)malloc(len + 1);
+    if (!out) return NULL;
+    size_t o = 0;
+    for (size_t i = 0; i < len; i++) {
+        char ch = v[i];
+        if (ch == '\\' && i + 1 < len) {
+            char e = v[++i];
+            ch = e == 's' ? ' ' : e == 'n' ? '\n' : e == 't' ? '\t' : e == 'r' ? '\r' : e;
+        }
+        out[o++] = ch;
+    }
+    out[o] = '\0';
+    return out;
+}
+
+void app_parse_free(AppParse *p) {
+    free(p->name);
+    free(p->exec);
+    free(p->icon);
+    free(p->categories);
+    free(p->workdir);
+}
+
+// Read the [Desktop Entry] group of one file
+void app_parse_file(const char *path, char keys[4][64], int keyCount, AppParse *p) {
+    memset(p, 0, sizeof(*p));
+    p->nameRank = keyCount + 1;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    char *buf = (char *)malloc(APPS_FILE_BYTES + 1);
+    ssize_t len = buf ? read(fd, buf, APPS_FILE_BYTES) : -1;
+    close(fd);
+    if (len <= 0) {
+        free(buf);
+        return;
+    }
+    buf[len] = '\0';
+
+    int inEntry = 0;
+    for (char *line = buf; line && *line; ) {
+        char *next = strchr(line, '\n');
+        size_t n = next ? (size_t)(next - line) : strlen(line);
+        if (n > 0 && line[n - 1] == '\r') n--;
+        if (line[0] == '[') {
+            inEntry = n == 15 && strncmp(line, "[Desktop Entry]", 15) == 0;
+        } else if (inEntry && line[0] != '#') {
+            char *eq = memchr(line, '=', n);
+            if (eq) {
+                size_t keyLen = (size_t)(eq - line);
+                while (keyLen > 0 && line[keyLen - 1] == ' ') keyLen--;
+                const char *val = eq + 1;
+                while (val < line + n && *val == ' ') val++;
+                size_t valLen = (size_t)(line + n - val);
+                char key[96];
+                snprintf(key, sizeof(key), "%.*s", (int)(keyLen < 95 ? keyLen : 95), line);
+
+                char **slot = NULL;
+                if (strncmp(key, "Name", 4) == 0 && (key[4] == '\0' || key[4] == '[')) {
+                    int rank = keyCount;
+                    if (key[4] == '[') {
+                        rank = keyCount + 1;
+                        for (int k = 0; k < keyCount; k++)
+                            if (strncmp(key + 5, keys[k], strlen(keys[k])) == 0 &&
+                                strcmp(key + 5 + strlen(keys[k]), "]") == 0) {
+                                rank = k;
+                                break;
+                            }
+                    }
+                    if (rank < p->nameRank) {
+                        p->nameRank = rank;
+                        slot = &p->name;
+                    }
+                } else if (strcmp(key, "Exec") == 0) {
+                    slot = &p->exec;
+                } else if (strcmp(key, "Icon") == 0) {
+                    slot = &p->icon;
+                } else if (strcmp(key, "Categories") == 0) {
+                    slot = &p->categories;
+                } else if (strcmp(key, "Path") == 0) {
+                    slot = &p->workdir;
+                } else if (strcmp(key, "Type") == 0) {
+                    p->isApp = valLen == 11 && strncmp(val, "Application", 11) == 0;
+                } else if (strcmp(key, "Terminal") == 0) {
+                    p->terminal = valLen == 4 && strncmp(val, "true", 4) == 0;
+                } else if (strcmp(key, "Hidden") == 0) {
+                    p->hidden = valLen == 4 && strncmp(val, "true", 4) == 0;
+                } else if (strcmp(key, "NoDisplay") == 0) {
+                    p->noDisplay = valLen == 4 && strncmp(val, "true", 4) == 0;
+                }
+                if (slot) {
+                    free(*slot);
+                    *slot = app_unescape(val, valLen);
+                }
+            }
+        }
+        line = next ? next + 1 : NULL;
+    }
+    free(buf);
+}
+
+typedef struct {
+    AppFile *files;
+    AppParse *parsed;
+    int count;
+    int next;
+    char keys[4][64];
+    int keyCount;
+} AppBuildJob;
+
+// Each thread takes the next unparsed file until none are left
+void app_parse_item(void *ctx, int index) {
+    (void)index;
+    AppBuildJob *job = (AppBuildJob *)ctx;
+    for (;;) {
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) break;
+        app_parse_file(job->files[i].path, job->keys, job->keyCount, &job->parsed[i]);
+    }
+}
+
+typedef struct {
+    AppDirStamp *stamps;
+    char **paths;
+    int dirCount;
+    AppFile *files;
+    int fileCount;
+    int fileCapacity;
+} AppScan;
+
+// Record a folder's mtime and collect the .desktop files below it
+void app_scan_dir(AppScan *s, const char *dir, const char *idPrefix, int precedence, int depth) {
+    if (s->dirCount == APPS_MAX_DIRS) return;
+    char *copy = strdup(dir);
+    if (!copy) return;
+    int slot = s->dirCount++;
+    s->paths[slot] = copy;
+    struct stat st;
+    DIR *d = stat(dir, &st) == 0 && S_ISDIR(st.st_mode) ? opendir(dir) : NULL;
+    s->stamps[slot].mtimeSec = d ? (int64_t)st.st_mtim.tv_sec : -1;
+    s->stamps[slot].mtimeNsec = d ? (uint32_t)st.st_mtim.tv_nsec : 0;
+    if (!d) return;
+
+    struct dirent *e;
+    char path[MAX_PATH_LEN], id[NAME_MAX + 1];
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, e->d_name) >= (int)sizeof(path)) continue;
+        if (snprintf(id, sizeof(id), "%s%s", idPrefix, e->d_name) >= (int)sizeof(id)) continue;
+        int type = e->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            struct stat target;
+            if (stat(path, &target) < 0) continue;
+            type = S_ISDIR(target.st_mode) ? DT_DIR : S_ISREG(target.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        size_t len = strlen(e->d_name);
+        if (type == DT_DIR && depth < APPS_MAX_DEPTH) {
+            char prefix[NAME_MAX + 1];
+            if (snprintf(prefix, sizeof(prefix), "%s-", id) < (int)sizeof(prefix))
+                app_scan_dir(s, path, prefix, precedence, depth + 1);
+        } else if (type == DT_REG && len > 8 && strcmp(e->d_name + len - 8, ".desktop") == 0 &&
+                   s->fileCount < APPS_MAX_FILES) {
+            if (s->fileCount == s->fileCapacity) {
+                int cap = s->fileCapacity ? s->fileCapacity * 2 : 256;
+                AppFile *grown = (AppFile *)realloc(s->files, (size_t)cap * sizeof(AppFile));
+                if (!grown) break;
+                s->files = grown;
+                s->fileCapacity = cap;
+            }
+            AppFile *f = &s->files[s->fileCount];
+            f->path = strdup(path);
+            f->id = strdup(id);
+            f->precedence = precedence;
+            if (!f->path || !f->id) {
+                free(f->path);
+                free(f->id);
+                break;
+            }
+            s->fileCount++;
+        }
+    }
+    closedir(d);
+}
+
+int compare_app_files(const void *a, const void *b) {
+    const AppFile *fa = (const AppFile *)a, *fb = (const AppFile *)b;
+    int c = strcmp(fa->id, fb->id);
+    return c ? c : fa->precedence - fb->precedence;
+}
+
+// What the index depends on besides folder mtimes: the locale and the data dirs. A string
+// for the caller to free; NULL when out of memory.
+char *app_context(char *dirs[], int dirCount) {
+    char keys[4][64];
+    int keyCount = app_locale_keys(keys);
+    size_t outLen = 96;
+    for (int i = 0; i < dirCount; i++) outLen += strlen(dirs[i]) + 1;
+    char *out = (char *)malloc(outLen);
+    if (!out) return NULL;
+    size_t len = (size_t)snprintf(out, outLen, "%d%s", APPS_VERSION, keyCount ? keys[0] : "C");
+    for (int i = 0; i < dirCount && len < outLen; i++)
+        len += (size_t)snprintf(out + len, outLen - len, ":%s", dirs[i]);
+    return out;
+}
+
+// Check an index image and turn it into an AppIndex that takes ownership of it. With
+// checkDirs, every folder must still have the recorded mtime. Returns NULL if anything is off.
+AppIndex *app_index_from_blob(char *blob, size_t size, const char *context, int checkDirs) {
+    AppIndexHeader h;
+    if (size < sizeof(h)) return NULL;
+    memcpy(&h, blob, sizeof(h));
+    if (memcmp(h.magic, APPS_MAGIC, 8) != 0 || h.version != APPS_VERSION || h.headerSize != sizeof(h) ||
+        h.dirCount > APPS_MAX_DIRS || h.entryCount > APPS_MAX_FILES)
+        return NULL;
+    uint64_t expected = (uint64_t)sizeof(h) + (uint64_t)h.dirCount * sizeof(AppDirStamp) +
+                        (uint64_t)h.entryCount * sizeof(AppRecord) + h.stringsSize;
+    if (expected != size || h.stringsSize == 0) return NULL;
+    if ((uint32_t)crc32(0L, (const Bytef *)blob + sizeof(h), (uInt)(size - sizeof(h))) != h.crc) return NULL;
+
+    const char *strings = blob + size - h.stringsSize;
+    if (strings[h.stringsSize - 1] != '\0' || h.context >= h.stringsSize) return NULL;
+    if (strcmp(strings + h.context, context) != 0) return NULL;
+
+    const char *dirs = blob + sizeof(h);
+    for (uint32_t i = 0; i < h.dirCount; i++) {
+        AppDirStamp d;
+        memcpy(&d, dirs + (size_t)i * sizeof(d), sizeof(d));
+        if (d.path >= h.stringsSize) return NULL;
+        if (!checkDirs) continue;
+        struct stat st;
+        int exists = stat(strings + d.path, &st) == 0 && S_ISDIR(st.st_mode);
+        if (exists ? (d.mtimeSec != (int64_t)st.st_mtim.tv_sec || d.mtimeNsec != (uint32_t)st.st_mtim.tv_nsec)
+                   : d.mtimeSec != -1)
+            return NULL;
+    }
+
+    AppIndex *ix = (AppIndex *)calloc(1, sizeof(AppIndex));
+    if (!ix) return NULL;
+    ix->entries = (AppEntry *)calloc(h.entryCount ? h.entryCount : 1, sizeof(AppEntry));
+    if (!ix->entries) {
+        free(ix);
+        return NULL;
+    }
+    const char *records = dirs + (size_t)h.dirCount * sizeof(AppDirStamp);
+    for (uint32_t i = 0; i < h.entryCount; i++) {
+        AppRecord r;
+        memcpy(&r, records + (size_t)i * sizeof(r), sizeof(r));
+        if (r.id >= h.stringsSize || r.name >= h.stringsSize || r.exec >= h.stringsSize || r.icon >= h.stringsSize ||
+            r.categories >= h.stringsSize || r.path >= h.stringsSize || r.workdir >= h.stringsSize) {
+            free(ix->entries);
+            free(ix);
+            return NULL;
+        }
+        AppEntry *e = &ix->entries[i];
+        e->id = strings + r.id;
+        e->name = strings + r.name;
+        e->exec = strings + r.exec;
+        e->icon = strings + r.icon;
+        e->categories = strings + r.categories;
+        e->path = strings + r.path;
+        e->workdir = strings + r.workdir;
+        e->terminal = r.terminal != 0;
+    }
+    ix->count = (int)h.entryCount;
+    ix->blob = blob;
+    return ix;
+}
+
+void app_index_free(AppIndex *ix) {
+    if (!ix) return;
+    free(ix->entries);
+    free(ix->blob);
+    free(ix);
+}
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+    int failed;
+} AppBuffer;
+
+void app_buffer_put(AppBuffer *b, const void *data, size_t len) {
+    if (b->failed) return;
+    if (b->len + len > b->capacity) {
+        size_t cap = b->capacity ? b->capacity * 2 : 64 * 1024;
+        while (cap < b->len + len) cap *= 2;
+        char *grown = (char *)realloc(b->data, cap);
+        if (!grown) {
+            b->failed = 1;
+            return;
+        }
+        b->data = grown;
+        b->capacity = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+// Offset of s in the strings section, appending it
+uint32_t app_string(AppBuffer *strings, const char *s) {
+    uint32_t at = (uint32_t)strings->len;
+    app_buffer_put(strings, s ? s : "", strlen(s ? s : "") + 1);
+    return at;
+}
+
+typedef struct {
+    const AppParse *p;
+    const AppFile *f;
+} AppPick;
+
+int compare_app_picks(const void *a, const void *b) {
+    const AppPick *pa = (const AppPick *)a, *pb = (const AppPick *)b;
+    int c = utf8_casecmp(pa->p->name, pb->p->name);
+    return c ? c : strcmp(pa->p->name, pb->p->name);
+}
+
+// Parse every .desktop file and lay the result out as an index image
+char *app_index_build(char *dirs[], int dirCount, const char *context, size_t *size) {
+    AppScan scan = {0};
+    scan.stamps = (AppDirStamp *)calloc(APPS_MAX_DIRS, sizeof(AppDirStamp));
+    scan.paths = (char **)calloc(APPS_MAX_DIRS, sizeof(char *));
+    AppBuildJob job = {0};
+    AppPick *picks = NULL;
+    AppBuffer body = {0}, strings = {0};
+    char *blob = NULL;
+    if (!scan.stamps || !scan.paths) goto done;
+
+    for (int i = 0; i < dirCount; i++) app_scan_dir(&scan, dirs[i], "", i, 0);
+    qsort(scan.files, (size_t)scan.fileCount, sizeof(AppFile), compare_app_files);
+
+    job.files = scan.files;
+    job.count = scan.fileCount;
+    job.keyCount = app_locale_keys(job.keys);
+    job.parsed = (AppParse *)calloc((size_t)(job.count ? job.count : 1), sizeof(AppParse));
+    picks = (AppPick *)calloc((size_t)(job.count ? job.count : 1), sizeof(AppPick));
+    if (!job.parsed || !picks) goto done;
+    int threads = search_thread_count();
+    if (threads > job.count) threads = job.count;
+    run_concurrently(threads, app_parse_item, &job);
+
+    // The first file for an id wins; if it is Hidden, the id is gone altogether
+    int pickCount = 0;
+    for (int i = 0; i < job.count; i++) {
+        if (i > 0 && strcmp(job.files[i].id, job.files[i - 1].id) == 0) continue;
+        const AppParse *p = &job.parsed[i];
+        if (p->hidden || p->noDisplay || !p->isApp || !p->name || !p->exec || !p->name[0]) continue;
+        picks[pickCount].p = p;
+        picks[pickCount].f = &job.files[i];
+        pickCount++;
+    }
+    qsort(picks, (size_t)pickCount, sizeof(AppPick), compare_app_picks);
+
+    AppIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, APPS_MAGIC, 8);
+    h.version = APPS_VERSION;
+    h.headerSize = sizeof(h);
+    h.dirCount = (uint32_t)scan.dirCount;
+    h.entryCount = (uint32_t)pickCount;
+    h.context = app_string(&strings, context);
+    for (int i = 0; i < scan.dirCount; i++) {
+        scan.stamps[i].path = app_string(&strings, scan.paths[i]);
+        app_buffer_put(&body, &scan.stamps[i], sizeof(AppDirStamp));
+    }
+    for (int i = 0; i < pickCount; i++) {
+        const AppParse *p = picks[i].p;
+        AppRecord r;
+        r.id = app_string(&strings, picks[i].f->id);
+        r.name = app_string(&strings, p->name);
+        r.exec = app_string(&strings, p->exec);
+        r.icon = app_string(&strings, p->icon);
+        r.categories = app_string(&strings, p->categories);
+        r.path = app_string(&strings, picks[i].f->path);
+        r.workdir = app_string(&strings, p->workdir);
+        r.terminal = (uint32_t)p->terminal;
+        app_buffer_put(&body, &r, sizeof(r));
+    }
+    app_buffer_put(&body, strings.data, strings.len);
+    if (body.failed || strings.failed) goto done;
+    h.stringsSize = (uint32_t)strings.len;
+    h.crc = (uint32_t)crc32(0L, (const Bytef *)body.data, (uInt)body.len);
+
+    blob = (char *)malloc(sizeof(h) + body.len);
+    if (blob) {
+        memcpy(blob, &h, sizeof(h));
+        memcpy(blob + sizeof(h), body.data, body.len);
+        *size = sizeof(h) + body.len;
+    }
+
+done:
+    for (int i = 0; job.parsed && i < job.count; i++) app_parse_free(&job.parsed[i]);
+    free(job.parsed);
+    free(picks);
+    for (int i = 0; i < scan.fileCount; i++) {
+        free(scan.files[i].path);
+        free(scan.files[i].id);
+    }
+    free(scan.files);
+    free(scan.stamps);
+    for (int i = 0; i < scan.dirCount; i++) free(scan.paths[i]);
+    free(scan.paths);
+    free(body.data);
+    free(strings.data);
+    return blob;
+}
+
+// The cached index if no folder changed since it was written, else a fresh one (which is
+// then cached). NULL on failure.
+AppIndex *app_index_load(char *dirs[], int dirCount, const char *context) {
+    char path[MAX_PATH_LEN], tmp[MAX_PATH_LEN + 8];
+    int cached = app_cache_path("apps", path, sizeof(path));
+
+    if (cached) {
+        // One read of the whole file; nothing is parsed unless a folder changed
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size < (64 << 20)) {
+            char *blob = (char *)malloc((size_t)st.st_size);
+            AppIndex *ix = NULL;
+            if (blob && read(fd, blob, (size_t)st.st_size) == st.st_size)
+                ix = app_index_from_blob(blob, (size_t)st.st_size, context, 1);
+            if (!ix) free(blob);
+            close(fd);
+            if (ix) return ix;
+        } else if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    size_t size = 0;
+    char *blob = app_index_build(dirs, dirCount, context, &size);
+    if (!blob) return NULL;
+    if (cached) {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        FILE *out = fopen(tmp, "wb");
+        int ok = out && fwrite(blob, 1, size, out) == size;
+        if (out && fclose(out) != 0) ok = 0;
+        if (!ok || rename(tmp, path) != 0) unlink(tmp);
+    }
+    AppIndex *ix = app_index_from_blob(blob, size, context, 0);
+    if (!ix) free(blob);
+    return ix;
+}
+
+// The application index for the current locale and data dirs. The dirs and the context
+// string live on the heap: this runs on I/O threads, whose stacks are smaller.
+AppIndex *app_index_get() {
+    char *dirs[APPS_DATA_DIRS];
+    int dirCount = app_data_dirs(dirs, APPS_DATA_DIRS);
+    char *context = app_context(dirs, dirCount);
+    AppIndex *ix = context ? app_index_load(dirs, dirCount, context) : NULL;
+    free(context);
+    app_dirs_free(dirs, dirCount);
+    return ix;
+}
+
+// --bench-apps: parse every .desktop file, then load the cached index, best of five each
+int bench_apps() {
+    char *dirs[APPS_DATA_DIRS];
+    int dirCount = app_data_dirs(dirs, APPS_DATA_DIRS);
+    char *context = app_context(dirs, dirCount);
+    if (!context) {
+        app_dirs_free(dirs, dirCount);
+        fprintf(stderr, "Cannot build the application index\n");
+        return 1;
+    }
+
+    double tBuild = 1e9, tCached = 1e9;
+    int count = 0;
+    for (int rep = 0; rep < 5; rep++) {
+        size_t size = 0;
+        double t0 = monotonic_seconds();
+        char *blob = app_index_build(dirs, dirCount, context, &size);
+        AppIndex *ix = blob ? app_index_from_blob(blob, size, context, 0) : NULL;
+        double t = monotonic_seconds() - t0;
+        if (!ix) {
+            free(blob);
+            free(context);
+            app_dirs_free(dirs, dirCount);
+            fprintf(stderr, "Cannot build the application index\n");
+            return 1;
+        }
+        if (t < tBuild) tBuild = t;
+        count = ix->count;
+        app_index_free(ix);
+    }
+    app_index_free(app_index_get());   // makes sure the cache is current
+    for (int rep = 0; rep < 5; rep++) {
+        double t0 = monotonic_seconds();
+        AppIndex *ix = app_index_get();
+        double t = monotonic_seconds() - t0;
+        if (t < tCached) tCached = t;
+        app_index_free(ix);
+    }
+    free(context);
+    app_dirs_free(dirs, dirCount);
+    printf("%d applications, %d threads\n", count, search_thread_count());
+    printf("parse: %8.2f ms\n", tBuild * 1000);
+    printf("cache: %8.2f ms\n", tCached * 1000);
+    return 0;
+}
+
+// ============ LINUX RECENT FILES ============
+
+// A "Recent files" view (--recent, or Ctrl+R to go there and back): the files desktop
+// applications recorded in ~/.local/share/recently-used.xbel, plus the ones opened from
+// here, which are logged in ~/.local/state/better-toolbar/launches.log. Most recent first,
+// filtered like a folder. The xbel file is often several megabytes, so it is mapped and
+// scanned for <bookmark> tags and their attributes only; no document tree is built. Each
+// source is parsed again only when its mtime or size changes.
+
+#define RECENT_MAX_ROWS 2000
+#define RECENT_LOG_MAX  (256 * 1024)    // the launch log is rewritten without duplicates past this
+
+typedef struct {
+    char *path;
+    long long used;         // seconds since the epoch
+} RecentItem;
+
+typedef struct {
+    RecentItem *items;
+    int count;
+    int64_t mtimeSec;
+    uint32_t mtimeNsec;
+    int64_t size;           // -1: not read yet, or missing
+} RecentSource;
+
+typedef struct {
+    pthread_mutex_t lock;
+    RecentSource xbel;
+    RecentSource log;
+    RecentItem *merged;     // both, one item per path, most recent first
+    int mergedCount;
+} RecentCache;
+
+RecentCache g_recent = { .lock = PTHREAD_MUTEX_INITIALIZER, .xbel = { .size = -1 }, .log = { .size = -1 } };
+
+int recent_xbel_path(char *out, size_t outLen) {
+    const char *data = getenv("XDG_DATA_HOME");
+    const char *home = getenv("HOME");
+    if (data && data[0] == '/') return snprintf(out, outLen, "%s/recently-used.xbel", data) < (int)outLen;
+    if (home) return snprintf(out, outLen, "%s/.local/share/recently-used.xbel", home) < (int)outLen;
+    return 0;
+}
+
+int recent_log_path(char *out, size_t outLen, int create) {
+    const char *state = getenv("XDG_STATE_HOME");
+    const char *home = getenv("HOME");
+    char dir[MAX_PATH_LEN];
+    if (state && state[0] == '/') snprintf(dir, sizeof(dir), "%s/better-toolbar", state);
+    else if (home) snprintf(dir, sizeof(dir), "%s/.local/state/better-toolbar", home);
+    else return 0;
+    if (create) make_dirs(dir, 0700);
+    return snprintf(out, outLen, "%s/launches.log", dir) < (int)outLen;
+}
+
+// Open the launch log for appending with an exclusive flock held. A compaction replaces
+// the file under the same lock, so a descriptor that lost the race to one is reopened
+// rather than appended to a log nobody reads any more.
+int recent_log_open_locked(const char *logPath) {
+    for (int tries = 0; tries < 4; tries++) {
+        int fd = open(logPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if (fd < 0) return -1;
+        struct stat held, now;
+        if (flock(fd, LOCK_EX) == 0 && fstat(fd, &held) == 0 && stat(logPath, &now) == 0 &&
+            held.st_dev == now.st_dev && held.st_ino == now.st_ino)
+            return fd;
+        close(fd);
+    }
+    return -1;
+}
+
+// Add a file opened from the toolbar to the launch log
+void recent_log_launch(const char *path) {
+    char logPath[MAX_PATH_LEN], line[MAX_PATH_LEN + 32];
+    if (path[0] != '/' || strchr(path, '\n') || !recent_log_path(logPath, sizeof(logPath), 1)) return;
+    int fd = recent_log_open_locked(logPath);
+    if (fd < 0) return;
+    int len = snprintf(line, sizeof(line), "%lld\t%s\n", (long long)time(NULL), path);
+    if (len < (int)sizeof(line) && write(fd, line, (size_t)len) != len) {}
+    close(fd);
+}
+
+void recent_items_free(RecentItem *items, int count) {
+    for (int i = 0; i < count; i++) free(items[i].path);
+    free(items);
+}
+
+int recent_push(RecentItem **items, int *count, int *capacity, const char *path, size_t len, long long used) {
+    if (*count == *capacity) {
+        int cap = *capacity ? *capacity * 2 : 256;
+        RecentItem *grown = (RecentItem *)realloc(*items, (size_t)cap * sizeof(RecentItem));
+        if (!grown) return -1;
+        *items = grown;
+        *capacity = cap;
+    }
+    char *copy = (char *)malloc(len + 1);
+    if (!copy) return -1;
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    (*items)[*count].path = copy;
+    (*items)[*count].used = used;
+    (*count)++;
+    return 0;
+}
+
+// "2024-05-01T09:30:12.123456Z" (always UTC in xbel files), or 0
+long long recent_parse_time(const char *s, size_t len) {
+    char buf[32];
+    if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(buf, "%4d-%2d-%2dT%2d:%2d:%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+        return 0;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return (long long)timegm(&tm);
+}
+
+int recent_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// A file:// href attribute to a path: XML entities first, then percent-escapes.
+// Returns the length, or -1 for other URLs and bad escapes.
+int recent_href_path(const char *v, size_t len, char *out, size_t outLen) {
+    char url[MAX_PATH_LEN * 3];
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 1 < sizeof(url); i++) {
+        if (v[i] != '&') {
+            url[n++] = v[i];
+            continue;
+        }
+        const char *semi = memchr(v + i, ';', len - i);
+        if (!semi) return -1;
+        size_t elen = (size_t)(semi - (v + i)) + 1;
+        if (elen == 5 && memcmp(v + i, "&amp;", 5) == 0) url[n++] = '&';
+        else if (elen == 6 && memcmp(v + i, "&apos;", 6) == 0) url[n++] = '\'';
+        else if (elen == 6 && memcmp(v + i, "&quot;", 6) == 0) url[n++] = '"';
+        else if (elen == 4 && memcmp(v + i, "&lt;", 4) == 0) url[n++] = '<';
+        else if (elen == 4 && memcmp(v + i, "&gt;", 4) == 0) url[n++] = '>';
+        else return -1;         // numeric references do not show up in hrefs, which are escaped URLs
+        i += elen - 1;
+    }
+    url[n] = '\0';
+    if (strncmp(url, "file://", 7) != 0) return -1;
+    const char *p = strchr(url + 7, '/');    // past "localhost" or an empty host
+    if (!p) return -1;
+    size_t o = 0;
+    for (; *p && o + 1 < outLen; p++) {
+        if (*p == '%') {
+            int hi = recent_hex(p[1]), lo = hi < 0 ? -1 : recent_hex(p[2]);
+            if (lo < 0) return -1;
+            out[o++] = (char)(hi * 16 + lo);
+            p += 2;
+        } else {
+            out[o++] = *p;
+        }
+    }
+    out[o] = '\0';
+    return memchr(out, '\0', o) ? -1 : (int)o;
+}
+
+// Scan an xbel document for <bookmark href=... added=... modified=... visited=...>. The
+// newest of the three times is the bookmark's. Nested elements are skipped unread.
+int recent_parse_xbel(const char *data, size_t len, RecentItem **items, int *count) {
+    int capacity = 0;
+    const char *end = data + len;
+    char path[MAX_PATH_LEN];
+    for (const char *p = data; (p = memmem(p, (size_t)(end - p), "<bookmark ", 10)) != NULL; ) {
+        const char *close = memchr(p, '>', (size_t)(end - p));
+        if (!close) break;
+        const char *a = p + 10;
+        int pathLen = -1;
+        long long used = 0;
+        while (a < close) {
+            while (a < close && isspace((unsigned char)*a)) a++;
+            const char *eq = memchr(a, '=', (size_t)(close - a));
+            if (!eq || eq + 1 >= close || (eq[1] != '"' && eq[1] != '\'')) break;
+            const char *v = eq + 2;
+            const char *vend = memchr(v, eq[1], (size_t)(close - v));
+            if (!vend) break;
+            size_t nameLen = (size_t)(eq - a);
+            if (nameLen == 4 && memcmp(a, "href", 4) == 0) {
+                pathLen = recent_href_path(v, (size_t)(vend - v), path, sizeof(path));
+            } else if ((nameLen == 5 && memcmp(a, "added", 5) == 0) ||
+                       (nameLen == 8 && memcmp(a, "modified", 8) == 0) ||
+                       (nameLen == 7 && memcmp(a, "visited", 7) == 0)) {
+                long long t = recent_parse_time(v, (size_t)(vend - v));
+                if (t > used) used = t;
+            }
+            a = vend + 1;
+        }
+        if (pathLen > 0 && recent_push(items, count, &capacity, path, (size_t)pathLen, used) < 0) return -1;
+        p = close + 1;
+    }
+    return 0;
+}
+
+// "<seconds>\t<path>" lines
+int recent_parse_log(const char *data, size_t len, RecentItem **items, int *count) {
+    int capacity = 0;
+    const char *end = data + len;
+    for (const char *p = data; p < end; ) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *lineEnd = nl ? nl : end;
+        const char *tab = memchr(p, '\t', (size_t)(lineEnd - p));
+        if (tab && tab + 1 < lineEnd && tab[1] == '/') {
+            long long used = strtoll(p, NULL, 10);
+            if (recent_push(items, count, &capacity, tab + 1, (size_t)(lineEnd - tab - 1), used) < 0) return -1;
+        }
+        p = nl ? nl + 1 : end;
+    }
+    return 0;
+}
+
+// Re-read a source if its file changed. Returns 1 if the items changed.
+int recent_source_refresh(RecentSource *src, const char *path, int (*parse)(const char *, size_t, RecentItem **, int *)) {
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) close(fd);
+        if (src->size < 0) return 0;
+        recent_items_free(src->items, src->count);
+        src->items = NULL;
+        src->count = 0;
+        src->size = -1;
+        return 1;
+    }
+    if (src->size == (int64_t)st.st_size && src->mtimeSec == (int64_t)st.st_mtim.tv_sec &&
+        src->mtimeNsec == (uint32_t)st.st_mtim.tv_nsec) {
+        close(fd);
+        return 0;
+    }
+    RecentItem *items = NULL;
+    int count = 0;
+    int ok = 1;
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            ok = 0;
+        } else {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            ok = parse((const char *)map, (size_t)st.st_size, &items, &count) == 0;
+            munmap(map, (size_t)st.st_size);
+        }
+    }
+    close(fd);
+    if (!ok) {
+        recent_items_free(items, count);
+        return 0;
+    }
+    recent_items_free(src->items, src->count);
+    src->items = items;
+    src->count = count;
+    src->size = (int64_t)st.st_size;
+    src->mtimeSec = (int64_t)st.st_mtim.tv_sec;
+    src->mtimeNsec = (uint32_t)st.st_mtim.tv_nsec;
+    return 1;
+}
+
+int compare_recent_paths(const void *a, const void *b) {
+    const RecentItem *x = (const RecentItem *)a, *y = (const RecentItem *)b;
+    int c = strcmp(x->path, y->path);
+    if (c) return c;
+    return x->used > y->used ? -1 : x->used < y->used;
+}
+
+int compare_recent_used(const void *a, const void *b) {
+    const RecentItem *x = (const RecentItem *)a, *y = (const RecentItem *)b;
+    if (x->used != y->used) return x->used > y->used ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+// Rewrite an overgrown launch log with one line per file, the RECENT_MAX_ROWS newest
+// kept, oldest first like the appends. The new file replaces the log while its lock is
+// held; if lines were appended since `log` was read, it is left for the next refresh.
+void recent_compact_log(const char *path, const RecentSource *log) {
+    char tmp[MAX_PATH_LEN + 8];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return;
+    int fd = recent_log_open_locked(path);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (int64_t)st.st_size != log->size || (int64_t)st.st_mtim.tv_sec != log->mtimeSec ||
+        (uint32_t)st.st_mtim.tv_nsec != log->mtimeNsec) {
+        close(fd);
+        return;
+    }
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        close(fd);
+        return;
+    }
+    RecentItem *items = (RecentItem *)malloc((size_t)(log->count ? log->count : 1) * sizeof(RecentItem));
+    int ok = items != NULL;
+    if (ok) {
+        memcpy(items, log->items, (size_t)log->count * sizeof(RecentItem));
+        qsort(items, (size_t)log->count, sizeof(RecentItem), compare_recent_paths);
+        int kept = 0;
+        for (int i = 0; i < log->count; i++)
+            if (i == 0 || strcmp(items[i].path, items[i - 1].path) != 0) items[kept++] = items[i];
+        qsort(items, (size_t)kept, sizeof(RecentItem), compare_recent_used);
+        int keep = kept < RECENT_MAX_ROWS ? kept : RECENT_MAX_ROWS;
+        for (int i = keep - 1; i >= 0; i--)
+            fprintf(out, "%lld\t%s\n", items[i].used, items[i].path);
+    }
+    free(items);
+    if (fclose(out) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) unlink(tmp);
+    close(fd);
+}
+
+// Paths of the recent files, most recent first (a copy for the caller to free with
+// recent_items_free). Runs on an I/O thread.
+int recent_items_get(RecentItem **out, int *outCount) {
+    RecentCache *c = &g_recent;
+    char xbel[MAX_PATH_LEN], log[MAX_PATH_LEN];
+    *out = NULL;
+    *outCount = 0;
+    pthread_mutex_lock(&c->lock);
+    int changed = 0;
+    if (recent_xbel_path(xbel, sizeof(xbel))) changed |= recent_source_refresh(&c->xbel, xbel, recent_parse_xbel);
+    if (recent_log_path(log, sizeof(log), 0)) {
+        changed |= recent_source_refresh(&c->log, log, recent_parse_log);
+        if (c->log.size > RECENT_LOG_MAX) recent_compact_log(log, &c->log);
+    }
+
+    if (changed || !c->merged) {
+        int total = c->xbel.count + c->log.count;
+        RecentItem *all = (RecentItem *)malloc((size_t)(total ? total : 1) * sizeof(RecentItem));
+        if (!all) {
+            pthread_mutex_unlock(&c->lock);
+            return -1;
+        }
+        memcpy(all, c->xbel.items, (size_t)c->xbel.count * sizeof(RecentItem));
+        memcpy(all + c->xbel.count, c->log.items, (size_t)c->log.count * sizeof(RecentItem));
+        // One row per path, at its latest use; the strings stay owned by the sources
+        qsort(all, (size_t)total, sizeof(RecentItem), compare_recent_paths);
+        int kept = 0;
+        for (int i = 0; i < total; i++)
+            if (i == 0 || strcmp(all[i].path, all[kept - 1].path) != 0) all[kept++] = all[i];
+        qsort(all, (size_t)kept, sizeof(RecentItem), compare_recent_used);
+        free(c->merged);
+        c->merged = all;
+        c->mergedCount = kept;
+    }
+
+    RecentItem *copy = (RecentItem *)calloc((size_t)(c->mergedCount ? c->mergedCount : 1), sizeof(RecentItem));
+    int n = 0;
+    for (int i = 0; copy && i < c->mergedCount; i++) {
+        if (!(copy[n].path = strdup(c->merged[i].path))) break;
+        copy[n++].used = c->merged[i].used;
+    }
+    pthread_mutex_unlock(&c->lock);
+    if (!copy) return -1;
+    *out = copy;
+    *outCount = n;
+    return 0;
+}
+
+// --bench-recent [file]: scan an xbel file, best of five
+int bench_recent(const char *path) {
+    char def[MAX_PATH_LEN];
+    if (!path && !recent_xbel_path(def, sizeof(def))) return 1;
+    if (!path) path = def;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 1;
+    double best = 1e9;
+    int count = 0;
+    for (int rep = 0; rep < 5; rep++) {
+        RecentItem *items = NULL;
+        count = 0;
+        double t0 = monotonic_seconds();
+        recent_parse_xbel((const char *)map, (size_t)st.st_size, &items, &count);
+        double t = monotonic_seconds() - t0;
+        if (t < best) best = t;
+        recent_items_free(items, count);
+    }
+    munmap(map, (size_t)st.st_size);
+    printf("%d bookmarks in %.1f MB: %.2f ms, %.0f MB/s\n", count, st.st_size / 1e6, best * 1000,
+           st.st_size / 1e6 / best);
+    return 0;
+}
+
+// ============ LINUX I/O WORKER LAYER ============
+
+// Everything that can block on a slow or hung filesystem (resolving, opening and scanning a
+// directory, the directory check on click) runs on an I/O thread, never on the UI thread.
+// Each navigation gets its own detached thread: a request stuck in the kernel on a dead NFS
+// or SSHFS mount only pins that thread. Navigating again abandons the pending request; its
+// thread frees the result whenever the kernel lets it go.
+
+#define IO_MAX_STUCK_THREADS 16
+#define IO_DEFAULT_TIMEOUT_MS 1500
+
+#define IO_LAUNCH_IF_FILE 1    // the path came from a click: open it if it is not a directory
+#define IO_PROBE_FIRST_ARG 2   // startup: argv[1] is the folder only if it is a directory
+#define IO_MERGED_ROOTS 4      // list all of the request's roots as one folder
+#define IO_REVALIDATE 8        // startup: rescan the folder restored from the session snapshot
+#define IO_APPS 16             // list the installed applications
+#define IO_RECENT 32           // list the recently used files
+
+// Folders of the merged listing on screen; owned by the UI thread. Each request works on
+// its own copy (IoRequest.roots), which replaces this one when its listing is installed.
+RootSet g_roots;
+
+typedef struct {
+    // Request, fixed at submit time
+    char path[MAX_PATH_LEN];
+    int flags;
+    int sortMode;
+    int filterStart;
+    double deadline;
+
+    // Result, written by the worker before `done`
+    int status;                // 0 or an errno value
+    int isDirectory;
+    int inArchive;             // the listing is a folder inside a zip or tar file
+    int merged;                // the listing merges all of roots
+    RootSet roots;             // IO_MERGED_ROOTS: the folders to merge, owned by the request
+    int failedRoot;            // merged: first root that could not be read, or -1
+    char resolved[MAX_PATH_LEN];
+    Listing listing;
+    int dirfd;
+    AppIndex *apps;            // IO_APPS: the index the rows come from
+    int *appRows;              // IO_APPS: entry of each row
+    char **recentPaths;        // IO_RECENT: full path of each row, NULL-terminated
+
+    // Shared state, under g_io.lock
+    int done;
+    int abandoned;
+} IoRequest;
+
+typedef struct {
+    pthread_mutex_t lock;
+    IoRequest *active;         // the request the UI is waiting for
+    int liveThreads;           // worker threads that have not returned yet (stuck ones included)
+    double timeout;
+    int latencyMs;             // BT_IO_LATENCY_MS: injected delay for testing slow mounts
+} IoLayer;
+
+IoLayer g_io = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+void io_layer_init() {
+    const char *t = getenv("BT_IO_TIMEOUT_MS");
+    g_io.timeout = (t && atoi(t) > 0 ? atoi(t) : IO_DEFAULT_TIMEOUT_MS) / 1000.0;
+    const char *lat = getenv("BT_IO_LATENCY_MS");
+    g_io.latencyMs = lat ? atoi(lat) : 0;
+}
+
+// Stand-in for a slow filesystem: every worker-side filesystem operation waits this long first
+void io_inject_latency() {
+    if (g_io.latencyMs > 0) usleep((useconds_t)g_io.latencyMs * 1000);
+}
+
+void recent_paths_free(char **paths) {
+    for (int i = 0; paths && paths[i]; i++) free(paths[i]);
+    free(paths);
+}
+
+void io_request_free(IoRequest *req) {
+    listing_free(&req->listing);
+    app_index_free(req->apps);
+    free(req->appRows);
+    recent_paths_free(req->recentPaths);
+    roots_free(&req->roots);
+    if (req->dirfd >= 0) close(req->dirfd);
+    free(req);
+}
+
+// The path is, or runs through, a zip or tar file: list the folder inside it, or extract
+// the member if it is a file. Leaves the request alone if no archive is involved.
+void io_navigate_archive(IoRequest *req, const char *path) {
+    char archivePath[MAX_PATH_LEN], inner[MAX_PATH_LEN];
+    if (!archive_split_path(path, archivePath, inner)) return;
+    Archive *ax = archive_get(archivePath);
+    if (!ax) return;
+
+    int member = inner[0] ? archive_find(ax, inner, strlen(inner)) : -1;
+    if (inner[0] && member < 0) {
+        req->status = ENOENT;
+    } else if (member < 0 || S_ISDIR(ax->members[member].mode)) {
+        if (archive_list(ax, inner, &req->listing, g_argc, g_argv, req->filterStart) < 0) {
+            req->status = errno ? errno : EIO;
+        } else {
+            sort_listing(&req->listing, req->sortMode);
+            int len = snprintf(req->resolved, sizeof(req->resolved), "%s%s%s", archivePath, inner[0] ? "/" : "", inner);
+            req->status = len < (int)sizeof(req->resolved) ? 0 : ENAMETOOLONG;
+            req->isDirectory = 1;
+            req->inArchive = 1;
+        }
+    } else if (req->flags & IO_LAUNCH_IF_FILE) {
+        req->status = archive_extract(ax, member, req->resolved, sizeof(req->resolved)) < 0 ? errno : 0;
+        req->isDirectory = 0;
+    } else {
+        req->status = ENOTDIR;
+    }
+    archive_release(ax);
+}
+
+// Each root of a merged listing is scanned on its own thread, metadata included: the
+// metadata loader works on one open folder, and rows from several cannot wait for it.
+typedef struct {
+    const RootSet *roots;
+    Listing parts[MAX_ROOTS];
+    int errors[MAX_ROOTS];
+    int filterStart;
+} RootListingJob;
+
+void scan_root_listing_item(void *ctx, int index) {
+    RootListingJob *job = (RootListingJob *)ctx;
+    Listing *l = &job->parts[index];
+    if (scan_listing(job->roots->paths[index], l, g_argc, g_argv, job->filterStart) < 0) {
+        job->errors[index] = errno ? errno : EIO;
+        return;
+    }
+    collect_metadata(job->roots->paths[index], l, 0, l->count);
+    for (int i = 0; i < l->count; i++) l->meta[i].root = (unsigned char)index;
+}
+
+// Drop rows whose name and kind match the row before them; the listing is name-sorted,
+// so the row that stays is the one from the first root
+void listing_drop_duplicates(Listing *l) {
+    int kept = l->count > 0 ? 1 : 0;
+    for (int i = 1; i < l->count; i++) {
+        if (strcmp(l->names[i], l->names[kept - 1]) == 0 &&
+            listing_row_is_dir(l, i) == listing_row_is_dir(l, kept - 1))
+            continue;
+        l->names[kept] = l->names[i];
+        l->meta[kept] = l->meta[i];
+        kept++;
+    }
+    l->count = kept;
+}
+
+// Scan every root of the request concurrently and merge them into its listing
+void io_scan_roots(IoRequest *req) {
+    const RootSet *roots = &req->roots;
+    if (roots->count == 0) {
+        req->status = ENOMEM;   // roots_copy failed
+        return;
+    }
+    RootListingJob *job = (RootListingJob *)calloc(1, sizeof(RootListingJob));
+    if (!job) {
+        req->status = ENOMEM;
+        return;
+    }
+    job->roots = roots;
+    job->filterStart = req->filterStart;
+    run_concurrently(roots->count, scan_root_listing_item, job);
+
+    Listing *l = &req->listing;
+    int failed = 0;
+    req->failedRoot = -1;
+    for (int r = 0; r < roots->count; r++) {
+        Listing *part = &job->parts[r];
+        if (job->errors[r] && failed++ == 0) req->failedRoot = r;
+        for (int i = 0; i < part->count && req->status == 0; i++) {
+            if (listing_append(l, part->names[i], part->meta[i].type) < 0) req->status = ENOMEM;
+            else l->meta[l->count - 1] = part->meta[i];
+        }
+        listing_free(part);
+    }
+    if (failed == roots->count) req->status = job->errors[0];
+    free(job);
+    if (req->status != 0) return;
+
+    sort_listing(l, SORT_NAME);
+    if (g_dedup_roots) listing_drop_duplicates(l);
+    if (req->sortMode != SORT_NAME) sort_listing(l, req->sortMode);
+
+    // Shown in place of the path
+    size_t len = 0;
+    req->resolved[0] = '\0';
+    for (int r = 0; r < roots->count && len < sizeof(req->resolved); r++)
+        len += (size_t)snprintf(req->resolved + len, sizeof(req->resolved) - len, "%s%s", r ? " + " : "", roots->labels[r]);
+    req->isDirectory = 1;
+    req->merged = 1;
+}
+
+// Applications under their localized names, filtered like a folder
+void io_list_apps(IoRequest *req) {
+    AppIndex *ix = app_index_get();
+    if (!ix) {
+        req->status = errno ? errno : EIO;
+        return;
+    }
+    req->apps = ix;
+    req->appRows = (int *)malloc((size_t)(ix->count ? ix->count : 1) * sizeof(int));
+    if (!req->appRows) {
+        req->status = ENOMEM;
+        return;
+    }
+    FilterSet filters;
+    filter_set_init(&filters, g_argc, g_argv, req->filterStart);
+    Listing *l = &req->listing;
+    for (int i = 0; i < ix->count; i++) {
+        if (!filter_set_match(&filters, ix->entries[i].name)) continue;
+        if (listing_append(l, ix->entries[i].name, ENTRY_TYPE_FILE) < 0) {
+            req->status = ENOMEM;
+            break;
+        }
+        EntryMeta *m = &l->meta[l->count - 1];
+        m->mode = S_IFREG | 0755;
+        m->state = META_READY;
+        req->appRows[l->count - 1] = i;
+    }
+    filter_set_free(&filters);
+    snprintf(req->resolved, sizeof(req->resolved), "Applications");
+    req->isDirectory = 1;
+}
+
+#define RECENT_STAT_BATCH 1024
+
+typedef struct {
+    RecentItem *items;
+    int *rows;              // items to stat
+    struct statx *stx;
+    unsigned char *found;
+    int count;
+    int next;
+} RecentStatJob;
+
+void recent_stat_item(void *ctx, int index) {
+    (void)index;
+    RecentStatJob *job = (RecentStatJob *)ctx;
+    for (;;) {
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) break;
+        job->found[i] = statx(AT_FDCWD, job->items[job->rows[i]].path, 0, STATX_WANTED, &job->stx[i]) == 0;
+    }
+}
+
+// Recently used files, most recent first, filtered by name like a folder. Files that
+// are gone are left out; the rest get their metadata here. Old entries often point at
+// files deleted long ago, so the lookups run in parallel batches, newest first, until
+// the view is full.
+void io_list_recent(IoRequest *req) {
+    RecentItem *items;
+    int count;
+    if (recent_items_get(&items, &count) < 0) {
+        req->status = ENOMEM;
+        return;
+    }
+    int rows = count < RECENT_MAX_ROWS ? count : RECENT_MAX_ROWS;
+    RecentStatJob job = { .items = items };
+    req->recentPaths = (char **)calloc((size_t)rows + 1, sizeof(char *));
+    job.rows = (int *)malloc((size_t)(count ? count : 1) * sizeof(int));
+    job.stx = (struct statx *)malloc(RECENT_STAT_BATCH * sizeof(struct statx));
+    job.found = (unsigned char *)malloc(RECENT_STAT_BATCH);
+    if (!req->recentPaths || !job.rows || !job.stx || !job.found) {
+        req->status = ENOMEM;
+        goto done;
+    }
+
+    FilterSet filters;
+    filter_set_init(&filters, g_argc, g_argv, req->filterStart);
+    int matches = 0;
+    for (int i = 0; i < count; i++) {
+        const char *slash = strrchr(items[i].path, '/');
+        if (filter_set_match(&filters, slash && slash[1] ? slash + 1 : items[i].path)) job.rows[matches++] = i;
+    }
+    filter_set_free(&filters);
+
+    Listing *l = &req->listing;
+    int threads = search_thread_count();
+    for (int first = 0; first < matches && l->count < rows && req->status == 0; first += RECENT_STAT_BATCH) {
+        int batch = matches - first < RECENT_STAT_BATCH ? matches - first : RECENT_STAT_BATCH;
+        RecentStatJob part = job;
+        part.rows = job.rows + first;
+        part.count = batch;
+        part.next = 0;
+        run_concurrently(threads < batch ? threads : batch, recent_stat_item, &part);
+        for (int b = 0; b < batch && l->count < rows; b++) {
+            if (!part.found[b]) continue;
+            RecentItem *item = &items[part.rows[b]];
+            const char *slash = strrchr(item->path, '/');
+            int type = S_ISDIR(part.stx[b].stx_mode) ? ENTRY_TYPE_DIR : ENTRY_TYPE_FILE;
+            if (listing_append(l, slash && slash[1] ? slash + 1 : item->path, type) < 0) {
+                req->status = ENOMEM;
+                break;
+            }
+            meta_from_statx(&l->meta[l->count - 1], &part.stx[b]);
+            req->recentPaths[l->count - 1] = item->path;
+            item->path = NULL;
+        }
+    }
+    snprintf(req->resolved, sizeof(req->resolved), "Recent files");
+    req->isDirectory = 1;
+done:
+    free(job.rows);
+    free(job.stx);
+    free(job.found);
+    recent_items_free(items, count);
+}
+
+void *io_navigate_worker(void *arg) {
+    IoRequest *req = (IoRequest *)arg;
+    const char *path = req->path;
+    double start = monotonic_seconds();
+
+    io_inject_latency();
+    if ((req->flags & IO_REVALIDATE) && !is_directory(path)) {
+        // The folder of the last session is gone: start where a fresh launch would
+        req->flags |= IO_PROBE_FIRST_ARG;
+        path = g_argc >= 2 ? g_argv[1] : "";
+    }
+    if (req->flags & IO_PROBE_FIRST_ARG) {
+        if (collect_roots(g_argc, g_argv, &req->roots) >= 2) {
+            req->flags |= IO_MERGED_ROOTS;
+            req->filterStart = req->roots.filterStart;
+        } else if (path[0] && is_directory(path)) {
+            req->filterStart = 2;
+            if (app_is_applications_dir(path)) req->flags |= IO_APPS;
+        } else {
+            path = ".";
+            req->filterStart = 1;
+        }
+    }
+
+    if (req->flags & IO_APPS) {
+        io_list_apps(req);
+    } else if (req->flags & IO_RECENT) {
+        io_list_recent(req);
+    } else if (req->flags & IO_MERGED_ROOTS) {
+        io_scan_roots(req);
+    } else if (!realpath(path, req->resolved)) {
+        req->status = errno;
+        if (req->status == ENOTDIR) io_navigate_archive(req, path);   // "src.zip/lib"
+    } else {
+        remove_trailing_slash(req->resolved);
+        if (req->resolved[0] == '\0') strcpy(req->resolved, "/");
+        req->dirfd = open(req->resolved, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (req->dirfd < 0) {
+            req->status = errno == ENOTDIR ? 0 : errno;
+            if (req->status == 0) io_navigate_archive(req, req->resolved);
+        } else {
+            req->isDirectory = 1;
+            if (scan_listing(req->resolved, &req->listing, g_argc, g_argv, req->filterStart) < 0) {
+                req->status = errno ? errno : EIO;
+            } else {
+                // A revalidation replaces rows that already show their size, so it stats them all
+                if (req->sortMode != SORT_NAME || (req->flags & IO_REVALIDATE))
+                    collect_metadata(req->resolved, &req->listing, 0, req->listing.count);
+                sort_listing(&req->listing, req->sortMode);
+            }
+        }
+    }
+
+    counters_add_us(&g_counters.scanUs, monotonic_seconds() - start);
+    if (req->status == 0 && req->isDirectory) hist_add(&g_counters.scanEntries, (unsigned long long)req->listing.count);
+
+    pthread_mutex_lock(&g_io.lock);
+    req->done = 1;
+    g_io.liveThreads--;
+    int abandoned = req->abandoned;
+    pthread_mutex_unlock(&g_io.lock);
+
+    if (abandoned) io_request_free(req);
+    else wake_ui();
+    return NULL;
+}
+
+// Start loading path; abandons whatever request was pending. Returns -1 if too many
+// earlier requests are still stuck in the kernel to start another one.
+int io_navigate(const char *path, int flags, int sortMode, int filterStart) {
+    IoRequest *req = (IoRequest *)calloc(1, sizeof(IoRequest));
+    if (!req) return -1;
+    snprintf(req->path, sizeof(req->path), "%s", path);
+    req->flags = flags;
+    req->sortMode = sortMode;
+    req->filterStart = filterStart;
+    req->dirfd = -1;
+    req->deadline = monotonic_seconds() + g_io.timeout;
+    if (flags & IO_MERGED_ROOTS) roots_copy(&req->roots, &g_roots);
+
+    pthread_mutex_lock(&g_io.lock);
+    if (g_io.liveThreads >= IO_MAX_STUCK_THREADS) {
+        pthread_mutex_unlock(&g_io.lock);
+        free(req);
+        return -1;
+    }
+    IoRequest *old = g_io.active;
+    if (old) {
+        if (old->done) {
+            pthread_mutex_unlock(&g_io.lock);
+            io_request_free(old);
+            pthread_mutex_lock(&g_io.lock);
+        } else {
+            old->abandoned = 1;
+        }
+    }
+    g_io.active = NULL;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t tid;
+    int rc = pthread_create(&tid, &attr, io_navigate_worker, req);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        pthread_mutex_unlock(&g_io.lock);
+        free(req);
+        return -1;
+    }
+    g_io.liveThreads++;
+    g_io.active = req;
+    pthread_mutex_unlock(&g_io.lock);
+    return 0;
+}
+
+// The finished active request, handed over to the caller (who frees it), or NULL
+IoRequest *io_take_result() {
+    pthread_mutex_lock(&g_io.lock);
+    IoRequest *req = g_io.active;
+    if (req && req->done) g_io.active = NULL;
+    else req = NULL;
+    pthread_mutex_unlock(&g_io.lock);
+    return req;
+}
+
+// Path of the pending request and whether it is past its deadline; returns 0 if nothing is pending
+int io_pending(char *path, size_t pathLen, int *overdue, double *deadline) {
+    pthread_mutex_lock(&g_io.lock);
+    IoRequest *req = g_io.active;
+    int pending = req && !req->done;
+    if (pending) {
+        if (path) snprintf(path, pathLen, "%s", req->path);
+        if (overdue) *overdue = monotonic_seconds() >= req->deadline;
+        if (deadline) *deadline = req->deadline;
+    }
+    pthread_mutex_unlock(&g_io.lock);
+    return pending;
+}
+
+// Abandon everything at exit; stuck workers free their own requests if they ever return
+void io_layer_shutdown() {
+    pthread_mutex_lock(&g_io.lock);
+    IoRequest *req = g_io.active;
+    g_io.active = NULL;
+    if (req && !req->done) {
+        req->abandoned = 1;
+        req = NULL;
+    }
+    pthread_mutex_unlock(&g_io.lock);
+    if (req) io_request_free(req);
+}
+
+// Join a worker, giving up after `seconds` so a thread stuck on a hung mount cannot block exit
+int join_with_timeout(pthread_t tid, double seconds) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += (time_t)seconds;
+    ts.tv_nsec += (long)((seconds - (double)(time_t)seconds) * 1e9);
+    if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+    return pthread_timedjoin_np(tid, NULL, &ts);
+}
+
+// ---- row type icons ----
+
+#define ICON_PLACEHOLDER 0
+#define ICON_FOLDER      1
+#define ICON_FILE        2
+#define ICON_IMAGE       3
+#define ICON_TEXT        4
+#define ICON_ARCHIVE     5
+#define ICON_EXEC        6
+#define ICON_LINK        7
+
+// Does name end with one of the given extensions (case-insensitive)
+int has_extension(const char *name, const char *const *exts) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name) return 0;
+    for (; *exts; exts++)
+        if (stricmp_cross(dot + 1, *exts) == 0) return 1;
+    return 0;
+}
+
+// Pick the icon for a row; needs loaded metadata, otherwise a placeholder is drawn
+int row_icon(const Listing *l, int row) {
+    static const char *const imageExts[] = { "png", "jpg", "jpeg", "gif", "bmp", "webp", "svg", "ico", NULL };
+    static const char *const textExts[] = { "txt", "md", "log", "c", "h", "cpp", "py", "sh", "json", "xml", "ini", "conf", NULL };
+    static const char *const archiveExts[] = { "zip", "tar", "gz", "tgz", "xz", "bz2", "7z", "rar", "zst", NULL };
+
+    const EntryMeta *m = &l->meta[row];
+    if (m->state != META_READY) return m->state == META_FAILED ? ICON_FILE : ICON_PLACEHOLDER;
+    if (S_ISDIR(m->mode)) return ICON_FOLDER;
+    if (m->type == ENTRY_TYPE_LINK) return ICON_LINK;
+
+    const char *name = l->names[row];
+    if (has_extension(name, imageExts)) return ICON_IMAGE;
+    if (has_extension(name, archiveExts)) return ICON_ARCHIVE;
+    if (has_extension(name, textExts)) return ICON_TEXT;
+    if (m->mode & S_IXUSR) return ICON_EXEC;
+    return ICON_FILE;
+}
+
+// Format a byte count as a short human-readable string
+void format_size(long long size, char *out, size_t outLen) {
+    static const char *units[] = { "B", "K", "M", "G", "T" };
+    double v = (double)size;
+    int u = 0;
+    while (v >= 1024.0 && u < 4) { v /= 1024.0; u++; }
+    if (u == 0) snprintf(out, outLen, "%lld B", size);
+    else snprintf(out, outLen, v < 10.0 ? "%.1f %s" : "%.0f %s", v, units[u]);
+}
+
+// ---- prefix jump index ----
+
+// First row of every run of rows that share a leading character, built once per
+// name-sorted listing. Folders-first grouping means a key can have two runs.
+typedef struct {
+    unsigned key;
+    int row;
+} JumpEntry;
+
+typedef struct {
+    JumpEntry *entries;
+    int count;
+    int capacity;
+    unsigned *keys;         // distinct keys in listing order, for the letter strip
+    int keyCount;
+} JumpIndex;
+
+// First code point of s (invalid bytes are returned as-is)
+unsigned utf8_first_codepoint(const char *s) {
+    const unsigned char *p = (const unsigned char *)s;
+    return utf8_decode(&p);
+}
+
+// Bucket for a name: its uppercased first letter (case-folded outside ASCII, matching
+// the sort order); digits and punctuation share '#'
+unsigned jump_key_for_codepoint(unsigned cp) {
+    if (cp >= 'a' && cp <= 'z') return cp - 'a' + 'A';
+    if (cp < 0x80 && !(cp >= 'A' && cp <= 'Z')) return '#';
+    return fold_codepoint(cp);
+}
+
+unsigned jump_key(const char *name) {
+    return jump_key_for_codepoint(utf8_first_codepoint(name));
+}
+
+void jump_index_free(JumpIndex *j) {
+    free(j->entries);
+    free(j->keys);
+    memset(j, 0, sizeof(*j));
+}
+
+// One pass over the sorted rows
+void build_jump_index(JumpIndex *j, const Listing *l) {
+    j->count = 0;
+    j->keyCount = 0;
+    for (int row = 0; row < l->count; row++) {
+        unsigned key = jump_key(l->names[row]);
+        if (j->count > 0 && j->entries[j->count - 1].key == key) continue;
+        if (j->count == j->capacity) {
+            int cap = j->capacity ? j->capacity * 2 : 64;
+            JumpEntry *e = (JumpEntry *)realloc(j->entries, (size_t)cap * sizeof(JumpEntry));
+            unsigned *k = (unsigned *)realloc(j->keys, (size_t)cap * sizeof(unsigned));
+            if (e) j->entries = e;
+            if (k) j->keys = k;
+            if (!e || !k) return;
+            j->capacity = cap;
+        }
+        j->entries[j->count].key = key;
+        j->entries[j->count].row = row;
+        j->count++;
+
+        int seen = 0;
+        for (int i = 0; i < j->keyCount && !seen; i++) seen = j->keys[i] == key;
+        if (!seen) j->keys[j->keyCount++] = key;
+    }
+}
+
+// Row to jump to for key: the first run of that key after `fromRow`, wrapping around. -1 if none.
+int jump_find(const JumpIndex *j, unsigned key, int fromRow) {
+    int wrap = -1;
+    for (int i = 0; i < j->count; i++) {
+        if (j->entries[i].key != key) continue;
+        if (j->entries[i].row > fromRow) return j->entries[i].row;
+        if (wrap < 0) wrap = j->entries[i].row;
+    }
+    return wrap;
+}
+
+// X11 state structure
+typedef struct {
     Display *display;
     Window window;
     GC gc;
+    XFontStruct *font;
     char dirpath[MAX_PATH_LEN];
-    char *files[MAX_FILES];
-    int fileCount;
+    Listing listing;
+    int sortMode;
     int filterStart;
-    int scrollPos;
+    int scrollPos;          // pixel offset of the frame being drawn
+    double scrollY;         // animated scroll position
+    double scrollTarget;    // where the scroll animation is heading
     int windowWidth;
     int windowHeight;
     int mouseX, mouseY;
     int buttonPressed;
+    int dragMode;           // DRAG_* while the left button is held on the scrollbar or letter strip
+    int dragOffset;         // pointer offset inside the scrollbar thumb
+    JumpIndex jump;
+    char statusText[512];   // last navigation error, shown under the path
+    int inArchive;          // dirpath is a folder inside a zip or tar file
+    int merged;             // the listing merges all of g_roots; dirpath is just their labels
+    double clickTime;       // when the row being opened was clicked, for the launch latency counter
+    int replaying;          // --replay: files are not actually opened
+    int stale;              // the listing came from the session snapshot and is being rescanned
+    AppIndex *apps;         // the listing is the installed applications (IO_APPS), else NULL
+    int *appRows;           // apps: entry of each row
+    char **recentPaths;     // the listing is the recent files (IO_RECENT): full path of each row, else NULL
+    char recentFrom[MAX_PATH_LEN];  // folder to go back to from the recent files ("" for the startup one)
+    unsigned char *selected;   // per row, for file operations; NULL when nothing is selected
+    int selectedCount;
+    const char *hoverName;  // row under the pointer, for hover readahead
+    double hoverSince;
+    int hoverQueued;
     int quitFlag;
 } X11AppState;
 
-X11AppState g_x11_state = {0};
+X11AppState g_x11_state = {0};
+
+#define DRAG_NONE  0
+#define DRAG_THUMB 1
+#define DRAG_STRIP 2
+
+#define SCROLLBAR_WIDTH 20
+#define STRIP_WIDTH 14
+
+// ============ LINUX SOFTWARE RENDERER ============
+// Client-side rendering of the whole window into a 0x00RRGGBB buffer. With
+// BT_RENDER=soft the buffer is an MIT-SHM XImage presented with one XShmPutImage per
+// frame instead of a request per rectangle and string; --render-ppm and
+// --bench-render run the same code with no X server at all.
+
+typedef struct {
+    uint32_t *pixels;
+    int width, height;
+    int stride;                           // in pixels
+    int clipX0, clipY0, clipX1, clipY1;   // drawing is limited to [clipX0, clipX1) x [clipY0, clipY1)
+} Canvas;
+
+void canvas_init(Canvas *c, uint32_t *pixels, int width, int height, int stride) {
+    c->pixels = pixels;
+    c->width = width;
+    c->height = height;
+    c->stride = stride;
+    c->clipX0 = c->clipY0 = 0;
+    c->clipX1 = width;
+    c->clipY1 = height;
+}
+
+void canvas_clip(Canvas *c, int x, int y, int w, int h) {
+    c->clipX0 = x < 0 ? 0 : x;
+    c->clipY0 = y < 0 ? 0 : y;
+    c->clipX1 = x + w > c->width ? c->width : x + w;
+    c->clipY1 = y + h > c->height ? c->height : y + h;
+}
+
+void canvas_unclip(Canvas *c) {
+    canvas_clip(c, 0, 0, c->width, c->height);
+}
+
+// Fill n pixels; SSE2 stores eight per iteration
+void fill_span(uint32_t *p, int n, uint32_t color) {
+#ifdef HAVE_SSE2
+    __m128i v = _mm_set1_epi32((int)color);
+    for (; n >= 8; n -= 8, p += 8) {
+        _mm_storeu_si128((__m128i *)p, v);
+        _mm_storeu_si128((__m128i *)(p + 4), v);
+    }
+#endif
+    while (n-- > 0) *p++ = color;
+}
+
+void canvas_fill_rect(Canvas *c, int x, int y, int w, int h, uint32_t color) {
+    int x0 = x < c->clipX0 ? c->clipX0 : x, x1 = x + w > c->clipX1 ? c->clipX1 : x + w;
+    int y0 = y < c->clipY0 ? c->clipY0 : y, y1 = y + h > c->clipY1 ? c->clipY1 : y + h;
+    if (x0 >= x1) return;
+    for (int row = y0; row < y1; row++) fill_span(c->pixels + (size_t)row * c->stride + x0, x1 - x0, color);
+}
+
+// Outline with XDrawRectangle semantics: covers (w + 1) x (h + 1) pixels
+void canvas_draw_rect(Canvas *c, int x, int y, int w, int h, uint32_t color) {
+    canvas_fill_rect(c, x, y, w + 1, 1, color);
+    canvas_fill_rect(c, x, y + h, w + 1, 1, color);
+    canvas_fill_rect(c, x, y + 1, 1, h - 1, color);
+    canvas_fill_rect(c, x + w, y + 1, 1, h - 1, color);
+}
+
+// Copy an opaque 0x00RRGGBB image
+void canvas_blit(Canvas *c, int x, int y, const uint32_t *src, int w, int h) {
+    int x0 = x < c->clipX0 ? c->clipX0 : x, x1 = x + w > c->clipX1 ? c->clipX1 : x + w;
+    int y0 = y < c->clipY0 ? c->clipY0 : y, y1 = y + h > c->clipY1 ? c->clipY1 : y + h;
+    if (x0 >= x1) return;
+    for (int row = y0; row < y1; row++)
+        memcpy(c->pixels + (size_t)row * c->stride + x0, src + (size_t)(row - y) * w + (x0 - x),
+               (size_t)(x1 - x0) * sizeof(uint32_t));
+}
+
+// ---- embedded 6x13 font ----
+// Rasterized from DejaVu Sans Mono at 10 px (arrows drawn by hand), in the cell size
+// of the X "fixed" font so layout matches the Xlib path. One byte per row, leftmost
+// pixel in the high bit; the baseline is row FONT_ASCENT.
+
+#define FONT_WIDTH 6
+#define FONT_HEIGHT 13
+#define FONT_ASCENT 10
+
+typedef struct {
+    unsigned first, last;
+    int index;
+} FontRange;
+
+const FontRange g_font_ranges[] = {
+    { 0x0020, 0x007E, 0 },     // ASCII
+    { 0x00A0, 0x00FF, 95 },    // Latin-1
+    { 0x0400, 0x045F, 191 },   // Cyrillic
+    { 0x2190, 0x2193, 287 },   // arrows
+};
+
+#define GLYPH_MISSING 291
+#define GLYPH_COUNT 292
+
+const unsigned char g_font_glyphs[GLYPH_COUNT][FONT_HEIGHT] = {
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+0020
+    {0x00,0x00,0x00,0x10,0x10,0x10,0x10,0x10,0x00,0x10,0x00,0x00,0x00},  // U+0021
+    {0x00,0x00,0x00,0x28,0x28,0x28,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+0022
+    {0x00,0x00,0x00,0x28,0x28,0x7C,0x50,0xF8,0x50,0x50,0x00,0x00,0x00},  // U+0023
+    {0x00,0x00,0x00,0x10,0x3C,0x50,0x70,0x1C,0x14,0x78,0x10,0x00,0x00},  // U+0024
+    {0x00,0x00,0x00,0xE0,0xA0,0xE8,0x30,0x5C,0x14,0x1C,0x00,0x00,0x00},  // U+0025
+    {0x00,0x00,0x00,0x38,0x20,0x30,0x54,0x4C,0x48,0x34,0x00,0x00,0x00},  // U+0026
+    {0x00,0x00,0x00,0x10,0x10,0x10,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+0027
+    {0x00,0x00,0x10,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x10,0x00,0x00},  // U+0028
+    {0x00,0x00,0x20,0x20,0x10,0x10,0x10,0x10,0x10,0x20,0x20,0x00,0x00},  // U+0029
+    {0x00,0x00,0x00,0x54,0x38,0x38,0x54,0x00,0x00,0x00,0x00,0x00,0x00},  // U+002A
+    {0x00,0x00,0x00,0x00,0x10,0x10,0x7C,0x10,0x10,0x00,0x00,0x00,0x00},  // U+002B
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x20,0x20,0x20,0x00},  // U+002C
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x38,0x00,0x00,0x00,0x00,0x00},  // U+002D
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x20,0x00,0x00,0x00},  // U+002E
+    {0x00,0x00,0x00,0x04,0x08,0x08,0x10,0x10,0x20,0x20,0x40,0x00,0x00},  // U+002F
+    {0x00,0x00,0x00,0x38,0x44,0x44,0x54,0x44,0x44,0x38,0x00,0x00,0x00},  // U+0030
+    {0x00,0x00,0x00,0x70,0x10,0x10,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+0031
+    {0x00,0x00,0x00,0x38,0x44,0x04,0x0C,0x18,0x20,0x7C,0x00,0x00,0x00},  // U+0032
+    {0x00,0x00,0x00,0x38,0x44,0x04,0x38,0x04,0x44,0x38,0x00,0x00,0x00},  // U+0033
+    {0x00,0x00,0x00,0x08,0x18,0x28,0x68,0x7C,0x08,0x08,0x00,0x00,0x00},  // U+0034
+    {0x00,0x00,0x00,0x78,0x40,0x78,0x04,0x04,0x04,0x78,0x00,0x00,0x00},  // U+0035
+    {0x00,0x00,0x00,0x3C,0x60,0x40,0x78,0x44,0x44,0x38,0x00,0x00,0x00},  // U+0036
+    {0x00,0x00,0x00,0x7C,0x0C,0x08,0x08,0x10,0x10,0x20,0x00,0x00,0x00},  // U+0037
+    {0x00,0x00,0x00,0x38,0x44,0x44,0x38,0x44,0x44,0x38,0x00,0x00,0x00},  // U+0038
+    {0x00,0x00,0x00,0x38,0x44,0x44,0x3C,0x04,0x0C,0x78,0x00,0x00,0x00},  // U+0039
+    {0x00,0x00,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x20,0x00,0x00,0x00},  // U+003A
+    {0x00,0x00,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x20,0x20,0x20,0x00},  // U+003B
+    {0x00,0x00,0x00,0x00,0x04,0x38,0x40,0x38,0x04,0x00,0x00,0x00,0x00},  // U+003C
+    {0x00,0x00,0x00,0x00,0x00,0xF8,0x00,0xF8,0x00,0x00,0x00,0x00,0x00},  // U+003D
+    {0x00,0x00,0x00,0x00,0x40,0x38,0x04,0x38,0x40,0x00,0x00,0x00,0x00},  // U+003E
+    {0x00,0x00,0x00,0x78,0x08,0x10,0x20,0x20,0x00,0x20,0x00,0x00,0x00},  // U+003F
+    {0x00,0x00,0x00,0x38,0x24,0x5C,0x54,0x54,0x54,0x5C,0x20,0x18,0x00},  // U+0040
+    {0x00,0x00,0x00,0x10,0x10,0x28,0x28,0x38,0x44,0x44,0x00,0x00,0x00},  // U+0041
+    {0x00,0x00,0x00,0x78,0x44,0x44,0x78,0x44,0x44,0x78,0x00,0x00,0x00},  // U+0042
+    {0x00,0x00,0x00,0x3C,0x64,0x40,0x40,0x40,0x64,0x3C,0x00,0x00,0x00},  // U+0043
+    {0x00,0x00,0x00,0x78,0x4C,0x44,0x44,0x44,0x4C,0x78,0x00,0x00,0x00},  // U+0044
+    {0x00,0x00,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+0045
+    {0x00,0x00,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x40,0x00,0x00,0x00},  // U+0046
+    {0x00,0x00,0x00,0x38,0x64,0x40,0x4C,0x44,0x64,0x3C,0x00,0x00,0x00},  // U+0047
+    {0x00,0x00,0x00,0x44,0x44,0x44,0x7C,0x44,0x44,0x44,0x00,0x00,0x00},  // U+0048
+    {0x00,0x00,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+0049
+    {0x00,0x00,0x00,0x38,0x08,0x08,0x08,0x08,0x48,0x30,0x00,0x00,0x00},  // U+004A
+    {0x00,0x00,0x00,0x44,0x48,0x50,0x60,0x50,0x48,0x44,0x00,0x00,0x00},  // U+004B
+    {0x00,0x00,0x00,0x40,0x40,0x40,0x40,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+004C
+    {0x00,0x00,0x00,0x44,0x6C,0x6C,0x54,0x44,0x44,0x44,0x00,0x00,0x00},  // U+004D
+    {0x00,0x00,0x00,0x44,0x64,0x64,0x54,0x4C,0x4C,0x44,0x00,0x00,0x00},  // U+004E
+    {0x00,0x00,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+004F
+    {0x00,0x00,0x00,0x78,0x44,0x44,0x78,0x40,0x40,0x40,0x00,0x00,0x00},  // U+0050
+    {0x00,0x00,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x0C,0x00,0x00},  // U+0051
+    {0x00,0x00,0x00,0xF0,0x88,0x88,0xF0,0x98,0x88,0x84,0x00,0x00,0x00},  // U+0052
+    {0x00,0x00,0x00,0x38,0x44,0x40,0x38,0x04,0x44,0x38,0x00,0x00,0x00},  // U+0053
+    {0x00,0x00,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x10,0x00,0x00,0x00},  // U+0054
+    {0x00,0x00,0x00,0x44,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+0055
+    {0x00,0x00,0x00,0x44,0x44,0x28,0x28,0x28,0x10,0x10,0x00,0x00,0x00},  // U+0056
+    {0x00,0x00,0x00,0x84,0xB4,0xB4,0x78,0x48,0x48,0x48,0x00,0x00,0x00},  // U+0057
+    {0x00,0x00,0x00,0x44,0x28,0x28,0x10,0x28,0x28,0x44,0x00,0x00,0x00},  // U+0058
+    {0x00,0x00,0x00,0x44,0x28,0x28,0x10,0x10,0x10,0x10,0x00,0x00,0x00},  // U+0059
+    {0x00,0x00,0x00,0x7C,0x08,0x08,0x10,0x20,0x20,0x7C,0x00,0x00,0x00},  // U+005A
+    {0x00,0x00,0x30,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x30,0x00,0x00},  // U+005B
+    {0x00,0x00,0x00,0x40,0x20,0x20,0x10,0x10,0x08,0x08,0x04,0x00,0x00},  // U+005C
+    {0x00,0x00,0x30,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x30,0x00,0x00},  // U+005D
+    {0x00,0x00,0x00,0x20,0x50,0x88,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+005E
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xFC,0x00},  // U+005F
+    {0x00,0x00,0x40,0x20,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+0060
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x04,0x3C,0x44,0x7C,0x00,0x00,0x00},  // U+0061
+    {0x00,0x00,0x40,0x40,0x40,0x78,0x44,0x44,0x44,0x78,0x00,0x00,0x00},  // U+0062
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x40,0x40,0x40,0x38,0x00,0x00,0x00},  // U+0063
+    {0x00,0x00,0x04,0x04,0x04,0x3C,0x44,0x44,0x44,0x3C,0x00,0x00,0x00},  // U+0064
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x44,0x7C,0x40,0x3C,0x00,0x00,0x00},  // U+0065
+    {0x00,0x00,0x18,0x20,0x20,0x78,0x20,0x20,0x20,0x20,0x00,0x00,0x00},  // U+0066
+    {0x00,0x00,0x00,0x00,0x00,0x3C,0x44,0x44,0x44,0x3C,0x04,0x38,0x00},  // U+0067
+    {0x00,0x00,0x40,0x40,0x40,0x58,0x64,0x44,0x44,0x44,0x00,0x00,0x00},  // U+0068
+    {0x00,0x00,0x10,0x00,0x00,0x30,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+0069
+    {0x00,0x00,0x10,0x00,0x00,0x70,0x10,0x10,0x10,0x10,0x10,0x60,0x00},  // U+006A
+    {0x00,0x00,0x40,0x40,0x40,0x48,0x50,0x70,0x48,0x44,0x00,0x00,0x00},  // U+006B
+    {0x00,0x00,0xE0,0x20,0x20,0x20,0x20,0x20,0x20,0x18,0x00,0x00,0x00},  // U+006C
+    {0x00,0x00,0x00,0x00,0x00,0x7C,0x54,0x54,0x54,0x54,0x00,0x00,0x00},  // U+006D
+    {0x00,0x00,0x00,0x00,0x00,0x58,0x64,0x44,0x44,0x44,0x00,0x00,0x00},  // U+006E
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+006F
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x44,0x44,0x44,0x78,0x40,0x40,0x00},  // U+0070
+    {0x00,0x00,0x00,0x00,0x00,0x3C,0x44,0x44,0x44,0x3C,0x04,0x04,0x00},  // U+0071
+    {0x00,0x00,0x00,0x00,0x00,0x3C,0x24,0x20,0x20,0x20,0x00,0x00,0x00},  // U+0072
+    {0x00,0x00,0x00,0x00,0x00,0x3C,0x40,0x3C,0x04,0x78,0x00,0x00,0x00},  // U+0073
+    {0x00,0x00,0x00,0x20,0x20,0x78,0x20,0x20,0x20,0x38,0x00,0x00,0x00},  // U+0074
+    {0x00,0x00,0x00,0x00,0x00,0x44,0x44,0x44,0x44,0x3C,0x00,0x00,0x00},  // U+0075
+    {0x00,0x00,0x00,0x00,0x00,0x44,0x28,0x28,0x28,0x10,0x00,0x00,0x00},  // U+0076
+    {0x00,0x00,0x00,0x00,0x00,0x44,0x54,0x28,0x28,0x28,0x00,0x00,0x00},  // U+0077
+    {0x00,0x00,0x00,0x00,0x00,0x6C,0x28,0x10,0x28,0x6C,0x00,0x00,0x00},  // U+0078
+    {0x00,0x00,0x00,0x00,0x00,0x44,0x28,0x28,0x10,0x10,0x10,0x60,0x00},  // U+0079
+    {0x00,0x00,0x00,0x00,0x00,0x7C,0x08,0x10,0x20,0x7C,0x00,0x00,0x00},  // U+007A
+    {0x00,0x00,0x18,0x10,0x10,0x10,0x60,0x10,0x10,0x10,0x18,0x00,0x00},  // U+007B
+    {0x00,0x00,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x00},  // U+007C
+    {0x00,0x00,0x30,0x10,0x10,0x10,0x0C,0x10,0x10,0x10,0x30,0x00,0x00},  // U+007D
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x70,0x0C,0x00,0x00,0x00,0x00,0x00},  // U+007E
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+00A0
+    {0x00,0x00,0x00,0x00,0x00,0x10,0x00,0x10,0x10,0x10,0x10,0x10,0x00},  // U+00A1
+    {0x00,0x00,0x00,0x00,0x10,0x38,0x50,0x50,0x50,0x38,0x10,0x10,0x00},  // U+00A2
+    {0x00,0x00,0x00,0x1C,0x20,0x20,0x78,0x20,0x20,0x7C,0x00,0x00,0x00},  // U+00A3
+    {0x00,0x00,0x00,0x00,0x44,0x38,0x28,0x38,0x44,0x00,0x00,0x00,0x00},  // U+00A4
+    {0x00,0x00,0x00,0x44,0x28,0x6C,0x10,0x7C,0x10,0x10,0x00,0x00,0x00},  // U+00A5
+    {0x00,0x00,0x00,0x10,0x10,0x10,0x10,0x00,0x10,0x10,0x10,0x10,0x00},  // U+00A6
+    {0x00,0x00,0x00,0x78,0x40,0x30,0x58,0x68,0x10,0x08,0x78,0x00,0x00},  // U+00A7
+    {0x00,0x00,0x28,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+00A8
+    {0x00,0x00,0x00,0x78,0x58,0xA4,0xA4,0x9C,0x48,0x78,0x00,0x00,0x00},  // U+00A9
+    {0x00,0x00,0x00,0x78,0x78,0x48,0x78,0x00,0x78,0x00,0x00,0x00,0x00},  // U+00AA
+    {0x00,0x00,0x00,0x00,0x00,0x28,0x50,0x50,0x28,0x00,0x00,0x00,0x00},  // U+00AB
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x7C,0x04,0x00,0x00,0x00,0x00,0x00},  // U+00AC
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x38,0x00,0x00,0x00,0x00,0x00},  // U+00AD
+    {0x00,0x00,0x00,0x78,0x78,0xBC,0xB4,0xAC,0x48,0x78,0x00,0x00,0x00},  // U+00AE
+    {0x00,0x00,0x00,0x38,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+00AF
+    {0x00,0x00,0x00,0x70,0x50,0x70,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+00B0
+    {0x00,0x00,0x00,0x00,0x10,0x10,0x7C,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00B1
+    {0x00,0x00,0x00,0x38,0x08,0x10,0x38,0x00,0x00,0x00,0x00,0x00,0x00},  // U+00B2
+    {0x00,0x00,0x00,0x38,0x10,0x08,0x38,0x00,0x00,0x00,0x00,0x00,0x00},  // U+00B3
+    {0x00,0x00,0x10,0x20,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},  // U+00B4
+    {0x00,0x00,0x00,0x00,0x00,0x88,0x88,0x88,0x88,0xFC,0x80,0x80,0x00},  // U+00B5
+    {0x00,0x00,0x00,0x3C,0x74,0x74,0x34,0x14,0x14,0x14,0x14,0x00,0x00},  // U+00B6
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x20,0x20,0x00,0x00,0x00,0x00,0x00},  // U+00B7
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x10,0x30,0x00},  // U+00B8
+    {0x00,0x00,0x00,0x30,0x10,0x10,0x38,0x00,0x00,0x00,0x00,0x00,0x00},  // U+00B9
+    {0x00,0x00,0x00,0x30,0x48,0x48,0x30,0x00,0x78,0x00,0x00,0x00,0x00},  // U+00BA
+    {0x00,0x00,0x00,0x00,0x00,0x50,0x28,0x28,0x50,0x00,0x00,0x00,0x00},  // U+00BB
+    {0x00,0x00,0x60,0x20,0x20,0x70,0x38,0xE0,0x08,0x38,0x3C,0x08,0x00},  // U+00BC
+    {0x00,0x00,0x60,0x20,0x20,0x70,0x38,0xE0,0x1C,0x04,0x08,0x1C,0x00},  // U+00BD
+    {0x00,0x00,0x70,0x20,0x10,0x70,0x38,0xE0,0x08,0x38,0x3C,0x08,0x00},  // U+00BE
+    {0x00,0x00,0x00,0x00,0x00,0x10,0x00,0x10,0x10,0x20,0x40,0x78,0x00},  // U+00BF
+    {0x20,0x10,0x00,0x10,0x10,0x28,0x28,0x38,0x44,0x44,0x00,0x00,0x00},  // U+00C0
+    {0x08,0x10,0x00,0x10,0x10,0x28,0x28,0x38,0x44,0x44,0x00,0x00,0x00},  // U+00C1
+    {0x10,0x28,0x00,0x10,0x10,0x28,0x28,0x38,0x44,0x44,0x00,0x00,0x00},  // U+00C2
+    {0x28,0x30,0x00,0x10,0x10,0x28,0x28,0x38,0x44,0x44,0x00,0x00,0x00},  // U+00C3
+    {0x00,0x28,0x00,0x10,0x10,0x28,0x28,0x38,0x44,0x44,0x00,0x00,0x00},  // U+00C4
+    {0x00,0x38,0x28,0x10,0x10,0x28,0x28,0x38,0x44,0x44,0x00,0x00,0x00},  // U+00C5
+    {0x00,0x00,0x00,0x3C,0x30,0x50,0x5C,0x70,0x90,0x9C,0x00,0x00,0x00},  // U+00C6
+    {0x00,0x00,0x00,0x3C,0x64,0x40,0x40,0x40,0x64,0x3C,0x10,0x30,0x00},  // U+00C7
+    {0x20,0x10,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+00C8
+    {0x08,0x10,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+00C9
+    {0x10,0x28,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+00CA
+    {0x00,0x28,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+00CB
+    {0x20,0x10,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00CC
+    {0x08,0x10,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00CD
+    {0x10,0x28,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00CE
+    {0x00,0x28,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00CF
+    {0x00,0x00,0x00,0x78,0x4C,0x44,0xE4,0x44,0x4C,0x78,0x00,0x00,0x00},  // U+00D0
+    {0x28,0x30,0x00,0x44,0x64,0x64,0x54,0x4C,0x4C,0x44,0x00,0x00,0x00},  // U+00D1
+    {0x20,0x10,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00D2
+    {0x08,0x10,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00D3
+    {0x10,0x28,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00D4
+    {0x28,0x30,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00D5
+    {0x00,0x28,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00D6
+    {0x00,0x00,0x00,0x00,0x00,0x44,0x28,0x10,0x28,0x44,0x00,0x00,0x00},  // U+00D7
+    {0x00,0x00,0x00,0x3C,0x44,0x4C,0x54,0x64,0x44,0xB8,0x00,0x00,0x00},  // U+00D8
+    {0x20,0x10,0x00,0x44,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00D9
+    {0x08,0x10,0x00,0x44,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00DA
+    {0x10,0x28,0x00,0x44,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00DB
+    {0x00,0x28,0x00,0x44,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00DC
+    {0x08,0x10,0x00,0x44,0x28,0x28,0x10,0x10,0x10,0x10,0x00,0x00,0x00},  // U+00DD
+    {0x00,0x00,0x00,0x40,0x78,0x44,0x44,0x78,0x40,0x40,0x00,0x00,0x00},  // U+00DE
+    {0x00,0x00,0x30,0x48,0x58,0x50,0x50,0x4C,0x44,0x5C,0x00,0x00,0x00},  // U+00DF
+    {0x00,0x00,0x40,0x20,0x00,0x78,0x04,0x3C,0x44,0x7C,0x00,0x00,0x00},  // U+00E0
+    {0x00,0x00,0x10,0x20,0x00,0x78,0x04,0x3C,0x44,0x7C,0x00,0x00,0x00},  // U+00E1
+    {0x00,0x00,0x20,0x50,0x00,0x78,0x04,0x3C,0x44,0x7C,0x00,0x00,0x00},  // U+00E2
+    {0x00,0x00,0x28,0x50,0x00,0x78,0x04,0x3C,0x44,0x7C,0x00,0x00,0x00},  // U+00E3
+    {0x00,0x00,0x28,0x00,0x00,0x78,0x04,0x3C,0x44,0x7C,0x00,0x00,0x00},  // U+00E4
+    {0x00,0x38,0x28,0x38,0x00,0x78,0x04,0x3C,0x44,0x7C,0x00,0x00,0x00},  // U+00E5
+    {0x00,0x00,0x00,0x00,0x00,0x6C,0x14,0x7C,0x50,0x6C,0x00,0x00,0x00},  // U+00E6
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x40,0x40,0x40,0x38,0x10,0x10,0x00},  // U+00E7
+    {0x00,0x00,0x40,0x20,0x00,0x38,0x44,0x7C,0x40,0x3C,0x00,0x00,0x00},  // U+00E8
+    {0x00,0x00,0x10,0x20,0x00,0x38,0x44,0x7C,0x40,0x3C,0x00,0x00,0x00},  // U+00E9
+    {0x00,0x00,0x20,0x50,0x00,0x38,0x44,0x7C,0x40,0x3C,0x00,0x00,0x00},  // U+00EA
+    {0x00,0x00,0x28,0x00,0x00,0x38,0x44,0x7C,0x40,0x3C,0x00,0x00,0x00},  // U+00EB
+    {0x00,0x00,0x40,0x20,0x00,0x30,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00EC
+    {0x00,0x00,0x10,0x20,0x00,0x30,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00ED
+    {0x00,0x00,0x20,0x50,0x00,0x30,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00EE
+    {0x00,0x00,0x28,0x00,0x00,0x30,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+00EF
+    {0x00,0x00,0x20,0x38,0x08,0x3C,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00F0
+    {0x00,0x00,0x28,0x50,0x00,0x58,0x64,0x44,0x44,0x44,0x00,0x00,0x00},  // U+00F1
+    {0x00,0x00,0x40,0x20,0x00,0x38,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00F2
+    {0x00,0x00,0x10,0x20,0x00,0x38,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00F3
+    {0x00,0x00,0x10,0x28,0x00,0x38,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00F4
+    {0x00,0x00,0x34,0x58,0x00,0x38,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00F5
+    {0x00,0x00,0x28,0x00,0x00,0x38,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+00F6
+    {0x00,0x00,0x00,0x00,0x20,0x00,0xF8,0x00,0x20,0x00,0x00,0x00,0x00},  // U+00F7
+    {0x00,0x00,0x00,0x00,0x00,0x3C,0x4C,0x54,0x64,0x78,0x00,0x00,0x00},  // U+00F8
+    {0x00,0x00,0x40,0x20,0x00,0x44,0x44,0x44,0x44,0x3C,0x00,0x00,0x00},  // U+00F9
+    {0x00,0x00,0x10,0x20,0x00,0x44,0x44,0x44,0x44,0x3C,0x00,0x00,0x00},  // U+00FA
+    {0x00,0x00,0x10,0x28,0x00,0x44,0x44,0x44,0x44,0x3C,0x00,0x00,0x00},  // U+00FB
+    {0x00,0x00,0x28,0x00,0x00,0x44,0x44,0x44,0x44,0x3C,0x00,0x00,0x00},  // U+00FC
+    {0x00,0x00,0x10,0x20,0x00,0x44,0x28,0x28,0x10,0x10,0x10,0x60,0x00},  // U+00FD
+    {0x00,0x00,0x40,0x40,0x40,0x78,0x44,0x44,0x44,0x78,0x40,0x40,0x00},  // U+00FE
+    {0x00,0x00,0x28,0x00,0x00,0x44,0x28,0x28,0x10,0x10,0x10,0x60,0x00},  // U+00FF
+    {0x20,0x10,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+0400
+    {0x00,0x28,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+0401
+    {0x00,0x00,0x00,0xF0,0x40,0x50,0x68,0x44,0x44,0x44,0x08,0x18,0x00},  // U+0402
+    {0x08,0x10,0x00,0x7C,0x40,0x40,0x40,0x40,0x40,0x40,0x00,0x00,0x00},  // U+0403
+    {0x00,0x00,0x00,0x3C,0x64,0x40,0x78,0x40,0x64,0x3C,0x00,0x00,0x00},  // U+0404
+    {0x00,0x00,0x00,0x38,0x44,0x40,0x38,0x04,0x44,0x38,0x00,0x00,0x00},  // U+0405
+    {0x00,0x00,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+0406
+    {0x00,0x28,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+0407
+    {0x00,0x00,0x00,0x38,0x08,0x08,0x08,0x08,0x48,0x30,0x00,0x00,0x00},  // U+0408
+    {0x00,0x00,0x00,0x70,0x50,0x50,0x5C,0x54,0x54,0x98,0x00,0x00,0x00},  // U+0409
+    {0x00,0x00,0x00,0x90,0x90,0x90,0xFC,0x94,0x94,0x98,0x00,0x00,0x00},  // U+040A
+    {0x00,0x00,0x00,0xF0,0x40,0x50,0x68,0x44,0x44,0x44,0x00,0x00,0x00},  // U+040B
+    {0x08,0x10,0x00,0x44,0x48,0x50,0x60,0x50,0x48,0x44,0x00,0x00,0x00},  // U+040C
+    {0x20,0x10,0x00,0x4C,0x4C,0x5C,0x54,0x74,0x64,0x64,0x00,0x00,0x00},  // U+040D
+    {0x50,0x70,0x00,0x44,0x28,0x28,0x38,0x10,0x30,0x60,0x00,0x00,0x00},  // U+040E
+    {0x00,0x00,0x00,0x48,0x48,0x48,0x48,0x48,0x48,0x78,0x20,0x00,0x00},  // U+040F
+    {0x00,0x00,0x00,0x10,0x10,0x28,0x28,0x38,0x44,0x44,0x00,0x00,0x00},  // U+0410
+    {0x00,0x00,0x00,0x7C,0x40,0x40,0x78,0x44,0x44,0x78,0x00,0x00,0x00},  // U+0411
+    {0x00,0x00,0x00,0x78,0x44,0x44,0x78,0x44,0x44,0x78,0x00,0x00,0x00},  // U+0412
+    {0x00,0x00,0x00,0x7C,0x40,0x40,0x40,0x40,0x40,0x40,0x00,0x00,0x00},  // U+0413
+    {0x00,0x00,0x00,0x78,0x48,0x48,0x48,0x48,0x48,0xFC,0x84,0x84,0x00},  // U+0414
+    {0x00,0x00,0x00,0x7C,0x40,0x40,0x7C,0x40,0x40,0x7C,0x00,0x00,0x00},  // U+0415
+    {0x00,0x00,0x00,0x54,0x54,0x38,0x38,0x54,0x54,0x54,0x00,0x00,0x00},  // U+0416
+    {0x00,0x00,0x00,0x38,0x44,0x04,0x38,0x04,0x44,0x38,0x00,0x00,0x00},  // U+0417
+    {0x00,0x00,0x00,0x4C,0x4C,0x5C,0x54,0x74,0x64,0x64,0x00,0x00,0x00},  // U+0418
+    {0x50,0x70,0x00,0x4C,0x4C,0x5C,0x54,0x74,0x64,0x64,0x00,0x00,0x00},  // U+0419
+    {0x00,0x00,0x00,0x44,0x48,0x50,0x60,0x50,0x48,0x44,0x00,0x00,0x00},  // U+041A
+    {0x00,0x00,0x00,0x78,0x48,0x48,0x48,0x48,0x48,0x88,0x00,0x00,0x00},  // U+041B
+    {0x00,0x00,0x00,0x44,0x6C,0x6C,0x54,0x44,0x44,0x44,0x00,0x00,0x00},  // U+041C
+    {0x00,0x00,0x00,0x44,0x44,0x44,0x7C,0x44,0x44,0x44,0x00,0x00,0x00},  // U+041D
+    {0x00,0x00,0x00,0x38,0x44,0x44,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+041E
+    {0x00,0x00,0x00,0x7C,0x44,0x44,0x44,0x44,0x44,0x44,0x00,0x00,0x00},  // U+041F
+    {0x00,0x00,0x00,0x78,0x44,0x44,0x78,0x40,0x40,0x40,0x00,0x00,0x00},  // U+0420
+    {0x00,0x00,0x00,0x3C,0x64,0x40,0x40,0x40,0x64,0x3C,0x00,0x00,0x00},  // U+0421
+    {0x00,0x00,0x00,0x7C,0x10,0x10,0x10,0x10,0x10,0x10,0x00,0x00,0x00},  // U+0422
+    {0x00,0x00,0x00,0x44,0x28,0x28,0x38,0x10,0x30,0x60,0x00,0x00,0x00},  // U+0423
+    {0x00,0x00,0x00,0x10,0x38,0x54,0x54,0x54,0x38,0x10,0x00,0x00,0x00},  // U+0424
+    {0x00,0x00,0x00,0x44,0x28,0x28,0x10,0x28,0x28,0x44,0x00,0x00,0x00},  // U+0425
+    {0x00,0x00,0x00,0x88,0x88,0x88,0x88,0x88,0x88,0xFC,0x04,0x04,0x00},  // U+0426
+    {0x00,0x00,0x00,0x44,0x44,0x44,0x7C,0x04,0x04,0x04,0x00,0x00,0x00},  // U+0427
+    {0x00,0x00,0x00,0x54,0x54,0x54,0x54,0x54,0x54,0x7C,0x00,0x00,0x00},  // U+0428
+    {0x00,0x00,0x00,0xA8,0xA8,0xA8,0xA8,0xA8,0xA8,0xFC,0x04,0x04,0x00},  // U+0429
+    {0x00,0x00,0x00,0xC0,0x40,0x78,0x44,0x44,0x44,0x78,0x00,0x00,0x00},  // U+042A
+    {0x00,0x00,0x00,0x84,0x84,0xE4,0x94,0x94,0x94,0xE4,0x00,0x00,0x00},  // U+042B
+    {0x00,0x00,0x00,0x40,0x40,0x40,0x78,0x44,0x44,0x78,0x00,0x00,0x00},  // U+042C
+    {0x00,0x00,0x00,0x78,0x4C,0x04,0x3C,0x04,0x4C,0x78,0x00,0x00,0x00},  // U+042D
+    {0x00,0x00,0x00,0x48,0x54,0x54,0x74,0x54,0x54,0x48,0x00,0x00,0x00},  // U+042E
+    {0x00,0x00,0x00,0x78,0x88,0x88,0x78,0x48,0x48,0x88,0x00,0x00,0x00},  // U+042F
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x04,0x3C,0x44,0x7C,0x00,0x00,0x00},  // U+0430
+    {0x00,0x00,0x00,0x3C,0x60,0x78,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+0431
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x48,0x70,0x48,0x78,0x00,0x00,0x00},  // U+0432
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x40,0x40,0x40,0x40,0x00,0x00,0x00},  // U+0433
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x48,0x48,0x48,0xFC,0x84,0x00,0x00},  // U+0434
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x44,0x7C,0x40,0x3C,0x00,0x00,0x00},  // U+0435
+    {0x00,0x00,0x00,0x00,0x00,0x54,0x38,0x38,0x54,0x54,0x00,0x00,0x00},  // U+0436
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x48,0x30,0x08,0x78,0x00,0x00,0x00},  // U+0437
+    {0x00,0x00,0x00,0x00,0x00,0x48,0x58,0x58,0x68,0x48,0x00,0x00,0x00},  // U+0438
+    {0x00,0x00,0x50,0x70,0x00,0x48,0x58,0x58,0x68,0x48,0x00,0x00,0x00},  // U+0439
+    {0x00,0x00,0x00,0x00,0x00,0x48,0x50,0x70,0x48,0x44,0x00,0x00,0x00},  // U+043A
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x48,0x48,0x48,0xC8,0x00,0x00,0x00},  // U+043B
+    {0x00,0x00,0x00,0x00,0x00,0x44,0x6C,0x6C,0x7C,0x44,0x00,0x00,0x00},  // U+043C
+    {0x00,0x00,0x00,0x00,0x00,0x48,0x48,0x78,0x48,0x48,0x00,0x00,0x00},  // U+043D
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x44,0x44,0x44,0x38,0x00,0x00,0x00},  // U+043E
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x48,0x48,0x48,0x48,0x00,0x00,0x00},  // U+043F
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x44,0x44,0x44,0x78,0x40,0x40,0x00},  // U+0440
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x40,0x40,0x40,0x38,0x00,0x00,0x00},  // U+0441
+    {0x00,0x00,0x00,0x00,0x00,0x7C,0x10,0x10,0x10,0x10,0x00,0x00,0x00},  // U+0442
+    {0x00,0x00,0x00,0x00,0x00,0x44,0x28,0x28,0x10,0x10,0x10,0x60,0x00},  // U+0443
+    {0x00,0x00,0x10,0x10,0x10,0x38,0x54,0x54,0x54,0x38,0x10,0x10,0x00},  // U+0444
+    {0x00,0x00,0x00,0x00,0x00,0x6C,0x28,0x10,0x28,0x6C,0x00,0x00,0x00},  // U+0445
+    {0x00,0x00,0x00,0x00,0x00,0x48,0x48,0x48,0x48,0x7C,0x04,0x00,0x00},  // U+0446
+    {0x00,0x00,0x00,0x00,0x00,0x48,0x48,0x78,0x08,0x08,0x00,0x00,0x00},  // U+0447
+    {0x00,0x00,0x00,0x00,0x00,0x54,0x54,0x54,0x54,0x7C,0x00,0x00,0x00},  // U+0448
+    {0x00,0x00,0x00,0x00,0x00,0xA8,0xA8,0xA8,0xA8,0xFC,0x04,0x00,0x00},  // U+0449
+    {0x00,0x00,0x00,0x00,0x00,0xC0,0x40,0x7C,0x44,0x7C,0x00,0x00,0x00},  // U+044A
+    {0x00,0x00,0x00,0x00,0x00,0x44,0x44,0x74,0x54,0x74,0x00,0x00,0x00},  // U+044B
+    {0x00,0x00,0x00,0x00,0x00,0x40,0x40,0x78,0x48,0x78,0x00,0x00,0x00},  // U+044C
+    {0x00,0x00,0x00,0x00,0x00,0x70,0x08,0x78,0x08,0x70,0x00,0x00,0x00},  // U+044D
+    {0x00,0x00,0x00,0x00,0x00,0x48,0x54,0x74,0x54,0x48,0x00,0x00,0x00},  // U+044E
+    {0x00,0x00,0x00,0x00,0x00,0x78,0x48,0x38,0x28,0x48,0x00,0x00,0x00},  // U+044F
+    {0x00,0x00,0x40,0x20,0x00,0x38,0x44,0x7C,0x40,0x3C,0x00,0x00,0x00},  // U+0450
+    {0x00,0x00,0x28,0x00,0x00,0x38,0x44,0x7C,0x40,0x3C,0x00,0x00,0x00},  // U+0451
+    {0x00,0x00,0x40,0x40,0x40,0x70,0x58,0x68,0x48,0x48,0x08,0x10,0x00},  // U+0452
+    {0x00,0x00,0x10,0x20,0x00,0x78,0x40,0x40,0x40,0x40,0x00,0x00,0x00},  // U+0453
+    {0x00,0x00,0x00,0x00,0x00,0x38,0x40,0x70,0x40,0x38,0x00,0x00,0x00},  // U+0454
+    {0x00,0x00,0x00,0x00,0x00,0x3C,0x40,0x3C,0x04,0x78,0x00,0x00,0x00},  // U+0455
+    {0x00,0x00,0x10,0x00,0x00,0x30,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+0456
+    {0x00,0x00,0x28,0x00,0x00,0x30,0x10,0x10,0x10,0x7C,0x00,0x00,0x00},  // U+0457
+    {0x00,0x00,0x10,0x00,0x00,0x70,0x10,0x10,0x10,0x10,0x10,0x60,0x00},  // U+0458
+    {0x00,0x00,0x00,0x00,0x00,0x70,0x50,0x5C,0x54,0x9C,0x00,0x00,0x00},  // U+0459
+    {0x00,0x00,0x00,0x00,0x00,0x90,0x90,0xFC,0x94,0x98,0x00,0x00,0x00},  // U+045A
+    {0x00,0x00,0x40,0x40,0x40,0x70,0x58,0x68,0x48,0x48,0x00,0x00,0x00},  // U+045B
+    {0x00,0x00,0x10,0x20,0x00,0x48,0x50,0x70,0x48,0x44,0x00,0x00,0x00},  // U+045C
+    {0x00,0x00,0x40,0x20,0x00,0x48,0x58,0x58,0x68,0x48,0x00,0x00,0x00},  // U+045D
+    {0x00,0x00,0x50,0x70,0x00,0x44,0x28,0x28,0x10,0x10,0x10,0x60,0x00},  // U+045E
+    {0x00,0x00,0x00,0x00,0x00,0x48,0x48,0x48,0x48,0x78,0x20,0x00,0x00},  // U+045F
+    {0x00,0x00,0x00,0x00,0x00,0x20,0x7C,0x20,0x00,0x00,0x00,0x00,0x00},  // U+2190
+    {0x00,0x00,0x00,0x10,0x38,0x54,0x10,0x10,0x10,0x10,0x00,0x00,0x00},  // U+2191
+    {0x00,0x00,0x00,0x00,0x00,0x08,0x7C,0x08,0x00,0x00,0x00,0x00,0x00},  // U+2192
+    {0x00,0x00,0x00,0x10,0x10,0x10,0x10,0x54,0x38,0x10,0x00,0x00,0x00},  // U+2193
+    {0x00,0x00,0x00,0x78,0x48,0x48,0x48,0x48,0x48,0x78,0x00,0x00,0x00},  // missing glyph box
+};
+
+int font_glyph_index(unsigned cp) {
+    for (size_t i = 0; i < sizeof(g_font_ranges) / sizeof(g_font_ranges[0]); i++)
+        if (cp >= g_font_ranges[i].first && cp <= g_font_ranges[i].last)
+            return g_font_ranges[i].index + (int)(cp - g_font_ranges[i].first);
+    return GLYPH_MISSING;
+}
+
+// Width in pixels of a UTF-8 string in the embedded font
+int font_text_width(const char *text) {
+    int n = 0;
+    for (const unsigned char *p = (const unsigned char *)text; *p; utf8_decode(&p)) n++;
+    return n * FONT_WIDTH;
+}
+
+// Glyphs are expanded on first use into 8-pixel lane masks, so drawing a row is one
+// masked store of eight pixels; blank rows above and below the glyph are skipped.
+typedef struct {
+    uint32_t lanes[FONT_HEIGHT][8];
+    int top, bottom;
+} GlyphMask;
+
+GlyphMask *g_glyph_cache[GLYPH_COUNT];
+
+GlyphMask *glyph_mask(int index) {
+    GlyphMask *g = g_glyph_cache[index];
+    if (g) return g;
+    g = (GlyphMask *)calloc(1, sizeof(GlyphMask));
+    if (!g) return NULL;
+    g->top = FONT_HEIGHT;
+    for (int row = 0; row < FONT_HEIGHT; row++) {
+        unsigned bits = g_font_glyphs[index][row];
+        for (int x = 0; x < FONT_WIDTH; x++) g->lanes[row][x] = (bits & (0x80u >> x)) ? 0xFFFFFFFFu : 0;
+        if (bits) {
+            if (g->top == FONT_HEIGHT) g->top = row;
+            g->bottom = row + 1;
+        }
+    }
+    g_glyph_cache[index] = g;
+    return g;
+}
+
+void glyph_cache_free() {
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        free(g_glyph_cache[i]);
+        g_glyph_cache[i] = NULL;
+    }
+}
+
+void canvas_draw_glyph(Canvas *c, int x, int top, const GlyphMask *g, uint32_t color) {
+    int rowStart = top + g->top < c->clipY0 ? c->clipY0 - top : g->top;
+    int rowEnd = top + g->bottom > c->clipY1 ? c->clipY1 - top : g->bottom;
+    int inside = x >= c->clipX0 && x + FONT_WIDTH <= c->clipX1 && x + 8 <= c->width;
+    for (int row = rowStart; row < rowEnd; row++) {
+        uint32_t *dst = c->pixels + (size_t)(top + row) * c->stride + x;
+        const uint32_t *m = g->lanes[row];
+        if (inside) {
+            // The two spare lanes have an empty mask and store back what they read
+#ifdef HAVE_SSE2
+            __m128i col = _mm_set1_epi32((int)color);
+            for (int half = 0; half < 8; half += 4) {
+                __m128i mask = _mm_loadu_si128((const __m128i *)(m + half));
+                __m128i old = _mm_loadu_si128((const __m128i *)(dst + half));
+                _mm_storeu_si128((__m128i *)(dst + half),
+                                 _mm_or_si128(_mm_and_si128(mask, col), _mm_andnot_si128(mask, old)));
+            }
+#else
+            for (int i = 0; i < 8; i++) dst[i] = (color & m[i]) | (dst[i] & ~m[i]);
+#endif
+        } else {
+            for (int i = 0; i < FONT_WIDTH; i++)
+                if (m[i] && x + i >= c->clipX0 && x + i < c->clipX1) dst[i] = color;
+        }
+    }
+}
+
+// Draw UTF-8 text with its baseline at y; returns the advance in pixels
+int canvas_draw_text(Canvas *c, int x, int y, const char *text, uint32_t color) {
+    int startX = x;
+    const unsigned char *p = (const unsigned char *)text;
+    while (*p && x < c->clipX1) {
+        GlyphMask *g = glyph_mask(font_glyph_index(utf8_decode(&p)));
+        if (g && g->top < g->bottom && x + FONT_WIDTH > c->clipX0) canvas_draw_glyph(c, x, y - FONT_ASCENT, g, color);
+        x += FONT_WIDTH;
+    }
+    return x - startX;
+}
+
+// ---- presenting through MIT-SHM ----
+
+void request_frame();
+
+typedef struct {
+    Canvas *canvas;          // active canvas for draw_window(), NULL for Xlib drawing
+    Canvas surfaceCanvas;
+    XImage *image;
+    XShmSegmentInfo shm;
+    int useShm;
+    int busy;                // the server has not finished reading the last XShmPutImage
+    int deferred;            // a frame was skipped while busy
+    int completionEvent;
+} SoftRenderer;
+
+SoftRenderer g_soft;
+
+int g_shm_error;
+
+int shm_error_handler(Display *d, XErrorEvent *e) {
+    (void)d;
+    (void)e;
+    g_shm_error = 1;
+    return 0;
+}
+
+void soft_surface_destroy() {
+    SoftRenderer *s = &g_soft;
+    if (!s->image) return;
+    if (s->useShm) {
+        XShmDetach(g_x11_state.display, &s->shm);
+        XSync(g_x11_state.display, False);
+        shmdt(s->shm.shmaddr);
+        s->image->data = NULL;
+    }
+    XDestroyImage(s->image);
+    s->image = NULL;
+    s->canvas = NULL;
+}
+
+// Back buffer matching the window size: shared memory when the server allows it (it
+// must be local), a client-side XImage otherwise. Returns 0 if the visual is not 32-bit
+// 0x00RRGGBB, in which case Xlib drawing is used.
+int soft_surface_create(int width, int height) {
+    SoftRenderer *s = &g_soft;
+    Display *d = g_x11_state.display;
+    int screen = DefaultScreen(d);
+    Visual *visual = DefaultVisual(d, screen);
+    unsigned depth = (unsigned)DefaultDepth(d, screen);
+    if ((depth != 24 && depth != 32) || visual->red_mask != 0xFF0000 ||
+        visual->green_mask != 0x00FF00 || visual->blue_mask != 0x0000FF)
+        return 0;
+
+    s->useShm = 0;
+    if (XShmQueryExtension(d) && !getenv("BT_NO_SHM")) {
+        s->image = XShmCreateImage(d, visual, depth, ZPixmap, NULL, &s->shm, (unsigned)width, (unsigned)height);
+        if (s->image) {
+            s->shm.shmid = shmget(IPC_PRIVATE, (size_t)s->image->bytes_per_line * height, IPC_CREAT | 0600);
+            s->shm.shmaddr = s->shm.shmid >= 0 ? (char *)shmat(s->shm.shmid, NULL, 0) : (char *)-1;
+            if (s->shm.shmaddr != (char *)-1) {
+                s->image->data = s->shm.shmaddr;
+                s->shm.readOnly = False;
+                // Attaching fails with an X error on remote displays
+                g_shm_error = 0;
+                XErrorHandler old = XSetErrorHandler(shm_error_handler);
+                XShmAttach(d, &s->shm);
+                XSync(d, False);
+                XSetErrorHandler(old);
+                s->useShm = !g_shm_error;
+                if (!s->useShm) shmdt(s->shm.shmaddr);
+            }
+            // Marked for removal now; the segment goes away once both sides detach
+            if (s->shm.shmid >= 0) shmctl(s->shm.shmid, IPC_RMID, NULL);
+            if (!s->useShm) {
+                s->image->data = NULL;
+                XDestroyImage(s->image);
+                s->image = NULL;
+            }
+        }
+    }
+    if (!s->useShm) {
+        char *data = (char *)malloc((size_t)width * height * 4);
+        if (!data) return 0;
+        s->image = XCreateImage(d, visual, depth, ZPixmap, 0, data, (unsigned)width, (unsigned)height, 32, 0);
+        if (!s->image) {
+            free(data);
+            return 0;
+        }
+    }
+    if (s->image->bits_per_pixel != 32) {
+        soft_surface_destroy();
+        return 0;
+    }
+    canvas_init(&s->surfaceCanvas, (uint32_t *)s->image->data, width, height, s->image->bytes_per_line / 4);
+    s->canvas = &s->surfaceCanvas;
+    s->completionEvent = XShmGetEventBase(d) + ShmCompletion;
+    return 1;
+}
+
+// Get the canvas ready for a frame. Returns 0 if the frame has to wait for the
+// previous upload to finish.
+int soft_begin_frame() {
+    SoftRenderer *s = &g_soft;
+    if (s->busy) {
+        s->deferred = 1;
+        return 0;
+    }
+    if (s->image && (s->image->width != g_x11_state.windowWidth || s->image->height != g_x11_state.windowHeight)) {
+        soft_surface_destroy();
+        soft_surface_create(g_x11_state.windowWidth, g_x11_state.windowHeight);
+    }
+    return 1;
+}
+
+void soft_present() {
+    SoftRenderer *s = &g_soft;
+    unsigned w = (unsigned)s->surfaceCanvas.width, h = (unsigned)s->surfaceCanvas.height;
+    if (s->useShm) {
+        XShmPutImage(g_x11_state.display, g_x11_state.window, g_x11_state.gc, s->image, 0, 0, 0, 0, w, h, True);
+        s->busy = 1;
+    } else {
+        XPutImage(g_x11_state.display, g_x11_state.window, g_x11_state.gc, s->image, 0, 0, 0, 0, w, h);
+    }
+}
+
+// ShmCompletion from the event loop: the buffer may be drawn into again
+void soft_upload_done() {
+    g_soft.busy = 0;
+    if (g_soft.deferred) {
+        g_soft.deferred = 0;
+        request_frame();
+    }
+}
+
+// ============ LINUX IMAGE THUMBNAILS ============
+
+// Thumbnails follow the freedesktop thumbnail spec: $XDG_CACHE_HOME/thumbnails/normal/<md5(uri)>.png,
+// valid when its Thumb::URI and Thumb::MTime match the source file.
+#define THUMB_NORMAL_SIZE 128
+#define THUMB_ROW_SIZE 28
+#define THUMB_QUEUE_SIZE 128
+#define THUMB_HASH_BUCKETS 4096
+#define THUMB_MAX_ENTRIES 20000
+#define THUMB_DECODE_THREADS 2
+#define THUMB_MAX_PIXELS (64 * 1024 * 1024)
+
+// ---- MD5 (RFC 1321), only used for thumbnail file names ----
+
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t used;
+} Md5Context;
+
+void md5_transform(uint32_t state[4], const unsigned char block[64]) {
+    static const uint32_t K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+    static const int R[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+    };
+    uint32_t M[16];
+    for (int i = 0; i < 16; i++)
+        M[i] = (uint32_t)block[i * 4] | ((uint32_t)block[i * 4 + 1] << 8) |
+               ((uint32_t)block[i * 4 + 2] << 16) | ((uint32_t)block[i * 4 + 3] << 24);
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16)      { f = (b & c) | (~b & d); g = i; }
+        else if (i < 32) { f = (d & b) | (~d & c); g = (5 * i + 1) & 15; }
+        else if (i < 48) { f = b ^ c ^ d;          g = (3 * i + 5) & 15; }
+        else             { f = c ^ (b | ~d);       g = (7 * i) & 15; }
+        uint32_t tmp = d;
+        d = c;
+        c = b;
+        uint32_t x = a + f + K[i] + M[g];
+        b = b + ((x << R[i]) | (x >> (32 - R[i])));
+        a = tmp;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+}
+
+void md5_init(Md5Context *ctx) {
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+void md5_update(Md5Context *ctx, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    ctx->length += len;
+    while (len > 0) {
+        size_t n = 64 - ctx->used < len ? 64 - ctx->used : len;
+        memcpy(ctx->buffer + ctx->used, p, n);
+        ctx->used += n;
+        p += n;
+        len -= n;
+        if (ctx->used == 64) {
+            md5_transform(ctx->state, ctx->buffer);
+            ctx->used = 0;
+        }
+    }
+}
+
+// Finish and write the digest as 32 lowercase hex characters plus NUL
+void md5_final_hex(Md5Context *ctx, char out[33]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad = 0x80;
+    md5_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->used != 56) md5_update(ctx, &pad, 1);
+    unsigned char lenBytes[8];
+    for (int i = 0; i < 8; i++) lenBytes[i] = (unsigned char)(bits >> (8 * i));
+    md5_update(ctx, lenBytes, 8);
+
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 16; i++) {
+        unsigned char byte = (unsigned char)(ctx->state[i / 4] >> (8 * (i % 4)));
+        out[i * 2] = hex[byte >> 4];
+        out[i * 2 + 1] = hex[byte & 15];
+    }
+    out[32] = '\0';
+}
+
+// ---- thumbnail paths ----
+
+// file:// URI of an absolute path, escaped the way GLib's g_filename_to_uri() does
+// Returns -1 if the URI did not fit in out
+int path_to_file_uri(const char *path, char *out, size_t outLen) {
+    static const char hex[] = "0123456789ABCDEF";
+    static const char safe[] = "!$&'()*+,-./:=@_~";
+    size_t o = 0;
+    const char *prefix = "file://";
+    for (; *prefix && o + 1 < outLen; prefix++) out[o++] = *prefix;
+    const unsigned char *p = (const unsigned char *)path;
+    for (; *p && o + 4 < outLen; p++) {
+        if (isalnum(*p) || (*p < 0x80 && strchr(safe, *p))) {
+            out[o++] = (char)*p;
+        } else {
+            out[o++] = '%';
+            out[o++] = hex[*p >> 4];
+            out[o++] = hex[*p & 15];
+        }
+    }
+    out[o] = '\0';
+    return *prefix || *p ? -1 : 0;
+}
+
+// Base thumbnail directory ($XDG_CACHE_HOME/thumbnails or ~/.cache/thumbnails)
+int thumbnail_base_dir(char *out, size_t outLen) {
+    const char *cache = getenv("XDG_CACHE_HOME");
+    if (cache && cache[0] == '/') return snprintf(out, outLen, "%s/thumbnails", cache) < (int)outLen ? 0 : -1;
+    const char *home = getenv("HOME");
+    if (!home) return -1;
+    return snprintf(out, outLen, "%s/.cache/thumbnails", home) < (int)outLen ? 0 : -1;
+}
+
+// Create each missing component of dir with the given mode
+void make_dirs(const char *dir, mode_t mode) {
+    char tmp[MAX_PATH_LEN];
+    snprintf(tmp, sizeof(tmp), "%s", dir);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(tmp, mode);
+        *p = '/';
+    }
+    mkdir(tmp, mode);
+}
+
+// ---- PNG / JPEG decoding into RGBA8 ----
+
+typedef struct {
+    unsigned char *pixels;  // RGBA, width * height * 4
+    int width;
+    int height;
+} RgbaImage;
+
+// Text chunks a thumbnail must carry to be valid for a source file
+typedef struct {
+    char uri[MAX_PATH_LEN];
+    long long mtime;
+} ThumbInfo;
+
+// Read a PNG. When info is non-NULL the Thumb::URI / Thumb::MTime text chunks are returned in it.
+int read_png_rgba(const char *path, RgbaImage *img, ThumbInfo *info) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    unsigned char sig[8];
+    if (fread(sig, 1, 8, f) != 8 || png_sig_cmp(sig, 0, 8) != 0) {
+        fclose(f);
+        return -1;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop pinfo = png ? png_create_info_struct(png) : NULL;
+    if (!pinfo) {
+        png_destroy_read_struct(&png, NULL, NULL);
+        fclose(f);
+        return -1;
+    }
+
+    unsigned char *volatile pixels = NULL;
+    png_bytep *volatile rows = NULL;
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &pinfo, NULL);
+        free(pixels);
+        free(rows);
+        fclose(f);
+        return -1;
+    }
+
+    png_init_io(png, f);
+    png_set_sig_bytes(png, 8);
+    png_read_info(png, pinfo);
+
+    if (info) {
+        png_textp text;
+        int ntext = 0;
+        info->uri[0] = '\0';
+        info->mtime = -1;
+        if (png_get_text(png, pinfo, &text, &ntext) > 0) {
+            for (int i = 0; i < ntext; i++) {
+                if (strcmp(text[i].key, "Thumb::URI") == 0)
+                    snprintf(info->uri, sizeof(info->uri), "%s", text[i].text);
+                else if (strcmp(text[i].key, "Thumb::MTime") == 0)
+                    info->mtime = atoll(text[i].text);
+            }
+        }
+    }
+
+    png_uint_32 w = png_get_image_width(png, pinfo);
+    png_uint_32 h = png_get_image_height(png, pinfo);
+    if (w == 0 || h == 0 || (unsigned long long)w * h > THUMB_MAX_PIXELS) png_error(png, "image too large");
+
+    int colorType = png_get_color_type(png, pinfo);
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    if (!(colorType & PNG_COLOR_MASK_ALPHA) && !png_get_valid(png, pinfo, PNG_INFO_tRNS))
+        png_set_add_alpha(png, 0xFF, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, pinfo);
+
+    pixels = (unsigned char *)malloc((size_t)w * h * 4);
+    rows = (png_bytep *)malloc(h * sizeof(png_bytep));
+    if (!pixels || !rows) png_error(png, "out of memory");
+    for (png_uint_32 y = 0; y < h; y++) rows[y] = pixels + (size_t)y * w * 4;
+    png_read_image(png, rows);
+    png_read_end(png, NULL);
+
+    png_destroy_read_struct(&png, &pinfo, NULL);
+    free(rows);
+    fclose(f);
+    img->pixels = pixels;
+    img->width = (int)w;
+    img->height = (int)h;
+    return 0;
+}
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} JpegErrorManager;
+
+void jpeg_error_longjmp(j_common_ptr cinfo) {
+    longjmp(((JpegErrorManager *)cinfo->err)->jump, 1);
+}
+
+// Decode a JPEG, letting libjpeg downscale by up to 8x while the result stays >= minSize
+int read_jpeg_rgba(const char *path, RgbaImage *img, int minSize) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    struct jpeg_decompress_struct cinfo;
+    JpegErrorManager jerr;
+    unsigned char *volatile pixels = NULL;
+    unsigned char *volatile line = NULL;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_longjmp;
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(pixels);
+        free(line);
+        fclose(f);
+        return -1;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, f);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    while (cinfo.scale_denom < 8 &&
+           cinfo.image_width / (cinfo.scale_denom * 2) >= (unsigned)minSize &&
+           cinfo.image_height / (cinfo.scale_denom * 2) >= (unsigned)minSize)
+        cinfo.scale_denom *= 2;
+    jpeg_start_decompress(&cinfo);
+
+    unsigned w = cinfo.output_width, h = cinfo.output_height;
+    if (w == 0 || h == 0 || (unsigned long long)w * h > THUMB_MAX_PIXELS || cinfo.output_components != 3)
+        longjmp(jerr.jump, 1);
+    pixels = (unsigned char *)malloc((size_t)w * h * 4);
+    line = (unsigned char *)malloc((size_t)w * 3);
+    if (!pixels || !line) longjmp(jerr.jump, 1);
+
+    while (cinfo.output_scanline < h) {
+        unsigned y = cinfo.output_scanline;
+        JSAMPROW row = line;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+        unsigned char *dst = pixels + (size_t)y * w * 4;
+        for (unsigned x = 0; x < w; x++) {
+            dst[x * 4] = line[x * 3];
+            dst[x * 4 + 1] = line[x * 3 + 1];
+            dst[x * 4 + 2] = line[x * 3 + 2];
+            dst[x * 4 + 3] = 0xFF;
+        }
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    free(line);
+    fclose(f);
+    img->pixels = pixels;
+    img->width = (int)w;
+    img->height = (int)h;
+    return 0;
+}
+
+// Box-filter an image down so it fits in maxSize x maxSize (never upscales)
+int scale_rgba_to_fit(const RgbaImage *src, RgbaImage *dst, int maxSize) {
+    int dw = src->width, dh = src->height;
+    if (dw > maxSize || dh > maxSize) {
+        if (dw >= dh) { dh = (int)((long long)dh * maxSize / dw); dw = maxSize; }
+        else          { dw = (int)((long long)dw * maxSize / dh); dh = maxSize; }
+        if (dw < 1) dw = 1;
+        if (dh < 1) dh = 1;
+    }
+    dst->pixels = (unsigned char *)malloc((size_t)dw * dh * 4);
+    if (!dst->pixels) return -1;
+    dst->width = dw;
+    dst->height = dh;
+
+    for (int y = 0; y < dh; y++) {
+        int y0 = (int)((long long)y * src->height / dh);
+        int y1 = (int)((long long)(y + 1) * src->height / dh);
+        if (y1 <= y0) y1 = y0 + 1;
+        for (int x = 0; x < dw; x++) {
+            int x0 = (int)((long long)x * src->width / dw);
+            int x1 = (int)((long long)(x + 1) * src->width / dw);
+            if (x1 <= x0) x1 = x0 + 1;
+            unsigned long long sum[4] = { 0, 0, 0, 0 };
+            for (int sy = y0; sy < y1; sy++) {
+                const unsigned char *p = src->pixels + ((size_t)sy * src->width + x0) * 4;
+                for (int sx = x0; sx < x1; sx++, p += 4) {
+                    sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; sum[3] += p[3];
+                }
+            }
+            unsigned long long n = (unsigned long long)(y1 - y0) * (x1 - x0);
+            unsigned char *d = dst->pixels + ((size_t)y * dw + x) * 4;
+            for (int c = 0; c < 4; c++) d[c] = (unsigned char)(sum[c] / n);
+        }
+    }
+    return 0;
+}
+
+// Write a thumbnail PNG with the spec's text chunks; written to a temp file and renamed into place
+int write_thumbnail_png(const char *path, const RgbaImage *img, const char *uri, long long mtime, long long size) {
+    char tmpPath[MAX_PATH_LEN];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.XXXXXX", path) >= (int)sizeof(tmpPath)) return -1;
+    int fd = mkstemp(tmpPath);
+    if (fd < 0) return -1;
+    fchmod(fd, 0600);
+    FILE *f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        unlink(tmpPath);
+        return -1;
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop pinfo = png ? png_create_info_struct(png) : NULL;
+    png_bytep *volatile rows = NULL;
+    if (!pinfo || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &pinfo);
+        free(rows);
+        fclose(f);
+        unlink(tmpPath);
+        return -1;
+    }
+
+    png_init_io(png, f);
+    png_set_IHDR(png, pinfo, (png_uint_32)img->width, (png_uint_32)img->height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+    char mtimeText[32], sizeText[32];
+    snprintf(mtimeText, sizeof(mtimeText), "%lld", mtime);
+    snprintf(sizeText, sizeof(sizeText), "%lld", size);
+    png_text text[4];
+    memset(text, 0, sizeof(text));
+    const char *keys[4] = { "Thumb::URI", "Thumb::MTime", "Thumb::Size", "Software" };
+    const char *values[4] = { uri, mtimeText, sizeText, "better-toolbar" };
+    for (int i = 0; i < 4; i++) {
+        text[i].compression = PNG_TEXT_COMPRESSION_NONE;
+        text[i].key = (png_charp)keys[i];
+        text[i].text = (png_charp)values[i];
+    }
+    png_set_text(png, pinfo, text, 4);
+    png_write_info(png, pinfo);
+
+    rows = (png_bytep *)malloc((size_t)img->height * sizeof(png_bytep));
+    if (!rows) png_error(png, "out of memory");
+    for (int y = 0; y < img->height; y++) rows[y] = img->pixels + (size_t)y * img->width * 4;
+    png_write_image(png, rows);
+    png_write_end(png, pinfo);
+    png_destroy_write_struct(&png, &pinfo);
+    free(rows);
+
+    if (fclose(f) != 0 || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        return -1;
+    }
+    return 0;
+}
+
+// ---- thumbnail cache ----
+
+#define THUMB_NONE    0
+#define THUMB_PENDING 1
+#define THUMB_READY   2
+#define THUMB_FAILED  3
+
+typedef struct ThumbEntry {
+    char *path;
+    long long mtime;
+    unsigned hash;
+    int state;
+    Pixmap pixmap;
+    unsigned int *pixels;   // instead of a pixmap when the software renderer draws the window
+    int width, height;
+    struct ThumbEntry *hashNext;
+    struct ThumbEntry *lruPrev, *lruNext;   // most recently used at lruHead
+} ThumbEntry;
+
+typedef struct {
+    ThumbEntry *entry;
+    char *path;
+    long long mtime;
+    long long size;
+} ThumbJob;
+
+typedef struct {
+    ThumbEntry *entry;
+    int ok;
+    int width, height;
+    unsigned int *pixels;   // 0x00RRGGBB, composited over the row background
+} ThumbResult;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t threads[THUMB_DECODE_THREADS];
+    int threadCount;
+    int shutdown;
+    ThumbJob queue[THUMB_QUEUE_SIZE];      // LIFO; the oldest job is dropped when full
+    int queued;
+    ThumbResult *results;
+    int resultCount, resultCapacity;
+
+    // Owned by the UI thread
+    ThumbEntry *buckets[THUMB_HASH_BUCKETS];
+    ThumbEntry *lruHead, *lruTail;
+    int entryCount;
+    size_t pixmapBytes;     // pixmaps or pixel buffers held by entries
+    size_t byteLimit;
+    int enabled;
+} ThumbCache;
+
+ThumbCache g_thumbs = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+unsigned hash_string(const char *s) {
+    unsigned h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+// Produce the small row thumbnail for a source image, using or refreshing the on-disk cache
+int build_row_thumbnail(const char *path, long long mtime, long long size, ThumbResult *res) {
+    char uri[MAX_PATH_LEN], base[MAX_PATH_LEN], thumbPath[MAX_PATH_LEN];
+    char md5[33];
+    // A path too long for the cache's URI or file name is thumbnailed without the cache
+    int haveBase = path_to_file_uri(path, uri, sizeof(uri)) == 0 &&
+                   thumbnail_base_dir(base, sizeof(base)) == 0;
+    Md5Context ctx;
+    md5_init(&ctx);
+    md5_update(&ctx, uri, strlen(uri));
+    md5_final_hex(&ctx, md5);
+    if (haveBase && snprintf(thumbPath, sizeof(thumbPath), "%s/normal/%s.png", base, md5) >= (int)sizeof(thumbPath))
+        haveBase = 0;
+
+    RgbaImage normal = { 0 };
+    ThumbInfo info;
+    int loaded = 0;
+    if (haveBase) {
+        if (read_png_rgba(thumbPath, &normal, &info) == 0) {
+            if (strcmp(info.uri, uri) == 0 && info.mtime == mtime) loaded = 1;
+            else { free(normal.pixels); normal.pixels = NULL; }
+        }
+    }
+
+    if (!loaded) {
+        // Other image types only use thumbnails that another program already made
+        static const char *const jpegExts[] = { "jpg", "jpeg", NULL };
+        static const char *const pngExts[] = { "png", NULL };
+        RgbaImage full = { 0 };
+        int rc = -1;
+        if (has_extension(path, jpegExts)) rc = read_jpeg_rgba(path, &full, THUMB_NORMAL_SIZE);
+        else if (has_extension(path, pngExts)) rc = read_png_rgba(path, &full, NULL);
+        if (rc != 0) return -1;
+        rc = scale_rgba_to_fit(&full, &normal, THUMB_NORMAL_SIZE);
+        free(full.pixels);
+        if (rc != 0) return -1;
+
+        if (haveBase) {
+            char dir[MAX_PATH_LEN];
+            if (snprintf(dir, sizeof(dir), "%s/normal", base) < (int)sizeof(dir)) {
+                make_dirs(dir, 0700);
+                write_thumbnail_png(thumbPath, &normal, uri, mtime, size);
+            }
+        }
+    }
+
+    RgbaImage small;
+    int rc = scale_rgba_to_fit(&normal, &small, THUMB_ROW_SIZE);
+    free(normal.pixels);
+    if (rc != 0) return -1;
+
+    // Composite over the row background so the pixmap can be copied as-is
+    res->pixels = (unsigned int *)malloc((size_t)small.width * small.height * sizeof(unsigned int));
+    if (!res->pixels) {
+        free(small.pixels);
+        return -1;
+    }
+    for (int i = 0; i < small.width * small.height; i++) {
+        const unsigned char *p = small.pixels + i * 4;
+        unsigned a = p[3];
+        unsigned r = (p[0] * a + 0xDD * (255 - a)) / 255;
+        unsigned g = (p[1] * a + 0xDD * (255 - a)) / 255;
+        unsigned b = (p[2] * a + 0xDD * (255 - a)) / 255;
+        res->pixels[i] = (r << 16) | (g << 8) | b;
+    }
+    res->width = small.width;
+    res->height = small.height;
+    free(small.pixels);
+    return 0;
+}
+
+void *thumb_worker(void *arg) {
+    ThumbCache *tc = (ThumbCache *)arg;
+    pthread_mutex_lock(&tc->lock);
+    for (;;) {
+        while (!tc->shutdown && tc->queued == 0) pthread_cond_wait(&tc->cond, &tc->lock);
+        if (tc->shutdown) break;
+        ThumbJob job = tc->queue[--tc->queued];
+        pthread_mutex_unlock(&tc->lock);
+
+        ThumbResult res = { job.entry, 0, 0, 0, NULL };
+        res.ok = build_row_thumbnail(job.path, job.mtime, job.size, &res) == 0;
+        free(job.path);
+
+        pthread_mutex_lock(&tc->lock);
+        while (tc->resultCount == tc->resultCapacity) {
+            int cap = tc->resultCapacity ? tc->resultCapacity * 2 : 64;
+            ThumbResult *grown = (ThumbResult *)realloc(tc->results, (size_t)cap * sizeof(ThumbResult));
+            if (grown) {
+                tc->results = grown;
+                tc->resultCapacity = cap;
+                break;
+            }
+            pthread_mutex_unlock(&tc->lock);
+            usleep(10000);
+            pthread_mutex_lock(&tc->lock);
+        }
+        tc->results[tc->resultCount++] = res;
+        wake_ui();
+    }
+    pthread_mutex_unlock(&tc->lock);
+    return NULL;
+}
+
+void thumb_lru_unlink(ThumbCache *tc, ThumbEntry *e) {
+    if (e->lruPrev) e->lruPrev->lruNext = e->lruNext; else tc->lruHead = e->lruNext;
+    if (e->lruNext) e->lruNext->lruPrev = e->lruPrev; else tc->lruTail = e->lruPrev;
+    e->lruPrev = e->lruNext = NULL;
+}
+
+void thumb_lru_push_front(ThumbCache *tc, ThumbEntry *e) {
+    e->lruPrev = NULL;
+    e->lruNext = tc->lruHead;
+    if (tc->lruHead) tc->lruHead->lruPrev = e;
+    tc->lruHead = e;
+    if (!tc->lruTail) tc->lruTail = e;
+}
+
+void thumb_entry_free(ThumbCache *tc, ThumbEntry *e) {
+    ThumbEntry **pp = &tc->buckets[e->hash % THUMB_HASH_BUCKETS];
+    while (*pp && *pp != e) pp = &(*pp)->hashNext;
+    if (*pp) *pp = e->hashNext;
+    thumb_lru_unlink(tc, e);
+    if (e->pixmap || e->pixels) {
+        if (e->pixmap) XFreePixmap(g_x11_state.display, e->pixmap);
+        free(e->pixels);
+        tc->pixmapBytes -= (size_t)e->width * e->height * 4;
+    }
+    free(e->path);
+    free(e);
+    tc->entryCount--;
+}
+
+// Evict least recently used entries until the pixmap memory and entry count are under their caps.
+// Entries with a decode in flight are skipped; their worker still refers to them.
+void thumb_evict(ThumbCache *tc) {
+    ThumbEntry *e = tc->lruTail;
+    while (e && (tc->pixmapBytes > tc->byteLimit || tc->entryCount > THUMB_MAX_ENTRIES)) {
+        ThumbEntry *prev = e->lruPrev;
+        if (e->state != THUMB_PENDING) thumb_entry_free(tc, e);
+        e = prev;
+    }
+}
+
+void thumbs_init() {
+    ThumbCache *tc = &g_thumbs;
+    Display *d = g_x11_state.display;
+    int depth = DefaultDepth(d, DefaultScreen(d));
+    tc->enabled = (depth == 24 || depth == 32) && !getenv("BT_NO_THUMBNAILS");
+    const char *mb = getenv("BT_THUMB_CACHE_MB");
+    tc->byteLimit = (size_t)(mb && atoi(mb) > 0 ? atoi(mb) : 8) * 1024 * 1024;
+    if (!tc->enabled) return;
+    for (int i = 0; i < THUMB_DECODE_THREADS; i++)
+        if (pthread_create(&tc->threads[tc->threadCount], NULL, thumb_worker, tc) == 0)
+            tc->threadCount++;
+}
+
+void thumbs_shutdown() {
+    ThumbCache *tc = &g_thumbs;
+    pthread_mutex_lock(&tc->lock);
+    tc->shutdown = 1;
+    pthread_cond_broadcast(&tc->cond);
+    pthread_mutex_unlock(&tc->lock);
+    int stuck = 0;
+    for (int i = 0; i < tc->threadCount; i++)
+        if (join_with_timeout(tc->threads[i], 0.2) != 0) stuck = 1;
+    tc->threadCount = 0;
+    if (stuck) return;  // a decoder is blocked reading a file and still uses the queue
+
+    for (int i = 0; i < tc->queued; i++) free(tc->queue[i].path);
+    tc->queued = 0;
+    for (int i = 0; i < tc->resultCount; i++) free(tc->results[i].pixels);
+    free(tc->results);
+    tc->results = NULL;
+    tc->resultCount = tc->resultCapacity = 0;
+    while (tc->lruHead) thumb_entry_free(tc, tc->lruHead);
+}
+
+// Look up the thumbnail for path at mtime, queueing a decode if there is none yet.
+// Returns the entry when its pixmap is ready, NULL otherwise.
+ThumbEntry *thumb_get(const char *path, long long mtime, long long size) {
+    ThumbCache *tc = &g_thumbs;
+    if (!tc->enabled) return NULL;
+
+    unsigned h = hash_string(path);
+    ThumbEntry *e = tc->buckets[h % THUMB_HASH_BUCKETS];
+    while (e && (e->hash != h || strcmp(e->path, path) != 0)) e = e->hashNext;
+
+    if (e && e->mtime != mtime && e->state != THUMB_PENDING) {
+        thumb_entry_free(tc, e);  // source changed since it was decoded
+        e = NULL;
+    }
+    if (!e) {
+        e = (ThumbEntry *)calloc(1, sizeof(ThumbEntry));
+        if (!e) return NULL;
+        e->path = strdup(path);
+        e->mtime = mtime;
+        e->hash = h;
+        e->hashNext = tc->buckets[h % THUMB_HASH_BUCKETS];
+        tc->buckets[h % THUMB_HASH_BUCKETS] = e;
+        tc->entryCount++;
+        thumb_lru_push_front(tc, e);
+    } else {
+        thumb_lru_unlink(tc, e);
+        thumb_lru_push_front(tc, e);
+    }
+
+    if (e->state == THUMB_NONE) {
+        char *jobPath = strdup(path);
+        if (!jobPath) return NULL;
+        pthread_mutex_lock(&tc->lock);
+        if (tc->queued == THUMB_QUEUE_SIZE) {
+            // Drop the job requested longest ago; it is re-requested if it scrolls back into view
+            tc->queue[0].entry->state = THUMB_NONE;
+            free(tc->queue[0].path);
+            memmove(&tc->queue[0], &tc->queue[1], (THUMB_QUEUE_SIZE - 1) * sizeof(ThumbJob));
+            tc->queued--;
+        }
+        ThumbJob *job = &tc->queue[tc->queued++];
+        job->entry = e;
+        job->path = jobPath;
+        job->mtime = mtime;
+        job->size = size;
+        e->state = THUMB_PENDING;
+        pthread_cond_signal(&tc->cond);
+        pthread_mutex_unlock(&tc->lock);
+    }
+    return e->state == THUMB_READY ? e : NULL;
+}
+
+// Upload finished thumbnails to the X server as pixmaps. Returns 1 if anything changed.
+int thumb_apply_results() {
+    ThumbCache *tc = &g_thumbs;
+    if (!tc->enabled) return 0;
+    Display *d = g_x11_state.display;
+    int screen = DefaultScreen(d);
+
+    pthread_mutex_lock(&tc->lock);
+    int n = tc->resultCount;
+    ThumbResult *results = tc->results;
+    tc->results = NULL;
+    tc->resultCount = tc->resultCapacity = 0;
+    pthread_mutex_unlock(&tc->lock);
+
+    for (int i = 0; i < n; i++) {
+        ThumbResult *r = &results[i];
+        ThumbEntry *e = r->entry;
+        if (!r->ok) {
+            e->state = THUMB_FAILED;
+            continue;
+        }
+        if (g_soft.image) {
+            // The software renderer blits straight from the decoded pixels
+            e->pixels = r->pixels;
+            e->width = r->width;
+            e->height = r->height;
+            e->state = THUMB_READY;
+            tc->pixmapBytes += (size_t)r->width * r->height * 4;
+            continue;
+        }
+        XImage *img = XCreateImage(d, DefaultVisual(d, screen), (unsigned)DefaultDepth(d, screen), ZPixmap, 0,
+                                   (char *)r->pixels, (unsigned)r->width, (unsigned)r->height, 32, 0);
+        if (!img) {
+            free(r->pixels);
+            e->state = THUMB_FAILED;
+            continue;
+        }
+        e->pixmap = XCreatePixmap(d, g_x11_state.window, (unsigned)r->width, (unsigned)r->height,
+                                  (unsigned)DefaultDepth(d, screen));
+        XPutImage(d, e->pixmap, g_x11_state.gc, img, 0, 0, 0, 0, (unsigned)r->width, (unsigned)r->height);
+        XDestroyImage(img);  // also frees r->pixels
+        e->width = r->width;
+        e->height = r->height;
+        e->state = THUMB_READY;
+        tc->pixmapBytes += (size_t)r->width * r->height * 4;
+    }
+    free(results);
+    if (n > 0) thumb_evict(tc);
+    return n > 0;
+}
+
+// ============ LINUX HOVER READAHEAD ============
+
+// Resting the pointer on a file row for a moment asks the kernel to start reading the
+// beginning of that file into the page cache, so the application it is opened in does
+// not start cold. One background thread works through a small queue (newest hover
+// first, the oldest dropped when it is full) and issues at most a fixed number of bytes
+// per second, so sweeping the pointer over a long list cannot flood the disk. Pages that
+// are already cached are counted but not charged to that budget.
+
+#define READAHEAD_DWELL_MS     250
+#define READAHEAD_QUEUE_SIZE   8
+#define READAHEAD_DEFAULT_MB   16   // BT_READAHEAD_MB: how much of each file to warm
+#define READAHEAD_DEFAULT_MBPS 64   // BT_READAHEAD_MBPS: the I/O budget
+#define READAHEAD_CHUNK        (2 * 1024 * 1024)   // the kernel trims a single large WILLNEED
+
+typedef struct {
+    char *path;
+} ReadaheadJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int running;
+    int shutdown;
+    ReadaheadJob queue[READAHEAD_QUEUE_SIZE];
+    int queued;
+    long long maxBytes;
+    double bytesPerSecond;
+    double budget;          // bytes that may be issued right now, refilled over time
+    double budgetTime;
+
+    // Session totals, under lock
+    unsigned long long files;           // files the kernel was asked to read ahead
+    unsigned long long bytesWarmed;     // bytes that were not cached when asked for
+    unsigned long long bytesCached;     // bytes that were already cached
+    unsigned long long bytesDeferred;   // uncached bytes left out to stay within the budget
+    unsigned long long dropped;         // hovers pushed out of a full queue
+    int logStats;
+} Readahead;
+
+Readahead g_readahead = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+// Ask for the first maxBytes of one file. mincore() on a mapping (which reads nothing
+// itself) tells which pages are already cached; the request stops once the uncached
+// pages it covers reach the remaining budget.
+void readahead_file(Readahead *ra, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd < 0 && errno == EPERM) fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t len = (unsigned long long)st.st_size < (unsigned long long)ra->maxBytes ? (size_t)st.st_size : (size_t)ra->maxBytes;
+    size_t pages = (len + page - 1) / page;
+    unsigned char *resident = (unsigned char *)calloc(pages, 1);
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+        if (resident && mincore(map, len, resident) < 0) memset(resident, 0, pages);
+        munmap(map, len);
+    }
+
+    pthread_mutex_lock(&ra->lock);
+    double now = monotonic_seconds();
+    ra->budget += (now - ra->budgetTime) * ra->bytesPerSecond;
+    if (ra->budget > ra->bytesPerSecond) ra->budget = ra->bytesPerSecond;   // at most one second of burst
+    ra->budgetTime = now;
+
+    size_t issueLen = 0, warmed = 0, cached = 0, deferred = 0;
+    for (size_t i = 0; i < pages; i++) {
+        size_t bytes = i + 1 < pages ? page : len - i * page;
+        if (resident && (resident[i] & 1)) cached += bytes;
+        else if (!deferred && (double)(warmed + bytes) <= ra->budget) warmed += bytes;
+        else deferred += bytes;
+        if (!deferred) issueLen = i * page + bytes;
+    }
+    ra->budget -= (double)warmed;
+    if (warmed) ra->files++;
+    ra->bytesWarmed += warmed;
+    ra->bytesCached += cached;
+    ra->bytesDeferred += deferred;
+    pthread_mutex_unlock(&ra->lock);
+
+    for (size_t off = 0; warmed && off < issueLen; off += READAHEAD_CHUNK) {
+        size_t n = issueLen - off < READAHEAD_CHUNK ? issueLen - off : READAHEAD_CHUNK;
+        posix_fadvise(fd, (off_t)off, (off_t)n, POSIX_FADV_WILLNEED);
+    }
+    free(resident);
+    close(fd);
+}
+
+void *readahead_worker(void *arg) {
+    Readahead *ra = (Readahead *)arg;
+    pthread_mutex_lock(&ra->lock);
+    for (;;) {
+        while (!ra->shutdown && ra->queued == 0) pthread_cond_wait(&ra->cond, &ra->lock);
+        if (ra->shutdown) break;
+        ReadaheadJob job = ra->queue[--ra->queued];
+        pthread_mutex_unlock(&ra->lock);
+
+        io_inject_latency();
+        readahead_file(ra, job.path);
+        free(job.path);
+
+        pthread_mutex_lock(&ra->lock);
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+void readahead_init() {
+    Readahead *ra = &g_readahead;
+    if (getenv("BT_NO_READAHEAD")) return;
+    const char *mb = getenv("BT_READAHEAD_MB");
+    const char *mbps = getenv("BT_READAHEAD_MBPS");
+    ra->maxBytes = (long long)(mb && atoi(mb) > 0 ? atoi(mb) : READAHEAD_DEFAULT_MB) * 1024 * 1024;
+    ra->bytesPerSecond = (double)(mbps && atoi(mbps) > 0 ? atoi(mbps) : READAHEAD_DEFAULT_MBPS) * 1024 * 1024;
+    ra->budget = ra->bytesPerSecond;
+    ra->budgetTime = monotonic_seconds();
+    ra->logStats = getenv("BT_READAHEAD_STATS") != NULL;
+    ra->running = pthread_create(&ra->thread, NULL, readahead_worker, ra) == 0;
+}
+
+// Queue a file; never blocks the caller on the disk
+void readahead_request(const char *path) {
+    Readahead *ra = &g_readahead;
+    if (!ra->running) return;
+    char *copy = strdup(path);
+    if (!copy) return;
+
+    pthread_mutex_lock(&ra->lock);
+    for (int i = 0; i < ra->queued; i++) {
+        if (strcmp(ra->queue[i].path, path) == 0) {
+            pthread_mutex_unlock(&ra->lock);
+            free(copy);
+            return;
+        }
+    }
+    if (ra->queued == READAHEAD_QUEUE_SIZE) {
+        free(ra->queue[0].path);
+        memmove(ra->queue, ra->queue + 1, (READAHEAD_QUEUE_SIZE - 1) * sizeof(ReadaheadJob));
+        ra->queued--;
+        ra->dropped++;
+    }
+    ra->queue[ra->queued++].path = copy;
+    pthread_cond_signal(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+void readahead_report(FILE *out) {
+    Readahead *ra = &g_readahead;
+    pthread_mutex_lock(&ra->lock);
+    fprintf(out, "readahead: %llu files, %.1f MB warmed, %.1f MB already cached, "
+                 "%.1f MB held back by the budget, %llu hovers dropped\n",
+            ra->files, ra->bytesWarmed / 1048576.0, ra->bytesCached / 1048576.0,
+            ra->bytesDeferred / 1048576.0, ra->dropped);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+void readahead_shutdown() {
+    Readahead *ra = &g_readahead;
+    if (!ra->running) return;
+    pthread_mutex_lock(&ra->lock);
+    ra->shutdown = 1;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+    ra->running = 0;
+    if (join_with_timeout(ra->thread, 0.2) != 0) return;   // stuck opening a file on a hung mount
+
+    for (int i = 0; i < ra->queued; i++) free(ra->queue[i].path);
+    ra->queued = 0;
+}
+
+#define BENCH_IO_CLICKS 4
+#define BENCH_IO_CLICK_GAP 0.25
+
+// --bench-io [DIR]: run the event loop's side of a folder load on a hung mount. Every
+// filesystem call of the I/O and readahead threads waits BT_IO_LATENCY_MS (3000 by
+// default here); the loop clicks into DIR a few times, hovers one file per frame, and
+// reports how long its own work and the gaps between frames took.
+int bench_io(const char *dirpath) {
+    Listing files = {0};
+    if (scan_listing(dirpath, &files, 0, NULL, 0) < 0) {
+        fprintf(stderr, "Error: Cannot access directory '%s'\n", dirpath);
+        return 1;
+    }
+    io_layer_init();
+    if (!getenv("BT_IO_LATENCY_MS")) g_io.latencyMs = 3000;
+    if (init_wake_pipe() < 0) return 1;
+    readahead_init();
+    printf("%d ms injected latency, %.0f ms timeout, %d entries in %s\n",
+           g_io.latencyMs, g_io.timeout * 1e3, files.count, dirpath);
+
+    double start = monotonic_seconds(), lastClick = 0, lastFrame = start;
+    double maxWork = 0, maxGap = 0, overdueAfter = -1, loadedAfter = -1;
+    int clicks = 0, frames = 0, rows = 0;
+    while (loadedAfter < 0 && monotonic_seconds() - start < 30) {
+        double t0 = monotonic_seconds();
+        if (clicks < BENCH_IO_CLICKS && t0 - lastClick >= BENCH_IO_CLICK_GAP) {
+            if (io_navigate(dirpath, 0, SORT_NAME, 0) == 0) clicks++;
+            lastClick = t0;
+        }
+        if (files.count > 0) {
+            char path[MAX_PATH_LEN];
+            if (snprintf(path, sizeof(path), "%s/%s", dirpath, files.names[frames % files.count]) < (int)sizeof(path))
+                readahead_request(path);
+        }
+        int overdue = 0;
+        if (io_pending(NULL, 0, &overdue, NULL) && overdue && overdueAfter < 0 && clicks == BENCH_IO_CLICKS)
+            overdueAfter = t0 - lastClick;
+        IoRequest *req = io_take_result();
+        if (req) {
+            if (clicks == BENCH_IO_CLICKS) {
+                loadedAfter = t0 - lastClick;
+                rows = req->listing.count;
+            }
+            io_request_free(req);
+        }
+        double work = monotonic_seconds() - t0;
+        if (work > maxWork) maxWork = work;
+        if (t0 - lastFrame > maxGap) maxGap = t0 - lastFrame;
+        lastFrame = t0;
+        frames++;
+
+        struct pollfd fd = { g_wake_pipe[0], POLLIN, 0 };
+        if (poll(&fd, 1, 16) > 0) drain_wake_pipe();
+    }
+
+    printf("  frames           : %d, longest UI-side work %.3f ms, longest gap %.1f ms\n",
+           frames, maxWork * 1e3, maxGap * 1e3);
+    if (overdueAfter >= 0) printf("  not responding   : shown %.0f ms after the last click\n", overdueAfter * 1e3);
+    else printf("  not responding   : never shown\n");
+    if (loadedAfter >= 0)
+        printf("  last click       : loaded %d rows after %.0f ms, %d earlier clicks abandoned\n",
+               rows, loadedAfter * 1e3, clicks - 1);
+    else printf("  last click       : still loading after 30 s\n");
+    readahead_report(stdout);
+
+    io_layer_shutdown();
+    readahead_shutdown();
+    listing_free(&files);
+    return 0;
+}
+
+// ============ LINUX CONTENT SEARCH ============
+
+// Find-in-files over the current folder (or it and its subfolders). A producer thread
+// feeds file paths to a pool of workers through a bounded queue; each worker maps a file
+// and counts the occurrences of the search string with a vector scan. Files that look
+// binary from their first bytes are skipped. Matches stream back to the UI, which lists
+// them ranked by hit count. Threads are detached and share a reference-counted job, so a
+// search stuck on a hung mount is abandoned the same way a folder load is.
+
+#define SEARCH_QUEUE_SIZE    1024
+#define SEARCH_MAX_THREADS   16
+#define SEARCH_SNIFF_BYTES   4096               // a NUL byte in here marks the file as binary
+#define SEARCH_READ_MAX      (256 * 1024)       // smaller files are read, not mapped
+#define SEARCH_WAKE_FILES    256                // progress repaint interval
+
+typedef struct {
+    char *path;             // relative to the search root
+    long long size;
+    long long mtime;
+    unsigned int mode;
+    int hits;               // duplicate search: the number of identical files
+    int group;              // duplicate search: rows of one group hold the same contents
+} SearchHit;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int refs;               // live threads plus the UI's reference
+    int cancel;
+    char *root;
+    int rootfd;             // opened by the producer, so starting a search never touches the disk
+    int rootError;
+    char *needle;           // NULL: look for duplicate files instead
+    size_t nlen;
+    int wide;               // CPU has AVX2
+    int recursive;
+    FilterSet filters;      // name filters from the command line, for files found in subfolders
+
+    // Path queue from the producer to the workers
+    char *queue[SEARCH_QUEUE_SIZE];
+    int head;
+    int queued;
+    int producerDone;
+    char **names;           // flat search: the files to look at, handed to the producer
+    int nameCount;
+
+    // Results not yet taken by the UI, and progress
+    SearchHit *results;
+    int resultCount;
+    int resultCapacity;
+    int workersLeft;
+    unsigned long long filesSearched;
+    unsigned long long filesMatched;
+    unsigned long long binarySkipped;
+    unsigned long long bytesSearched;
+    unsigned long long filesHashed;     // duplicates: files hashed so far, of filesToHash
+    unsigned long long filesToHash;
+    int dupGroups;
+    long long dupWasted;                // bytes taken by all but one file of each group
+    double started;
+    double elapsed;         // set when the last worker finishes
+} ContentSearch;
+
+// Non-overlapping occurrences of needle in hay[i..len), counting from position `next`
+size_t count_matches_scalar(const unsigned char *hay, size_t len, size_t i, size_t next,
+                            const unsigned char *needle, size_t nlen, size_t count) {
+    if (i < next) i = next;
+    while (i + nlen <= len) {
+        const unsigned char *p = (const unsigned char *)memmem(hay + i, len - i, needle, nlen);
+        if (!p) break;
+        count++;
+        i = (size_t)(p - hay) + nlen;
+    }
+    return count;
+}
+
+// The vector scans test the first and last needle byte at 32 or 16 positions at once
+// and verify only those candidates. Loads stay inside [hay, hay + len).
+
+#ifdef HAVE_AVX2
+__attribute__((target("avx2")))
+size_t count_matches_avx2(const unsigned char *hay, size_t len, const unsigned char *needle, size_t nlen) {
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle[nlen - 1]);
+    size_t i = 0, next = 0, count = 0;
+    for (; i + nlen - 1 + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(hay + i + nlen - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+                                                                        _mm256_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t pos = i + (size_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            if (pos >= next && (nlen <= 2 || memcmp(hay + pos + 1, needle + 1, nlen - 2) == 0)) {
+                count++;
+                next = pos + nlen;
+            }
+        }
+    }
+    return count_matches_scalar(hay, len, i, next, needle, nlen, count);
+}
+#endif
+
+#ifdef HAVE_SSE2
+size_t count_matches_sse2(const unsigned char *hay, size_t len, const unsigned char *needle, size_t nlen) {
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[nlen - 1]);
+    size_t i = 0, next = 0, count = 0;
+    for (; i + nlen - 1 + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(hay + i + nlen - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t pos = i + (size_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            if (pos >= next && (nlen <= 2 || memcmp(hay + pos + 1, needle + 1, nlen - 2) == 0)) {
+                count++;
+                next = pos + nlen;
+            }
+        }
+    }
+    return count_matches_scalar(hay, len, i, next, needle, nlen, count);
+}
+#endif
+
+// Count non-overlapping occurrences (case-sensitive, like grep)
+size_t count_matches(const unsigned char *hay, size_t len, const unsigned char *needle, size_t nlen, int wide) {
+    (void)wide;
+    if (nlen == 0 || len < nlen) return 0;
+#ifdef HAVE_AVX2
+    if (wide) return count_matches_avx2(hay, len, needle, nlen);
+#endif
+#ifdef HAVE_SSE2
+    return count_matches_sse2(hay, len, needle, nlen);
+#else
+    return count_matches_scalar(hay, len, 0, 0, needle, nlen, 0);
+#endif
+}
+
+// ---- scans of mapped files ----
+
+// A file truncated while it is mapped (a log being rotated) turns reads past its new
+// end into SIGBUS. A scan of a mapping runs under a guard: the handler jumps back to the
+// guard of the faulting thread, and the scan counts as a failed read. SIGBUS outside a
+// guard still kills the process.
+
+__thread sigjmp_buf *t_sigbus_jump;
+pthread_once_t g_sigbus_once = PTHREAD_ONCE_INIT;
+
+void sigbus_handler(int sig) {
+    sigjmp_buf *jump = t_sigbus_jump;
+    if (jump) siglongjmp(*jump, 1);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void sigbus_install() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigbus_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+// Run scan(ctx) over memory mapped from a file; returns -1 if the file shrank under it.
+// The scan must not take locks, and anything it allocates must be reachable from ctx:
+// it is abandoned wherever the fault hits.
+int guarded_scan(void (*scan)(void *), void *ctx) {
+    pthread_once(&g_sigbus_once, sigbus_install);
+    sigjmp_buf jump;
+    if (sigsetjmp(jump, 1)) {
+        t_sigbus_jump = NULL;
+        return -1;
+    }
+    t_sigbus_jump = &jump;
+    scan(ctx);
+    t_sigbus_jump = NULL;
+    return 0;
+}
+
+void content_search_release(ContentSearch *cs) {
+    pthread_mutex_lock(&cs->lock);
+    int last = --cs->refs == 0;
+    pthread_mutex_unlock(&cs->lock);
+    if (!last) return;
+
+    for (int i = 0; i < cs->queued; i++) free(cs->queue[(cs->head + i) % SEARCH_QUEUE_SIZE]);
+    for (int i = 0; i < cs->resultCount; i++) free(cs->results[i].path);
+    for (int i = 0; i < cs->nameCount; i++) free(cs->names[i]);
+    free(cs->names);
+    free(cs->results);
+    free(cs->needle);
+    free(cs->root);
+    filter_set_free(&cs->filters);
+    if (cs->rootfd >= 0) close(cs->rootfd);
+    free(cs);
+}
+
+// Queue a path for the workers, waiting for room. Takes ownership; returns -1 when cancelled.
+int search_push(void *ctx, char *path) {
+    ContentSearch *cs = (ContentSearch *)ctx;
+    pthread_mutex_lock(&cs->lock);
+    while (!cs->cancel && cs->queued == SEARCH_QUEUE_SIZE) pthread_cond_wait(&cs->cond, &cs->lock);
+    int cancel = cs->cancel;
+    if (!cancel) {
+        cs->queue[(cs->head + cs->queued) % SEARCH_QUEUE_SIZE] = path;
+        cs->queued++;
+        pthread_cond_broadcast(&cs->cond);
+    }
+    pthread_mutex_unlock(&cs->lock);
+    if (cancel) free(path);
+    return cancel ? -1 : 0;
+}
+
+// Depth-first walk below the root, handing each matching file to `visit`. Hidden folders
+// (.git, .cache) and symlinks are not followed, so the walk cannot loop.
+void search_walk(ContentSearch *cs, int (*visit)(void *ctx, char *path), void *ctx) {
+    char **stack = NULL;
+    int depth = 0, capacity = 0;
+    char *start = strdup("");
+    if (!start) return;
+    stack = (char **)malloc(sizeof(char *));
+    if (!stack) {
+        free(start);
+        return;
+    }
+    stack[depth++] = start;
+    capacity = 1;
+
+    char path[MAX_PATH_LEN];
+    while (depth > 0) {
+        char *dir = stack[--depth];
+        int fd = openat(cs->rootfd, dir[0] ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+        if (!d && fd >= 0) close(fd);
+        struct dirent *e;
+        while (d && !cs->cancel && (e = readdir(d)) != NULL) {
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+            int type = e->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+            }
+            if (snprintf(path, sizeof(path), "%s%s%s", dir, dir[0] ? "/" : "", e->d_name) >= (int)sizeof(path)) continue;
+            if (type == DT_DIR && e->d_name[0] != '.') {
+                if (depth == capacity) {
+                    int cap = capacity * 2;
+                    char **grown = (char **)realloc(stack, (size_t)cap * sizeof(char *));
+                    if (!grown) continue;
+                    stack = grown;
+                    capacity = cap;
+                }
+                char *sub = strdup(path);
+                if (sub) stack[depth++] = sub;
+            } else if (type == DT_REG && filter_set_match(&cs->filters, e->d_name)) {
+                char *file = strdup(path);
+                if (file && visit(ctx, file) < 0) break;
+            }
+        }
+        if (d) closedir(d);
+        free(dir);
+        if (cs->cancel) break;
+    }
+    while (depth > 0) free(stack[--depth]);
+    free(stack);
+}
+
+void duplicates_find(ContentSearch *cs);
+
+void *search_producer(void *arg) {
+    ContentSearch *cs = (ContentSearch *)arg;
+    io_inject_latency();
+    cs->rootfd = open(cs->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cs->rootfd < 0) {
+        cs->rootError = errno;
+    } else if (!cs->needle) {
+        duplicates_find(cs);
+    } else if (cs->recursive) {
+        search_walk(cs, search_push, cs);
+    } else {
+        for (int i = 0; i < cs->nameCount; i++) {
+            char *name = cs->names[i];
+            cs->names[i] = NULL;
+            if (search_push(cs, name) < 0) break;
+        }
+    }
+    pthread_mutex_lock(&cs->lock);
+    cs->producerDone = 1;
+    int last = !cs->needle && --cs->workersLeft == 0;    // a duplicate search has no other workers
+    if (last) cs->elapsed = monotonic_seconds() - cs->started;
+    pthread_cond_broadcast(&cs->cond);
+    pthread_mutex_unlock(&cs->lock);
+    if (last) wake_ui();
+    content_search_release(cs);
+    return NULL;
+}
+
+typedef struct {
+    ContentSearch *cs;
+    const unsigned char *data;
+    size_t len;
+    int hits;
+} SearchScan;
+
+void search_scan(void *ctx) {
+    SearchScan *s = (SearchScan *)ctx;
+    s->hits = -1;
+    if (!memchr(s->data, 0, s->len < SEARCH_SNIFF_BYTES ? s->len : SEARCH_SNIFF_BYTES)) {
+        size_t n = count_matches(s->data, s->len, (const unsigned char *)s->cs->needle, s->cs->nlen, s->cs->wide);
+        s->hits = n > INT_MAX ? INT_MAX : (int)n;
+    }
+}
+
+// Search one file. Returns the hit count, or -1 if it was skipped.
+int search_file(ContentSearch *cs, const char *path, unsigned char **buf, size_t *bufSize, struct stat *st) {
+    int fd = openat(cs->rootfd, path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd < 0 && errno == EPERM) fd = openat(cs->rootfd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (fstat(fd, st) < 0 || !S_ISREG(st->st_mode)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t len = (size_t)st->st_size;
+    const unsigned char *data = NULL;
+    void *map = NULL;
+    if (len <= SEARCH_READ_MAX) {
+        if (*bufSize < SEARCH_READ_MAX) {
+            unsigned char *grown = (unsigned char *)realloc(*buf, SEARCH_READ_MAX);
+            if (!grown) {
+                close(fd);
+                return -1;
+            }
+            *buf = grown;
+            *bufSize = SEARCH_READ_MAX;
+        }
+        ssize_t n = len ? pread(fd, *buf, len, 0) : 0;
+        if (n < 0) {
+            close(fd);
+            return -1;
+        }
+        len = (size_t)n;
+        data = *buf;
+    } else {
+        map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+        data = (const unsigned char *)map;
+    }
+    close(fd);
+
+    SearchScan scan = { cs, data, len, -1 };
+    int truncated = 0;
+    if (map) truncated = guarded_scan(search_scan, &scan) < 0;
+    else search_scan(&scan);
+    int hits = truncated ? -1 : scan.hits;
+    if (map) munmap(map, len);
+
+    pthread_mutex_lock(&cs->lock);
+    if (hits < 0 && !truncated) cs->binarySkipped++;
+    else if (hits >= 0) cs->bytesSearched += len;
+    pthread_mutex_unlock(&cs->lock);
+    return hits;
+}
+
+void *search_worker(void *arg) {
+    ContentSearch *cs = (ContentSearch *)arg;
+    unsigned char *buf = NULL;
+    size_t bufSize = 0;
+
+    pthread_mutex_lock(&cs->lock);
+    for (;;) {
+        while (!cs->cancel && cs->queued == 0 && !cs->producerDone) pthread_cond_wait(&cs->cond, &cs->lock);
+        if (cs->cancel || cs->queued == 0) break;
+        char *path = cs->queue[cs->head];
+        cs->head = (cs->head + 1) % SEARCH_QUEUE_SIZE;
+        cs->queued--;
+        pthread_cond_broadcast(&cs->cond);
+        pthread_mutex_unlock(&cs->lock);
+
+        struct stat st;
+        int hits = search_file(cs, path, &buf, &bufSize, &st);
+
+        pthread_mutex_lock(&cs->lock);
+        cs->filesSearched++;
+        int wake = cs->filesSearched % SEARCH_WAKE_FILES == 0;
+        if (hits > 0) {
+            if (cs->resultCount == cs->resultCapacity) {
+                int cap = cs->resultCapacity ? cs->resultCapacity * 2 : 64;
+                SearchHit *grown = (SearchHit *)realloc(cs->results, (size_t)cap * sizeof(SearchHit));
+                if (grown) {
+                    cs->results = grown;
+                    cs->resultCapacity = cap;
+                }
+            }
+            if (cs->resultCount < cs->resultCapacity) {
+                SearchHit *h = &cs->results[cs->resultCount++];
+                h->path = path;
+                h->size = (long long)st.st_size;
+                h->mtime = (long long)st.st_mtime;
+                h->mode = st.st_mode;
+                h->hits = hits;
+                path = NULL;
+                cs->filesMatched++;
+                wake = 1;
+            }
+        }
+        free(path);
+        if (wake) wake_ui();
+    }
+    int last = --cs->workersLeft == 0;
+    if (last) cs->elapsed = monotonic_seconds() - cs->started;
+    pthread_mutex_unlock(&cs->lock);
+    if (last) wake_ui();
+
+    free(buf);
+    content_search_release(cs);
+    return NULL;
+}
+
+int search_thread_count() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = (int)(cores > 0 ? cores : 4);
+    return n > SEARCH_MAX_THREADS ? SEARCH_MAX_THREADS : n;
+}
+
+// Start searching dirpath for needle, or for duplicate files if it is NULL: the given
+// files, or everything below it when recursive. The caller holds one reference. Returns
+// NULL only when out of memory or threads.
+ContentSearch *content_search_start(const char *dirpath, const char *needle, int recursive,
+                                    char *const *names, int nameCount, int argc, char *argv[], int filterStart) {
+    ContentSearch *cs = (ContentSearch *)calloc(1, sizeof(ContentSearch));
+    if (!cs) return NULL;
+    pthread_mutex_init(&cs->lock, NULL);
+    pthread_cond_init(&cs->cond, NULL);
+    cs->refs = 1;
+    cs->rootfd = -1;
+    cs->root = strdup(dirpath);
+    cs->needle = needle ? strdup(needle) : NULL;
+    cs->nlen = needle ? strlen(needle) : 0;
+    cs->recursive = recursive;
+    cs->started = monotonic_seconds();
+    filter_set_init(&cs->filters, argc, argv, filterStart);
+#ifdef HAVE_AVX2
+    cs->wide = __builtin_cpu_supports("avx2");
+#endif
+    if (!recursive && nameCount > 0) {
+        cs->names = (char **)calloc((size_t)nameCount, sizeof(char *));
+        for (int i = 0; cs->names && i < nameCount; i++) {
+            cs->names[i] = strdup(names[i]);
+            if (cs->names[i]) cs->nameCount++;
+        }
+    }
+    if (!cs->root || (needle && !cs->needle)) {
+        content_search_release(cs);
+        return NULL;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t tid;
+    int workers = needle ? search_thread_count() : 0;
+    pthread_mutex_lock(&cs->lock);
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&tid, &attr, search_worker, cs) != 0) break;
+        cs->refs++;
+        cs->workersLeft++;
+    }
+    if (!needle) cs->workersLeft = 1;      // the producer, which hashes through its own pool
+    int started = cs->workersLeft > 0 && pthread_create(&tid, &attr, search_producer, cs) == 0;
+    if (started) cs->refs++;
+    else cs->cancel = 1;
+    pthread_cond_broadcast(&cs->cond);
+    pthread_mutex_unlock(&cs->lock);
+    pthread_attr_destroy(&attr);
+    if (!started) {
+        content_search_release(cs);
+        return NULL;
+    }
+    return cs;
+}
+
+// Stop a search and drop the caller's reference; threads still inside a read finish it
+// and then exit
+void content_search_cancel(ContentSearch *cs) {
+    pthread_mutex_lock(&cs->lock);
+    cs->cancel = 1;
+    pthread_cond_broadcast(&cs->cond);
+    pthread_mutex_unlock(&cs->lock);
+    content_search_release(cs);
+}
+
+// Move the results found since the last call into *out (caller frees the array and paths)
+int content_search_take(ContentSearch *cs, SearchHit **out) {
+    pthread_mutex_lock(&cs->lock);
+    int n = cs->resultCount;
+    *out = cs->results;
+    cs->results = NULL;
+    cs->resultCount = cs->resultCapacity = 0;
+    pthread_mutex_unlock(&cs->lock);
+    return n;
+}
+
+// Progress so far; returns 1 once every worker has finished
+int content_search_progress(ContentSearch *cs, unsigned long long *searched, unsigned long long *matched, int *rootError) {
+    pthread_mutex_lock(&cs->lock);
+    if (searched) *searched = cs->filesSearched;
+    if (matched) *matched = cs->filesMatched;
+    if (rootError) *rootError = cs->rootError;
+    int done = cs->workersLeft == 0;
+    pthread_mutex_unlock(&cs->lock);
+    return done;
+}
+
+// --bench-grep TEXT [DIR]: search DIR and everything below it, as Ctrl+Shift+F does,
+// and report the throughput
+int bench_grep(const char *needle, const char *dir) {
+    ContentSearch *cs = content_search_start(dir, needle, 1, NULL, 0, 0, NULL, 0);
+    if (!cs) return 1;
+    int rootError;
+    while (!content_search_progress(cs, NULL, NULL, &rootError)) usleep(1000);
+    if (rootError) {
+        fprintf(stderr, "%s: %s\n", dir, strerror(rootError));
+        content_search_release(cs);
+        return 1;
+    }
+
+    SearchHit *hits;
+    int n = content_search_take(cs, &hits);
+    unsigned long long total = 0;
+    for (int i = 0; i < n; i++) {
+        total += (unsigned long long)hits[i].hits;
+        free(hits[i].path);
+    }
+    free(hits);
+    printf("%llu files searched (%llu binary skipped), %.1f MB in %.3f s = %.0f MB/s, %d threads\n",
+           cs->filesSearched, cs->binarySkipped, cs->bytesSearched / 1048576.0, cs->elapsed,
+           cs->elapsed > 0 ? cs->bytesSearched / 1048576.0 / cs->elapsed : 0.0, search_thread_count());
+    printf("%llu files match, %llu hits\n", cs->filesMatched, total);
+    content_search_release(cs);
+    return 0;
+}
+
+// ============ LINUX DUPLICATE FILES ============
+
+// Ctrl+D: find identical files among the shown ones, or (pressed again) in all subfolders.
+// It runs as a content search job without a needle, so its threads, cancellation and
+// result view are the search's. Files are narrowed in passes that each read more than the
+// last, and only for the files still in question: sizes first (hard links count once),
+// then a hash of the first and last DUP_EDGE_BYTES, then a hash of the whole file. Each
+// pass spreads its files over all cores.
+
+#define DUP_EDGE_BYTES  4096
+#define DUP_CHUNK_BYTES (16 * 1024 * 1024)     // whole-file hashing checks for cancellation this often
+
+#define DUP_SKIP     0      // not a candidate (yet): unique size, unreadable, or an extra hard link
+#define DUP_PARTIAL  1      // hash covers the edges only
+#define DUP_COMPLETE 2      // hash covers the whole file
+
+typedef struct {
+    char *path;             // relative to the search root
+    long long size;
+    long long mtime;
+    unsigned int mode;
+    uint64_t dev, ino;
+    uint64_t hash;
+    int state;
+} DupFile;
+
+typedef struct {
+    ContentSearch *cs;
+    DupFile *files;
+    int *order;             // files this pass works on
+    int count;
+    int next;
+    int pass;               // 0: stat, 1: edges, 2: whole files
+} DupPass;
+
+// ---- xxHash64 (Yann Collet's XXH64, one-shot) ----
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t xxh_read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    return xxh_rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t v) {
+    acc ^= xxh64_round(0, v);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = (const unsigned char *)data, *end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2, v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed, v4 = seed - XXH_PRIME64_1;
+        do {
+            v1 = xxh64_round(v1, xxh_read64(p));
+            v2 = xxh64_round(v2, xxh_read64(p + 8));
+            v3 = xxh64_round(v3, xxh_read64(p + 16));
+            v4 = xxh64_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+        h = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+        h = xxh64_merge(xxh64_merge(xxh64_merge(xxh64_merge(h, v1), v2), v3), v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t)len;
+    for (; p + 8 <= end; p += 8) h = xxh_rotl64(h ^ xxh64_round(0, xxh_read64(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    if (p + 4 <= end) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        h = xxh_rotl64(h ^ (uint64_t)v * XXH_PRIME64_1, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) h = xxh_rotl64(h ^ *p * XXH_PRIME64_5, 11) * XXH_PRIME64_1;
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ---- passes ----
+
+int dup_open(ContentSearch *cs, const char *path) {
+    int fd = openat(cs->rootfd, path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd < 0 && errno == EPERM) fd = openat(cs->rootfd, path, O_RDONLY | O_CLOEXEC);
+    return fd;
+}
+
+// Hash of the first and last DUP_EDGE_BYTES; for a file no longer than both, that is all of it
+void dup_hash_edges(ContentSearch *cs, DupFile *f) {
+    unsigned char buf[DUP_EDGE_BYTES];
+    int fd = dup_open(cs, f->path);
+    if (fd < 0) {
+        f->state = DUP_SKIP;
+        return;
+    }
+    size_t size = (size_t)f->size;
+    size_t head = size < DUP_EDGE_BYTES ? size : DUP_EDGE_BYTES;
+    size_t tail = size - head < DUP_EDGE_BYTES ? size - head : DUP_EDGE_BYTES;
+    ssize_t a = pread(fd, buf, head, 0);
+    uint64_t h = a == (ssize_t)head ? xxh64(buf, head, 0) : 0;
+    ssize_t b = tail ? pread(fd, buf, tail, (off_t)(size - tail)) : 0;
+    close(fd);
+    if (a != (ssize_t)head || b != (ssize_t)tail) {
+        f->state = DUP_SKIP;       // unreadable, or shrank under us
+        return;
+    }
+    f->hash = tail ? xxh64(buf, tail, h) : h;
+    f->state = head + tail == size ? DUP_COMPLETE : DUP_PARTIAL;
+    __atomic_fetch_add(&cs->bytesSearched, head + tail, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    ContentSearch *cs;
+    const unsigned char *map;
+    size_t size;
+    size_t done;
+    uint64_t hash;
+} DupHash;
+
+void dup_hash_scan(void *ctx) {
+    DupHash *d = (DupHash *)ctx;
+    while (d->done < d->size && !d->cs->cancel) {
+        size_t n = d->size - d->done < DUP_CHUNK_BYTES ? d->size - d->done : DUP_CHUNK_BYTES;
+        d->hash = xxh64(d->map + d->done, n, d->hash);
+        d->done += n;
+        __atomic_fetch_add(&d->cs->bytesSearched, n, __ATOMIC_RELAXED);
+    }
+}
+
+// Hash of the whole file, chained over DUP_CHUNK_BYTES pieces of a mapping. The mapping is
+// read under the SIGBUS guard: a file truncated since it was sized drops out of the groups.
+void dup_hash_file(ContentSearch *cs, DupFile *f) {
+    int fd = dup_open(cs, f->path);
+    if (fd < 0) {
+        f->state = DUP_SKIP;
+        return;
+    }
+    size_t size = (size_t)f->size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        f->state = DUP_SKIP;
+        return;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    DupHash d = { cs, (const unsigned char *)map, size, 0, 0 };
+    int truncated = guarded_scan(dup_hash_scan, &d) < 0;
+    munmap(map, size);
+    f->hash = d.hash;
+    f->state = !truncated && d.done == size ? DUP_COMPLETE : DUP_SKIP;
+}
+
+void dup_pass_item(void *ctx, int index) {
+    (void)index;
+    DupPass *p = (DupPass *)ctx;
+    ContentSearch *cs = p->cs;
+    for (;;) {
+        int i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+        if (i >= p->count || cs->cancel) break;
+        DupFile *f = &p->files[p->order[i]];
+        if (p->pass == 0) {
+            struct statx stx;
+            if (statx(cs->rootfd, f->path, AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME | STATX_INO,
+                      &stx) == 0 && S_ISREG(stx.stx_mode) && stx.stx_size > 0) {
+                f->size = (long long)stx.stx_size;
+                f->mtime = (long long)stx.stx_mtime.tv_sec;
+                f->mode = stx.stx_mode;
+                f->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+                f->ino = stx.stx_ino;
+                f->state = DUP_PARTIAL;
+            }
+            if (__atomic_add_fetch(&cs->filesSearched, 1, __ATOMIC_RELAXED) % SEARCH_WAKE_FILES == 0) wake_ui();
+        } else {
+            if (p->pass == 1) dup_hash_edges(cs, f);
+            else dup_hash_file(cs, f);
+            if (__atomic_add_fetch(&cs->filesHashed, 1, __ATOMIC_RELAXED) % SEARCH_WAKE_FILES == 0) wake_ui();
+        }
+    }
+}
+
+void dup_run_pass(ContentSearch *cs, DupFile *files, int *order, int count, int pass) {
+    DupPass p = { cs, files, order, count, 0, pass };
+    int threads = search_thread_count();
+    if (count > 0) run_concurrently(threads < count ? threads : count, dup_pass_item, &p);
+}
+
+// Biggest first, then by content: identical files end up next to each other
+int compare_dup_files(const void *a, const void *b) {
+    const DupFile *x = (const DupFile *)a, *y = (const DupFile *)b;
+    if (x->state == DUP_SKIP || y->state == DUP_SKIP) return (x->state == DUP_SKIP) - (y->state == DUP_SKIP);
+    if (x->size != y->size) return x->size > y->size ? -1 : 1;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+// Sort, then keep only files whose size and hash another file shares. Extra links to
+// one inode are dropped; they take no space. Returns the number of files left, which
+// stay at the front; the indexes of those still hashed partially go to `order`.
+int dup_narrow(DupFile *files, int count, int *order, int *orderCount) {
+    if (count > 0) qsort(files, (size_t)count, sizeof(DupFile), compare_dup_files);
+    int kept = 0;
+    *orderCount = 0;
+    for (int i = 0; i < count && files[i].state != DUP_SKIP; ) {
+        int j = i + 1, distinct = 1;
+        while (j < count && files[j].state != DUP_SKIP && files[j].size == files[i].size && files[j].hash == files[i].hash) {
+            if (files[j].dev == files[j - 1].dev && files[j].ino == files[j - 1].ino) files[j].state = DUP_SKIP;
+            else distinct++;
+            j++;
+        }
+        for (int k = i; k < j; k++) {
+            if (distinct < 2 || files[k].state == DUP_SKIP) {
+                free(files[k].path);
+                files[k].path = NULL;
+                continue;
+            }
+            files[kept] = files[k];
+            if (kept != k) files[k].path = NULL;
+            if (files[kept].state == DUP_PARTIAL) order[(*orderCount)++] = kept;
+            kept++;
+        }
+        i = j;
+    }
+    for (int i = kept; i < count; i++) free(files[i].path);
+    return kept;
+}
+
+typedef struct {
+    ContentSearch *cs;
+    DupFile *files;
+    int count;
+    int capacity;
+} DupList;
+
+// Walk visitor: takes ownership of the path
+int dup_collect(void *ctx, char *path) {
+    DupList *list = (DupList *)ctx;
+    if (list->count == list->capacity) {
+        int cap = list->capacity ? list->capacity * 2 : 1024;
+        DupFile *grown = (DupFile *)realloc(list->files, (size_t)cap * sizeof(DupFile));
+        if (!grown) {
+            free(path);
+            return 0;
+        }
+        list->files = grown;
+        list->capacity = cap;
+    }
+    memset(&list->files[list->count], 0, sizeof(DupFile));
+    list->files[list->count++].path = path;
+    return list->cs->cancel ? -1 : 0;
+}
+
+typedef struct {
+    int first, count;
+    long long wasted;
+} DupGroup;
+
+int compare_dup_groups(const void *a, const void *b) {
+    const DupGroup *x = (const DupGroup *)a, *y = (const DupGroup *)b;
+    if (x->wasted != y->wasted) return x->wasted > y->wasted ? -1 : 1;
+    return x->first - y->first;
+}
+
+// Producer side of a duplicate search: collect the files, narrow them down, and hand
+// the groups to the UI, most space wasted first
+void duplicates_find(ContentSearch *cs) {
+    DupList list = { .cs = cs };
+    if (cs->recursive) {
+        search_walk(cs, dup_collect, &list);
+    } else {
+        for (int i = 0; i < cs->nameCount && !cs->cancel; i++) {
+            dup_collect(&list, cs->names[i]);
+            cs->names[i] = NULL;
+        }
+    }
+    DupFile *files = list.files;
+    int count = list.count;
+    int *order = (int *)malloc((size_t)(count ? count : 1) * sizeof(int));
+    DupGroup *groups = NULL;
+    if (!order) goto done;
+
+    for (int i = 0; i < count; i++) order[i] = i;
+    dup_run_pass(cs, files, order, count, 0);
+    int partial;
+    count = dup_narrow(files, count, order, &partial);      // by size
+    __atomic_store_n(&cs->filesToHash, (unsigned long long)count, __ATOMIC_RELAXED);
+    dup_run_pass(cs, files, order, partial, 1);
+    count = dup_narrow(files, count, order, &partial);      // by size and edges
+    __atomic_add_fetch(&cs->filesToHash, (unsigned long long)partial, __ATOMIC_RELAXED);
+    dup_run_pass(cs, files, order, partial, 2);              // biggest first, for an even spread
+    count = dup_narrow(files, count, order, &partial);      // by size and contents
+    if (cs->cancel) goto done;
+
+    size_t slots = count > 0 ? (size_t)count : 1;
+    groups = (DupGroup *)malloc(slots * sizeof(DupGroup));
+    if (!groups) goto done;
+    int groupCount = 0;
+    long long wasted = 0;
+    for (int i = 0; i < count; ) {
+        int j = i + 1;
+        while (j < count && files[j].size == files[i].size && files[j].hash == files[i].hash) j++;
+        groups[groupCount].first = i;
+        groups[groupCount].count = j - i;
+        groups[groupCount].wasted = files[i].size * (j - i - 1);
+        wasted += groups[groupCount++].wasted;
+        i = j;
+    }
+    qsort(groups, (size_t)groupCount, sizeof(DupGroup), compare_dup_groups);
+
+    SearchHit *results = (SearchHit *)malloc(slots * sizeof(SearchHit));
+    if (!results) goto done;
+    int n = 0;
+    for (int g = 0; g < groupCount; g++) {
+        for (int k = groups[g].first; k < groups[g].first + groups[g].count; k++) {
+            SearchHit *h = &results[n++];
+            h->path = files[k].path;
+            h->size = files[k].size;
+            h->mtime = files[k].mtime;
+            h->mode = files[k].mode;
+            h->hits = groups[g].count;
+            h->group = g;
+            files[k].path = NULL;
+        }
+    }
+    pthread_mutex_lock(&cs->lock);
+    free(cs->results);
+    cs->results = results;
+    cs->resultCount = cs->resultCapacity = n;
+    cs->filesMatched = (unsigned long long)n;
+    cs->dupGroups = groupCount;
+    cs->dupWasted = wasted;
+    pthread_mutex_unlock(&cs->lock);
+
+done:
+    for (int i = 0; i < count; i++) free(files[i].path);
+    free(files);
+    free(groups);
+    free(order);
+}
+
+// --bench-dups [DIR]: find the duplicates below DIR, as Ctrl+D pressed twice does, and
+// report how much had to be read
+int bench_dups(const char *dir) {
+    ContentSearch *cs = content_search_start(dir, NULL, 1, NULL, 0, 0, NULL, 0);
+    if (!cs) return 1;
+    int rootError;
+    while (!content_search_progress(cs, NULL, NULL, &rootError)) usleep(1000);
+    if (rootError) {
+        fprintf(stderr, "%s: %s\n", dir, strerror(rootError));
+        content_search_release(cs);
+        return 1;
+    }
+    SearchHit *hits;
+    int n = content_search_take(cs, &hits);
+    for (int i = 0; i < n; i++) free(hits[i].path);
+    free(hits);
+    printf("%llu files, %llu hashed, %.1f MB read in %.3f s, %d threads\n", cs->filesSearched, cs->filesHashed,
+           cs->bytesSearched / 1048576.0, cs->elapsed, search_thread_count());
+    printf("%d duplicate files in %d groups, %.1f MB wasted\n", n, cs->dupGroups, cs->dupWasted / 1048576.0);
+    content_search_release(cs);
+    return 0;
+}
+
+// ============ LINUX FOLDER SIZES ============
+
+// Optional size column for folder rows (Ctrl+Shift+S or BT_DIR_SIZES=1): the allocated size
+// of everything below each folder, like `du -sx`. Every folder of the listing is walked by
+// detached threads sharing one reference-counted job, the same way as a content search, and
+// a new listing cancels the job. Work is a shared stack of folders, so several threads go
+// through one huge folder together. Totals grow as the walk goes; a row turns final when
+// its last subfolder is done. Walks stay on the row's filesystem and do not follow symlinks.
+//
+// Each folder's own share (the folder and the files directly in it) is cached by device,
+// inode and mtime, which changes whenever an entry is added, removed or renamed. A cached
+// folder is still read for its subfolders but its files are not statted again, so a second
+// visit costs one statx per folder instead of one per file. Files that grow in place keep
+// their old size until their folder changes. The cache is kept in
+// ~/.cache/better-toolbar/dirsizes between sessions. Hard links are counted once per folder,
+// but once in every folder that has one.
+
+#define DIRSIZE_MAX_THREADS 16
+#define DIRSIZE_WAKE_DIRS   64                  // progress repaint interval
+#define DIRSIZE_CACHE_MAX   (1024 * 1024)       // cached folders; the table starts over when full
+#define DIRSIZE_LINKS       256                 // hard links remembered per folder
+#define DIRSIZE_MAGIC       "BTDSIZES"
+#define DIRSIZE_VERSION     1
+
+#define DIRSIZE_NONE    0   // not a folder row
+#define DIRSIZE_RUNNING 1
+#define DIRSIZE_DONE    2
+#define DIRSIZE_FAILED  3   // the folder itself could not be read
+
+typedef struct {
+    char *path;
+    int row;
+    int top;                // the row's folder itself: its device bounds the walk
+} DirSizeTask;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int refs;               // live threads plus the UI's reference
+    int cancel;
+    DirSizeTask *tasks;     // stack of folders to read
+    int taskCount;
+    int taskCapacity;
+    int busy;               // workers inside a folder
+    int rows;
+    long long *bytes;       // per row, updated atomically, read by the UI while drawing
+    int *pending;           // per row: folders queued or being read
+    dev_t *dev;
+    unsigned char *state;   // DIRSIZE_*, per row
+    unsigned long long dirsRead;
+} DirSizeJob;
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtimeSec;
+    uint32_t mtimeNsec;
+    uint32_t used;
+    uint64_t ownBytes;
+} DirSizeRecord;
+
+typedef struct {
+    uint32_t count;
+    uint32_t crc;           // zlib crc32 of the records
+} DirSizeFileTail;
+
+typedef struct {
+    pthread_mutex_t lock;
+    DirSizeRecord *table;   // open addressing on (dev, ino)
+    size_t capacity;
+    size_t count;
+    int loaded;
+    int dirty;
+} DirSizeCache;
+
+DirSizeCache g_dirsize_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+typedef struct {
+    int enabled;
+    DirSizeJob *job;        // for the listing on screen, or NULL
+    unsigned long long shownDirs;
+} DirSizes;
+
+DirSizes g_dirsizes;
+
+void dirsizes_init() {
+    g_dirsizes.enabled = getenv("BT_DIR_SIZES") != NULL;
+}
+
+// Path of a file in ~/.cache/better-toolbar (or $XDG_CACHE_HOME), creating the folder
+int app_cache_path(const char *name, char *out, size_t outLen) {
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[MAX_PATH_LEN];
+    if (cache && cache[0] == '/') snprintf(dir, sizeof(dir), "%s/better-toolbar", cache);
+    else if (home) snprintf(dir, sizeof(dir), "%s/.cache/better-toolbar", home);
+    else return 0;
+    make_dirs(dir, 0700);
+    snprintf(out, outLen, "%s/%s", dir, name);
+    return 1;
+}
+
+size_t dirsize_slot(const DirSizeCache *c, uint64_t dev, uint64_t ino) {
+    uint64_t h = (ino ^ (dev << 32) ^ (dev >> 32)) * 0x9E3779B97F4A7C15ULL;
+    size_t i = (size_t)(h >> 20) & (c->capacity - 1);
+    while (c->table[i].used && (c->table[i].dev != dev || c->table[i].ino != ino)) i = (i + 1) & (c->capacity - 1);
+    return i;
+}
+
+// Insert or update under the cache lock; keeps the table at most half full
+void dirsize_cache_put(DirSizeCache *c, const DirSizeRecord *r) {
+    if (c->count + 1 > c->capacity / 2) {
+        size_t cap = c->capacity ? c->capacity * 2 : 4096;
+        DirSizeRecord *old = c->table;
+        size_t oldCap = c->capacity;
+        if (c->count >= DIRSIZE_CACHE_MAX) {
+            memset(c->table, 0, c->capacity * sizeof(DirSizeRecord));
+            c->count = 0;
+        } else {
+            c->table = (DirSizeRecord *)calloc(cap, sizeof(DirSizeRecord));
+            if (!c->table) {
+                c->table = old;
+                return;
+            }
+            c->capacity = cap;
+            c->count = 0;
+            for (size_t i = 0; i < oldCap; i++)
+                if (old[i].used) {
+                    c->table[dirsize_slot(c, old[i].dev, old[i].ino)] = old[i];
+                    c->count++;
+                }
+            free(old);
+        }
+    }
+    size_t i = dirsize_slot(c, r->dev, r->ino);
+    if (!c->table[i].used) c->count++;
+    c->table[i] = *r;
+    c->table[i].used = 1;
+    c->dirty = 1;
+}
+
+// Load the cache file once, from the first worker; a file that does not check out is ignored
+void dirsize_cache_load(DirSizeCache *c) {
+    char path[MAX_PATH_LEN];
+    c->loaded = 1;
+    if (!app_cache_path("dirsizes", path, sizeof(path))) return;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    void *map = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= 16 + (off_t)sizeof(DirSizeFileTail)) {
+        size = (size_t)st.st_size;
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return;
+
+    const unsigned char *data = (const unsigned char *)map;
+    DirSizeFileTail tail;
+    memcpy(&tail, data + size - sizeof(tail), sizeof(tail));
+    uint32_t header[2];
+    memcpy(header, data + 8, sizeof(header));
+    size_t records = size - 16 - sizeof(tail);
+    if (memcmp(data, DIRSIZE_MAGIC, 8) == 0 && header[0] == DIRSIZE_VERSION && header[1] == sizeof(DirSizeRecord) &&
+        records % sizeof(DirSizeRecord) == 0 && records / sizeof(DirSizeRecord) == tail.count &&
+        tail.count <= DIRSIZE_CACHE_MAX && (uint32_t)crc32(0L, data + 16, (uInt)records) == tail.crc) {
+        for (uint32_t i = 0; i < tail.count; i++) {
+            DirSizeRecord r;
+            memcpy(&r, data + 16 + (size_t)i * sizeof(r), sizeof(r));
+            dirsize_cache_put(c, &r);
+        }
+        c->dirty = 0;
+    }
+    munmap(map, size);
+}
+
+// Write the cache for the next session, if this one added to it
+void dirsizes_save() {
+    DirSizeCache *c = &g_dirsize_cache;
+    char path[MAX_PATH_LEN], tmp[MAX_PATH_LEN + 8];
+    pthread_mutex_lock(&c->lock);
+    if (!c->dirty || !app_cache_path("dirsizes", path, sizeof(path))) {
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *out = fopen(tmp, "wb");
+    int ok = out != NULL;
+    if (ok) {
+        uint32_t header[2] = { DIRSIZE_VERSION, (uint32_t)sizeof(DirSizeRecord) };
+        ok = fwrite(DIRSIZE_MAGIC, 1, 8, out) == 8 && fwrite(header, sizeof(header), 1, out) == 1;
+        DirSizeFileTail tail = { 0, (uint32_t)crc32(0L, Z_NULL, 0) };
+        for (size_t i = 0; i < c->capacity && ok; i++) {
+            if (!c->table[i].used) continue;
+            ok = fwrite(&c->table[i], sizeof(DirSizeRecord), 1, out) == 1;
+            tail.crc = (uint32_t)crc32(tail.crc, (const Bytef *)&c->table[i], sizeof(DirSizeRecord));
+            tail.count++;
+        }
+        ok = ok && fwrite(&tail, sizeof(tail), 1, out) == 1;
+        if (fclose(out) != 0) ok = 0;
+    }
+    if (ok && rename(tmp, path) == 0) c->dirty = 0;
+    else if (out) unlink(tmp);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void dirsize_job_release(DirSizeJob *job) {
+    pthread_mutex_lock(&job->lock);
+    int last = --job->refs == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (!last) return;
+    for (int i = 0; i < job->taskCount; i++) free(job->tasks[i].path);
+    free(job->tasks);
+    free(job->bytes);
+    free(job->pending);
+    free(job->dev);
+    free(job->state);
+    free(job);
+}
+
+// Queue a folder under the job lock; counts toward its row until read
+int dirsize_push(DirSizeJob *job, char *path, int row, int top) {
+    if (job->taskCount == job->taskCapacity) {
+        int cap = job->taskCapacity ? job->taskCapacity * 2 : 256;
+        DirSizeTask *grown = (DirSizeTask *)realloc(job->tasks, (size_t)cap * sizeof(DirSizeTask));
+        if (!grown) {
+            free(path);
+            return -1;
+        }
+        job->tasks = grown;
+        job->taskCapacity = cap;
+    }
+    DirSizeTask *t = &job->tasks[job->taskCount++];
+    t->path = path;
+    t->row = row;
+    t->top = top;
+    job->pending[row]++;
+    return 0;
+}
+
+// Read one folder: add its own share to the row, queue its subfolders
+void dirsize_read(DirSizeJob *job, const DirSizeTask *task) {
+    DirSizeCache *c = &g_dirsize_cache;
+    int fd = open(task->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+    struct statx self;
+    if (fd < 0 || statx(fd, "", AT_EMPTY_PATH, STATX_INO | STATX_MTIME | STATX_BLOCKS, &self) < 0) {
+        if (fd >= 0) close(fd);
+        if (task->top) __atomic_store_n(&job->state[task->row], DIRSIZE_FAILED, __ATOMIC_RELAXED);
+        return;
+    }
+    dev_t dev = makedev(self.stx_dev_major, self.stx_dev_minor);
+    if (task->top) job->dev[task->row] = dev;   // nothing else reads it before the subfolders are queued
+    else if (dev != job->dev[task->row]) {      // a mount point below the row
+        close(fd);
+        return;
+    }
+
+    DirSizeRecord key = { (uint64_t)dev, self.stx_ino, self.stx_mtime.tv_sec, self.stx_mtime.tv_nsec, 0, 0 };
+    pthread_mutex_lock(&c->lock);
+    if (!c->loaded) dirsize_cache_load(c);
+    int cached = 0;
+    if (c->capacity) {
+        const DirSizeRecord *r = &c->table[dirsize_slot(c, key.dev, key.ino)];
+        cached = r->used && r->mtimeSec == key.mtimeSec && r->mtimeNsec == key.mtimeNsec;
+        if (cached) key.ownBytes = r->ownBytes;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    unsigned long long own = cached ? key.ownBytes : self.stx_blocks * 512ULL;
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return;
+    }
+    struct dirent *e;
+    char sub[MAX_PATH_LEN];
+    int seen = 0, complete = 1;
+    ino_t links[DIRSIZE_LINKS];     // hard-linked files counted once per folder, like du
+    int linkCount = 0;
+    while ((e = readdir(d)) != NULL) {
+        if ((++seen & 255) == 0 && __atomic_load_n(&job->cancel, __ATOMIC_RELAXED)) {
+            complete = 0;
+            break;
+        }
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        int isDir = e->d_type == DT_DIR;
+        if (e->d_type == DT_UNKNOWN || (!isDir && !cached)) {
+            struct stat st;
+            if (fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+            isDir = S_ISDIR(st.st_mode);
+            int counted = 0;
+            for (int i = 0; i < linkCount && st.st_nlink > 1 && !counted; i++) counted = links[i] == st.st_ino;
+            if (!isDir && !cached && !counted) own += (unsigned long long)st.st_blocks * 512ULL;
+            if (!isDir && st.st_nlink > 1 && !counted && linkCount < DIRSIZE_LINKS) links[linkCount++] = st.st_ino;
+        }
+        if (!isDir) continue;
+        if (snprintf(sub, sizeof(sub), "%s/%s", task->path, e->d_name) >= (int)sizeof(sub)) continue;
+        char *copy = strdup(sub);
+        if (!copy) continue;
+        pthread_mutex_lock(&job->lock);
+        if (dirsize_push(job, copy, task->row, 0) == 0) pthread_cond_signal(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+    }
+    closedir(d);
+
+    __atomic_fetch_add(&job->bytes[task->row], (long long)own, __ATOMIC_RELAXED);
+    if (!cached && complete) {
+        key.ownBytes = own;
+        pthread_mutex_lock(&c->lock);
+        dirsize_cache_put(c, &key);
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+void *dirsize_worker(void *arg) {
+    DirSizeJob *job = (DirSizeJob *)arg;
+    pthread_mutex_lock(&job->lock);
+    for (;;) {
+        while (!job->cancel && job->taskCount == 0 && job->busy > 0) pthread_cond_wait(&job->cond, &job->lock);
+        if (job->cancel || job->taskCount == 0) break;
+        DirSizeTask task = job->tasks[--job->taskCount];
+        job->busy++;
+        pthread_mutex_unlock(&job->lock);
+
+        io_inject_latency();
+        dirsize_read(job, &task);
+        free(task.path);
+
+        pthread_mutex_lock(&job->lock);
+        job->busy--;
+        int wake = __atomic_add_fetch(&job->dirsRead, 1, __ATOMIC_RELAXED) % DIRSIZE_WAKE_DIRS == 0;
+        if (--job->pending[task.row] == 0) {
+            if (job->state[task.row] == DIRSIZE_RUNNING)
+                __atomic_store_n(&job->state[task.row], DIRSIZE_DONE, __ATOMIC_RELEASE);
+            wake = 1;
+        }
+        if (job->taskCount == 0 && job->busy == 0) pthread_cond_broadcast(&job->cond);
+        if (wake) wake_ui();
+    }
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+    dirsize_job_release(job);
+    return NULL;
+}
+
+// Stop the walk for the listing that is going away; threads in a folder finish it and exit
+void dirsizes_cancel() {
+    DirSizeJob *job = g_dirsizes.job;
+    if (!job) return;
+    g_dirsizes.job = NULL;
+    pthread_mutex_lock(&job->lock);
+    job->cancel = 1;
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+    dirsize_job_release(job);
+}
+
+int search_thread_count();
+
+// Start sizing the folder rows among `rows` whose full paths are given (NULL for other rows)
+void dirsizes_start(char **paths, int rows) {
+    dirsizes_cancel();
+    if (!g_dirsizes.enabled) return;
+    DirSizeJob *job = (DirSizeJob *)calloc(1, sizeof(DirSizeJob));
+    if (!job) return;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cond, NULL);
+    job->refs = 1;
+    job->rows = rows;
+    job->bytes = (long long *)calloc((size_t)rows + 1, sizeof(long long));
+    job->pending = (int *)calloc((size_t)rows + 1, sizeof(int));
+    job->dev = (dev_t *)calloc((size_t)rows + 1, sizeof(dev_t));
+    job->state = (unsigned char *)calloc((size_t)rows + 1, 1);
+    if (!job->bytes || !job->pending || !job->dev || !job->state) {
+        dirsize_job_release(job);
+        return;
+    }
+    // Pushed last = read first, so rows fill in from the top
+    for (int row = rows - 1; row >= 0; row--) {
+        if (!paths[row]) continue;
+        if (dirsize_push(job, paths[row], row, 1) < 0) break;
+        paths[row] = NULL;
+        job->state[row] = DIRSIZE_RUNNING;
+    }
+    g_dirsizes.job = job;
+    g_dirsizes.shownDirs = 0;
+    if (job->taskCount == 0) return;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t tid;
+    int workers = search_thread_count();
+    if (workers > DIRSIZE_MAX_THREADS) workers = DIRSIZE_MAX_THREADS;
+    pthread_mutex_lock(&job->lock);
+    for (int i = 0; i < workers; i++)
+        if (pthread_create(&tid, &attr, dirsize_worker, job) == 0) job->refs++;
+    pthread_mutex_unlock(&job->lock);
+    pthread_attr_destroy(&attr);
+}
+
+// 1 if the walk moved on since the last call, to repaint the sizes
+int dirsizes_progress() {
+    DirSizeJob *job = g_dirsizes.job;
+    if (!job) return 0;
+    unsigned long long n = __atomic_load_n(&job->dirsRead, __ATOMIC_RELAXED);
+    int changed = n != g_dirsizes.shownDirs;
+    g_dirsizes.shownDirs = n;
+    return changed;
+}
+
+// Size of a folder row so far: DIRSIZE_RUNNING or DIRSIZE_DONE with *bytes set, or the
+// state telling there is nothing to show
+int dirsizes_get(int row, long long *bytes) {
+    DirSizeJob *job = g_dirsizes.job;
+    if (!job || row >= job->rows) return DIRSIZE_NONE;
+    int state = __atomic_load_n(&job->state[row], __ATOMIC_ACQUIRE);
+    *bytes = __atomic_load_n(&job->bytes[row], __ATOMIC_RELAXED);
+    return state;
+}
+
+// ============ LINUX CHILD COUNTS ============
+
+// Folder rows show how many entries they hold ("24 items", "10k+ items"). A probe opens the
+// folder and counts getdents64 records in a fixed buffer, so no name is copied or allocated,
+// and gives up at CHILDREN_CAP. Only rows on screen and a screen either side are probed,
+// on a few worker threads fed from a LIFO queue like the thumbnail decoders: the rows asked
+// for last go first, and the oldest request is dropped when the queue is full. Drawing only
+// looks up the cache, so it never waits for a probe. Counts are cached by path and trusted
+// while the folder's mtime, which changes whenever an entry is added, removed or renamed,
+// stays what it was. BT_CHILD_COUNTS=0 turns them off.
+
+#define CHILDREN_CAP          10000
+#define CHILDREN_THREADS      4
+#define CHILDREN_QUEUE_SIZE   256
+#define CHILDREN_HASH_BUCKETS 4096
+#define CHILDREN_MAX_ENTRIES  65536             // the cache starts over past this
+#define CHILDREN_BUF_BYTES    32768
+
+#define CHILDREN_NONE    0
+#define CHILDREN_PENDING 1
+#define CHILDREN_READY   2
+#define CHILDREN_FAILED  3
+
+typedef struct ChildCount {
+    char *path;
+    long long mtime;
+    unsigned hash;
+    int state;
+    int count;
+    struct ChildCount *hashNext;
+} ChildCount;
+
+typedef struct {
+    char *path;
+    long long mtime;
+    int count;              // result: entries, or -1 if the folder could not be read
+} ChildJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t threads[CHILDREN_THREADS];
+    int threadCount;        // started with the first request
+    int shutdown;
+    ChildJob queue[CHILDREN_QUEUE_SIZE];
+    int queued;
+    ChildJob *results;
+    int resultCount, resultCapacity;
+
+    // Owned by the UI thread
+    ChildCount *buckets[CHILDREN_HASH_BUCKETS];
+    int entryCount;
+    int enabled;
+} ChildCounts;
+
+ChildCounts g_children = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+void children_init() {
+    const char *v = getenv("BT_CHILD_COUNTS");
+    g_children.enabled = !v || strcmp(v, "0") != 0;
+}
+
+// Entries in a folder, "." and ".." aside, up to CHILDREN_CAP; -1 if it cannot be read
+int children_probe(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    char buf[CHILDREN_BUF_BYTES] __attribute__((aligned(8)));
+    int count = 0;
+    long n = 0;
+    while (count < CHILDREN_CAP && (n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        for (long off = 0; off < n; ) {
+            const struct dirent64 *e = (const struct dirent64 *)(buf + off);
+            const char *name = e->d_name;
+            if (!(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))) count++;
+            off += e->d_reclen;
+        }
+    }
+    close(fd);
+    if (n < 0 && count == 0) return -1;
+    return count < CHILDREN_CAP ? count : CHILDREN_CAP;
+}
+
+void *children_worker(void *arg) {
+    ChildCounts *cc = (ChildCounts *)arg;
+    pthread_mutex_lock(&cc->lock);
+    for (;;) {
+        while (!cc->shutdown && cc->queued == 0) pthread_cond_wait(&cc->cond, &cc->lock);
+        if (cc->shutdown) break;
+        ChildJob job = cc->queue[--cc->queued];
+        pthread_mutex_unlock(&cc->lock);
+
+        io_inject_latency();
+        job.count = children_probe(job.path);
+
+        pthread_mutex_lock(&cc->lock);
+        if (cc->resultCount == cc->resultCapacity) {
+            int cap = cc->resultCapacity ? cc->resultCapacity * 2 : 64;
+            ChildJob *grown = (ChildJob *)realloc(cc->results, (size_t)cap * sizeof(ChildJob));
+            if (!grown) {
+                free(job.path);     // stays pending until the cache starts over
+                continue;
+            }
+            cc->results = grown;
+            cc->resultCapacity = cap;
+        }
+        cc->results[cc->resultCount++] = job;
+        wake_ui();
+    }
+    pthread_mutex_unlock(&cc->lock);
+    return NULL;
+}
+
+ChildCount *children_find(ChildCounts *cc, const char *path, unsigned h) {
+    ChildCount *e = cc->buckets[h % CHILDREN_HASH_BUCKETS];
+    while (e && (e->hash != h || strcmp(e->path, path) != 0)) e = e->hashNext;
+    return e;
+}
+
+void children_clear(ChildCounts *cc) {
+    for (int b = 0; b < CHILDREN_HASH_BUCKETS; b++) {
+        while (cc->buckets[b]) {
+            ChildCount *e = cc->buckets[b];
+            cc->buckets[b] = e->hashNext;
+            free(e->path);
+            free(e);
+        }
+    }
+    cc->entryCount = 0;
+}
+
+// Cached count of the folder at path as of mtime, queueing a probe if there is none yet.
+// Returns the entry once counted, NULL until then.
+ChildCount *children_get(const char *path, long long mtime) {
+    ChildCounts *cc = &g_children;
+    if (!cc->enabled) return NULL;
+    unsigned h = hash_string(path);
+    ChildCount *e = children_find(cc, path, h);
+    if (e && e->mtime != mtime && e->state != CHILDREN_PENDING) {
+        e->state = CHILDREN_NONE;   // entries came or went since it was counted
+        e->mtime = mtime;
+    }
+    if (!e) {
+        if (cc->entryCount >= CHILDREN_MAX_ENTRIES) children_clear(cc);
+        e = (ChildCount *)calloc(1, sizeof(ChildCount));
+        if (!e || !(e->path = strdup(path))) {
+            free(e);
+            return NULL;
+        }
+        e->mtime = mtime;
+        e->hash = h;
+        e->hashNext = cc->buckets[h % CHILDREN_HASH_BUCKETS];
+        cc->buckets[h % CHILDREN_HASH_BUCKETS] = e;
+        cc->entryCount++;
+    }
+
+    if (e->state == CHILDREN_NONE) {
+        char *jobPath = strdup(path);
+        if (!jobPath) return NULL;
+        pthread_mutex_lock(&cc->lock);
+        if (cc->threadCount == 0) {
+            for (int i = 0; i < CHILDREN_THREADS; i++)
+                if (pthread_create(&cc->threads[cc->threadCount], NULL, children_worker, cc) == 0)
+                    cc->threadCount++;
+        }
+        if (cc->queued == CHILDREN_QUEUE_SIZE) {
+            // Drop the request made longest ago; its row asks again if it comes back into view
+            ChildCount *old = children_find(cc, cc->queue[0].path, hash_string(cc->queue[0].path));
+            if (old && old->state == CHILDREN_PENDING) old->state = CHILDREN_NONE;
+            free(cc->queue[0].path);
+            memmove(&cc->queue[0], &cc->queue[1], (CHILDREN_QUEUE_SIZE - 1) * sizeof(ChildJob));
+            cc->queued--;
+        }
+        ChildJob *job = &cc->queue[cc->queued++];
+        job->path = jobPath;
+        job->mtime = mtime;
+        job->count = 0;
+        e->state = CHILDREN_PENDING;
+        pthread_cond_signal(&cc->cond);
+        pthread_mutex_unlock(&cc->lock);
+    }
+    return e->state == CHILDREN_READY ? e : NULL;
+}
+
+// Store finished probes. Returns 1 if any count arrived.
+int children_apply_results() {
+    ChildCounts *cc = &g_children;
+    if (!cc->threadCount) return 0;
+    pthread_mutex_lock(&cc->lock);
+    int n = cc->resultCount;
+    ChildJob *results = cc->results;
+    cc->results = NULL;
+    cc->resultCount = cc->resultCapacity = 0;
+    pthread_mutex_unlock(&cc->lock);
+
+    int changed = 0;
+    for (int i = 0; i < n; i++) {
+        ChildJob *r = &results[i];
+        ChildCount *e = children_find(cc, r->path, hash_string(r->path));
+        if (e && e->state == CHILDREN_PENDING) {
+            // Counted for an older mtime: count again when the row is next drawn
+            e->state = e->mtime != r->mtime ? CHILDREN_NONE : r->count < 0 ? CHILDREN_FAILED : CHILDREN_READY;
+            e->count = r->count;
+            changed = 1;
+        }
+        free(r->path);
+    }
+    free(results);
+    return changed;
+}
+
+void children_shutdown() {
+    ChildCounts *cc = &g_children;
+    pthread_mutex_lock(&cc->lock);
+    cc->shutdown = 1;
+    pthread_cond_broadcast(&cc->cond);
+    pthread_mutex_unlock(&cc->lock);
+    int stuck = 0;
+    for (int i = 0; i < cc->threadCount; i++)
+        if (join_with_timeout(cc->threads[i], 0.2) != 0) stuck = 1;
+    cc->threadCount = 0;
+    if (stuck) return;  // a probe is blocked reading a folder and still uses the queue
+
+    for (int i = 0; i < cc->queued; i++) free(cc->queue[i].path);
+    cc->queued = 0;
+    for (int i = 0; i < cc->resultCount; i++) free(cc->results[i].path);
+    free(cc->results);
+    cc->results = NULL;
+    cc->resultCount = cc->resultCapacity = 0;
+    children_clear(cc);
+}
+
+// ============ LINUX GIT STATUS ============
+
+// Rows of a folder inside a git work tree get a mark: modified, untracked or ignored. No git
+// process is run; .git/index is mapped and parsed here, the same way git decides a file is
+// unchanged: its ctime/mtime, size, inode and mode still match what the index recorded when
+// it was staged. Only the index entries below the folder on screen are looked at (they are
+// one contiguous, sorted range), so a big repository costs no more than a small one.
+// Parsed indexes are kept while the index file's mtime and size stay the same.
+//
+// One detached thread per listing does the work after the listing is on screen, files first,
+// then folders (a folder is modified if any tracked file below it is, up to a budget of
+// stats). Files git would re-hash to confirm (a touched but unchanged file) show as
+// modified. Untracked files inside tracked subfolders are not searched for.
+// BT_GIT_STATUS=0 turns the marks off.
+
+#define GIT_NONE      0     // not in a work tree, or not known yet
+#define GIT_CLEAN     1
+#define GIT_MODIFIED  2
+#define GIT_UNTRACKED 3
+#define GIT_IGNORED   4
+
+#define GIT_INDEX_CACHE   4         // parsed indexes kept
+#define GIT_STAT_BUDGET   20000     // tracked files statted for the folder rows of one listing
+#define GIT_WAKE_ROWS     256       // progress repaint interval
+#define GIT_MAX_DEPTH     64        // folders between the listing and its work tree root
+
+#define GIT_FLAG_EXTENDED     0x4000
+#define GIT_FLAG_STAGE        0x3000
+#define GIT_FLAG_ASSUME_VALID 0x8000
+#define GIT_XFLAG_SKIP_WORKTREE 0x4000
+
+typedef struct {
+    const char *name;       // path from the work tree root, not NUL-terminated
+    uint32_t nameLen;
+    uint32_t ctimeSec, ctimeNsec, mtimeSec, mtimeNsec;
+    uint32_t ino, mode, size;
+    uint16_t flags;
+    uint16_t xflags;
+} GitIndexEntry;
+
+typedef struct {
+    int refs;
+    char path[MAX_PATH_LEN];    // the index file
+    int64_t mtimeSec;
+    uint32_t mtimeNsec;
+    int64_t size;
+    void *map;
+    size_t mapSize;
+    char *names;                // version 4: names expanded from their prefix compression
+    GitIndexEntry *entries;     // in index order: sorted by name, then stage
+    int count;
+} GitIndex;
+
+typedef struct {
+    pthread_mutex_t lock;
+    GitIndex *slots[GIT_INDEX_CACHE];
+    unsigned next;
+} GitIndexCache;
+
+GitIndexCache g_git_indexes = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+typedef struct {
+    char *pattern;
+    const char *base;       // the rule applies below this work tree path ("" or "sub/dir/")
+    size_t baseLen;
+    int negate;
+    int dirOnly;
+    int anchored;           // had a '/' before its end: matched against the path below base
+} GitIgnoreRule;
+
+typedef struct {
+    GitIgnoreRule *rules;
+    int count;
+    int capacity;
+    char *bases[GIT_MAX_DEPTH + 2];
+    int baseCount;
+} GitIgnore;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int refs;
+    int cancel;
+    char dir[MAX_PATH_LEN];
+    char **names;           // into nameBlob
+    char *nameBlob;
+    unsigned char *isDir;
+    int rows;
+    unsigned char *state;   // GIT_*, per row, read by the UI while drawing
+    unsigned long long rowsDone;
+} GitStatusJob;
+
+typedef struct {
+    int enabled;
+    GitStatusJob *job;      // for the listing on screen, or NULL
+    unsigned long long shownRows;
+} GitStatus;
+
+GitStatus g_git_status;
+
+void git_status_init() {
+    const char *v = getenv("BT_GIT_STATUS");
+    g_git_status.enabled = !v || strcmp(v, "0") != 0;
+}
+
+uint32_t git_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void git_index_release(GitIndex *ix) {
+    if (!ix) return;
+    pthread_mutex_lock(&g_git_indexes.lock);
+    int last = --ix->refs == 0;
+    pthread_mutex_unlock(&g_git_indexes.lock);
+    if (!last) return;
+    if (ix->map) munmap(ix->map, ix->mapSize);
+    free(ix->names);
+    free(ix->entries);
+    free(ix);
+}
+
+// Parse a mapped index file (versions 2 to 4). hashLen is 20 for SHA-1 repositories,
+// 32 for SHA-256 ones. Returns 0, or -1 if the file is not an index or is cut short.
+int git_index_parse(GitIndex *ix, size_t hashLen) {
+    const unsigned char *p = (const unsigned char *)ix->map;
+    size_t size = ix->mapSize;
+    if (size < 12 + hashLen || memcmp(p, "DIRC", 4) != 0) return -1;
+    uint32_t version = git_be32(p + 4);
+    uint32_t count = git_be32(p + 8);
+    if (version < 2 || version > 4 || count > size / 40) return -1;
+    ix->entries = (GitIndexEntry *)calloc(count ? count : 1, sizeof(GitIndexEntry));
+    if (!ix->entries) return -1;
+
+    // Version 4 names are the previous name minus N trailing bytes, plus a suffix
+    size_t namesCap = 0, namesLen = 0;
+    const char *prev = "";
+    size_t prevLen = 0;
+    size_t fixed = 40 + hashLen + 2;        // stat data, object id, flags
+    size_t end = size - hashLen;            // the checksum trails the file
+    size_t off = 12;
+    for (uint32_t i = 0; i < count; i++) {
+        if (off + fixed > end) return -1;
+        const unsigned char *e = p + off;
+        GitIndexEntry *out = &ix->entries[i];
+        out->ctimeSec = git_be32(e);
+        out->ctimeNsec = git_be32(e + 4);
+        out->mtimeSec = git_be32(e + 8);
+        out->mtimeNsec = git_be32(e + 12);
+        out->ino = git_be32(e + 20);
+        out->mode = git_be32(e + 24);
+        out->size = git_be32(e + 36);
+        out->flags = (uint16_t)((e[40 + hashLen] << 8) | e[41 + hashLen]);
+        if (S_ISDIR(out->mode)) return -1;          // sparse index: a whole folder in one entry
+        size_t at = off + fixed;
+        if ((out->flags & GIT_FLAG_EXTENDED) && version >= 3) {
+            if (at + 2 > end) return -1;
+            out->xflags = (uint16_t)((p[at] << 8) | p[at + 1]);
+            at += 2;
+        }
+
+        if (version < 4) {
+            const unsigned char *nul = (const unsigned char *)memchr(p + at, '\0', end - at);
+            if (!nul) return -1;
+            out->name = (const char *)p + at;
+            out->nameLen = (uint32_t)(nul - (p + at));
+            // Padded with NULs to a multiple of 8 bytes from the start of the entry
+            off = (at + out->nameLen + 8 - off) / 8 * 8 + off;
+        } else {
+            size_t strip = 0;
+            int shift = 0;
+            for (;;) {
+                if (at >= end || shift > 28) return -1;
+                unsigned char byte = p[at++];
+                strip = (strip << 7) | (byte & 0x7F);   // git's offset varint: each continuation adds one
+                if (!(byte & 0x80)) break;
+                strip++;
+                shift += 7;
+            }
+            const unsigned char *nul = (const unsigned char *)memchr(p + at, '\0', end - at);
+            if (!nul || strip > prevLen) return -1;
+            size_t suffixLen = (size_t)(nul - (p + at));
+            size_t len = prevLen - strip + suffixLen;
+            if (namesLen + len + 1 > namesCap) {
+                size_t cap = namesCap ? namesCap * 2 : 64 * 1024;
+                while (cap < namesLen + len + 1) cap *= 2;
+                char *grown = (char *)realloc(ix->names, cap);
+                if (!grown) return -1;
+                // Names are stored as offsets until the buffer stops moving
+                ix->names = grown;
+                namesCap = cap;
+                if (i > 0) prev = ix->names + (size_t)(intptr_t)ix->entries[i - 1].name;
+            }
+            char *dst = ix->names + namesLen;
+            memmove(dst, prev, prevLen - strip);
+            memcpy(dst + prevLen - strip, p + at, suffixLen);
+            dst[len] = '\0';
+            out->name = (const char *)(intptr_t)namesLen;
+            out->nameLen = (uint32_t)len;
+            prev = dst;
+            prevLen = len;
+            namesLen += len + 1;
+            off = (size_t)(nul - p) + 1;
+        }
+    }
+    if (version == 4)
+        for (uint32_t i = 0; i < count; i++) ix->entries[i].name = ix->names + (size_t)(intptr_t)ix->entries[i].name;
+
+    // A split index ("link") keeps most entries in a shared file, and a sparse one ("sdir")
+    // folds whole folders into one entry: either way the entries above are not the full
+    // list, and every missing file would show as untracked
+    while (off + 8 <= end) {
+        if (memcmp(p + off, "link", 4) == 0 || memcmp(p + off, "sdir", 4) == 0) return -1;
+        uint32_t extSize = git_be32(p + off + 4);
+        if (extSize > end - off - 8) break;
+        off += 8 + (size_t)extSize;
+    }
+    ix->count = (int)count;
+    return 0;
+}
+
+// The parsed index of a repository, shared with other listings while the file is unchanged.
+// Release with git_index_release.
+GitIndex *git_index_get(const char *gitDir, size_t hashLen) {
+    char path[MAX_PATH_LEN];
+    if (snprintf(path, sizeof(path), "%s/index", gitDir) >= (int)sizeof(path)) return NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+
+    GitIndexCache *c = &g_git_indexes;
+    pthread_mutex_lock(&c->lock);
+    for (int i = 0; i < GIT_INDEX_CACHE; i++) {
+        GitIndex *ix = c->slots[i];
+        if (ix && strcmp(ix->path, path) == 0 && ix->size == (int64_t)st.st_size &&
+            ix->mtimeSec == (int64_t)st.st_mtim.tv_sec && ix->mtimeNsec == (uint32_t)st.st_mtim.tv_nsec) {
+            ix->refs++;
+            pthread_mutex_unlock(&c->lock);
+            close(fd);
+            return ix;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    GitIndex *ix = (GitIndex *)calloc(1, sizeof(GitIndex));
+    if (!ix) {
+        close(fd);
+        return NULL;
+    }
+    snprintf(ix->path, sizeof(ix->path), "%s", path);
+    ix->mtimeSec = (int64_t)st.st_mtim.tv_sec;
+    ix->mtimeNsec = (uint32_t)st.st_mtim.tv_nsec;
+    ix->size = (int64_t)st.st_size;
+    ix->mapSize = (size_t)st.st_size;
+    ix->map = mmap(NULL, ix->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    ix->refs = 1;
+    if (ix->map == MAP_FAILED) {
+        ix->map = NULL;
+        git_index_release(ix);
+        return NULL;
+    }
+    madvise(ix->map, ix->mapSize, MADV_SEQUENTIAL);
+    if (git_index_parse(ix, hashLen) < 0) {
+        git_index_release(ix);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&c->lock);
+    GitIndex *old = c->slots[c->next % GIT_INDEX_CACHE];
+    c->slots[c->next++ % GIT_INDEX_CACHE] = ix;
+    ix->refs++;                 // the cache's reference
+    pthread_mutex_unlock(&c->lock);
+    git_index_release(old);
+    return ix;
+}
+
+void git_index_cache_free() {
+    for (int i = 0; i < GIT_INDEX_CACHE; i++) {
+        git_index_release(g_git_indexes.slots[i]);
+        g_git_indexes.slots[i] = NULL;
+    }
+}
+
+// Compare a work tree path with an index name the way the index is sorted
+int git_name_cmp(const GitIndexEntry *e, const char *name, size_t len) {
+    size_t n = e->nameLen < len ? e->nameLen : len;
+    int c = memcmp(e->name, name, n);
+    if (c) return c;
+    return e->nameLen < len ? -1 : e->nameLen > len;
+}
+
+// First entry whose name is not below `name` in index order
+int git_lower_bound(const GitIndex *ix, const char *name, size_t len) {
+    int lo = 0, hi = ix->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (git_name_cmp(&ix->entries[mid], name, len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Find the work tree around `dir`: its root, the git dir (.git, or where a .git file points
+// for worktrees and submodules) and the hash length. Returns 0 if `dir` is not in one, or
+// if one of those paths is too long to hold.
+int git_find_repo(const char *dir, char *root, size_t rootLen, char *gitDir, size_t gitDirLen, size_t *hashLen) {
+    char path[MAX_PATH_LEN], dotgit[MAX_PATH_LEN];
+    if (snprintf(path, sizeof(path), "%s", dir) >= (int)sizeof(path)) return 0;
+    for (;;) {
+        struct stat st;
+        if (snprintf(dotgit, sizeof(dotgit), "%s/.git", path[1] ? path : "") >= (int)sizeof(dotgit)) return 0;
+        if (stat(dotgit, &st) == 0) {
+            int n;
+            if (S_ISDIR(st.st_mode)) {
+                n = snprintf(gitDir, gitDirLen, "%s", dotgit);
+            } else {
+                // "gitdir: <path>", relative to the folder holding the file
+                char line[MAX_PATH_LEN];
+                FILE *f = fopen(dotgit, "r");
+                if (!f) return 0;
+                int ok = fgets(line, sizeof(line), f) != NULL && strncmp(line, "gitdir: ", 8) == 0;
+                fclose(f);
+                if (!ok) return 0;
+                line[strcspn(line, "\r\n")] = '\0';
+                if (line[8] == '/') n = snprintf(gitDir, gitDirLen, "%s", line + 8);
+                else n = snprintf(gitDir, gitDirLen, "%s/%s", path[1] ? path : "", line + 8);
+            }
+            if (n >= (int)gitDirLen || snprintf(root, rootLen, "%s", path) >= (int)rootLen) return 0;
+            break;
+        }
+        char *slash = strrchr(path, '/');
+        if (!slash || !path[1]) return 0;
+        if (slash == path) slash[1] = '\0';
+        else *slash = '\0';
+    }
+
+    // extensions.objectFormat = sha256 changes the size of every index entry
+    *hashLen = 20;
+    char config[MAX_PATH_LEN], line[512];
+    if (snprintf(config, sizeof(config), "%s/config", gitDir) >= (int)sizeof(config)) return 0;
+    FILE *f = fopen(config, "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f))
+            if (strcasestr(line, "objectformat") && strstr(line, "sha256")) *hashLen = 32;
+        fclose(f);
+    }
+    return 1;
+}
+
+// Shell-style match as gitignore uses it: '*' and '?' stop at '/', "**" does not
+int git_wildmatch(const char *p, const char *s) {
+    for (; *p; p++, s++) {
+        if (*p == '*') {
+            int any = p[1] == '*';
+            while (*p == '*') p++;
+            if (any && *p == '/' && git_wildmatch(p + 1, s)) return 1;   // "**/" as no folder at all
+            if (!*p) return any || !strchr(s, '/');
+            for (; *s; s++) {
+                if (git_wildmatch(p, s)) return 1;
+                if (*s == '/' && !any) return 0;
+            }
+            return 0;
+        }
+        if (!*s) return 0;
+        if (*p == '?') {
+            if (*s == '/') return 0;
+        } else if (*p == '[') {
+            const char *q = p + 1;
+            int negate = *q == '!' || *q == '^';
+            if (negate) q++;
+            int hit = 0;
+            if (*q == ']') hit |= *s == *q++;
+            for (; *q && *q != ']'; q++) {
+                if (q[1] == '-' && q[2] && q[2] != ']') {
+                    hit |= (unsigned char)*s >= (unsigned char)q[0] && (unsigned char)*s <= (unsigned char)q[2];
+                    q += 2;
+                } else {
+                    hit |= *s == *q;
+                }
+            }
+            if (!*q || hit == negate || *s == '/') return 0;
+            p = q;
+        } else {
+            if (*p == '\\' && p[1]) p++;
+            if (*p != *s) return 0;
+        }
+    }
+    return !*s;
+}
+
+// Add the rules of one ignore file; `base` is the work tree folder it applies to
+void git_ignore_load(GitIgnore *ig, const char *file, const char *base) {
+    FILE *f = fopen(file, "r");
+    if (!f) return;
+    if (ig->baseCount == GIT_MAX_DEPTH + 2 || !(ig->bases[ig->baseCount] = strdup(base))) {
+        fclose(f);
+        return;
+    }
+    const char *kept = ig->bases[ig->baseCount++];
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        // Trailing spaces go unless escaped
+        while (len > 0 && line[len - 1] == ' ' && !(len > 1 && line[len - 2] == '\\')) line[--len] = '\0';
+        char *pat = line;
+        if (!pat[0] || pat[0] == '#') continue;
+        GitIgnoreRule r = { .base = kept, .baseLen = strlen(kept) };
+        if (pat[0] == '!') {
+            r.negate = 1;
+            pat++;
+        } else if (pat[0] == '\\' && (pat[1] == '!' || pat[1] == '#')) {
+            pat++;
+        }
+        len = strlen(pat);
+        if (len > 0 && pat[len - 1] == '/') {
+            r.dirOnly = 1;
+            pat[--len] = '\0';
+        }
+        if (!pat[0]) continue;
+        r.anchored = strchr(pat, '/') != NULL;
+        if (pat[0] == '/') pat++;
+        if (ig->count == ig->capacity) {
+            int cap = ig->capacity ? ig->capacity * 2 : 64;
+            GitIgnoreRule *grown = (GitIgnoreRule *)realloc(ig->rules, (size_t)cap * sizeof(GitIgnoreRule));
+            if (!grown) break;
+            ig->rules = grown;
+            ig->capacity = cap;
+        }
+        if (!(r.pattern = strdup(pat))) break;
+        ig->rules[ig->count++] = r;
+    }
+    fclose(f);
+}
+
+// The global excludes file, info/exclude, then every .gitignore from the root down to `rel`
+// Returns -1 if an ignore file's path is too long to hold: the rules would be incomplete
+int git_ignore_init(GitIgnore *ig, const char *root, const char *gitDir, const char *rel) {
+    memset(ig, 0, sizeof(*ig));
+    char path[MAX_PATH_LEN], base[MAX_PATH_LEN];
+    const char *config = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    int n = 0;
+    if (config && config[0] == '/') n = snprintf(path, sizeof(path), "%s/git/ignore", config);
+    else if (home) n = snprintf(path, sizeof(path), "%s/.config/git/ignore", home);
+    else path[0] = '\0';
+    if (n >= (int)sizeof(path)) return -1;
+    if (path[0]) git_ignore_load(ig, path, "");
+    if (snprintf(path, sizeof(path), "%s/info/exclude", gitDir) >= (int)sizeof(path)) return -1;
+    git_ignore_load(ig, path, "");
+
+    // rel is "" or "a/b/": load "", "a/", "a/b/"
+    size_t len = 0;
+    for (;;) {
+        snprintf(base, sizeof(base), "%.*s", (int)len, rel);
+        if (snprintf(path, sizeof(path), "%s/%s.gitignore", root[1] ? root : "", base) >= (int)sizeof(path)) return -1;
+        git_ignore_load(ig, path, base);
+        const char *slash = strchr(rel + len, '/');
+        if (!slash) break;
+        len = (size_t)(slash - rel) + 1;
+    }
+    return 0;
+}
+
+void git_ignore_free(GitIgnore *ig) {
+    for (int i = 0; i < ig->count; i++) free(ig->rules[i].pattern);
+    for (int i = 0; i < ig->baseCount; i++) free(ig->bases[i]);
+    free(ig->rules);
+}
+
+// Is the work tree path ignored? The last rule that matches decides.
+int git_ignored(const GitIgnore *ig, const char *path, int isDir) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    for (int i = ig->count - 1; i >= 0; i--) {
+        const GitIgnoreRule *r = &ig->rules[i];
+        if (r->dirOnly && !isDir) continue;
+        if (strncmp(path, r->base, r->baseLen) != 0) continue;
+        if (r->anchored ? git_wildmatch(r->pattern, path + r->baseLen) : git_wildmatch(r->pattern, name))
+            return !r->negate;
+    }
+    return 0;
+}
+
+// A folder is ignored if it or any folder above it (below the root) is
+int git_ignored_dir(const GitIgnore *ig, const char *rel) {
+    char path[MAX_PATH_LEN];
+    for (const char *slash = strchr(rel, '/'); slash; slash = strchr(slash + 1, '/')) {
+        snprintf(path, sizeof(path), "%.*s", (int)(slash - rel), rel);
+        if (git_ignored(ig, path, 1)) return 1;
+    }
+    return 0;
+}
+
+// Does the file still match its index entry? Tests what git's stat check does.
+int git_entry_clean(const GitIndexEntry *e, int dirfd, const char *relPath) {
+    if ((e->flags & GIT_FLAG_ASSUME_VALID) || (e->xflags & GIT_XFLAG_SKIP_WORKTREE)) return 1;
+    if (e->flags & GIT_FLAG_STAGE) return 0;                // merge conflict
+    if ((e->mode & 0170000) == 0160000) return 1;           // submodule: its own repository
+    struct statx stx;
+    if (statx(dirfd, relPath, AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS, &stx) < 0) return 0;
+    if ((stx.stx_mode & S_IFMT) != (e->mode & 0170000)) return 0;
+    if (S_ISREG(stx.stx_mode) && ((stx.stx_mode & 0100) != 0) != ((e->mode & 0100) != 0)) return 0;
+    if ((uint32_t)stx.stx_size != e->size) return 0;
+    if ((uint32_t)stx.stx_mtime.tv_sec != e->mtimeSec || (uint32_t)stx.stx_ctime.tv_sec != e->ctimeSec) return 0;
+    // Written with nanoseconds only when git was built with them
+    if (e->mtimeNsec && (uint32_t)stx.stx_mtime.tv_nsec != e->mtimeNsec) return 0;
+    if (e->ctimeNsec && (uint32_t)stx.stx_ctime.tv_nsec != e->ctimeNsec) return 0;
+    if (e->ino && (uint32_t)stx.stx_ino != e->ino) return 0;
+    return 1;
+}
+
+void git_job_release(GitStatusJob *job) {
+    pthread_mutex_lock(&job->lock);
+    int last = --job->refs == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (!last) return;
+    free(job->names);
+    free(job->nameBlob);
+    free(job->isDir);
+    free(job->state);
+    free(job);
+}
+
+int git_job_cancelled(GitStatusJob *job) {
+    return __atomic_load_n(&job->cancel, __ATOMIC_RELAXED);
+}
+
+void git_set_row(GitStatusJob *job, int row, int state) {
+    __atomic_store_n(&job->state[row], (unsigned char)state, __ATOMIC_RELAXED);
+    if (__atomic_add_fetch(&job->rowsDone, 1, __ATOMIC_RELAXED) % GIT_WAKE_ROWS == 0) wake_ui();
+}
+
+void *git_status_worker(void *arg) {
+    GitStatusJob *job = (GitStatusJob *)arg;
+    char root[MAX_PATH_LEN], gitDir[MAX_PATH_LEN], rel[MAX_PATH_LEN], path[MAX_PATH_LEN];
+    size_t hashLen;
+    GitIndex *ix = NULL;
+    GitIgnore ig;
+    memset(&ig, 0, sizeof(ig));
+    int rootfd = -1;
+
+    io_inject_latency();
+    if (!git_find_repo(job->dir, root, sizeof(root), gitDir, sizeof(gitDir), &hashLen)) goto done;
+    // The folder relative to the work tree root, "" or ending in '/'; nothing inside .git itself
+    size_t rootLen = strlen(root);
+    const char *below = job->dir + (root[1] ? rootLen : 0);
+    if (*below == '/') below++;
+    if (snprintf(rel, sizeof(rel), "%s%s", below, below[0] ? "/" : "") >= (int)sizeof(rel)) goto done;
+    if (strncmp(rel, ".git/", 5) == 0) goto done;
+    if (!(ix = git_index_get(gitDir, hashLen))) goto done;
+    rootfd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rootfd < 0) goto done;
+    if (git_ignore_init(&ig, root, gitDir, rel) < 0) goto done;
+    int dirIgnored = git_ignored_dir(&ig, rel);
+
+    // Files: one lookup and one stat each
+    for (int row = 0; row < job->rows && !git_job_cancelled(job); row++) {
+        if (job->isDir[row]) continue;
+        int len = snprintf(path, sizeof(path), "%s%s", rel, job->names[row]);
+        if (len >= (int)sizeof(path)) continue;
+        int i = git_lower_bound(ix, path, (size_t)len);
+        int state;
+        if (i < ix->count && git_name_cmp(&ix->entries[i], path, (size_t)len) == 0) {
+            // Conflicted files have several entries, one per stage
+            int conflict = i + 1 < ix->count && git_name_cmp(&ix->entries[i + 1], path, (size_t)len) == 0;
+            state = !conflict && git_entry_clean(&ix->entries[i], rootfd, path) ? GIT_CLEAN : GIT_MODIFIED;
+        } else {
+            state = dirIgnored || git_ignored(&ig, path, 0) ? GIT_IGNORED : GIT_UNTRACKED;
+        }
+        git_set_row(job, row, state);
+    }
+
+    // Folders: their range of entries, statted until one differs or the budget is spent
+    int budget = GIT_STAT_BUDGET;
+    for (int row = 0; row < job->rows && !git_job_cancelled(job); row++) {
+        if (!job->isDir[row] || (!rel[0] && strcmp(job->names[row], ".git") == 0)) continue;
+        int len = snprintf(path, sizeof(path), "%s%s", rel, job->names[row]);
+        if (len + 1 >= (int)sizeof(path)) continue;     // room for the '/' added below
+        int i = git_lower_bound(ix, path, (size_t)len);
+        if (i < ix->count && git_name_cmp(&ix->entries[i], path, (size_t)len) == 0) {
+            git_set_row(job, row, GIT_CLEAN);               // a submodule
+            continue;
+        }
+        path[len] = '/';
+        path[len + 1] = '\0';
+        i = git_lower_bound(ix, path, (size_t)len + 1);
+        int state = GIT_CLEAN;
+        if (i == ix->count || ix->entries[i].nameLen <= (uint32_t)len + 1 ||
+            memcmp(ix->entries[i].name, path, (size_t)len + 1) != 0) {
+            path[len] = '\0';
+            state = dirIgnored || git_ignored(&ig, path, 1) ? GIT_IGNORED : GIT_UNTRACKED;
+        } else {
+            char entryPath[MAX_PATH_LEN];
+            for (; i < ix->count && state == GIT_CLEAN; i++) {
+                const GitIndexEntry *e = &ix->entries[i];
+                if (e->nameLen <= (uint32_t)len + 1 || memcmp(e->name, path, (size_t)len + 1) != 0) break;
+                if (budget-- <= 0 || git_job_cancelled(job)) {
+                    state = GIT_NONE;
+                    break;
+                }
+                if (e->nameLen >= sizeof(entryPath)) continue;
+                memcpy(entryPath, e->name, e->nameLen);
+                entryPath[e->nameLen] = '\0';
+                if (!git_entry_clean(e, rootfd, entryPath)) state = GIT_MODIFIED;
+            }
+        }
+        git_set_row(job, row, state);
+    }
+
+done:
+    if (rootfd >= 0) close(rootfd);
+    git_ignore_free(&ig);
+    git_index_release(ix);
+    wake_ui();
+    git_job_release(job);
+    return NULL;
+}
+
+// Forget the marks of the listing that is going away; the thread stops at its next row
+void git_status_cancel() {
+    GitStatusJob *job = g_git_status.job;
+    if (!job) return;
+    g_git_status.job = NULL;
+    __atomic_store_n(&job->cancel, 1, __ATOMIC_RELAXED);
+    git_job_release(job);
+}
+
+// Start marking the rows of a folder listing. The names are copied into one block, so
+// the listing can go away while the thread runs.
+void git_status_start(const char *dir, const Listing *l) {
+    git_status_cancel();
+    size_t rows = l->count > 0 ? (size_t)l->count : 0;
+    if (!g_git_status.enabled || rows == 0) return;
+    GitStatusJob *job = (GitStatusJob *)calloc(1, sizeof(GitStatusJob));
+    if (!job) return;
+    pthread_mutex_init(&job->lock, NULL);
+    job->refs = 1;
+    size_t total = 0;
+    for (size_t i = 0; i < rows; i++) total += strlen(l->names[i]) + 1;
+    job->names = (char **)malloc(rows * sizeof(char *));
+    job->nameBlob = (char *)malloc(total);
+    job->isDir = (unsigned char *)malloc(rows);
+    job->state = (unsigned char *)calloc(rows, 1);
+    if (!job->names || !job->nameBlob || !job->isDir || !job->state) {
+        git_job_release(job);
+        return;
+    }
+    char *at = job->nameBlob;
+    for (size_t i = 0; i < rows; i++) {
+        size_t len = strlen(l->names[i]) + 1;
+        memcpy(at, l->names[i], len);
+        job->names[i] = at;
+        job->isDir[i] = (unsigned char)listing_row_is_dir(l, (int)i);
+        at += len;
+    }
+    job->rows = (int)rows;
+    snprintf(job->dir, sizeof(job->dir), "%s", dir);
+    g_git_status.job = job;
+    g_git_status.shownRows = 0;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t tid;
+    pthread_mutex_lock(&job->lock);
+    if (pthread_create(&tid, &attr, git_status_worker, job) == 0) job->refs++;
+    pthread_mutex_unlock(&job->lock);
+    pthread_attr_destroy(&attr);
+}
+
+// 1 if more rows got their mark since the last call, to repaint
+int git_status_progress() {
+    GitStatusJob *job = g_git_status.job;
+    if (!job) return 0;
+    unsigned long long n = __atomic_load_n(&job->rowsDone, __ATOMIC_RELAXED);
+    int changed = n != g_git_status.shownRows;
+    g_git_status.shownRows = n;
+    return changed;
+}
+
+// GIT_* mark of a row of the listing on screen
+int git_status_get(int row) {
+    GitStatusJob *job = g_git_status.job;
+    if (!job || row >= job->rows) return GIT_NONE;
+    return __atomic_load_n(&job->state[row], __ATOMIC_RELAXED);
+}
+
+// ============ LINUX FILE OPERATIONS ============
+
+// Copy, move and move-to-trash for selected rows, on one background thread working through
+// a queue of operations so the window stays responsive. Copies try a reflink (FICLONE)
+// first, then copy_file_range, which stays in the kernel and lets NFS and SMB copy on the
+// server, then plain reads and writes in big chunks. Moves on one filesystem are a single
+// renameat2; across filesystems they copy, then remove the source. Nothing is overwritten:
+// a name that is taken gets " (2)", " (3)"... The trash follows the freedesktop.org spec:
+// ~/.local/share/Trash, or .Trash-<uid> at the top of another filesystem.
+//
+// When an operation finishes, the UI drops and adds the affected rows of the folder on screen
+// in place; the worker sends the new rows' metadata along so they sort in any mode.
+
+#define FILEOP_COPY  1
+#define FILEOP_MOVE  2
+#define FILEOP_TRASH 3
+
+#define FILEOP_CHUNK       (16 * 1024 * 1024)    // copy_file_range per call, between progress updates
+#define FILEOP_BUFFER      (1024 * 1024)         // read/write fallback
+#define FILEOP_WAKE_MS     100                   // progress repaint interval
+#define FILEOP_MAX_DEPTH   128
+
+typedef struct FileOp {
+    struct FileOp *next;
+    int kind;
+    char **sources;             // full paths
+    int count;
+    char destDir[MAX_PATH_LEN]; // copy and move
+
+    // Result, written by the worker before the operation is handed back
+    unsigned char *done;        // per source: it is in place (copied, moved, trashed)
+    char **addedNames;          // entries created in destDir
+    EntryMeta *addedMeta;
+    int addedCount;
+    int failed;                 // sources that could not be done
+    char error[256];            // the first failure
+} FileOp;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int started;
+    int shutdown;
+    FileOp *queue;              // waiting, oldest first
+    FileOp *finished;           // for the UI to apply
+    FileOp *current;            // being worked on (owned by the worker)
+    int queued;
+
+    // Progress of the current operation, written by the worker, read by the UI while drawing
+    int item;                   // source being worked on
+    char name[NAME_MAX + 1];    // under lock
+    long long bytesDone;
+    long long bytesTotal;
+    double lastWake;
+    unsigned long long ticks;   // bumps with every progress update
+    unsigned long long shownTicks;
+} FileOps;
+
+FileOps g_fileops = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+void fileop_free(FileOp *op) {
+    if (!op) return;
+    for (int i = 0; i < op->count; i++) free(op->sources[i]);
+    for (int i = 0; i < op->addedCount; i++) free(op->addedNames[i]);
+    free(op->sources);
+    free(op->done);
+    free(op->addedNames);
+    free(op->addedMeta);
+    free(op);
+}
+
+int fileop_cancelled() {
+    return __atomic_load_n(&g_fileops.shutdown, __ATOMIC_RELAXED);
+}
+
+// Count copied bytes; repaints at most every FILEOP_WAKE_MS
+void fileop_progress(long long bytes) {
+    FileOps *f = &g_fileops;
+    __atomic_add_fetch(&f->bytesDone, bytes, __ATOMIC_RELAXED);
+    double now = monotonic_seconds();
+    if (now - f->lastWake >= FILEOP_WAKE_MS / 1000.0) {
+        f->lastWake = now;
+        __atomic_add_fetch(&f->ticks, 1, __ATOMIC_RELAXED);
+        wake_ui();
+    }
+}
+
+void fileop_fail(FileOp *op, const char *path, int err) {
+    if (op->failed++ == 0) {
+        const char *slash = strrchr(path, '/');
+        snprintf(op->error, sizeof(op->error), "%s: %s", slash ? slash + 1 : path, strerror(err));
+    }
+}
+
+// Bytes a copy of path will write, for the progress bar
+long long fileop_tree_bytes(const char *path, int depth) {
+    struct stat st;
+    if (lstat(path, &st) < 0) return 0;
+    if (!S_ISDIR(st.st_mode)) return S_ISREG(st.st_mode) ? (long long)st.st_size : 0;
+    if (depth >= FILEOP_MAX_DEPTH) return 0;
+    DIR *d = opendir(path);
+    if (!d) return 0;
+    long long total = 0;
+    struct dirent *e;
+    char child[MAX_PATH_LEN];
+    while ((e = readdir(d)) != NULL && !fileop_cancelled()) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        if (snprintf(child, sizeof(child), "%s/%s", path, e->d_name) < (int)sizeof(child))
+            total += fileop_tree_bytes(child, depth + 1);
+    }
+    closedir(d);
+    return total;
+}
+
+// A free name for `name` in dir: the name itself, else "stem (2).ext", "stem (3).ext"...
+int fileop_free_name(const char *dir, const char *name, char *out, size_t outLen) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name) dot = name + strlen(name);
+    char path[MAX_PATH_LEN];
+    struct stat st;
+    for (int n = 1; n < 10000; n++) {
+        if (n == 1) snprintf(out, outLen, "%s", name);
+        else snprintf(out, outLen, "%.*s (%d)%s", (int)(dot - name), name, n, dot);
+        if (snprintf(path, sizeof(path), "%s/%s", dir, out) >= (int)sizeof(path)) return -1;
+        if (lstat(path, &st) < 0 && errno == ENOENT) return 0;
+    }
+    return -1;
+}
+
+// Copy one regular file's data: reflink, else copy_file_range, else read/write
+int fileop_copy_data(int in, int out, long long size) {
+    if (ioctl(out, FICLONE, in) == 0) {
+        fileop_progress(size);
+        return 0;
+    }
+    long long copied = 0;
+    int inKernel = 1;
+    while (copied < size || size == 0) {
+        if (fileop_cancelled()) return ECANCELED;
+        ssize_t n = copy_file_range(in, NULL, out, NULL, FILEOP_CHUNK, 0);
+        if (n < 0 && copied == 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+            inKernel = 0;
+            break;
+        }
+        if (n < 0) return errno;
+        if (n == 0) break;
+        copied += n;
+        fileop_progress(n);
+    }
+    if (inKernel) return 0;
+
+    // Offsets are untouched by a copy_file_range that failed right away
+    char *buf = (char *)malloc(FILEOP_BUFFER);
+    if (!buf) return ENOMEM;
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    int err = 0;
+    for (;;) {
+        if (fileop_cancelled()) {
+            err = ECANCELED;
+            break;
+        }
+        ssize_t n = read(in, buf, FILEOP_BUFFER);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n < 0) err = errno;
+            break;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) {
+                err = errno;
+                break;
+            }
+            off += w;
+        }
+        if (err) break;
+        fileop_progress(n);
+    }
+    free(buf);
+    return err;
+}
+
+int fileop_remove_tree(const char *path, int depth);
+
+// Copy a file, symlink or folder tree to dst, which must not exist. Returns 0 or an errno
+// value; a partly copied tree is removed again.
+int fileop_copy_tree(const char *src, const char *dst, int depth) {
+    struct stat st;
+    if (lstat(src, &st) < 0) return errno;
+    if (fileop_cancelled()) return ECANCELED;
+    int err = 0;
+    if (S_ISLNK(st.st_mode)) {
+        char target[MAX_PATH_LEN];
+        ssize_t n = readlink(src, target, sizeof(target) - 1);
+        if (n < 0) return errno;
+        target[n] = '\0';
+        return symlink(target, dst) < 0 ? errno : 0;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        if (depth >= FILEOP_MAX_DEPTH) return ELOOP;
+        DIR *d = opendir(src);
+        if (!d) return errno;
+        if (mkdir(dst, (st.st_mode & 07777) | S_IRWXU) < 0) {
+            err = errno;
+            closedir(d);
+            return err;
+        }
+        struct dirent *e;
+        char from[MAX_PATH_LEN], to[MAX_PATH_LEN];
+        while (!err && (e = readdir(d)) != NULL) {
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+            if (snprintf(from, sizeof(from), "%s/%s", src, e->d_name) >= (int)sizeof(from) ||
+                snprintf(to, sizeof(to), "%s/%s", dst, e->d_name) >= (int)sizeof(to)) {
+                err = ENAMETOOLONG;
+                break;
+            }
+            err = fileop_copy_tree(from, to, depth + 1);
+        }
+        closedir(d);
+        if (err) {
+            fileop_remove_tree(dst, 0);
+            return err;
+        }
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        utimensat(AT_FDCWD, dst, times, 0);
+        chmod(dst, st.st_mode & 07777);
+        return 0;
+    }
+    if (!S_ISREG(st.st_mode)) return ENOTSUP;    // devices, sockets and pipes stay where they are
+
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return errno;
+    int out = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (out < 0) {
+        err = errno;
+        close(in);
+        return err;
+    }
+    err = fileop_copy_data(in, out, (long long)st.st_size);
+    if (!err) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        futimens(out, times);
+        fchmod(out, st.st_mode & 07777);
+    }
+    if (close(out) < 0 && !err) err = errno;
+    close(in);
+    if (err) unlink(dst);
+    return err;
+}
+
+// Delete a file or a whole folder tree
+int fileop_remove_tree(const char *path, int depth) {
+    struct stat st;
+    if (lstat(path, &st) < 0) return errno;
+    if (!S_ISDIR(st.st_mode)) return unlink(path) < 0 ? errno : 0;
+    if (depth >= FILEOP_MAX_DEPTH) return ELOOP;
+    DIR *d = opendir(path);
+    if (!d) return errno;
+    struct dirent *e;
+    char child[MAX_PATH_LEN];
+    int err = 0;
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        if (snprintf(child, sizeof(child), "%s/%s", path, e->d_name) >= (int)sizeof(child)) {
+            err = ENAMETOOLONG;
+            continue;
+        }
+        int r = fileop_remove_tree(child, depth + 1);
+        if (r && !err) err = r;
+    }
+    closedir(d);
+    if (!err && rmdir(path) < 0) err = errno;
+    return err;
+}
+
+// Move src to dst (which must not exist): one rename on the same filesystem, else copy and delete
+int fileop_move_path(const char *src, const char *dst) {
+    if (renameat2(AT_FDCWD, src, AT_FDCWD, dst, RENAME_NOREPLACE) == 0) return 0;
+    int err = errno;
+    if (err == EINVAL || err == ENOSYS) {
+        // Filesystems without RENAME_NOREPLACE; dst was free a moment ago
+        struct stat st;
+        if (lstat(dst, &st) == 0) return EEXIST;
+        if (rename(src, dst) == 0) return 0;
+        err = errno;
+    }
+    if (err != EXDEV) return err;
+    __atomic_add_fetch(&g_fileops.bytesTotal, fileop_tree_bytes(src, 0), __ATOMIC_RELAXED);
+    err = fileop_copy_tree(src, dst, 0);
+    return err ? err : fileop_remove_tree(src, 0);
+}
+
+// Record an entry the operation created in its destination folder
+void fileop_added(FileOp *op, const char *name) {
+    char path[MAX_PATH_LEN];
+    int fits = snprintf(path, sizeof(path), "%s/%s", op->destDir, name) < (int)sizeof(path);
+    struct statx stx;
+    char *copy = strdup(name);
+    if (!copy) return;
+    int i = op->addedCount++;
+    op->addedNames[i] = copy;
+    memset(&op->addedMeta[i], 0, sizeof(EntryMeta));
+    struct stat lst;
+    int isLink = fits && lstat(path, &lst) == 0 && S_ISLNK(lst.st_mode);
+    if (fits && statx(AT_FDCWD, path, 0, STATX_WANTED, &stx) == 0) meta_from_statx(&op->addedMeta[i], &stx);
+    else op->addedMeta[i].state = META_FAILED;
+    op->addedMeta[i].type = isLink ? ENTRY_TYPE_LINK
+                          : S_ISDIR(op->addedMeta[i].mode) ? ENTRY_TYPE_DIR : ENTRY_TYPE_FILE;
+}
+
+// Percent-encode a path for the Path= line of a .trashinfo file. Returns -1 if it does not fit.
+int fileop_url_escape(const char *in, char *out, size_t outLen) {
+    size_t o = 0;
+    const unsigned char *p = (const unsigned char *)in;
+    for (; *p && o + 4 < outLen; p++) {
+        if (isalnum(*p) || strchr("/-_.~!$&'()*+,;=:@", *p)) out[o++] = (char)*p;
+        else o += (size_t)snprintf(out + o, outLen - o, "%%%02X", *p);
+    }
+    out[o] = '\0';
+    return *p ? -1 : 0;
+}
+
+// The trash folder for a file on device `dev`: <mount point>/.Trash/<uid> or
+// <mount point>/.Trash-<uid> when the file is on another filesystem than the home trash,
+// with topDir set to the mount point (Path= lines are relative to it there). Else, or if
+// neither can be used, the home trash, which a file from elsewhere is copied into.
+// Returns 0, or EXDEV when there is no home trash and ENAMETOOLONG when its path does not fit.
+int fileop_trash_dir(const char *path, dev_t dev, char *trash, size_t trashLen, char *topDir, size_t topLen) {
+    const char *data = getenv("XDG_DATA_HOME");
+    const char *home = getenv("HOME");
+    char homeTrash[MAX_PATH_LEN];
+    int len;
+    if (data && data[0] == '/') len = snprintf(homeTrash, sizeof(homeTrash), "%s/Trash", data);
+    else if (home) len = snprintf(homeTrash, sizeof(homeTrash), "%s/.local/share/Trash", home);
+    else return EXDEV;
+    if (len >= (int)sizeof(homeTrash) || snprintf(trash, trashLen, "%s", homeTrash) >= (int)trashLen) return ENAMETOOLONG;
+    topDir[0] = '\0';
+
+    // The home trash's filesystem is that of its closest existing folder
+    char probe[MAX_PATH_LEN];
+    snprintf(probe, sizeof(probe), "%s", homeTrash);
+    struct stat st;
+    while (stat(probe, &st) < 0) {
+        char *slash = strrchr(probe, '/');
+        if (!slash) return 0;
+        slash[slash == probe ? 1 : 0] = '\0';
+    }
+    if (st.st_dev == dev) return 0;
+
+    // Up to the mount point: the highest folder still on the file's device
+    char top[MAX_PATH_LEN], parent[MAX_PATH_LEN];
+    if (snprintf(top, sizeof(top), "%s", path) >= (int)sizeof(top)) return 0;
+    while (top[1]) {
+        char *slash = strrchr(top, '/');
+        if (!slash) return 0;
+        snprintf(parent, sizeof(parent), "%.*s", slash == top ? 1 : (int)(slash - top), top);
+        if (stat(parent, &st) < 0 || st.st_dev != dev) break;
+        snprintf(top, sizeof(top), "%s", parent);
+    }
+    const char *prefix = top[1] ? top : "";
+    uid_t uid = getuid();
+    struct stat ts;
+    char dir[MAX_PATH_LEN + 32];   // room for the suffix; one that does not fit in trash is skipped
+    snprintf(dir, sizeof(dir), "%s/.Trash", prefix);
+    if (lstat(dir, &ts) == 0 && S_ISDIR(ts.st_mode) && (ts.st_mode & S_ISVTX)) {
+        snprintf(dir, sizeof(dir), "%s/.Trash/%u", prefix, (unsigned)uid);
+        if (strlen(dir) < trashLen && (mkdir(dir, 0700) == 0 || errno == EEXIST)) {
+            snprintf(trash, trashLen, "%s", dir);
+            snprintf(topDir, topLen, "%s", top);
+            return 0;
+        }
+    }
+    snprintf(dir, sizeof(dir), "%s/.Trash-%u", prefix, (unsigned)uid);
+    if (strlen(dir) < trashLen && (mkdir(dir, 0700) == 0 || errno == EEXIST) && lstat(dir, &ts) == 0 &&
+        S_ISDIR(ts.st_mode) && ts.st_uid == uid && access(dir, W_OK) == 0) {
+        snprintf(trash, trashLen, "%s", dir);
+        snprintf(topDir, topLen, "%s", top);
+    }
+    return 0;
+}
+
+// Move one file or folder to the trash, with a .trashinfo saying where it came from
+int fileop_trash_path(const char *path) {
+    struct stat st;
+    if (lstat(path, &st) < 0) return errno;
+    char trash[MAX_PATH_LEN], topDir[MAX_PATH_LEN], files[MAX_PATH_LEN + 8], info[MAX_PATH_LEN + 8];
+    int err = fileop_trash_dir(path, st.st_dev, trash, sizeof(trash), topDir, sizeof(topDir));
+    if (err) return err;
+    snprintf(files, sizeof(files), "%s/files", trash);
+    snprintf(info, sizeof(info), "%s/info", trash);
+    make_dirs(files, 0700);
+    make_dirs(info, 0700);
+
+    // Claim a name by creating its .trashinfo exclusively. Names are cut so that
+    // "<name>.trashinfo" is still a valid name, and a path that does not fit fails the
+    // item rather than leaving a .trashinfo that does not match the trashed file.
+    const char *slash = strrchr(path, '/');
+    const char *base = slash ? slash + 1 : path;
+    char name[NAME_MAX + 1], infoPath[MAX_PATH_LEN * 2], filePath[MAX_PATH_LEN * 2];
+    int fd = -1;
+    for (int n = 1; n < 10000 && fd < 0; n++) {
+        if (n == 1) snprintf(name, sizeof(name), "%.*s", NAME_MAX - 10, base);
+        else snprintf(name, sizeof(name), "%.*s.%d", NAME_MAX - 16, base, n);
+        if (snprintf(infoPath, sizeof(infoPath), "%s/%s.trashinfo", info, name) >= (int)sizeof(infoPath) ||
+            snprintf(filePath, sizeof(filePath), "%s/%s", files, name) >= (int)sizeof(filePath))
+            return ENAMETOOLONG;
+        struct stat taken;
+        if (lstat(filePath, &taken) == 0) continue;
+        fd = open(infoPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0 && errno != EEXIST) return errno;
+    }
+    if (fd < 0) return EEXIST;
+
+    size_t topLen = strlen(topDir);
+    const char *shown = topLen > 1 ? path + topLen + 1 : topLen == 1 ? path + 1 : path;
+    char escaped[MAX_PATH_LEN * 3], date[32], text[MAX_PATH_LEN * 3 + 128];
+    if (fileop_url_escape(shown, escaped, sizeof(escaped)) < 0) {
+        close(fd);
+        unlink(infoPath);
+        return ENAMETOOLONG;
+    }
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+    int len = snprintf(text, sizeof(text), "[Trash Info]\nPath=%s\nDeletionDate=%s\n", escaped, date);
+    err = len < (int)sizeof(text) && write(fd, text, (size_t)len) == len ? 0 : EIO;
+    if (close(fd) < 0 && !err) err = errno;
+    if (!err) err = fileop_move_path(path, filePath);
+    if (err) unlink(infoPath);
+    return err;
+}
+
+// Is `path` the folder `dir` or inside it?
+int fileop_within(const char *path, const char *dir) {
+    size_t len = strlen(dir);
+    return strncmp(path, dir, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+void fileop_run(FileOp *op) {
+    FileOps *f = &g_fileops;
+    if (op->kind == FILEOP_COPY)
+        for (int i = 0; i < op->count && !fileop_cancelled(); i++)
+            __atomic_add_fetch(&f->bytesTotal, fileop_tree_bytes(op->sources[i], 0), __ATOMIC_RELAXED);
+
+    for (int i = 0; i < op->count; i++) {
+        const char *src = op->sources[i];
+        const char *slash = strrchr(src, '/');
+        const char *base = slash ? slash + 1 : src;
+        pthread_mutex_lock(&f->lock);
+        f->item = i;
+        snprintf(f->name, sizeof(f->name), "%s", base);
+        pthread_mutex_unlock(&f->lock);
+        __atomic_add_fetch(&f->ticks, 1, __ATOMIC_RELAXED);
+        wake_ui();
+        if (fileop_cancelled()) {
+            fileop_fail(op, src, ECANCELED);
+            continue;
+        }
+
+        int err = 0;
+        if (op->kind == FILEOP_TRASH) {
+            err = fileop_trash_path(src);
+        } else {
+            char srcDir[MAX_PATH_LEN], name[NAME_MAX + 1], dst[MAX_PATH_LEN * 2];
+            snprintf(srcDir, sizeof(srcDir), "%.*s", slash && slash != src ? (int)(slash - src) : 1, src);
+            if (op->kind == FILEOP_MOVE && strcmp(srcDir, op->destDir) == 0) {
+                op->done[i] = 0;        // already here
+                continue;
+            }
+            if (fileop_within(op->destDir, src)) err = EINVAL;   // a folder into itself
+            else if (fileop_free_name(op->destDir, base, name, sizeof(name)) < 0) err = EEXIST;
+            if (!err) {
+                snprintf(dst, sizeof(dst), "%s/%s", op->destDir, name);
+                err = op->kind == FILEOP_COPY ? fileop_copy_tree(src, dst, 0) : fileop_move_path(src, dst);
+                if (!err) fileop_added(op, name);
+            }
+        }
+        if (err) fileop_fail(op, src, err);
+        else op->done[i] = 1;
+    }
+}
+
+void *fileop_worker(void *arg) {
+    FileOps *f = (FileOps *)arg;
+    pthread_mutex_lock(&f->lock);
+    for (;;) {
+        while (!f->shutdown && !f->queue) pthread_cond_wait(&f->cond, &f->lock);
+        if (f->shutdown) break;
+        FileOp *op = f->queue;
+        f->queue = op->next;
+        f->queued--;
+        op->next = NULL;
+        f->current = op;
+        f->bytesDone = f->bytesTotal = 0;
+        pthread_mutex_unlock(&f->lock);
+
+        fileop_run(op);
+
+        pthread_mutex_lock(&f->lock);
+        f->current = NULL;
+        FileOp **tail = &f->finished;
+        while (*tail) tail = &(*tail)->next;
+        *tail = op;
+        __atomic_add_fetch(&f->ticks, 1, __ATOMIC_RELAXED);
+        pthread_cond_broadcast(&f->cond);   // for fileops_drain
+        wake_ui();
+    }
+    pthread_mutex_unlock(&f->lock);
+    return NULL;
+}
+
+// Queue an operation on full paths (taken over); destDir is used by copy and move
+void fileops_submit(int kind, char **sources, int count, const char *destDir) {
+    FileOps *f = &g_fileops;
+    FileOp *op = (FileOp *)calloc(1, sizeof(FileOp));
+    if (op) {
+        op->done = (unsigned char *)calloc((size_t)count + 1, 1);
+        op->addedNames = (char **)calloc((size_t)count + 1, sizeof(char *));
+        op->addedMeta = (EntryMeta *)calloc((size_t)count + 1, sizeof(EntryMeta));
+    }
+    if (!op || !op->done || !op->addedNames || !op->addedMeta) {
+        for (int i = 0; i < count; i++) free(sources[i]);
+        free(sources);
+        if (op) op->count = 0;
+        fileop_free(op);
+        return;
+    }
+    op->kind = kind;
+    op->sources = sources;
+    op->count = count;
+    snprintf(op->destDir, sizeof(op->destDir), "%s", destDir ? destDir : "");
+
+    pthread_mutex_lock(&f->lock);
+    if (!f->started && pthread_create(&f->thread, NULL, fileop_worker, f) == 0) f->started = 1;
+    FileOp **tail = &f->queue;
+    while (*tail) tail = &(*tail)->next;
+    *tail = op;
+    f->queued++;
+    pthread_cond_signal(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+}
+
+// The next finished operation for the UI to apply, or NULL; free it with fileop_free
+FileOp *fileops_take_finished() {
+    FileOps *f = &g_fileops;
+    pthread_mutex_lock(&f->lock);
+    FileOp *op = f->finished;
+    if (op) f->finished = op->next;
+    pthread_mutex_unlock(&f->lock);
+    if (op) op->next = NULL;
+    return op;
+}
+
+// One line about the operation under way, for the status line. Returns 0 when idle.
+int fileops_status(char *out, size_t outLen, double *fraction) {
+    FileOps *f = &g_fileops;
+    pthread_mutex_lock(&f->lock);
+    FileOp *op = f->current;
+    int queued = f->queued;
+    if (!op) {
+        pthread_mutex_unlock(&f->lock);
+        return 0;
+    }
+    const char *verb = op->kind == FILEOP_COPY ? "Copying" : op->kind == FILEOP_MOVE ? "Moving" : "Trashing";
+    long long done = __atomic_load_n(&f->bytesDone, __ATOMIC_RELAXED);
+    long long total = __atomic_load_n(&f->bytesTotal, __ATOMIC_RELAXED);
+    size_t len = (size_t)snprintf(out, outLen, "%s %d/%d: %s", verb, f->item + 1, op->count, f->name);
+    if (total > 0 && len < outLen) {
+        char a[32], b[32];
+        format_size(done, a, sizeof(a));
+        format_size(total, b, sizeof(b));
+        len += (size_t)snprintf(out + len, outLen - len, ", %s of %s", a, b);
+    }
+    if (queued > 0 && len < outLen) snprintf(out + len, outLen - len, " (+%d queued)", queued);
+    *fraction = total > 0 ? (double)done / (double)total : (double)f->item / (double)op->count;
+    pthread_mutex_unlock(&f->lock);
+    return 1;
+}
+
+// 1 if progress moved since the last call, to repaint
+int fileops_progress() {
+    unsigned long long n = __atomic_load_n(&g_fileops.ticks, __ATOMIC_RELAXED);
+    int changed = n != g_fileops.shownTicks;
+    g_fileops.shownTicks = n;
+    return changed;
+}
+
+// 1 while an operation is running or queued
+int fileops_busy() {
+    FileOps *f = &g_fileops;
+    pthread_mutex_lock(&f->lock);
+    int busy = f->current || f->queue;
+    pthread_mutex_unlock(&f->lock);
+    return busy;
+}
+
+// Wait for the running and queued operations to finish, so quitting does not roll back
+// a copy or move half done
+void fileops_drain() {
+    FileOps *f = &g_fileops;
+    pthread_mutex_lock(&f->lock);
+    while (f->started && !f->shutdown && (f->current || f->queue)) pthread_cond_wait(&f->cond, &f->lock);
+    pthread_mutex_unlock(&f->lock);
+}
+
+// Stop after the file being copied; a partly copied file is removed. Operations still
+// queued are dropped.
+void fileops_shutdown() {
+    FileOps *f = &g_fileops;
+    pthread_mutex_lock(&f->lock);
+    f->shutdown = 1;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    if (f->started && join_with_timeout(f->thread, 2.0) != 0) return;   // stuck in the kernel
+    f->started = 0;
+    while (f->queue) {
+        FileOp *op = f->queue;
+        f->queue = op->next;
+        fileop_free(op);
+    }
+    for (FileOp *op; (op = fileops_take_finished()) != NULL; ) fileop_free(op);
+}
+
+// ============ LINUX FILE PREVIEW ============
+
+// Optional pane to the right of the list (BT_PREVIEW=1, or Ctrl+P to toggle) showing the
+// file under the pointer: the first lines of a text file, or what kind of file a binary
+// is. Files are read by one background thread after a short hover, and never more than
+// their first PREVIEW_BYTES, read into a buffer of that size (a mapping would fault if the
+// file were truncated meanwhile, as a rotated log is). Finished previews stay in a small
+// LRU cache keyed by path, mtime and size, so going back to a row shows it again at once
+// without touching the disk.
+
+#define PREVIEW_WIDTH      320
+#define PREVIEW_BYTES      (64 * 1024)
+#define PREVIEW_LINES      48
+#define PREVIEW_LINE_BYTES 160
+#define PREVIEW_CACHE_SIZE 32
+#define PREVIEW_DWELL_MS   150
+
+#define PREVIEW_TEXT   1
+#define PREVIEW_BINARY 2
+#define PREVIEW_FAILED 3
+
+typedef struct {
+    char *path;
+    long long mtime;
+    long long size;
+    int kind;
+    char *text;             // lines separated by '\n': the file's own, or a description
+    unsigned long lastUse;
+} PreviewEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int running;
+    int shutdown;
+    PreviewEntry *request;                      // waiting to be read; a newer hover replaces it
+    PreviewEntry *results[PREVIEW_CACHE_SIZE];  // read, not yet moved into the cache
+    int resultCount;
+
+    // UI thread only
+    PreviewEntry *cache[PREVIEW_CACHE_SIZE];
+    unsigned long clock;
+    int shown;
+    const char *hoverName;  // row under the pointer, and since when
+    double hoverSince;
+    int hoverDone;
+    char *path;             // the file the pane is about
+    long long mtime;
+    long long size;
+    unsigned int mode;
+    int inArchive;
+} Preview;
+
+Preview g_preview = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+void preview_entry_free(PreviewEntry *e) {
+    if (!e) return;
+    free(e->path);
+    free(e->text);
+    free(e);
+}
+
+// Lines of text as the pane shows them: tabs expanded, other control bytes as '.', long
+// lines cut at a character boundary
+char *preview_format_text(const unsigned char *data, size_t len) {
+    char *out = (char *)malloc(PREVIEW_LINES * (PREVIEW_LINE_BYTES + 4) + 1);
+    if (!out) return NULL;
+    size_t o = 0, col = 0;
+    int lines = 0;
+    for (size_t i = 0; i < len && lines < PREVIEW_LINES; i++) {
+        unsigned char c = data[i];
+        if (c == '\n') {
+            out[o++] = '\n';
+            col = 0;
+            lines++;
+            continue;
+        }
+        if (c == '\r') continue;
+        if (col >= PREVIEW_LINE_BYTES) continue;
+        if (c == '\t') {
+            for (int s = 0; s < 4 && col < PREVIEW_LINE_BYTES; s++, col++) out[o++] = ' ';
+        } else if (c < 0x20 || c == 0x7F) {
+            out[o++] = '.';
+            col++;
+        } else if (c >= 0x80 && col + 4 > PREVIEW_LINE_BYTES && (c & 0xC0) == 0xC0) {
+            col = PREVIEW_LINE_BYTES;   // no room for a whole multi-byte character
+        } else {
+            out[o++] = (char)c;
+            col++;
+        }
+    }
+    out[o] = '\0';
+    return out;
+}
+
+// What a binary file is, from its first bytes, plus a short hex dump
+char *preview_describe_binary(const unsigned char *data, size_t len) {
+    static const struct { const char *magic; size_t len; const char *name; } kinds[] = {
+        { "\x7f" "ELF", 4, "ELF executable or library" },
+        { "\x89PNG\r\n\x1a\n", 8, "PNG image" },
+        { "\xff\xd8\xff", 3, "JPEG image" },
+        { "GIF8", 4, "GIF image" },
+        { "%PDF", 4, "PDF document" },
+        { "PK\x03\x04", 4, "Zip archive (or an office document)" },
+        { "\x1f\x8b", 2, "gzip compressed data" },
+        { "BZh", 3, "bzip2 compressed data" },
+        { "\xfd" "7zXZ", 5, "xz compressed data" },
+        { "\x28\xb5\x2f\xfd", 4, "zstd compressed data" },
+        { "7z\xbc\xaf", 4, "7-Zip archive" },
+        { "SQLite format 3", 15, "SQLite database" },
+        { "OggS", 4, "Ogg media" },
+        { "RIFF", 4, "RIFF media (WAV, AVI or WebP)" },
+        { "ID3", 3, "MP3 audio" },
+        { "\0asm", 4, "WebAssembly module" },
+    };
+    const char *name = "Binary data";
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        if (len >= kinds[k].len && memcmp(data, kinds[k].magic, kinds[k].len) == 0) {
+            name = kinds[k].name;
+            break;
+        }
+    }
+    if (name[0] == 'B' && len >= 262 && memcmp(data + 257, "ustar", 5) == 0) name = "tar archive";
+
+    char *out = (char *)malloc(512);
+    if (!out) return NULL;
+    int o = snprintf(out, 512, "%s", name);
+    if (strcmp(name, "PNG image") == 0 && len >= 24) {
+        const unsigned char *ihdr = data + 16;   // big-endian width and height
+        unsigned w = (unsigned)ihdr[0] << 24 | ihdr[1] << 16 | ihdr[2] << 8 | ihdr[3];
+        unsigned h = (unsigned)ihdr[4] << 24 | ihdr[5] << 16 | ihdr[6] << 8 | ihdr[7];
+        o += snprintf(out + o, 512 - o, ", %u x %u", w, h);
+    }
+    o += snprintf(out + o, 512 - o, "\n");
+    for (size_t row = 0; row < 4 && row * 8 < len; row++) {
+        o += snprintf(out + o, 512 - o, "\n%04zx ", row * 8);
+        for (size_t i = row * 8; i < row * 8 + 8 && i < len; i++) o += snprintf(out + o, 512 - o, " %02x", data[i]);
+    }
+    return out;
+}
+
+// Fill in kind and text for one request; runs on the preview thread
+void preview_read(PreviewEntry *e) {
+    e->kind = PREVIEW_FAILED;
+    int fd = open(e->path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        e->text = strdup(strerror(errno));
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        e->text = strdup("Not a regular file");
+        close(fd);
+        return;
+    }
+    size_t len = (unsigned long long)st.st_size < PREVIEW_BYTES ? (size_t)st.st_size : PREVIEW_BYTES;
+    if (len == 0) {
+        e->kind = PREVIEW_TEXT;
+        e->text = strdup("(empty file)");
+        close(fd);
+        return;
+    }
+    unsigned char *data = (unsigned char *)malloc(len);
+    if (!data) {
+        e->text = strdup(strerror(ENOMEM));
+        close(fd);
+        return;
+    }
+    // Short if the file shrank since fstat
+    size_t got = 0;
+    int error = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, data + got, len - got, (off_t)got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) error = errno;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+    if (got == 0) {
+        if (!error) e->kind = PREVIEW_TEXT;
+        e->text = strdup(error ? strerror(error) : "(empty file)");
+        free(data);
+        return;
+    }
+    // Same test as the content search: a NUL near the start means binary
+    int binary = memchr(data, 0, got < SEARCH_SNIFF_BYTES ? got : SEARCH_SNIFF_BYTES) != NULL;
+    e->kind = binary ? PREVIEW_BINARY : PREVIEW_TEXT;
+    e->text = binary ? preview_describe_binary(data, got) : preview_format_text(data, got);
+    free(data);
+}
+
+void *preview_worker(void *arg) {
+    Preview *pv = (Preview *)arg;
+    pthread_mutex_lock(&pv->lock);
+    for (;;) {
+        while (!pv->shutdown && !pv->request) pthread_cond_wait(&pv->cond, &pv->lock);
+        if (pv->shutdown) break;
+        PreviewEntry *e = pv->request;
+        pv->request = NULL;
+        pthread_mutex_unlock(&pv->lock);
+
+        preview_read(e);
+
+        pthread_mutex_lock(&pv->lock);
+        if (pv->resultCount == PREVIEW_CACHE_SIZE) {
+            preview_entry_free(pv->results[0]);
+            memmove(pv->results, pv->results + 1, (PREVIEW_CACHE_SIZE - 1) * sizeof(PreviewEntry *));
+            pv->resultCount--;
+        }
+        pv->results[pv->resultCount++] = e;
+        wake_ui();
+    }
+    pthread_mutex_unlock(&pv->lock);
+    return NULL;
+}
+
+void preview_init() {
+    g_preview.shown = getenv("BT_PREVIEW") != NULL;
+}
+
+// Cached preview of a file as it is now, or NULL
+PreviewEntry *preview_find(const char *path, long long mtime, long long size) {
+    Preview *pv = &g_preview;
+    for (int i = 0; i < PREVIEW_CACHE_SIZE; i++) {
+        PreviewEntry *e = pv->cache[i];
+        if (e && e->mtime == mtime && e->size == size && strcmp(e->path, path) == 0) {
+            e->lastUse = ++pv->clock;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Hand a file to the preview thread, starting it on first use
+void preview_request(const char *path, long long mtime, long long size) {
+    Preview *pv = &g_preview;
+    if (!pv->running) {
+        pv->shutdown = 0;
+        pv->running = pthread_create(&pv->thread, NULL, preview_worker, pv) == 0;
+        if (!pv->running) return;
+    }
+    PreviewEntry *e = (PreviewEntry *)calloc(1, sizeof(PreviewEntry));
+    if (!e || !(e->path = strdup(path))) {
+        free(e);
+        return;
+    }
+    e->mtime = mtime;
+    e->size = size;
+
+    pthread_mutex_lock(&pv->lock);
+    PreviewEntry *old = pv->request;
+    pv->request = e;
+    pthread_cond_signal(&pv->cond);
+    pthread_mutex_unlock(&pv->lock);
+    preview_entry_free(old);
+}
+
+// Move finished previews into the cache, evicting the least recently used ones.
+// Returns 1 if the file the pane is about arrived.
+int preview_apply_results() {
+    Preview *pv = &g_preview;
+    if (!pv->running) return 0;
+    PreviewEntry *done[PREVIEW_CACHE_SIZE];
+    pthread_mutex_lock(&pv->lock);
+    int count = pv->resultCount;
+    memcpy(done, pv->results, (size_t)count * sizeof(PreviewEntry *));
+    pv->resultCount = 0;
+    pthread_mutex_unlock(&pv->lock);
+
+    int changed = 0;
+    for (int i = 0; i < count; i++) {
+        PreviewEntry *e = done[i];
+        int slot = 0;
+        for (int s = 0; s < PREVIEW_CACHE_SIZE; s++) {
+            if (!pv->cache[s]) { slot = s; break; }
+            if (pv->cache[s]->lastUse < pv->cache[slot]->lastUse) slot = s;
+        }
+        preview_entry_free(pv->cache[slot]);
+        e->lastUse = ++pv->clock;
+        pv->cache[slot] = e;
+        if (pv->path && strcmp(pv->path, e->path) == 0) changed = 1;
+    }
+    return changed;
+}
+
+void preview_shutdown() {
+    Preview *pv = &g_preview;
+    if (pv->running) {
+        pthread_mutex_lock(&pv->lock);
+        pv->shutdown = 1;
+        pthread_cond_broadcast(&pv->cond);
+        pthread_mutex_unlock(&pv->lock);
+        pv->running = 0;
+        if (join_with_timeout(pv->thread, 0.2) != 0) return;   // stuck opening a file on a hung mount
+    }
+    preview_entry_free(pv->request);
+    pv->request = NULL;
+    for (int i = 0; i < pv->resultCount; i++) preview_entry_free(pv->results[i]);
+    pv->resultCount = 0;
+    for (int i = 0; i < PREVIEW_CACHE_SIZE; i++) {
+        preview_entry_free(pv->cache[i]);
+        pv->cache[i] = NULL;
+    }
+    free(pv->path);
+    pv->path = NULL;
+}
+
+// ---- frame scheduling ----
+
+void draw_window();
+
+// Handlers only change state and call request_frame(); the event loop drains all
+// pending events first and then renders at most once per refresh interval.
+typedef struct {
+    int requested;
+    double interval;              // seconds per display refresh
+    double lastFrame;
+    double lastAnimation;
+    int animating;                // the previous frame was part of a running scroll animation
+    unsigned long long frames;
+    unsigned long long dropped;   // refresh slots missed while animating
+    double statsStart;
+    double windowStart;
+    int windowFrames;
+    int peakFps;
+    int logStats;
+} FrameScheduler;
+
+FrameScheduler g_frames;
+
+#define SCROLL_TIME_CONSTANT 0.06   // seconds for the scroll animation to cover ~63% of the distance
+
+void request_frame() {
+    g_frames.requested = 1;
+}
+
+void frame_scheduler_init() {
+    const char *hz = getenv("BT_REFRESH_HZ");
+    int rate = hz && atoi(hz) > 0 ? atoi(hz) : 60;
+    g_frames.interval = 1.0 / rate;
+    g_frames.logStats = getenv("BT_FRAME_STATS") != NULL;
+    g_frames.statsStart = g_frames.windowStart = monotonic_seconds();
+    g_frames.lastFrame = g_frames.statsStart - g_frames.interval;
+    g_frames.requested = 1;
+}
+
+int max_scroll() {
+    int clientHeight = g_x11_state.windowHeight - BUTTON_START_Y;
+    int maxScroll = g_x11_state.listing.count * BUTTON_HEIGHT - clientHeight;
+    return maxScroll > 0 ? maxScroll : 0;
+}
+
+// Jump to a scroll position without animating (navigation, refresh, re-sort)
+void set_scroll_immediate(int pos) {
+    g_x11_state.scrollPos = pos;
+    g_x11_state.scrollY = pos;
+    g_x11_state.scrollTarget = pos;
+    request_frame();
+}
+
+int scroll_animating() {
+    return g_x11_state.scrollY != g_x11_state.scrollTarget;
+}
+
+// Move the animated scroll position toward its target for the elapsed time
+void advance_scroll(double now) {
+    double maxPos = max_scroll();
+    if (g_x11_state.scrollTarget > maxPos) g_x11_state.scrollTarget = maxPos;
+    if (g_x11_state.scrollTarget < 0) g_x11_state.scrollTarget = 0;
+
+    double dt = now - g_frames.lastAnimation;
+    g_frames.lastAnimation = now;
+    if (scroll_animating()) {
+        double k = dt > 0 ? 1.0 - exp(-dt / SCROLL_TIME_CONSTANT) : 0.0;
+        g_x11_state.scrollY += (g_x11_state.scrollTarget - g_x11_state.scrollY) * k;
+        if (fabs(g_x11_state.scrollTarget - g_x11_state.scrollY) < 0.5)
+            g_x11_state.scrollY = g_x11_state.scrollTarget;
+    }
+    if (g_x11_state.scrollY > maxPos) g_x11_state.scrollY = maxPos;
+    g_x11_state.scrollPos = (int)(g_x11_state.scrollY + 0.5);
+}
+
+void frame_stats_report(FILE *out) {
+    double elapsed = monotonic_seconds() - g_frames.statsStart;
+    fprintf(out, "frames: %llu rendered in %.1f s (%.1f fps avg, %d fps peak), %llu dropped while animating\n",
+            g_frames.frames, elapsed, elapsed > 0 ? g_frames.frames / elapsed : 0.0,
+            g_frames.peakFps, g_frames.dropped);
+}
+
+// Render one frame if one is requested and due. Returns the poll timeout in ms
+// until the next frame is due, or -1 when nothing needs drawing.
+int run_frame_scheduler() {
+    double now = monotonic_seconds();
+    if (!g_frames.requested && !scroll_animating()) {
+        g_frames.animating = 0;
+        return -1;
+    }
+
+    double due = g_frames.lastFrame + g_frames.interval;
+    if (now < due) {
+        int ms = (int)((due - now) * 1000.0 + 0.999);
+        return ms > 0 ? ms : 1;
+    }
+
+    int wasAnimating = g_frames.animating;
+    if (!scroll_animating()) g_frames.lastAnimation = now;
+    advance_scroll(now);
+    unsigned long firstRequest = g_x11_state.display ? NextRequest(g_x11_state.display) : 0;
+    draw_window();
+    counters_add_us(&g_counters.drawUs, monotonic_seconds() - now);
+    if (g_x11_state.display) hist_add(&g_counters.drawRequests, NextRequest(g_x11_state.display) - firstRequest);
+
+    if (wasAnimating) {
+        long missed = (long)((now - g_frames.lastFrame) / g_frames.interval + 0.5) - 1;
+        if (missed > 0) g_frames.dropped += (unsigned long long)missed;
+    }
+    g_frames.animating = scroll_animating();
+    g_frames.requested = 0;
+    g_frames.lastFrame = now;
+    g_frames.frames++;
+    g_frames.windowFrames++;
+
+    if (now - g_frames.windowStart >= 1.0) {
+        int fps = (int)(g_frames.windowFrames / (now - g_frames.windowStart) + 0.5);
+        if (fps > g_frames.peakFps) g_frames.peakFps = fps;
+        if (g_frames.logStats) {
+            fprintf(stderr, "fps: %d, frames %llu, dropped %llu\n", fps, g_frames.frames, g_frames.dropped);
+        }
+        g_frames.windowStart = now;
+        g_frames.windowFrames = 0;
+    }
+    return g_frames.animating ? (int)(g_frames.interval * 1000.0) : -1;
+}
+
+// Free files
+void free_files() {
+    listing_free(&g_x11_state.listing);
+}
+
+// Rebuild the jump index (only meaningful in name order)
+void index_listing() {
+    if (g_x11_state.sortMode == SORT_NAME && !g_x11_state.recentPaths) build_jump_index(&g_x11_state.jump, &g_x11_state.listing);
+    else g_x11_state.jump.count = g_x11_state.jump.keyCount = 0;
+}
+
+// ---- content search view ----
+
+// While a search is shown, its matches replace the folder listing, ranked by hit count,
+// or grouped when looking for duplicates. Any navigation (Up, refresh, sort, Escape) goes
+// back to the folder.
+typedef struct {
+    int editing;            // typing a query: Ctrl+F, or Ctrl+Shift+F to include subfolders
+    int recursive;
+    int duplicates;         // the job looks for identical files (Ctrl+D), not for the query
+    char query[256];
+    ContentSearch *job;     // the search whose results are listed
+    SearchHit *hits;        // the results, in row order
+    int count;
+    int capacity;
+    unsigned long long shownSearched;
+} SearchView;
+
+SearchView g_search_view;
+
+void search_view_close() {
+    if (g_search_view.job) content_search_cancel(g_search_view.job);
+    g_search_view.job = NULL;
+    for (int i = 0; i < g_search_view.count; i++) free(g_search_view.hits[i].path);
+    g_search_view.count = 0;
+}
+
+// Most hits first, then by name
+int compare_hits(const void *a, const void *b) {
+    const SearchHit *x = (const SearchHit *)a, *y = (const SearchHit *)b;
+    if (x->hits != y->hits) return x->hits > y->hits ? -1 : 1;
+    return utf8_casecmp(x->path, y->path);
+}
+
+// Duplicate groups in the order the finder gave them, files by name within each
+int compare_duplicates(const void *a, const void *b) {
+    const SearchHit *x = (const SearchHit *)a, *y = (const SearchHit *)b;
+    if (x->group != y->group) return x->group - y->group;
+    return utf8_casecmp(x->path, y->path);
+}
+
+void selection_clear();
+
+// Rebuild the listing from the ranked results; rows are paths relative to dirpath
+void search_view_relist() {
+    Listing *l = &g_x11_state.listing;
+    dirsizes_cancel();
+    git_status_cancel();
+    selection_clear();
+    listing_clear(l);
+    for (int i = 0; i < g_search_view.count; i++) {
+        const SearchHit *h = &g_search_view.hits[i];
+        if (listing_append(l, h->path, ENTRY_TYPE_FILE) < 0) break;
+        EntryMeta *m = &l->meta[l->count - 1];
+        m->size = h->size;
+        m->mtime = h->mtime;
+        m->mode = h->mode;
+        m->state = META_READY;
+    }
+    g_x11_state.jump.count = g_x11_state.jump.keyCount = 0;
+}
+
+// Take the matches found since the last call. Returns 1 if the screen needs a repaint.
+int search_view_apply() {
+    if (!g_search_view.job) return 0;
+    SearchHit *fresh;
+    int n = content_search_take(g_search_view.job, &fresh);
+    if (n > 0) {
+        if (g_search_view.count + n > g_search_view.capacity) {
+            int cap = (g_search_view.count + n) * 2;
+            SearchHit *grown = (SearchHit *)realloc(g_search_view.hits, (size_t)cap * sizeof(SearchHit));
+            if (!grown) {
+                for (int i = 0; i < n; i++) free(fresh[i].path);
+                free(fresh);
+                return 0;
+            }
+            g_search_view.hits = grown;
+            g_search_view.capacity = cap;
+        }
+        memcpy(g_search_view.hits + g_search_view.count, fresh, (size_t)n * sizeof(SearchHit));
+        g_search_view.count += n;
+        qsort(g_search_view.hits, (size_t)g_search_view.count, sizeof(SearchHit),
+              g_search_view.duplicates ? compare_duplicates : compare_hits);
+        search_view_relist();
+    }
+    free(fresh);
+
+    unsigned long long searched;
+    content_search_progress(g_search_view.job, &searched, NULL, NULL);
+    searched += __atomic_load_n(&g_search_view.job->filesHashed, __ATOMIC_RELAXED);
+    int changed = n > 0 || searched != g_search_view.shownSearched;
+    g_search_view.shownSearched = searched;
+    return changed;
+}
+
+// Search the shown files, or everything below the folder, for needle (NULL: duplicates)
+void search_view_launch(const char *needle, int recursive) {
+    if (g_x11_state.inArchive) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Search does not look inside archives");
+        return;
+    }
+    if (g_x11_state.merged || g_x11_state.apps || g_x11_state.recentPaths) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Search works in one folder at a time");
+        return;
+    }
+
+    // A flat search looks at the files of the listing as filtered, folders left out.
+    // From a result list, that means narrowing the previous results.
+    const Listing *l = &g_x11_state.listing;
+    char **names = NULL;
+    int nameCount = 0;
+    if (!recursive) {
+        names = (char **)malloc((size_t)(l->count ? l->count : 1) * sizeof(char *));
+        for (int i = 0; names && i < l->count; i++) {
+            const EntryMeta *m = &l->meta[i];
+            int isDir = m->state == META_READY ? S_ISDIR(m->mode) : m->type == ENTRY_TYPE_DIR;
+            if (!isDir) names[nameCount++] = l->names[i];
+        }
+    }
+
+    ContentSearch *job = content_search_start(g_x11_state.dirpath, needle, recursive,
+                                              names, nameCount, g_argc, g_argv, g_x11_state.filterStart);
+    free(names);
+    search_view_close();
+    if (!job) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Cannot start the search");
+        return;
+    }
+    g_search_view.job = job;
+    g_search_view.recursive = recursive;
+    g_search_view.duplicates = needle == NULL;
+    g_search_view.shownSearched = 0;
+    g_x11_state.statusText[0] = '\0';
+    search_view_relist();
+    set_scroll_immediate(0);
+}
+
+// Enter in the query field
+void search_view_start() {
+    g_search_view.editing = 0;
+    if (g_search_view.query[0]) search_view_launch(g_search_view.query, g_search_view.recursive);
+}
+
+// Ctrl+D: duplicates among the shown files; pressed again over those, in all subfolders
+void search_view_find_duplicates() {
+    int again = g_search_view.job && g_search_view.duplicates && !g_search_view.recursive;
+    search_view_launch(NULL, again);
+}
+
+// Status line for the shown search; returns its colour
+unsigned long search_view_status(char *out, size_t outLen) {
+    unsigned long long searched, matched;
+    int rootError;
+    int done = content_search_progress(g_search_view.job, &searched, &matched, &rootError);
+    if (rootError) {
+        snprintf(out, outLen, "Cannot search %s: %s", g_x11_state.dirpath, strerror(rootError));
+        return 0xCC0000;
+    }
+    if (g_search_view.duplicates) {
+        const ContentSearch *cs = g_search_view.job;
+        char wasted[32];
+        if (done) {
+            format_size(cs->dupWasted, wasted, sizeof(wasted));
+            snprintf(out, outLen, "%llu duplicates in %d groups, %s to spare%s", matched, cs->dupGroups, wasted,
+                     g_search_view.recursive ? "" : "; Ctrl+D again for subfolders");
+        } else {
+            snprintf(out, outLen, "Looking for duplicates: %llu files, %llu of %llu compared", searched,
+                     __atomic_load_n(&cs->filesHashed, __ATOMIC_RELAXED), __atomic_load_n(&cs->filesToHash, __ATOMIC_RELAXED));
+        }
+        return done ? 0x000000 : 0x777777;
+    }
+    if (done) snprintf(out, outLen, "\"%s\": %llu of %llu files match", g_search_view.query, matched, searched);
+    else snprintf(out, outLen, "Searching \"%s\": %llu matches in %llu files", g_search_view.query, matched, searched);
+    return done ? 0x000000 : 0x777777;
+}
+
+// Keys while typing a query. Text comes from XLookupString, which covers Latin-1.
+void handle_search_key(KeySym sym, const char *typed, int typedLen) {
+    size_t len = strlen(g_search_view.query);
+    if (sym == XK_Escape) {
+        g_search_view.editing = 0;
+    } else if (sym == XK_Return || sym == XK_KP_Enter) {
+        search_view_start();
+    } else if (sym == XK_BackSpace) {
+        while (len > 0 && (g_search_view.query[len - 1] & 0xC0) == 0x80) len--;   // UTF-8 continuation bytes
+        if (len > 0) len--;
+        g_search_view.query[len] = '\0';
+    } else {
+        unsigned char c = typedLen == 1 ? (unsigned char)typed[0] : 0;
+        if (c >= 0x20 && c != 0x7F && !(c >= 0x80 && c < 0xA0) && len + 3 < sizeof(g_search_view.query)) {
+            if (c < 0x80) {
+                g_search_view.query[len++] = (char)c;
+            } else {
+                g_search_view.query[len++] = (char)(0xC0 | (c >> 6));
+                g_search_view.query[len++] = (char)(0x80 | (c & 0x3F));
+            }
+            g_search_view.query[len] = '\0';
+        }
+    }
+    request_frame();
+}
+
+void begin_search_query(int recursive) {
+    g_search_view.editing = 1;
+    g_search_view.recursive = recursive;
+    request_frame();
+}
+
+// ---- session snapshot ----
+
+// On exit the folder on screen, its rows with their metadata and the scroll position are
+// saved per argument set. The next launch with the same arguments maps the file and shows
+// it on the first frame, then rescans the folder in the background and swaps the result in
+// (stale-while-revalidate). The file is a cache in host byte order: anything that does not
+// check out exactly is ignored and the launch starts from nothing, as before.
+
+#define SNAPSHOT_MAGIC   "BTSNAPSH"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_ROWS (16 * 1024 * 1024)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;    // sizeof(SnapshotHeader): a changed layout is rejected too
+    uint64_t key;           // session_key() of the launch that wrote it
+    uint32_t count;
+    int32_t sortMode;
+    int32_t filterStart;
+    int32_t scrollPos;
+    uint32_t pathLen;       // folder path, no terminator
+    uint32_t namesSize;     // NUL-terminated names, in row order
+    uint32_t crc;           // zlib crc32 of everything after the header
+    uint32_t reserved;
+} SnapshotHeader;
+
+typedef struct {
+    int64_t size;
+    int64_t mtime;
+    uint32_t mode;
+    uint32_t nameOffset;
+    uint8_t state;
+    uint8_t type;
+    uint8_t reserved[6];
+} SnapshotRow;
+
+// Launches from the same shortcut share a snapshot: hash the working folder and the arguments
+uint64_t session_key(int argc, char *argv[]) {
+    uint64_t h = 14695981039346656037ULL;
+    char cwd[MAX_PATH_LEN];
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+    for (int i = 0; i < argc; i++) {
+        const char *s = i == 0 ? cwd : argv[i];
+        for (; *s; s++) h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+        h = (h ^ 0xFF) * 1099511628211ULL;   // separator, so "a b" and "ab" differ
+    }
+    return h;
+}
+
+// BT_SNAPSHOT=0 turns snapshots off; otherwise $XDG_CACHE_HOME/better-toolbar/session-<key>
+int session_path(uint64_t key, char *out, size_t outLen) {
+    const char *mode = getenv("BT_SNAPSHOT");
+    if (mode && strcmp(mode, "0") == 0) return 0;
+    char name[32];
+    snprintf(name, sizeof(name), "session-%016llx", (unsigned long long)key);
+    return app_cache_path(name, out, outLen);
+}
+
+// Check a mapped snapshot from end to end before anything in it is used. argc bounds the
+// stored filterStart, which indexes the arguments.
+int snapshot_valid(const unsigned char *data, size_t size, uint64_t key, int argc) {
+    if (size < sizeof(SnapshotHeader)) return 0;
+    SnapshotHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, SNAPSHOT_MAGIC, 8) != 0 || h.version != SNAPSHOT_VERSION ||
+        h.headerSize != sizeof(SnapshotHeader) || h.key != key) return 0;
+    if (h.count > SNAPSHOT_MAX_ROWS || h.pathLen == 0 || h.pathLen >= MAX_PATH_LEN) return 0;
+    if (h.sortMode < SORT_NAME || h.sortMode > SORT_MTIME || h.scrollPos < 0) return 0;
+    if (h.filterStart < 1 || h.filterStart > argc) return 0;
+    uint64_t expected = (uint64_t)sizeof(h) + h.pathLen + (uint64_t)h.count * sizeof(SnapshotRow) + h.namesSize;
+    if (expected != size) return 0;
+
+    const unsigned char *body = data + sizeof(h);
+    if ((uint32_t)crc32(0L, body, (uInt)(size - sizeof(h))) != h.crc) return 0;
+
+    const char *path = (const char *)body;
+    if (path[0] != '/' || memchr(path, '\0', h.pathLen)) return 0;
+    const char *names = (const char *)body + h.pathLen + (size_t)h.count * sizeof(SnapshotRow);
+    if (h.count > 0 && (h.namesSize == 0 || names[h.namesSize - 1] != '\0')) return 0;
+    for (uint32_t i = 0; i < h.count; i++) {
+        SnapshotRow r;
+        memcpy(&r, body + h.pathLen + (size_t)i * sizeof(r), sizeof(r));
+        if (r.nameOffset >= h.namesSize) return 0;
+        const char *name = names + r.nameOffset;
+        if (!name[0] || strchr(name, '/')) return 0;
+        if (r.state != META_NONE && r.state != META_READY && r.state != META_FAILED) return 0;
+    }
+    return 1;
+}
+
+// Show the snapshot for this argument set, if there is a good one. Returns 1 if the
+// listing now comes from it and the caller should revalidate g_x11_state.dirpath.
+int session_restore(int argc, char *argv[]) {
+    char path[MAX_PATH_LEN];
+    uint64_t key = session_key(argc, argv);
+    if (!session_path(key, path, sizeof(path))) return 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    const unsigned char *data = (const unsigned char *)map;
+    int ok = snapshot_valid(data, (size_t)st.st_size, key, argc);
+    SnapshotHeader h;
+    memcpy(&h, data, sizeof(h));
+    Listing l = {0};
+    if (ok) {
+        const unsigned char *rows = data + sizeof(h) + h.pathLen;
+        const char *names = (const char *)rows + (size_t)h.count * sizeof(SnapshotRow);
+        for (uint32_t i = 0; i < h.count && ok; i++) {
+            SnapshotRow r;
+            memcpy(&r, rows + (size_t)i * sizeof(r), sizeof(r));
+            if (listing_append(&l, names + r.nameOffset, r.type) < 0) {
+                ok = 0;
+                break;
+            }
+            EntryMeta *m = &l.meta[l.count - 1];
+            m->size = r.size;
+            m->mtime = r.mtime;
+            m->mode = r.mode;
+            m->state = r.state;
+        }
+    }
+    if (ok) {
+        memcpy(g_x11_state.dirpath, data + sizeof(h), h.pathLen);
+        g_x11_state.dirpath[h.pathLen] = '\0';
+        listing_free(&g_x11_state.listing);
+        g_x11_state.listing = l;
+        g_x11_state.sortMode = h.sortMode;
+        g_x11_state.filterStart = h.filterStart;
+        g_x11_state.stale = 1;
+        index_listing();
+        int maxScroll = max_scroll();
+        set_scroll_immediate(h.scrollPos < maxScroll ? h.scrollPos : maxScroll);
+    } else {
+        listing_free(&l);
+    }
+    munmap(map, (size_t)st.st_size);
+    return ok;
+}
+
+// Write the folder on screen for the next launch. Merged, archive, search and application
+// listings are not plain folders a rescan can confirm; they drop the old snapshot instead.
+void session_save(int argc, char *argv[]) {
+    char path[MAX_PATH_LEN], tmp[MAX_PATH_LEN + 8];
+    uint64_t key = session_key(argc, argv);
+    if (!session_path(key, path, sizeof(path))) return;
+    const Listing *l = &g_x11_state.listing;
+    if (g_x11_state.merged || g_x11_state.inArchive || g_search_view.job || g_x11_state.apps ||
+        g_x11_state.dirpath[0] != '/' || l->count > SNAPSHOT_MAX_ROWS) {
+        unlink(path);
+        return;
+    }
 
-// Free files
-void free_files() {
-    for (int i = 0; i < g_x11_state.fileCount; i++) {
-        if (g_x11_state.files[i]) {
-            free(g_x11_state.files[i]);
-            g_x11_state.files[i] = NULL;
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+    h.version = SNAPSHOT_VERSION;
+    h.headerSize = sizeof(h);
+    h.key = key;
+    h.count = (uint32_t)l->count;
+    h.sortMode = g_x11_state.sortMode;
+    h.filterStart = g_x11_state.filterStart;
+    h.scrollPos = (int32_t)g_x11_state.scrollTarget;
+    h.pathLen = (uint32_t)strlen(g_x11_state.dirpath);
+
+    SnapshotRow *rows = (SnapshotRow *)calloc(l->count ? (size_t)l->count : 1, sizeof(SnapshotRow));
+    if (!rows) return;
+    uint64_t offset = 0;
+    for (int i = 0; i < l->count; i++) {
+        const EntryMeta *m = &l->meta[i];
+        rows[i].size = m->size;
+        rows[i].mtime = m->mtime;
+        rows[i].mode = m->mode;
+        rows[i].state = m->state == META_PENDING ? META_NONE : m->state;
+        rows[i].type = m->type;
+        rows[i].nameOffset = (uint32_t)offset;
+        offset += strlen(l->names[i]) + 1;
+    }
+    if (offset > UINT32_MAX) {
+        free(rows);
+        return;
+    }
+    h.namesSize = (uint32_t)offset;
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef *)g_x11_state.dirpath, h.pathLen);
+    crc = crc32(crc, (const Bytef *)rows, (uInt)((size_t)l->count * sizeof(SnapshotRow)));
+    for (int i = 0; i < l->count; i++)
+        crc = crc32(crc, (const Bytef *)l->names[i], (uInt)strlen(l->names[i]) + 1);
+    h.crc = (uint32_t)crc;
+
+    // Written beside the old one and renamed over it, so a crash leaves one or the other
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *out = fopen(tmp, "wb");
+    if (!out) {
+        free(rows);
+        return;
+    }
+    int ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+             fwrite(g_x11_state.dirpath, 1, h.pathLen, out) == h.pathLen &&
+             fwrite(rows, sizeof(SnapshotRow), (size_t)l->count, out) == (size_t)l->count;
+    for (int i = 0; i < l->count && ok; i++)
+        ok = fwrite(l->names[i], 1, strlen(l->names[i]) + 1, out) == strlen(l->names[i]) + 1;
+    free(rows);
+    if (fclose(out) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) unlink(tmp);
+}
+
+// The rescan behind the snapshot arrived. Whatever was added or removed, the row at the
+// top of the view stays there; returns the scroll position that keeps it in place.
+int session_revalidated_scroll(const Listing *old, const Listing *fresh) {
+    int top = g_x11_state.scrollPos / BUTTON_HEIGHT;
+    if (top >= old->count) return 0;
+    int within = g_x11_state.scrollPos - top * BUTTON_HEIGHT;
+    const char *anchor = old->names[top];
+    int row = top < fresh->count && strcmp(fresh->names[top], anchor) == 0 ? top : -1;
+    for (int i = 0; i < fresh->count && row < 0; i++)
+        if (strcmp(fresh->names[i], anchor) == 0) row = i;
+    if (row < 0) row = top < fresh->count ? top : 0;
+    return row * BUTTON_HEIGHT + within;
+}
+
+// Load a folder through the I/O layer. The current listing stays on screen and
+// interactive until the new one arrives.
+void navigate_to(const char *path, int flags) {
+    if (io_navigate(path, flags, g_x11_state.sortMode, g_x11_state.filterStart) < 0) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText),
+                 "Too many folders are not responding");
+    }
+    request_frame();
+}
+
+// Rescan the current directory; metadata is then loaded on demand for visible rows
+void reload_listing() {
+    if (g_x11_state.apps) navigate_to("", IO_APPS);
+    else if (g_x11_state.recentPaths) navigate_to("", IO_RECENT);
+    else if (g_x11_state.merged) navigate_to("", IO_MERGED_ROOTS);
+    else navigate_to(g_x11_state.dirpath, 0);
+}
+
+// Full path of a row; rows of a merged listing live in their own root, applications
+// are their .desktop file, recent files carry their whole path
+void row_path(int row, char *out, size_t outLen) {
+    if (g_x11_state.apps) {
+        snprintf(out, outLen, "%s", g_x11_state.apps->entries[g_x11_state.appRows[row]].path);
+        return;
+    }
+    if (g_x11_state.recentPaths) {
+        snprintf(out, outLen, "%s", g_x11_state.recentPaths[row]);
+        return;
+    }
+    const char *dir = g_x11_state.merged ? g_roots.paths[g_x11_state.listing.meta[row].root] : g_x11_state.dirpath;
+    snprintf(out, outLen, "%s/%s", dir, g_x11_state.listing.names[row]);
+}
+
+// Size the folder rows of the listing on screen, or stop if the size column is off
+void start_dir_sizes() {
+    Listing *l = &g_x11_state.listing;
+    if (!g_dirsizes.enabled || g_x11_state.inArchive || g_search_view.job || g_x11_state.apps || l->count == 0) {
+        dirsizes_cancel();
+        return;
+    }
+    char **paths = (char **)calloc((size_t)l->count, sizeof(char *));
+    if (!paths) return;
+    char path[MAX_PATH_LEN];
+    for (int i = 0; i < l->count; i++) {
+        if (!listing_row_is_dir(l, i) || l->meta[i].type == ENTRY_TYPE_LINK) continue;
+        row_path(i, path, sizeof(path));
+        paths[i] = strdup(path);
+    }
+    dirsizes_start(paths, l->count);
+    for (int i = 0; i < l->count; i++) free(paths[i]);
+    free(paths);
+}
+
+// Mark the rows of a folder in a git work tree; other listings have no marks
+void start_git_status() {
+    if (g_x11_state.inArchive || g_x11_state.merged || g_x11_state.apps || g_x11_state.recentPaths || g_search_view.job)
+        git_status_cancel();
+    else git_status_start(g_x11_state.dirpath, &g_x11_state.listing);
+}
+
+// Entry count of a folder row, once its probe is in; asks for one otherwise
+ChildCount *child_count_row(int row) {
+    const EntryMeta *m = &g_x11_state.listing.meta[row];
+    if (!g_children.enabled || g_x11_state.inArchive || m->state != META_READY || !S_ISDIR(m->mode)) return NULL;
+    char path[MAX_PATH_LEN];
+    row_path(row, path, sizeof(path));
+    return children_get(path, m->mtime);
+}
+
+// Called from draw_window() with the visible rows [first, last): probes the folder rows
+// among them and one screen either side, in the order meta_request_viewport() uses
+void child_counts_viewport(int first, int last) {
+    int margin = last - first;
+    int lo = first - margin < 0 ? 0 : first - margin;
+    int hi = last + margin > g_x11_state.listing.count ? g_x11_state.listing.count : last + margin;
+    for (int row = hi - 1; row >= last; row--) child_count_row(row);
+    for (int row = lo; row < first; row++) child_count_row(row);
+    for (int row = last - 1; row >= first; row--) child_count_row(row);
+}
+
+// ---- selection and file operations ----
+
+// Rows copied (Ctrl+C) or cut (Ctrl+X), waiting for Ctrl+V in another folder
+typedef struct {
+    int kind;               // FILEOP_COPY or FILEOP_MOVE
+    char **paths;
+    int count;
+} FileClipboard;
+
+FileClipboard g_clipboard;
+
+void selection_clear() {
+    free(g_x11_state.selected);
+    g_x11_state.selected = NULL;
+    g_x11_state.selectedCount = 0;
+}
+
+// Copying, moving and trashing work on rows of a plain folder
+int file_ops_allowed() {
+    return !g_x11_state.inArchive && !g_x11_state.merged && !g_x11_state.apps && !g_x11_state.recentPaths &&
+           !g_search_view.job &&
+           g_x11_state.dirpath[0] == '/' && !g_x11_state.stale;
+}
+
+// Ctrl+click
+void selection_toggle(int row) {
+    if (!file_ops_allowed() || row < 0 || row >= g_x11_state.listing.count) return;
+    if (!g_x11_state.selected) {
+        g_x11_state.selected = (unsigned char *)calloc((size_t)g_x11_state.listing.count, 1);
+        if (!g_x11_state.selected) return;
+    }
+    g_x11_state.selected[row] = !g_x11_state.selected[row];
+    g_x11_state.selectedCount += g_x11_state.selected[row] ? 1 : -1;
+    if (g_x11_state.selectedCount == 0) selection_clear();
+    request_frame();
+}
+
+// Ctrl+A
+void selection_all() {
+    int count = g_x11_state.listing.count;
+    if (!file_ops_allowed() || count <= 0) return;
+    selection_clear();
+    g_x11_state.selected = (unsigned char *)malloc((size_t)count);
+    if (!g_x11_state.selected) return;
+    memset(g_x11_state.selected, 1, (size_t)count);
+    g_x11_state.selectedCount = count;
+    request_frame();
+}
+
+int row_at_point(int x, int y);
+
+// Full paths of the selected rows, or of the row under the pointer if none is selected.
+// Clears the selection.
+int selection_take_paths(char ***out) {
+    *out = NULL;
+    if (!file_ops_allowed()) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Files can only be copied in a plain folder");
+        return 0;
+    }
+    const Listing *l = &g_x11_state.listing;
+    int hover = row_at_point(g_x11_state.mouseX, g_x11_state.mouseY);
+    int count = g_x11_state.selected ? g_x11_state.selectedCount : hover >= 0;
+    char **paths = count > 0 ? (char **)calloc((size_t)count, sizeof(char *)) : NULL;
+    if (!paths) return 0;
+    char path[MAX_PATH_LEN];
+    int n = 0;
+    for (int i = 0; i < l->count && n < count; i++) {
+        if (g_x11_state.selected ? !g_x11_state.selected[i] : i != hover) continue;
+        row_path(i, path, sizeof(path));
+        if ((paths[n] = strdup(path)) != NULL) n++;
+    }
+    selection_clear();
+    request_frame();
+    *out = paths;
+    return n;
+}
+
+void clipboard_clear() {
+    for (int i = 0; i < g_clipboard.count; i++) free(g_clipboard.paths[i]);
+    free(g_clipboard.paths);
+    memset(&g_clipboard, 0, sizeof(g_clipboard));
+}
+
+// Ctrl+C / Ctrl+X: remember the rows for Ctrl+V
+void clipboard_set(int kind) {
+    char **paths;
+    int count = selection_take_paths(&paths);
+    if (count == 0) {
+        free(paths);
+        return;
+    }
+    clipboard_clear();
+    g_clipboard.kind = kind;
+    g_clipboard.paths = paths;
+    g_clipboard.count = count;
+}
+
+// Ctrl+V: copy or move the clipboard into the folder on screen. A cut is used up.
+void clipboard_paste() {
+    if (g_clipboard.count == 0 || g_x11_state.replaying) return;
+    if (!file_ops_allowed()) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Files can only be pasted into a plain folder");
+        return;
+    }
+    char **paths = (char **)calloc((size_t)g_clipboard.count, sizeof(char *));
+    if (!paths) return;
+    int n = 0;
+    for (int i = 0; i < g_clipboard.count; i++)
+        if ((paths[n] = strdup(g_clipboard.paths[i])) != NULL) n++;
+    fileops_submit(g_clipboard.kind, paths, n, g_x11_state.dirpath);
+    if (g_clipboard.kind == FILEOP_MOVE) clipboard_clear();
+    request_frame();
+}
+
+// Delete: move the rows to the trash
+void trash_selection() {
+    if (g_x11_state.replaying) return;
+    char **paths;
+    int count = selection_take_paths(&paths);
+    if (count == 0) {
+        free(paths);
+        return;
+    }
+    fileops_submit(FILEOP_TRASH, paths, count, NULL);
+}
+
+void listing_remove_row(Listing *l, int row) {
+    memmove(&l->names[row], &l->names[row + 1], (size_t)(l->count - row - 1) * sizeof(char *));
+    memmove(&l->meta[row], &l->meta[row + 1], (size_t)(l->count - row - 1) * sizeof(EntryMeta));
+    l->count--;
+}
+
+// A finished operation changes the folder on screen in place: rows that left it go, rows
+// it received come in at their sorted place, and the row at the top of the view stays put
+void apply_file_op(FileOp *op) {
+    if (op->failed) {
+        const char *verb = op->kind == FILEOP_COPY ? "copy" : op->kind == FILEOP_MOVE ? "move" : "trash";
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Cannot %s %d item%s: %s", verb, op->failed,
+                 op->failed == 1 ? "" : "s", op->error);
+    }
+    if (!file_ops_allowed()) return;
+    Listing *l = &g_x11_state.listing;
+    int top = g_x11_state.scrollPos / BUTTON_HEIGHT;
+    int within = g_x11_state.scrollPos - top * BUTTON_HEIGHT;
+    const char *anchor = top < l->count ? l->names[top] : NULL;
+    int changed = 0;
+
+    for (int i = 0; i < op->count && op->kind != FILEOP_COPY; i++) {
+        if (!op->done[i]) continue;
+        const char *slash = strrchr(op->sources[i], '/');
+        size_t dirLen = slash == op->sources[i] ? 1 : (size_t)(slash - op->sources[i]);
+        if (strlen(g_x11_state.dirpath) != dirLen || strncmp(op->sources[i], g_x11_state.dirpath, dirLen) != 0) continue;
+        for (int row = 0; row < l->count; row++) {
+            if (strcmp(l->names[row], slash + 1) != 0) continue;
+            if (l->names[row] == anchor) anchor = NULL;
+            listing_remove_row(l, row);
+            changed = 1;
+            break;
+        }
+    }
+    if (op->addedCount > 0 && strcmp(op->destDir, g_x11_state.dirpath) == 0) {
+        FilterSet filters;
+        filter_set_init(&filters, g_argc, g_argv, g_x11_state.filterStart);
+        for (int i = 0; i < op->addedCount; i++) {
+            if (!filter_set_match(&filters, op->addedNames[i])) continue;
+            if (listing_append(l, op->addedNames[i], op->addedMeta[i].type) < 0) break;
+            l->meta[l->count - 1] = op->addedMeta[i];
+            changed = 1;
+        }
+        filter_set_free(&filters);
+    }
+    if (!changed) return;
+
+    sort_listing(l, g_x11_state.sortMode);
+    // Rows moved, so metadata on its way is for the wrong rows: ask again
+    for (int i = 0; i < l->count; i++)
+        if (l->meta[i].state == META_PENDING) l->meta[i].state = META_NONE;
+    meta_loader_reset(-1);
+    selection_clear();
+    g_x11_state.hoverName = NULL;
+    g_preview.hoverName = NULL;
+    g_x11_state.buttonPressed = 0;
+    index_listing();
+    int row = top < l->count ? top : (l->count > 0 ? l->count - 1 : 0);
+    for (int i = 0; anchor && i < l->count; i++)
+        if (l->names[i] == anchor) row = i;
+    int scroll = row * BUTTON_HEIGHT + within;
+    set_scroll_immediate(scroll < max_scroll() ? scroll : max_scroll());
+    start_dir_sizes();
+    start_git_status();
+}
+
+// Called from the event loop: apply finished operations. Returns 1 if anything is to repaint.
+int file_ops_poll() {
+    int changed = fileops_progress();
+    for (FileOp *op; (op = fileops_take_finished()) != NULL; changed = 1) {
+        apply_file_op(op);
+        fileop_free(op);
+    }
+    return changed;
+}
+
+void dir_sizes_toggle() {
+    g_dirsizes.enabled = !g_dirsizes.enabled;
+    start_dir_sizes();
+    request_frame();
+}
+
+// Open a file with the default application
+void launch_file(const char *fullPath) {
+    if (g_x11_state.replaying) return;
+    int rc = open_with_default_app(fullPath);
+    if (rc != 0) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Cannot run xdg-open: %s", strerror(rc));
+        return;
+    }
+    if (!g_x11_state.inArchive) recent_log_launch(fullPath);   // extracted members are temporary
+    if (g_x11_state.clickTime > 0) counters_add_us(&g_counters.launchUs, monotonic_seconds() - g_x11_state.clickTime);
+    g_x11_state.clickTime = 0;
+}
+
+// Split an application's Exec line into arguments (desktop entry spec): double quotes group,
+// a backslash inside them escapes the next character, and field codes expand. No files are
+// passed, so %f %F %u %U and the deprecated codes disappear, along with an argument left empty.
+int app_exec_argv(const AppEntry *e, char *buf, size_t bufLen, char **args, int maxArgs) {
+    const char *s = e->exec;
+    size_t used = 0;
+    int count = 0;
+    while (*s) {
+        while (*s == ' ' || *s == '\t') s++;
+        if (!*s) break;
+        char *arg = buf + used;
+        int kept = 0;      // a quote or a literal character was seen: keep the argument even if empty
+        int quoted = 0;
+        for (; *s && (quoted || (*s != ' ' && *s != '\t')); s++) {
+            const char *add = NULL;
+            char one[2] = { *s, '\0' };
+            if (*s == '"') {
+                quoted = !quoted;
+                kept = 1;
+                continue;
+            } else if (quoted && *s == '\\' && s[1]) {
+                one[0] = *++s;
+                add = one;
+            } else if (*s == '%' && s[1]) {
+                char code = *++s;
+                if (code == '%') add = "%";
+                else if (code == 'c') add = e->name;
+                else if (code == 'k') add = e->path;
+                else if (code == 'i' && e->icon[0] && buf + used == arg && count + 2 < maxArgs && used + strlen(e->icon) + 8 < bufLen) {
+                    // Two arguments of its own: --icon <Icon>
+                    args[count++] = strcpy(buf + used, "--icon");
+                    used += 7;
+                    arg = buf + used;
+                    add = e->icon;
+                }
+            } else {
+                add = one;
+            }
+            if (!add) continue;
+            size_t len = strlen(add);
+            if (used + len + 1 >= bufLen) return -1;
+            memcpy(buf + used, add, len);
+            used += len;
+            kept = 1;
         }
+        if (!kept) continue;
+        if (count + 1 >= maxArgs || used + 1 >= bufLen) return -1;
+        buf[used++] = '\0';
+        args[count++] = arg;
+    }
+    args[count] = NULL;
+    return count;
+}
+
+// Start an application from its desktop entry, in its own session so it outlives us
+void launch_app(const AppEntry *e) {
+    if (g_x11_state.replaying) return;
+    char buf[8192];
+    char *args[128];
+    int prefix = 0;
+    if (e->terminal) {
+        const char *term = getenv("TERMINAL");
+        args[prefix++] = (char *)(term && term[0] ? term : "x-terminal-emulator");
+        args[prefix++] = (char *)"-e";
+    }
+    int count = app_exec_argv(e, buf, sizeof(buf), args + prefix, 128 - prefix);
+    if (count <= 0) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Cannot start %s: bad Exec line", e->name);
+        return;
+    }
+
+    // Earlier launches that have exited
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+    if (e->workdir[0]) posix_spawn_file_actions_addchdir_np(&actions, e->workdir);
+    pid_t pid;
+    int rc = posix_spawnp(&pid, args[0], &actions, &attr, args, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0) {
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText), "Cannot start %s: %s", e->name, strerror(rc));
+        return;
+    }
+    if (g_x11_state.clickTime > 0) counters_add_us(&g_counters.launchUs, monotonic_seconds() - g_x11_state.clickTime);
+    g_x11_state.clickTime = 0;
+}
+
+// Install the result of a finished navigation
+void apply_io_result(IoRequest *req) {
+    if (req->status != 0) {
+        // The path is cut to leave room for the reason
+        snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText),
+                 "Cannot open %.400s: %s", req->path, strerror(req->status));
+    } else if (!req->isDirectory) {
+        if (req->flags & IO_LAUNCH_IF_FILE) launch_file(req->resolved);
+    } else {
+        // A rescan of the snapshot on screen keeps the view where it is
+        int scroll = 0;
+        if (g_x11_state.stale && (req->flags & IO_REVALIDATE) && strcmp(req->resolved, g_x11_state.dirpath) == 0)
+            scroll = session_revalidated_scroll(&g_x11_state.listing, &req->listing);
+        g_x11_state.stale = 0;
+
+        Listing old = g_x11_state.listing;
+        g_x11_state.listing = req->listing;
+        memset(&req->listing, 0, sizeof(req->listing));
+        listing_free(&old);
+
+        search_view_close();
+        meta_loader_reset(req->dirfd);
+        req->dirfd = -1;
+        snprintf(g_x11_state.dirpath, sizeof(g_x11_state.dirpath), "%s", req->resolved);
+        g_x11_state.inArchive = req->inArchive;
+        g_x11_state.merged = req->merged;
+        if (req->merged) {
+            roots_free(&g_roots);
+            g_roots = req->roots;
+            req->roots.count = 0;
+        }
+        selection_clear();
+        app_index_free(g_x11_state.apps);
+        free(g_x11_state.appRows);
+        g_x11_state.apps = req->apps;
+        g_x11_state.appRows = req->appRows;
+        req->apps = NULL;
+        req->appRows = NULL;
+        recent_paths_free(g_x11_state.recentPaths);
+        g_x11_state.recentPaths = req->recentPaths;
+        req->recentPaths = NULL;
+        g_x11_state.hoverName = NULL;
+        g_preview.hoverName = NULL;
+        g_x11_state.filterStart = req->filterStart;
+        g_x11_state.statusText[0] = '\0';
+        if (req->merged && req->failedRoot >= 0) {
+            snprintf(g_x11_state.statusText, sizeof(g_x11_state.statusText),
+                     "Cannot open %s", g_roots.labels[req->failedRoot]);
+        }
+        g_x11_state.buttonPressed = 0;
+        index_listing();
+        set_scroll_immediate(scroll < max_scroll() ? scroll : max_scroll());
+        start_dir_sizes();
+        start_git_status();
+    }
+    io_request_free(req);
+    request_frame();
+}
+
+// Visible row range [first, last) for the current scroll position
+void visible_rows(int *first, int *last) {
+    *first = g_x11_state.scrollPos / BUTTON_HEIGHT;
+    *last = (g_x11_state.scrollPos + g_x11_state.windowHeight - BUTTON_START_Y) / BUTTON_HEIGHT + 1;
+    if (*last > g_x11_state.listing.count) *last = g_x11_state.listing.count;
+    if (*first > *last) *first = *last;
+}
+
+// ---- drawing backend ----
+// draw_window() and its helpers draw through these, so the same code either issues
+// Xlib requests or renders into the software canvas.
+
+void gfx_fill(int x, int y, int w, int h, unsigned long color) {
+    if (g_soft.canvas) {
+        canvas_fill_rect(g_soft.canvas, x, y, w, h, (uint32_t)color);
+        return;
+    }
+    XSetForeground(g_x11_state.display, g_x11_state.gc, color);
+    XFillRectangle(g_x11_state.display, g_x11_state.window, g_x11_state.gc, x, y, (unsigned)w, (unsigned)h);
+}
+
+// Outline with XDrawRectangle semantics: covers (w + 1) x (h + 1) pixels
+void gfx_rect(int x, int y, int w, int h, unsigned long color) {
+    if (g_soft.canvas) {
+        canvas_draw_rect(g_soft.canvas, x, y, w, h, (uint32_t)color);
+        return;
+    }
+    XSetForeground(g_x11_state.display, g_x11_state.gc, color);
+    XDrawRectangle(g_x11_state.display, g_x11_state.window, g_x11_state.gc, x, y, (unsigned)w, (unsigned)h);
+}
+
+// Text with its baseline at y
+void gfx_text(int x, int y, const char *text, unsigned long color) {
+    if (g_soft.canvas) {
+        canvas_draw_text(g_soft.canvas, x, y, text, (uint32_t)color);
+        return;
+    }
+    XSetForeground(g_x11_state.display, g_x11_state.gc, color);
+    XDrawString(g_x11_state.display, g_x11_state.window, g_x11_state.gc, x, y, text, strlen(text));
+}
+
+int gfx_text_width(const char *text) {
+    if (g_soft.canvas) return font_text_width(text);
+    int len = (int)strlen(text);
+    return g_x11_state.font ? XTextWidth(g_x11_state.font, text, len) : len * 6;
+}
+
+void gfx_clip(int x, int y, int w, int h) {
+    if (g_soft.canvas) {
+        canvas_clip(g_soft.canvas, x, y, w, h);
+        return;
+    }
+    XRectangle clip_rect = { (short)x, (short)y, (unsigned short)w, (unsigned short)h };
+    XSetClipRectangles(g_x11_state.display, g_x11_state.gc, 0, 0, &clip_rect, 1, Unsorted);
+}
+
+void gfx_unclip() {
+    if (g_soft.canvas) {
+        canvas_unclip(g_soft.canvas);
+        return;
+    }
+    XSetClipMask(g_x11_state.display, g_x11_state.gc, None);
+}
+
+// Draw a decoded thumbnail. Returns 0 if it is not held in a form this backend can draw.
+int gfx_thumb(const ThumbEntry *t, int x, int y) {
+    if (g_soft.canvas) {
+        if (!t->pixels) return 0;
+        canvas_blit(g_soft.canvas, x, y, t->pixels, t->width, t->height);
+        return 1;
     }
-    g_x11_state.fileCount = 0;
+    if (!t->pixmap) return 0;
+    XCopyArea(g_x11_state.display, t->pixmap, g_x11_state.window, g_x11_state.gc,
+              0, 0, (unsigned)t->width, (unsigned)t->height, x, y);
+    return 1;
 }
 
 // Draw text at position
@@ -974,34 +11346,362 @@ void draw_text(Display *display, Window window, GC gc, int x, int y, const char
 
 // Draw a button
 void draw_button(Display *display, Window window, GC gc, int x, int y, int width, int height, const char *label, int isPressed) {
+    (void)display; (void)window; (void)gc;
     // Draw button background
-    if (isPressed) {
-        XSetForeground(display, gc, 0x888888);
-    } else {
-        XSetForeground(display, gc, 0xDDDDDD);
-    }
-    XFillRectangle(display, window, gc, x, y, width, height);
+    gfx_fill(x, y, width, height, isPressed ? 0x888888 : 0xDDDDDD);
     
     // Draw border
-    XSetForeground(display, gc, 0x000000);
-    XDrawRectangle(display, window, gc, x, y, width - 1, height - 1);
+    gfx_rect(x, y, width - 1, height - 1, 0x000000);
     
     // Draw text
-    XSetForeground(display, gc, 0x000000);
-    XDrawString(display, window, gc, x + 10, y + 12, label, strlen(label));
+    gfx_text(x + 10, y + 12, label, 0x000000);
+}
+
+// Draw the type icon of a row; a hollow box stands in until its metadata arrives
+void draw_row_icon(int icon, int x, int y) {
+    static const unsigned long colors[] = {
+        0xBBBBBB, 0xE8B84A, 0xF4F4F4, 0x6BBF59, 0xFFFFFF, 0xA0724B, 0x5B8DD9, 0x9B6BD9
+    };
+    if (icon != ICON_PLACEHOLDER) {
+        gfx_fill(x, y, 12, 12, colors[icon]);
+    }
+    gfx_rect(x, y, 11, 11, icon == ICON_PLACEHOLDER ? 0xBBBBBB : 0x333333);
+}
+
+// Draw a file row: button, type icon, name and (for files) the size, or a placeholder
+void draw_file_row(int row, int yPos, int isPressed) {
+    const Listing *l = &g_x11_state.listing;
+    const EntryMeta *m = &l->meta[row];
+
+    int selected = g_x11_state.selected && g_x11_state.selected[row];
+    gfx_fill(10, yPos, BUTTON_WIDTH, BUTTON_HEIGHT - 5, isPressed ? 0x888888 : selected ? 0xB8D0EE : 0xDDDDDD);
+    gfx_rect(10, yPos, BUTTON_WIDTH - 1, BUTTON_HEIGHT - 6, 0x000000);
+
+    // Image rows show a thumbnail once it is decoded and uploaded, the type icon until then.
+    // Members of an archive are not files on disk, so they keep the icon.
+    int icon = row_icon(l, row);
+    ThumbEntry *thumb = NULL;
+    if (icon == ICON_IMAGE && !g_x11_state.inArchive) {
+        char fullPath[MAX_PATH_LEN];
+        row_path(row, fullPath, sizeof(fullPath));
+        thumb = thumb_get(fullPath, m->mtime, m->size);
+    }
+    if (!thumb || !gfx_thumb(thumb, 14 + (THUMB_ROW_SIZE - thumb->width) / 2,
+                             yPos + 3 + (THUMB_ROW_SIZE - thumb->height) / 2)) {
+        draw_row_icon(icon, 22, yPos + 11);
+    }
+
+    // Git work trees: a stripe for modified and untracked rows, ignored ones greyed out
+    int git = git_status_get(row);
+    if (git == GIT_MODIFIED || git == GIT_UNTRACKED)
+        gfx_fill(11, yPos + 1, 4, BUTTON_HEIGHT - 7, git == GIT_MODIFIED ? 0xE08A00 : 0x2E9E44);
+    gfx_text(48, yPos + 12, l->names[row], git == GIT_IGNORED ? 0x888888 : 0x000000);
+
+    // Duplicate groups: a stripe that alternates in colour from one group to the next
+    if (g_search_view.duplicates && g_search_view.job && row < g_search_view.count)
+        gfx_fill(11, yPos + 1, 4, BUTTON_HEIGHT - 7, g_search_view.hits[row].group % 2 ? 0x9AA8C0 : 0x3366AA);
+
+    // Merged listings tag each row with its folder, shortened to the last component if long
+    if (g_x11_state.merged) {
+        const char *label = g_roots.labels[m->root];
+        if (gfx_text_width(label) > BUTTON_WIDTH / 2) {
+            const char *slash = strrchr(g_roots.paths[m->root], '/');
+            label = slash && slash[1] ? slash + 1 : g_roots.paths[m->root];
+        }
+        gfx_text(48, yPos + 28, label, 0x3366AA);
+    } else if (g_x11_state.recentPaths) {
+        // Recent files under their folder, its tail if it does not fit
+        const char *path = g_x11_state.recentPaths[row];
+        const char *slash = strrchr(path, '/');
+        char folder[MAX_PATH_LEN];
+        snprintf(folder, sizeof(folder), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+        const char *label = folder;
+        while (gfx_text_width(label) > BUTTON_WIDTH / 2 && (slash = strchr(label + 1, '/')) != NULL) label = slash;
+        gfx_text(48, yPos + 28, label, 0x3366AA);
+    }
+
+    char text[64];
+    long long dirBytes = 0;
+    int dirState = DIRSIZE_NONE;
+    unsigned long color = m->state == META_READY ? 0x555555 : 0xAAAAAA;
+    if (g_search_view.job && row < g_search_view.count) {
+        // Search results: hit count next to the size, or the number of copies
+        char size[32];
+        format_size(m->size, size, sizeof(size));
+        snprintf(text, sizeof(text), g_search_view.duplicates ? "%d copies, %s" : "%d hits, %s",
+                 g_search_view.hits[row].hits, size);
+    } else if (g_x11_state.apps) {
+        // Applications: their first category where a file shows its size
+        const char *categories = g_x11_state.apps->entries[g_x11_state.appRows[row]].categories;
+        size_t len = strcspn(categories, ";");
+        if (len == 0) return;
+        snprintf(text, sizeof(text), "%.*s", (int)(len < 40 ? len : 40), categories);
+    } else if ((dirState = dirsizes_get(row, &dirBytes)) == DIRSIZE_RUNNING || dirState == DIRSIZE_DONE) {
+        // Folder sizes stay grey while they are still growing
+        if (dirState == DIRSIZE_RUNNING && dirBytes == 0) strcpy(text, "...");
+        else format_size(dirBytes, text, sizeof(text));
+        color = dirState == DIRSIZE_DONE ? 0x555555 : 0xAAAAAA;
+    } else if (m->state == META_READY) {
+        if (S_ISDIR(m->mode)) text[0] = '\0';
+        else format_size(m->size, text, sizeof(text));
+    } else if (m->state == META_FAILED) {
+        return;
+    } else {
+        strcpy(text, "...");
+    }
+    int width = text[0] ? gfx_text_width(text) : 0;
+    if (text[0]) gfx_text(10 + BUTTON_WIDTH - 8 - width, yPos + 28, text, color);
+
+    // Folders: a badge with their entry count, left of the size if there is one
+    const ChildCount *cc = child_count_row(row);
+    if (cc) {
+        char badge[16];
+        if (cc->count >= CHILDREN_CAP) snprintf(badge, sizeof(badge), "%dk+", CHILDREN_CAP / 1000);
+        else snprintf(badge, sizeof(badge), "%d", cc->count);
+        int badgeWidth = gfx_text_width(badge) + 8;
+        int x = 10 + BUTTON_WIDTH - 8 - width - (width ? 6 : 0) - badgeWidth;
+        gfx_fill(x, yPos + 18, badgeWidth, 14, 0xC4CEDC);
+        gfx_text(x + 4, yPos + 28, badge, 0x333333);
+    }
+}
+
+// Letter strip is shown for name-sorted listings that need scrolling
+int strip_visible() {
+    return g_x11_state.jump.keyCount > 1 && max_scroll() > 0;
+}
+
+// Width of the list with its scrollbar; the preview pane, when open, takes the rest
+int list_area_width() {
+    int width = g_x11_state.windowWidth - (g_preview.shown ? PREVIEW_WIDTH : 0);
+    return width > BUTTON_WIDTH ? width : BUTTON_WIDTH;
+}
+
+// Right edge of the file list, left of the letter strip and scrollbar
+int list_right_edge() {
+    return list_area_width() - SCROLLBAR_WIDTH - (strip_visible() ? STRIP_WIDTH : 0);
+}
+
+// Scrollbar thumb geometry. Returns 0 when the list does not scroll.
+int scrollbar_thumb(int *thumbY, int *thumbHeight) {
+    int clientHeight = g_x11_state.windowHeight - BUTTON_START_Y;
+    long long totalContentHeight = (long long)g_x11_state.listing.count * BUTTON_HEIGHT;
+    int maxScroll = max_scroll();
+    if (maxScroll <= 0) return 0;
+
+    *thumbHeight = (int)((long long)clientHeight * clientHeight / totalContentHeight);
+    if (*thumbHeight < 20) *thumbHeight = 20;
+    *thumbY = BUTTON_START_Y + (int)((long long)g_x11_state.scrollPos * (clientHeight - *thumbHeight) / maxScroll);
+    return 1;
+}
+
+// Letter strip layout: number of cells shown and the key step between them
+void strip_layout(int *cells, int *step, int *cellHeight) {
+    int clientHeight = g_x11_state.windowHeight - BUTTON_START_Y;
+    int keyCount = g_x11_state.jump.keyCount;
+    int maxCells = clientHeight / 12;
+    if (maxCells < 1) maxCells = 1;
+    *step = (keyCount + maxCells - 1) / maxCells;
+    if (*step < 1) *step = 1;
+    *cells = (keyCount + *step - 1) / *step;
+    *cellHeight = clientHeight / (*cells > 0 ? *cells : 1);
+}
+
+// Key under a y coordinate of the letter strip
+unsigned strip_key_at(int y) {
+    int cells, step, cellHeight;
+    strip_layout(&cells, &step, &cellHeight);
+    int cell = (y - BUTTON_START_Y) / (cellHeight > 0 ? cellHeight : 1);
+    if (cell < 0) cell = 0;
+    if (cell >= cells) cell = cells - 1;
+    return g_x11_state.jump.keys[cell * step];
+}
+
+void draw_letter_strip() {
+    if (!strip_visible()) return;
+    int x = list_area_width() - SCROLLBAR_WIDTH - STRIP_WIDTH;
+    int clientHeight = g_x11_state.windowHeight - BUTTON_START_Y;
+
+    gfx_fill(x, BUTTON_START_Y, STRIP_WIDTH, clientHeight, 0xEEEEEE);
+
+    // Highlight the bucket of the top visible row
+    unsigned current = 0;
+    int top = g_x11_state.scrollPos / BUTTON_HEIGHT;
+    if (top < g_x11_state.listing.count) current = jump_key(g_x11_state.listing.names[top]);
+
+    int cells, step, cellHeight;
+    strip_layout(&cells, &step, &cellHeight);
+    for (int c = 0; c < cells; c++) {
+        unsigned key = g_x11_state.jump.keys[c * step];
+        char label[5];
+        utf8_encode(key, label);
+        int y = BUTTON_START_Y + c * cellHeight;
+        gfx_text(x + 4, y + cellHeight / 2 + 4, label, key == current ? 0x000000 : 0x777777);
+    }
+}
+
+// Jump so that row becomes the top row; O(1), only the new viewport is drawn
+void jump_to_row(int row) {
+    if (row < 0) return;
+    long long pos = (long long)row * BUTTON_HEIGHT;
+    int maxScroll = max_scroll();
+    set_scroll_immediate(pos > maxScroll ? maxScroll : (int)pos);
+}
+
+// Map a thumb position straight to a scroll offset
+void drag_thumb_to(int y) {
+    int thumbY, thumbHeight;
+    if (!scrollbar_thumb(&thumbY, &thumbHeight)) return;
+    int clientHeight = g_x11_state.windowHeight - BUTTON_START_Y;
+    int track = clientHeight - thumbHeight;
+    int top = y - g_x11_state.dragOffset - BUTTON_START_Y;
+    if (top < 0) top = 0;
+    if (top > track) top = track;
+    set_scroll_immediate(track > 0 ? (int)((long long)top * max_scroll() / track) : 0);
+}
+
+// Jump to the first row of the bucket under the pointer on the letter strip
+void drag_strip_to(int y) {
+    int row = jump_find(&g_x11_state.jump, strip_key_at(y), -1);
+    jump_to_row(row);
+}
+
+// Jump-by-key: next run of rows starting with the typed character after the top row
+void handle_jump_key(unsigned cp) {
+    if (g_x11_state.jump.count == 0) return;
+    int top = g_x11_state.scrollPos / BUTTON_HEIGHT;
+    jump_to_row(jump_find(&g_x11_state.jump, jump_key_for_codepoint(cp), top));
+}
+
+// Left button on the scrollbar or strip. Returns 1 if it was handled there.
+int handle_scrollbar_press(int x, int y) {
+    int right = list_area_width();
+    if (y < BUTTON_START_Y || x >= right) return 0;
+    int thumbY, thumbHeight;
+    if (x >= right - SCROLLBAR_WIDTH) {
+        if (!scrollbar_thumb(&thumbY, &thumbHeight)) return 1;
+        // Grab the thumb where it was clicked, or centre it under the pointer when clicking the track
+        g_x11_state.dragOffset = (y >= thumbY && y < thumbY + thumbHeight) ? y - thumbY : thumbHeight / 2;
+        g_x11_state.dragMode = DRAG_THUMB;
+        drag_thumb_to(y);
+        return 1;
+    }
+    if (strip_visible() && x >= right - SCROLLBAR_WIDTH - STRIP_WIDTH) {
+        g_x11_state.dragMode = DRAG_STRIP;
+        drag_strip_to(y);
+        return 1;
+    }
+    return 0;
+}
+
+// The preview pane: name and size of the file under the pointer, then its first lines
+// or what kind of binary it is
+void draw_preview_pane() {
+    Preview *pv = &g_preview;
+    if (!pv->shown) return;
+    int x = list_area_width();
+    int width = g_x11_state.windowWidth - x;
+    int height = g_x11_state.windowHeight;
+    if (width <= 1) return;
+    gfx_fill(x, 0, width, height, 0xF6F6F6);
+    gfx_fill(x, 0, 1, height, 0xAAAAAA);
+    if (!pv->path) {
+        gfx_text(x + 10, 24, "Rest the pointer on a file", 0x777777);
+        return;
+    }
+
+    gfx_clip(x + 1, 0, width - 1, height);
+    const char *slash = strrchr(pv->path, '/');
+    gfx_text(x + 10, 24, slash ? slash + 1 : pv->path, 0x000000);
+
+    char info[128], size[32], date[32] = "";
+    time_t mtime = (time_t)pv->mtime;
+    struct tm tm;
+    if (localtime_r(&mtime, &tm)) strftime(date, sizeof(date), "%Y-%m-%d %H:%M", &tm);
+    format_size(pv->size, size, sizeof(size));
+
+    const char *body = NULL;
+    unsigned long bodyColor = 0x000000;
+    if (S_ISDIR(pv->mode)) {
+        snprintf(info, sizeof(info), "Folder, modified %s", date);
+    } else {
+        snprintf(info, sizeof(info), "%s, modified %s", size, date);
+        PreviewEntry *e = pv->inArchive ? NULL : preview_find(pv->path, pv->mtime, pv->size);
+        if (pv->inArchive) {
+            body = "Inside an archive: open it to see the contents";
+            bodyColor = 0x777777;
+        } else if (!e) {
+            body = "...";
+            bodyColor = 0xAAAAAA;
+        } else {
+            body = e->text ? e->text : "";
+            bodyColor = e->kind == PREVIEW_TEXT ? 0x000000 : (e->kind == PREVIEW_BINARY ? 0x555555 : 0xCC0000);
+        }
+    }
+    gfx_text(x + 10, 42, info, 0x555555);
+
+    // One text line per file line, until the pane is full
+    char line[PREVIEW_LINE_BYTES + 8];
+    int y = 68;
+    for (const char *p = body; p && *p && y < height + 12; y += 15) {
+        const char *end = strchr(p, '\n');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len >= sizeof(line)) len = sizeof(line) - 1;
+        memcpy(line, p, len);
+        line[len] = '\0';
+        if (len) gfx_text(x + 10, y, line, bodyColor);
+        if (!end) break;
+        p = end + 1;
+    }
+    gfx_unclip();
 }
 
 // Draw the entire window
 void draw_window() {
-    if (!g_x11_state.display) return;
+    if (!g_x11_state.display && !g_soft.canvas) return;
+    if (g_soft.image && !soft_begin_frame()) return;
     
     // Clear window
-    XSetForeground(g_x11_state.display, g_x11_state.gc, 0xFFFFFF);
-    XFillRectangle(g_x11_state.display, g_x11_state.window, g_x11_state.gc, 0, 0, g_x11_state.windowWidth, g_x11_state.windowHeight);
+    gfx_fill(0, 0, g_x11_state.windowWidth, g_x11_state.windowHeight, 0xFFFFFF);
     
-    // Draw current directory path
-    XSetForeground(g_x11_state.display, g_x11_state.gc, 0x000000);
-    draw_text(g_x11_state.display, g_x11_state.window, g_x11_state.gc, 10, 60, g_x11_state.dirpath);
+    // Draw current directory path, or the folder being loaded
+    char pendingPath[MAX_PATH_LEN];
+    int overdue = 0;
+    if (g_search_view.editing) {
+        char line[512];
+        snprintf(line, sizeof(line), "%s: %s_", g_search_view.recursive ? "Find in subfolders" : "Find in files",
+                 g_search_view.query);
+        gfx_text(10, 72, line, 0x000000);
+        gfx_text(10, 90, "Enter searches, Esc cancels", 0x777777);
+    } else if (io_pending(pendingPath, sizeof(pendingPath), &overdue, NULL) && (overdue || !g_x11_state.stale)) {
+        char line[MAX_PATH_LEN + 64];
+        snprintf(line, sizeof(line), overdue ? "Not responding: %s" : "Loading: %s", pendingPath);
+        gfx_text(10, 72, line, overdue ? 0xCC0000 : 0x777777);
+        if (overdue) {
+            gfx_text(10, 90, "Esc or x closes, Up goes back", 0xCC0000);
+        }
+    } else {
+        char line[512];
+        double fraction = 0;
+        gfx_text(10, 72, g_x11_state.dirpath, 0x000000);
+        if (g_x11_state.statusText[0]) {
+            gfx_text(10, 90, g_x11_state.statusText, 0xCC0000);
+        } else if (fileops_status(line, sizeof(line), &fraction)) {
+            // Operation under way, with a bar along the bottom of the line
+            gfx_text(10, 90, line, 0x3366AA);
+            gfx_fill(10, 96, (int)((list_area_width() - 20) * (fraction < 1 ? fraction : 1)), 3, 0x3366AA);
+        } else if (g_search_view.job) {
+            unsigned long color = search_view_status(line, sizeof(line));
+            gfx_text(10, 90, line, color);
+        } else if (g_x11_state.selectedCount > 0) {
+            snprintf(line, sizeof(line), "%d selected: Ctrl+C copies, Ctrl+X cuts, Delete trashes",
+                     g_x11_state.selectedCount);
+            gfx_text(10, 90, line, 0x777777);
+        } else if (g_clipboard.count > 0) {
+            snprintf(line, sizeof(line), "%d to %s: Ctrl+V puts %s here", g_clipboard.count,
+                     g_clipboard.kind == FILEOP_COPY ? "copy" : "move", g_clipboard.count == 1 ? "it" : "them");
+            gfx_text(10, 90, line, 0x777777);
+        }
+    }
     
     // Draw control buttons
     draw_button(g_x11_state.display, g_x11_state.window, g_x11_state.gc, 10, 10, 80, 40, "↑", 0);
@@ -1009,48 +11709,38 @@ void draw_window() {
     draw_button(g_x11_state.display, g_x11_state.window, g_x11_state.gc, 190, 10, 80, 40, "×", 0);
     
     // === CLIPPING FOR FILE BUTTONS ===
-    XRectangle clip_rect;
-    clip_rect.x = 0;
-    clip_rect.y = BUTTON_START_Y;
-    clip_rect.width = g_x11_state.windowWidth - 20;  // leave space for scrollbar
-    clip_rect.height = g_x11_state.windowHeight - BUTTON_START_Y;
-    XSetClipRectangles(g_x11_state.display, g_x11_state.gc, 0, 0, &clip_rect, 1, Unsorted);
-
-    // Draw file buttons (vertical list) - now properly clipped
-    for (int i = 0; i < g_x11_state.fileCount; i++) {
+    // leave space for scrollbar and letter strip
+    gfx_clip(0, BUTTON_START_Y, list_right_edge(), g_x11_state.windowHeight - BUTTON_START_Y);
+
+    // Draw file buttons (vertical list) - only the rows inside the viewport,
+    // whose metadata is requested from the demand loader
+    int firstRow, lastRow;
+    visible_rows(&firstRow, &lastRow);
+    meta_request_viewport(&g_x11_state.listing, firstRow, lastRow);
+    child_counts_viewport(firstRow, lastRow);
+    for (int i = firstRow; i < lastRow; i++) {
         int yPos = BUTTON_START_Y + (i * BUTTON_HEIGHT) - g_x11_state.scrollPos;
-        
-        // Only draw if at least partially visible (extra safety)
-        if (yPos + BUTTON_HEIGHT > BUTTON_START_Y && yPos < g_x11_state.windowHeight) {
-            int isPressed = (g_x11_state.buttonPressed == i + 1);
-            draw_button(g_x11_state.display, g_x11_state.window, g_x11_state.gc,
-                        10, yPos, BUTTON_WIDTH, BUTTON_HEIGHT - 5, g_x11_state.files[i], isPressed);
-        }
+        draw_file_row(i, yPos, g_x11_state.buttonPressed == i + 1);
     }
 
     // Remove clipping for scrollbar and other elements
-    XSetClipMask(g_x11_state.display, g_x11_state.gc, None);
+    gfx_unclip();
     
     // Draw scrollbar visual (outside clipped area)
     int clientHeight = g_x11_state.windowHeight - BUTTON_START_Y;
-    int totalContentHeight = g_x11_state.fileCount * BUTTON_HEIGHT;
-    int maxScroll = totalContentHeight - clientHeight;
+    int thumbY, thumbHeight;
     
-    if (maxScroll > 0) {
-        XSetForeground(g_x11_state.display, g_x11_state.gc, 0xAAAAAA);
-        XFillRectangle(g_x11_state.display, g_x11_state.window, g_x11_state.gc,
-                       g_x11_state.windowWidth - 20, BUTTON_START_Y, 20, clientHeight);
-        
-        int thumbHeight = (clientHeight * clientHeight) / totalContentHeight;
-        if (thumbHeight < 20) thumbHeight = 20;
-        int thumbY = BUTTON_START_Y + (g_x11_state.scrollPos * (clientHeight - thumbHeight)) / maxScroll;
-        
-        XSetForeground(g_x11_state.display, g_x11_state.gc, 0x666666);
-        XFillRectangle(g_x11_state.display, g_x11_state.window, g_x11_state.gc,
-                       g_x11_state.windowWidth - 20, thumbY, 20, thumbHeight);
+    if (scrollbar_thumb(&thumbY, &thumbHeight)) {
+        int scrollbarX = list_area_width() - SCROLLBAR_WIDTH;
+        gfx_fill(scrollbarX, BUTTON_START_Y, SCROLLBAR_WIDTH, clientHeight, 0xAAAAAA);
+        gfx_fill(scrollbarX, thumbY, SCROLLBAR_WIDTH, thumbHeight,
+                 g_x11_state.dragMode == DRAG_THUMB ? 0x333333 : 0x666666);
     }
+    draw_letter_strip();
+    draw_preview_pane();
     
-    XFlush(g_x11_state.display);
+    if (g_soft.image) soft_present();
+    if (g_x11_state.display) XFlush(g_x11_state.display);
 }
 
 // Check if point is inside a button
@@ -1060,57 +11750,50 @@ int is_point_in_button(int x, int y, int buttonX, int buttonY, int buttonWidth,
 
 // Handle file button click
 void handle_file_button_click(int buttonIndex) {
-    if (buttonIndex < 0 || buttonIndex >= g_x11_state.fileCount) return;
+    if (buttonIndex < 0 || buttonIndex >= g_x11_state.listing.count) return;
+    g_x11_state.clickTime = monotonic_seconds();
     
+    if (g_x11_state.apps) {
+        launch_app(&g_x11_state.apps->entries[g_x11_state.appRows[buttonIndex]]);
+        return;
+    }
+
     char fullPath[MAX_PATH_LEN];
-    snprintf(fullPath, MAX_PATH_LEN, "%s%c%s", g_x11_state.dirpath, PATH_SEP, g_x11_state.files[buttonIndex]);
+    row_path(buttonIndex, fullPath, sizeof(fullPath));
     
-    if (is_directory(fullPath)) {
-        // Navigate into directory
-        if (set_cur_dir(fullPath)) {
-            getcwd(g_x11_state.dirpath, MAX_PATH_LEN);
-            remove_trailing_slash(g_x11_state.dirpath);
-            
-            // Reset scroll position
-            g_x11_state.scrollPos = 0;
-            
-            // Refresh the file list
-            free_files();
-            g_x11_state.fileCount = scan_directory(g_x11_state.dirpath, g_x11_state.files, g_argc, g_argv, g_x11_state.filterStart);
-            
-            draw_window();
-        }
+    // Known plain files open right away; anything that may be a directory is
+    // resolved on an I/O thread, which opens it as a file if it turns out not to be one.
+    // Archives and archive members also go through the I/O thread, to be listed or extracted.
+    const EntryMeta *m = &g_x11_state.listing.meta[buttonIndex];
+    int knownFile = m->state == META_READY ? !S_ISDIR(m->mode) : m->type == ENTRY_TYPE_FILE;
+    if (knownFile && !g_x11_state.inArchive && !is_archive_name(g_x11_state.listing.names[buttonIndex])) {
+        launch_file(fullPath);
     } else {
-        // Open file with default application
-        char cmd[MAX_PATH_LEN * 2];
-        snprintf(cmd, sizeof(cmd), "xdg-open '%s' &", fullPath);
-        system(cmd);
+        navigate_to(fullPath, IO_LAUNCH_IF_FILE);
     }
 }
 
+void recent_toggle();
+
 // Handle "Up" button - go to parent directory
 void handle_up_button() {
+    if (g_x11_state.merged) return;   // the merged folders have no common parent
+    if (g_x11_state.apps) return;     // nor do the applications
+    if (g_x11_state.recentPaths) {    // the recent files go back where they were opened from
+        recent_toggle();
+        return;
+    }
     char tempPath[MAX_PATH_LEN];
     strcpy(tempPath, g_x11_state.dirpath);
-    
-    char *lastSlash = strrchr(tempPath, '/');
-    
-    if (lastSlash) {
-        *lastSlash = '\0';
-        
-        // Try to change to parent directory
-        if (set_cur_dir(tempPath)) {
-            getcwd(g_x11_state.dirpath, MAX_PATH_LEN);
-            remove_trailing_slash(g_x11_state.dirpath);
-            
-            // Reset scroll position
-            g_x11_state.scrollPos = 0;
-            
-            // Refresh the file list
-            free_files();
-            g_x11_state.fileCount = scan_directory(g_x11_state.dirpath, g_x11_state.files, g_argc, g_argv, g_x11_state.filterStart);
-            
-            draw_window();
+    
+    char *lastSlash = strrchr(tempPath, '/');
+    
+    if (lastSlash) {
+        // Parent is computed from the path; the I/O layer does the actual work
+        if (lastSlash == tempPath) lastSlash[1] = '\0';
+        else *lastSlash = '\0';
+        if (strcmp(tempPath, g_x11_state.dirpath) != 0) {
+            navigate_to(tempPath, 0);
         }
     }
 }
@@ -1118,16 +11801,35 @@ void handle_up_button() {
 // Handle mouse scroll
 void handle_mouse_scroll(int delta) {
     int clientHeight = g_x11_state.windowHeight - BUTTON_START_Y;
-    int totalContentHeight = g_x11_state.fileCount * BUTTON_HEIGHT;
+    int totalContentHeight = g_x11_state.listing.count * BUTTON_HEIGHT;
     int maxScroll = totalContentHeight - clientHeight;
     
     if (maxScroll <= 0) return;
     
-    g_x11_state.scrollPos += delta * BUTTON_HEIGHT;
-    if (g_x11_state.scrollPos < 0) g_x11_state.scrollPos = 0;
-    if (g_x11_state.scrollPos > maxScroll) g_x11_state.scrollPos = maxScroll;
+    // Move the target; the frame scheduler animates toward it
+    g_x11_state.scrollTarget += delta * BUTTON_HEIGHT;
+    if (g_x11_state.scrollTarget < 0) g_x11_state.scrollTarget = 0;
+    if (g_x11_state.scrollTarget > maxScroll) g_x11_state.scrollTarget = maxScroll;
     
-    draw_window();
+    request_frame();
+}
+
+// Cycle sort order: name -> size -> modification time
+void handle_sort_key() {
+    if (g_x11_state.recentPaths) return;   // recent files stay in the order they were used
+    g_x11_state.sortMode = (g_x11_state.sortMode + 1) % 3;
+
+    // Size and time orders need metadata for every row, which may block; relist on an I/O thread
+    reload_listing();
+}
+
+// Row whose button is under a point, or -1 (the row follows directly from the scroll offset)
+int row_at_point(int x, int y) {
+    if (y < BUTTON_START_Y) return -1;
+    int i = (y - BUTTON_START_Y + g_x11_state.scrollPos) / BUTTON_HEIGHT;
+    if (i < 0 || i >= g_x11_state.listing.count) return -1;
+    int yPos = BUTTON_START_Y + (i * BUTTON_HEIGHT) - g_x11_state.scrollPos;
+    return is_point_in_button(x, y, 10, yPos, BUTTON_WIDTH, BUTTON_HEIGHT - 5) ? i : -1;
 }
 
 // Handle mouse button press
@@ -1138,43 +11840,46 @@ void handle_mouse_press(int x, int y) {
         return;
     }
     if (is_point_in_button(x, y, 100, 10, 80, 40)) {
-        g_x11_state.scrollPos = 0;
-        free_files();
-        g_x11_state.fileCount = scan_directory(g_x11_state.dirpath, g_x11_state.files, g_argc, g_argv, g_x11_state.filterStart);
-        draw_window();
+        set_scroll_immediate(0);
+        reload_listing();
         return;
     }
     if (is_point_in_button(x, y, 190, 10, 80, 40)) {
         g_x11_state.quitFlag = 1;
         return;
     }
+    if (handle_scrollbar_press(x, y)) {
+        return;
+    }
     
     // Check file buttons
-    for (int i = 0; i < g_x11_state.fileCount; i++) {
-        int yPos = BUTTON_START_Y + (i * BUTTON_HEIGHT) - g_x11_state.scrollPos;
-        if (yPos + BUTTON_HEIGHT > 0 && yPos < g_x11_state.windowHeight) {
-            if (is_point_in_button(x, y, 10, yPos, BUTTON_WIDTH, BUTTON_HEIGHT - 5)) {
-                g_x11_state.buttonPressed = i + 1;
-                draw_window();
-                return;
-            }
-        }
+    int i = row_at_point(x, y);
+    if (i >= 0) {
+        g_x11_state.buttonPressed = i + 1;
+        request_frame();
     }
 }
 
 // Handle mouse button release
-void handle_mouse_release(int x, int y) {
+void handle_mouse_release(int x, int y, unsigned int state) {
+    if (g_x11_state.dragMode != DRAG_NONE) {
+        g_x11_state.dragMode = DRAG_NONE;
+        request_frame();
+        return;
+    }
+
     // Check if we're still over the same button
     if (g_x11_state.buttonPressed > 0) {
         int buttonIndex = g_x11_state.buttonPressed - 1;
         int yPos = BUTTON_START_Y + (buttonIndex * BUTTON_HEIGHT) - g_x11_state.scrollPos;
         
         if (is_point_in_button(x, y, 10, yPos, BUTTON_WIDTH, BUTTON_HEIGHT - 5)) {
-            handle_file_button_click(buttonIndex);
+            if (state & ControlMask) selection_toggle(buttonIndex);
+            else handle_file_button_click(buttonIndex);
         }
         
         g_x11_state.buttonPressed = 0;
-        draw_window();
+        request_frame();
     }
 }
 
@@ -1182,15 +11887,290 @@ void handle_mouse_release(int x, int y) {
 void handle_mouse_move(int x, int y) {
     g_x11_state.mouseX = x;
     g_x11_state.mouseY = y;
+
+    if (g_x11_state.dragMode == DRAG_THUMB) drag_thumb_to(y);
+    else if (g_x11_state.dragMode == DRAG_STRIP) drag_strip_to(y);
+}
+
+// Queue the file row the pointer has rested on for READAHEAD_DWELL_MS. Checked on every
+// loop pass rather than on motion, since scrolling moves rows under a still pointer.
+// Returns the poll timeout in ms until the dwell is up, or -1.
+int readahead_tick() {
+    if (!g_readahead.running) return -1;
+    int row = g_x11_state.dragMode == DRAG_NONE ? row_at_point(g_x11_state.mouseX, g_x11_state.mouseY) : -1;
+    const char *name = row >= 0 ? g_x11_state.listing.names[row] : NULL;
+    double now = monotonic_seconds();
+    if (name != g_x11_state.hoverName) {
+        g_x11_state.hoverName = name;
+        g_x11_state.hoverSince = now;
+        g_x11_state.hoverQueued = 0;
+    }
+    if (!name || g_x11_state.hoverQueued || g_x11_state.inArchive) return -1;
+
+    // Metadata arriving later wakes the loop, which checks again
+    const EntryMeta *m = &g_x11_state.listing.meta[row];
+    if (m->state != META_READY || !S_ISREG(m->mode) || m->size == 0) return -1;
+
+    double due = g_x11_state.hoverSince + READAHEAD_DWELL_MS / 1000.0;
+    if (now < due) return (int)((due - now) * 1000.0) + 1;
+    g_x11_state.hoverQueued = 1;
+    char fullPath[MAX_PATH_LEN];
+    row_path(row, fullPath, sizeof(fullPath));
+    readahead_request(fullPath);
+    return -1;
+}
+
+// Point the pane at the row the pointer rests on. A cached preview shows at once; reading
+// a new one waits for PREVIEW_DWELL_MS so sweeping over the list does not read every file.
+// Returns the poll timeout in ms until the dwell is up, or -1.
+int preview_tick() {
+    Preview *pv = &g_preview;
+    if (!pv->shown) return -1;
+    int row = g_x11_state.dragMode == DRAG_NONE ? row_at_point(g_x11_state.mouseX, g_x11_state.mouseY) : -1;
+    if (row < 0) return -1;   // off the list the pane keeps the last file
+    const char *name = g_x11_state.listing.names[row];
+    double now = monotonic_seconds();
+    if (name != pv->hoverName) {
+        pv->hoverName = name;
+        pv->hoverSince = now;
+        pv->hoverDone = 0;
+    }
+    const EntryMeta *m = &g_x11_state.listing.meta[row];
+    if (pv->hoverDone || m->state != META_READY) return -1;   // metadata arriving wakes the loop
+
+    char fullPath[MAX_PATH_LEN];
+    row_path(row, fullPath, sizeof(fullPath));
+    int reads = S_ISREG(m->mode) && !g_x11_state.inArchive;
+    int cached = reads && preview_find(fullPath, m->mtime, m->size);
+    double due = pv->hoverSince + PREVIEW_DWELL_MS / 1000.0;
+    if (reads && !cached && now < due) return (int)((due - now) * 1000.0) + 1;
+
+    pv->hoverDone = 1;
+    free(pv->path);
+    pv->path = strdup(fullPath);
+    pv->mtime = m->mtime;
+    pv->size = m->size;
+    pv->mode = m->mode;
+    pv->inArchive = g_x11_state.inArchive;
+    if (reads && !cached) preview_request(fullPath, m->mtime, m->size);
+    request_frame();
+    return -1;
+}
+
+// Ctrl+P: open or close the pane, widening or narrowing the window by its width
+void preview_toggle() {
+    Preview *pv = &g_preview;
+    pv->shown = !pv->shown;
+    pv->hoverName = NULL;
+    g_x11_state.windowWidth += pv->shown ? PREVIEW_WIDTH : -PREVIEW_WIDTH;
+    if (g_x11_state.display && g_x11_state.window) {
+        XResizeWindow(g_x11_state.display, g_x11_state.window, (unsigned)g_x11_state.windowWidth,
+                      (unsigned)g_x11_state.windowHeight);
+    }
+    request_frame();
+}
+
+// Ctrl+R: show the recent files, or go back to the folder shown before them
+void recent_toggle() {
+    if (g_x11_state.recentPaths) {
+        if (g_x11_state.recentFrom[0]) navigate_to(g_x11_state.recentFrom, 0);
+        else navigate_to(g_argc >= 2 ? g_argv[1] : "", IO_PROBE_FIRST_ARG);
+        return;
+    }
+    // Merged, application and search listings come back as the startup folder
+    int plain = !g_x11_state.merged && !g_x11_state.apps && !g_search_view.job && !g_x11_state.stale;
+    snprintf(g_x11_state.recentFrom, sizeof(g_x11_state.recentFrom), "%s", plain ? g_x11_state.dirpath : "");
+    navigate_to("", IO_RECENT);
+}
+
+// Keyboard input. sym is the unshifted keysym, typed the text XLookupString made of the key.
+void handle_key_press(KeySym sym, unsigned int state, const char *typed, int typedLen) {
+    if (g_search_view.editing) {
+        handle_search_key(sym, typed, typedLen);
+    } else if (sym == XK_Escape) { // drops the selection, leaves search results, else quits
+        if (g_x11_state.selectedCount > 0) selection_clear();
+        else if (g_search_view.job) reload_listing();
+        else g_x11_state.quitFlag = 1;
+        request_frame();
+    } else if ((state & ControlMask) && sym == XK_a) {
+        selection_all();
+    } else if ((state & ControlMask) && sym == XK_c) {
+        clipboard_set(FILEOP_COPY);
+    } else if ((state & ControlMask) && sym == XK_x) {
+        clipboard_set(FILEOP_MOVE);
+    } else if ((state & ControlMask) && sym == XK_v) {
+        clipboard_paste();
+    } else if (sym == XK_Delete) {
+        trash_selection();
+    } else if ((state & ControlMask) && (state & ShiftMask) && sym == XK_s) {
+        dir_sizes_toggle();
+    } else if ((state & ControlMask) && sym == XK_s) {
+        handle_sort_key();
+    } else if ((state & ControlMask) && (state & ShiftMask) && sym == XK_d) {
+        g_counters.dumpRequested = 1;
+    } else if ((state & ControlMask) && sym == XK_f) {
+        begin_search_query((state & ShiftMask) != 0);
+    } else if ((state & ControlMask) && sym == XK_d) {
+        search_view_find_duplicates();
+    } else if ((state & ControlMask) && sym == XK_p) {
+        preview_toggle();
+    } else if ((state & ControlMask) && sym == XK_r) {
+        recent_toggle();
+    } else if (typedLen > 0 && isalnum((unsigned char)typed[0])) {
+        handle_jump_key((unsigned char)typed[0]);
+    }
+}
+
+// One X event; the replay driver feeds recorded events through here too
+void handle_x_event(XEvent *event) {
+    switch (event->type) {
+        case Expose:
+            if (event->xexpose.count == 0) {
+                // refresh window content
+                request_frame();
+            }
+            break;
+
+        case ButtonPress:
+            if (event->xbutton.button == 4) {
+                handle_mouse_scroll(-1);
+            } else if (event->xbutton.button == 5) {
+                handle_mouse_scroll(1);
+            } else if (event->xbutton.button == 1) {
+                handle_mouse_press(event->xbutton.x, event->xbutton.y);
+            }
+            break;
+
+        case ButtonRelease:
+            if (event->xbutton.button == 1) {
+                handle_mouse_release(event->xbutton.x, event->xbutton.y, event->xbutton.state);
+            }
+            break;
+
+        case MotionNotify:
+            handle_mouse_move(event->xmotion.x, event->xmotion.y);
+            break;
+
+        case ConfigureNotify:
+            g_x11_state.windowWidth = event->xconfigure.width;
+            g_x11_state.windowHeight = event->xconfigure.height;
+            request_frame();
+            break;
+
+        case KeyPress: {
+            char typed[8];
+            int n = XLookupString(&event->xkey, typed, sizeof(typed), NULL, NULL);
+            handle_key_press(XLookupKeysym(&event->xkey, 0), event->xkey.state, typed, n);
+            break;
+        }
+
+        case FocusOut:
+            // quit when window loses focus/activation (behavior requested)
+            g_x11_state.quitFlag = 1;
+            break;
+
+        default:
+            if (g_soft.useShm && event->type == g_soft.completionEvent) {
+                soft_upload_done();
+            }
+            break;
+    }
+}
+
+// ---- event recording ----
+
+// BT_RECORD=FILE logs every input event the loop receives, one line each:
+// "<ms since start> <kind> <fields>". --replay plays such a log back headless.
+typedef struct {
+    FILE *file;
+    double start;
+} EventLog;
+
+EventLog g_event_log;
+
+void event_log_open() {
+    const char *path = getenv("BT_RECORD");
+    if (!path || !path[0]) return;
+    g_event_log.file = fopen(path, "w");
+    if (!g_event_log.file) {
+        fprintf(stderr, "Cannot record events to %s: %s\n", path, strerror(errno));
+        return;
+    }
+    g_event_log.start = monotonic_seconds();
+    fprintf(g_event_log.file, "# better-toolbar events %dx%d\n", g_x11_state.windowWidth, g_x11_state.windowHeight);
+}
+
+void event_log_write(XEvent *event) {
+    FILE *f = g_event_log.file;
+    if (!f) return;
+    long ms = (long)((monotonic_seconds() - g_event_log.start) * 1000.0 + 0.5);
+    switch (event->type) {
+        case Expose:
+            if (event->xexpose.count == 0) fprintf(f, "%ld expose\n", ms);
+            break;
+        case ButtonPress:
+        case ButtonRelease:
+            fprintf(f, "%ld %s %u %d %d\n", ms, event->type == ButtonPress ? "press" : "release",
+                    event->xbutton.button, event->xbutton.x, event->xbutton.y);
+            break;
+        case MotionNotify:
+            fprintf(f, "%ld motion %d %d\n", ms, event->xmotion.x, event->xmotion.y);
+            break;
+        case ConfigureNotify:
+            fprintf(f, "%ld configure %d %d\n", ms, event->xconfigure.width, event->xconfigure.height);
+            break;
+        case KeyPress: {
+            // Keysym and text are stored resolved, so replay needs no keymap
+            XKeyEvent key = event->xkey;
+            char typed[8];
+            int n = XLookupString(&key, typed, sizeof(typed), NULL, NULL);
+            fprintf(f, "%ld key %lx %x ", ms, (unsigned long)XLookupKeysym(&key, 0), key.state);
+            for (int i = 0; i < n; i++) fprintf(f, "%02x", (unsigned char)typed[i]);
+            fprintf(f, "%s\n", n > 0 ? "" : "-");
+            break;
+        }
+        case FocusOut:
+            fprintf(f, "%ld focusout\n", ms);
+            break;
+    }
+}
+
+void event_log_close() {
+    if (g_event_log.file) fclose(g_event_log.file);
+    g_event_log.file = NULL;
 }
 
 // Cleanup X11 resources
 void cleanup_x11() {
+    io_layer_shutdown();
+    meta_loader_shutdown();
+    if (g_x11_state.display) thumbs_shutdown();
+    children_shutdown();
+    readahead_shutdown();
+    preview_shutdown();
+    dirsizes_cancel();
+    git_status_cancel();
+    git_index_cache_free();
+    fileops_shutdown();
+    clipboard_clear();
+    selection_clear();
+    search_view_close();
+    free(g_search_view.hits);
     free_files();
+    app_index_free(g_x11_state.apps);
+    free(g_x11_state.appRows);
+    recent_paths_free(g_x11_state.recentPaths);
+    jump_index_free(&g_x11_state.jump);
+    glyph_cache_free();
+    archive_cache_free();
     if (g_x11_state.display) {
+        soft_surface_destroy();
         if (g_x11_state.window) {
             XDestroyWindow(g_x11_state.display, g_x11_state.window);
         }
+        if (g_x11_state.font) {
+            XFreeFontInfo(NULL, g_x11_state.font, 0);
+        }
         if (g_x11_state.gc) {
             XFreeGC(g_x11_state.display, g_x11_state.gc);
         }
@@ -1198,12 +12178,468 @@ void cleanup_x11() {
     }
 }
 
+// ---- headless rendering ----
+
+// Set up the window for argv the way the GUI would, with all metadata loaded up front,
+// and point draw_window() at an offscreen canvas. Needs no X server. The window size
+// comes from BT_RENDER_SIZE (WIDTHxHEIGHT, default 300x600).
+int headless_init(int argc, char *argv[], Canvas *canvas) {
+    g_argc = argc;
+    g_argv = argv;
+    preview_init();
+    int width = 300 + (g_preview.shown ? PREVIEW_WIDTH : 0), height = 600;
+    const char *size = getenv("BT_RENDER_SIZE");
+    if (size && (sscanf(size, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)) {
+        fprintf(stderr, "Error: BT_RENDER_SIZE must look like 300x600\n");
+        return 0;
+    }
+    g_x11_state.windowWidth = width;
+    g_x11_state.windowHeight = height;
+
+    Listing *l = &g_x11_state.listing;
+    IoRequest req = { .sortMode = SORT_NAME, .dirfd = -1 };
+    if (collect_roots(argc, argv, &req.roots) >= 2) {
+        req.filterStart = req.roots.filterStart;
+        io_scan_roots(&req);
+        g_roots = req.roots;
+        if (req.status != 0) {
+            fprintf(stderr, "Error: Cannot access directory '%s'\n", g_roots.paths[0]);
+            return 0;
+        }
+        *l = req.listing;
+        g_x11_state.merged = 1;
+        g_x11_state.filterStart = req.filterStart;
+        snprintf(g_x11_state.dirpath, sizeof(g_x11_state.dirpath), "%s", req.resolved);
+    } else {
+        const char *dir = ".";
+        g_x11_state.filterStart = 1;
+        if (argc >= 2 && is_directory(argv[1])) {
+            dir = argv[1];
+            g_x11_state.filterStart = 2;
+        }
+        if (!realpath(dir, g_x11_state.dirpath) ||
+            scan_listing(g_x11_state.dirpath, l, argc, argv, g_x11_state.filterStart) < 0) {
+            fprintf(stderr, "Error: Cannot access directory '%s'\n", dir);
+            return 0;
+        }
+        collect_metadata(g_x11_state.dirpath, l, 0, l->count);
+        sort_listing(l, SORT_NAME);
+    }
+    index_listing();
+
+    uint32_t *pixels = (uint32_t *)malloc((size_t)width * height * sizeof(uint32_t));
+    if (!pixels) return 0;
+    canvas_init(canvas, pixels, width, height, width);
+    g_soft.canvas = canvas;
+    set_scroll_immediate(0);
+    return 1;
+}
+
+void headless_free(Canvas *canvas) {
+    free(canvas->pixels);
+    g_soft.canvas = NULL;
+    free_files();
+    jump_index_free(&g_x11_state.jump);
+    glyph_cache_free();
+}
+
+// --render-ppm OUT [DIR] [filters]: render the first frame to a binary PPM. The output is
+// pixel-exact for a given tree and size, so it can be diffed against a stored image.
+int render_ppm(const char *outPath, int argc, char *argv[]) {
+    Canvas canvas;
+    if (!headless_init(argc, argv, &canvas)) return 1;
+    draw_window();
+
+    FILE *f = fopen(outPath, "wb");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", outPath);
+        headless_free(&canvas);
+        return 1;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", canvas.width, canvas.height);
+    unsigned char *rgb = (unsigned char *)malloc((size_t)canvas.width * 3);
+    for (int y = 0; rgb && y < canvas.height; y++) {
+        const uint32_t *row = canvas.pixels + (size_t)y * canvas.stride;
+        for (int x = 0; x < canvas.width; x++) {
+            rgb[x * 3] = (unsigned char)(row[x] >> 16);
+            rgb[x * 3 + 1] = (unsigned char)(row[x] >> 8);
+            rgb[x * 3 + 2] = (unsigned char)row[x];
+        }
+        fwrite(rgb, 3, (size_t)canvas.width, f);
+    }
+    free(rgb);
+    int failed = ferror(f) | fclose(f);
+    headless_free(&canvas);
+    return failed ? 1 : 0;
+}
+
+// --bench-render [DIR] [filters]: time full-window software frames while scrolling
+int bench_render(int argc, char *argv[]) {
+    Canvas canvas;
+    if (!headless_init(argc, argv, &canvas)) return 1;
+    const int frames = 2000;
+    int maxScroll = max_scroll();
+    double t0 = monotonic_seconds();
+    for (int f = 0; f < frames; f++) {
+        set_scroll_immediate(maxScroll > 0 ? (int)((long long)f * 37 % (maxScroll + 1)) : 0);
+        draw_window();
+    }
+    double elapsed = monotonic_seconds() - t0;
+    printf("%d rows, %dx%d window: %d frames in %.1f ms, %.3f ms/frame (%.0f fps)\n",
+           g_x11_state.listing.count, canvas.width, canvas.height, frames, elapsed * 1e3,
+           elapsed * 1e3 / frames, frames / elapsed);
+    headless_free(&canvas);
+    return 0;
+}
+
+// ---- event replay ----
+
+// --replay LOG [DIR] [filters]: feed a BT_RECORD log through the same handlers as the event
+// loop, rendering headless, and report per kind of event how long handling it took (handler
+// plus the frame it caused) and how many frames it caused. Time is virtual: the recorded
+// timestamps drive frame pacing and the scroll animation, so two runs on the same log and
+// tree draw the same frames. Without DIR a fixed synthetic folder is generated (and removed
+// afterwards). With BT_REPLAY_BUDGET_US=N the exit status is 1 if any kind's p99 exceeds N.
+
+#define REPLAY_PRESS     0
+#define REPLAY_RELEASE   1
+#define REPLAY_MOTION    2
+#define REPLAY_SCROLL    3
+#define REPLAY_CONFIGURE 4
+#define REPLAY_KEY       5
+#define REPLAY_OTHER     6   // expose, focus out
+#define REPLAY_FRAME     7   // animation and deferred frames between events
+#define REPLAY_IO        8   // waiting for a navigation the event started
+#define REPLAY_KINDS     9
+
+typedef struct {
+    const char *name;
+    double *samples;        // seconds
+    int count;
+    int capacity;
+    unsigned long long frames;
+} ReplayKind;
+
+ReplayKind g_replay_kinds[REPLAY_KINDS] = {
+    { .name = "press" }, { .name = "release" }, { .name = "motion" }, { .name = "scroll" },
+    { .name = "configure" }, { .name = "key" }, { .name = "other" }, { .name = "frame" }, { .name = "io" },
+};
+
+void replay_sample(int kind, double seconds) {
+    ReplayKind *k = &g_replay_kinds[kind];
+    if (k->count == k->capacity) {
+        int cap = k->capacity ? k->capacity * 2 : 256;
+        double *grown = (double *)realloc(k->samples, (size_t)cap * sizeof(double));
+        if (!grown) return;
+        k->samples = grown;
+        k->capacity = cap;
+    }
+    k->samples[k->count++] = seconds;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Render the frame due at virtual time now; returns the wall time it took
+double replay_frame(double now) {
+    double t0 = monotonic_seconds();
+    if (!scroll_animating()) g_frames.lastAnimation = now;
+    advance_scroll(now);
+    draw_window();
+    g_frames.requested = 0;
+    g_frames.lastFrame = now;
+    g_frames.frames++;
+    return monotonic_seconds() - t0;
+}
+
+// Frames the loop would have drawn before virtual time now: a requested frame waiting for
+// its refresh slot, then one per slot while the scroll animation runs
+void replay_frames_until(double now) {
+    while ((g_frames.requested || scroll_animating()) && g_frames.lastFrame + g_frames.interval <= now) {
+        replay_sample(REPLAY_FRAME, replay_frame(g_frames.lastFrame + g_frames.interval));
+        g_replay_kinds[REPLAY_FRAME].frames++;
+    }
+}
+
+// Wait for a navigation the event started and install it with all metadata, so what gets
+// drawn does not depend on thread timing
+void replay_settle() {
+    double t0 = monotonic_seconds();
+    while (io_pending(NULL, 0, NULL, NULL)) usleep(100);
+    IoRequest *done = io_take_result();
+    if (!done) return;
+    apply_io_result(done);
+    if (!g_x11_state.inArchive && !g_x11_state.merged && !g_x11_state.apps)
+        collect_metadata(g_x11_state.dirpath, &g_x11_state.listing, 0, g_x11_state.listing.count);
+    replay_sample(REPLAY_IO, monotonic_seconds() - t0);
+}
+
+// Turn one log line into an event. Returns the kind, or -1 for lines to skip.
+int replay_parse(const char *line, double *when, XEvent *event, KeySym *sym, char *typed, int *typedLen) {
+    long ms;
+    char what[16];
+    int used;
+    if (line[0] == '#' || sscanf(line, "%ld %15s %n", &ms, what, &used) != 2) return -1;
+    const char *args = line + used;
+    *when = ms / 1000.0;
+    memset(event, 0, sizeof(*event));
+
+    if (strcmp(what, "press") == 0 || strcmp(what, "release") == 0) {
+        event->type = what[0] == 'p' ? ButtonPress : ButtonRelease;
+        if (sscanf(args, "%u %d %d", &event->xbutton.button, &event->xbutton.x, &event->xbutton.y) != 3) return -1;
+        if (event->type == ButtonPress && (event->xbutton.button == 4 || event->xbutton.button == 5)) return REPLAY_SCROLL;
+        return event->type == ButtonPress ? REPLAY_PRESS : REPLAY_RELEASE;
+    }
+    if (strcmp(what, "motion") == 0) {
+        event->type = MotionNotify;
+        return sscanf(args, "%d %d", &event->xmotion.x, &event->xmotion.y) == 2 ? REPLAY_MOTION : -1;
+    }
+    if (strcmp(what, "configure") == 0) {
+        event->type = ConfigureNotify;
+        return sscanf(args, "%d %d", &event->xconfigure.width, &event->xconfigure.height) == 2 ? REPLAY_CONFIGURE : -1;
+    }
+    if (strcmp(what, "key") == 0) {
+        unsigned long keysym;
+        char text[17];
+        event->type = KeyPress;
+        if (sscanf(args, "%lx %x %16s", &keysym, &event->xkey.state, text) != 3) return -1;
+        *sym = (KeySym)keysym;
+        *typedLen = 0;
+        for (const char *p = text; p[0] && p[1] && *typedLen < 8; p += 2) {
+            unsigned byte;
+            if (sscanf(p, "%2x", &byte) != 1) break;
+            typed[(*typedLen)++] = (char)byte;
+        }
+        return REPLAY_KEY;
+    }
+    if (strcmp(what, "expose") == 0) {
+        event->type = Expose;
+        return REPLAY_OTHER;
+    }
+    if (strcmp(what, "focusout") == 0) {
+        event->type = FocusOut;
+        return REPLAY_OTHER;
+    }
+    return -1;
+}
+
+// A fixed folder to replay against: the same names and sizes on every machine
+int replay_make_tree(char *dir) {
+    static const char *exts[] = { "txt", "pdf", "c", "md", "log" };
+    strcpy(dir, "/tmp/bt-replay-XXXXXX");
+    if (!mkdtemp(dir)) return -1;
+    char path[MAX_PATH_LEN];
+    for (int d = 0; d < 30; d++) {
+        snprintf(path, sizeof(path), "%s/folder%02d", dir, d);
+        if (mkdir(path, 0755) < 0) return -1;
+        for (int f = 0; f < 100; f++) {
+            snprintf(path, sizeof(path), "%s/folder%02d/note%03d.txt", dir, d, f);
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) return -1;
+            close(fd);
+        }
+    }
+    for (int i = 0; i < 3000; i++) {
+        snprintf(path, sizeof(path), "%s/%c%s-%04d.%s", dir, 'a' + i % 26, i % 3 ? "report" : "Draft",
+                 i, exts[i % 5]);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return -1;
+        int failed = ftruncate(fd, (off_t)((long long)i * 7919 % 5000000)) < 0;   // sparse, costs no disk
+        close(fd);
+        if (failed) return -1;
+    }
+    return 0;
+}
+
+int replay_remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    remove(path);
+    return 0;
+}
+
+int replay_events(const char *logPath, int argc, char *argv[]) {
+    FILE *log = fopen(logPath, "r");
+    if (!log) {
+        fprintf(stderr, "Error: Cannot read '%s'\n", logPath);
+        return 1;
+    }
+
+    // The window starts at the recorded size unless BT_RENDER_SIZE says otherwise
+    char line[256];
+    int width, height;
+    if (fgets(line, sizeof(line), log) && sscanf(line, "# better-toolbar events %dx%d", &width, &height) == 2 &&
+        !getenv("BT_RENDER_SIZE")) {
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", width, height);
+        setenv("BT_RENDER_SIZE", size, 1);
+    }
+    rewind(log);
+
+    char tree[32] = "";
+    char *treeArgv[2];
+    if (argc < 2) {
+        if (replay_make_tree(tree) < 0) {
+            fprintf(stderr, "Error: Cannot create the synthetic folder: %s\n", strerror(errno));
+            if (tree[0]) nftw(tree, replay_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+            fclose(log);
+            return 1;
+        }
+        treeArgv[0] = argv[0];
+        treeArgv[1] = tree;
+        argc = 2;
+        argv = treeArgv;
+    }
+
+    Canvas canvas;
+    if (!headless_init(argc, argv, &canvas)) {
+        if (tree[0]) nftw(tree, replay_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        fclose(log);
+        return 1;
+    }
+    g_x11_state.replaying = 1;
+    io_layer_init();
+    const char *hz = getenv("BT_REFRESH_HZ");
+    g_frames.interval = 1.0 / (hz && atoi(hz) > 0 ? atoi(hz) : 60);
+    g_frames.lastFrame = -g_frames.interval;
+    replay_frame(0);
+
+    double now = 0;
+    int events = 0;
+    while (!g_x11_state.quitFlag && fgets(line, sizeof(line), log)) {
+        XEvent event;
+        KeySym sym = NoSymbol;
+        char typed[8];
+        int typedLen = 0;
+        int kind = replay_parse(line, &now, &event, &sym, typed, &typedLen);
+        if (kind < 0) continue;
+        replay_frames_until(now);
+
+        double t0 = monotonic_seconds();
+        if (event.type == KeyPress) handle_key_press(sym, event.xkey.state, typed, typedLen);
+        else handle_x_event(&event);
+        double handled = monotonic_seconds() - t0;
+        replay_settle();
+
+        // The loop draws right away unless the last frame was less than a refresh ago
+        if (g_frames.requested && g_frames.lastFrame + g_frames.interval <= now) {
+            handled += replay_frame(now);
+            g_replay_kinds[kind].frames++;
+        }
+        replay_sample(kind, handled);
+        events++;
+    }
+    // Let a running animation finish, at most ten seconds of it
+    replay_frames_until(now + 10.0);
+    fclose(log);
+
+    const char *budgetEnv = getenv("BT_REPLAY_BUDGET_US");
+    double budget = budgetEnv ? atof(budgetEnv) : 0;
+    int overBudget = 0;
+    printf("%d events, %d rows, %dx%d, %llu frames\n", events, g_x11_state.listing.count,
+           canvas.width, canvas.height, g_frames.frames);
+    printf("%-10s %7s %7s %9s %9s %9s %9s\n", "event", "count", "frames", "p50 us", "p90 us", "p99 us", "max us");
+    for (int i = 0; i < REPLAY_KINDS; i++) {
+        ReplayKind *k = &g_replay_kinds[i];
+        if (k->count == 0) continue;
+        qsort(k->samples, (size_t)k->count, sizeof(double), compare_doubles);
+        double p99 = k->samples[(int)((k->count - 1) * 0.99)] * 1e6;
+        printf("%-10s %7d %7llu %9.0f %9.0f %9.0f %9.0f\n", k->name, k->count, k->frames,
+               k->samples[(int)((k->count - 1) * 0.5)] * 1e6, k->samples[(int)((k->count - 1) * 0.9)] * 1e6,
+               p99, k->samples[k->count - 1] * 1e6);
+        if (budget > 0 && p99 > budget && i != REPLAY_IO) {
+            fprintf(stderr, "%s: p99 %.0f us is over the %.0f us budget\n", k->name, p99, budget);
+            overBudget = 1;
+        }
+        free(k->samples);
+        k->samples = NULL;
+        k->count = k->capacity = 0;
+    }
+
+    io_layer_shutdown();
+    meta_loader_shutdown();
+    search_view_close();
+    headless_free(&canvas);
+    if (tree[0]) nftw(tree, replay_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return overBudget;
+}
+
+// ---- startup round trips ----
+
+// Placing the window needs three answers from the server: the _NET_WORKAREA atom, the
+// pointer position and the GC font metrics. Through Xlib each is a blocking round trip in
+// turn; here they go out together on the display's XCB connection, and the replies are
+// collected only once the local setup (folder scan, snapshot, worker threads) is started.
+// Only the work area property itself has to wait for its atom.
+
+typedef struct {
+    xcb_intern_atom_cookie_t workareaAtom;
+    xcb_query_pointer_cookie_t pointer;
+    xcb_query_font_cookie_t font;
+} StartupQueries;
+
+void startup_send_queries(xcb_connection_t *xc, Window root, GContext gc, StartupQueries *q) {
+    static const char workarea[] = "_NET_WORKAREA";
+    q->workareaAtom = xcb_intern_atom(xc, 1, sizeof(workarea) - 1, workarea);
+    q->pointer = xcb_query_pointer(xc, (xcb_window_t)root);
+    q->font = xcb_query_font(xc, (xcb_fontable_t)gc);
+    xcb_flush(xc);
+}
+
+// x, y, width, height of the work area; the whole screen if the window manager publishes none
+void startup_work_area(xcb_connection_t *xc, StartupQueries *q, Window root, const xcb_screen_t *screen, long area[4]) {
+    area[0] = area[1] = 0;
+    area[2] = screen->width_in_pixels;
+    area[3] = screen->height_in_pixels;
+    xcb_intern_atom_reply_t *atom = xcb_intern_atom_reply(xc, q->workareaAtom, NULL);
+    if (!atom) return;
+    xcb_atom_t name = atom->atom;
+    free(atom);
+    if (name == XCB_ATOM_NONE) return;
+
+    xcb_get_property_cookie_t cookie = xcb_get_property(xc, 0, (xcb_window_t)root, name, XCB_ATOM_CARDINAL, 0, 4);
+    xcb_get_property_reply_t *prop = xcb_get_property_reply(xc, cookie, NULL);
+    if (!prop) return;
+    if (prop->format == 32 && xcb_get_property_value_length(prop) >= 16) {
+        const uint32_t *data = (const uint32_t *)xcb_get_property_value(prop);
+        for (int i = 0; i < 4; i++) area[i] = (long)(int32_t)data[i];
+    }
+    free(prop);
+}
+
+// The font metrics reply as the XFontStruct that XTextWidth and XFreeFontInfo expect
+XFontStruct *startup_font(xcb_connection_t *xc, StartupQueries *q) {
+    xcb_query_font_reply_t *r = xcb_query_font_reply(xc, q->font, NULL);
+    if (!r) return NULL;
+    XFontStruct *fs = (XFontStruct *)calloc(1, sizeof(XFontStruct));
+    if (fs) {
+        fs->direction = r->draw_direction;
+        fs->min_char_or_byte2 = r->min_char_or_byte2;
+        fs->max_char_or_byte2 = r->max_char_or_byte2;
+        fs->min_byte1 = r->min_byte1;
+        fs->max_byte1 = r->max_byte1;
+        fs->all_chars_exist = r->all_chars_exist;
+        fs->default_char = r->default_char;
+        fs->ascent = r->font_ascent;
+        fs->descent = r->font_descent;
+        memcpy(&fs->min_bounds, &r->min_bounds, sizeof(XCharStruct));
+        memcpy(&fs->max_bounds, &r->max_bounds, sizeof(XCharStruct));
+        int n = xcb_query_font_char_infos_length(r);
+        if (n > 0 && (fs->per_char = (XCharStruct *)malloc((size_t)n * sizeof(XCharStruct))))
+            memcpy(fs->per_char, xcb_query_font_char_infos(r), (size_t)n * sizeof(XCharStruct));
+    }
+    free(r);
+    return fs;
+}
+
 int main_gui_function(int argc, char *argv[]) {
     // Store argc/argv globally
     g_argc = argc;
     g_argv = argv;
     
     // Initialize X11
+    double startupStart = monotonic_seconds();
     g_x11_state.display = XOpenDisplay(NULL);
     if (!g_x11_state.display) {
         fprintf(stderr, "Error: Cannot open X11 display\n");
@@ -1212,47 +12648,59 @@ int main_gui_function(int argc, char *argv[]) {
     
     int screen = DefaultScreen(g_x11_state.display);
     Window root = RootWindow(g_x11_state.display, screen);
+    xcb_connection_t *xc = XGetXCBConnection(g_x11_state.display);
+
+    // Create GC on the root window (same depth as ours), so its font can be queried
+    // together with the other startup requests before the window exists
+    g_x11_state.gc = XCreateGC(g_x11_state.display, root, 0, NULL);
+    XSetBackground(g_x11_state.display, g_x11_state.gc, 0xFFFFFF);
+    XSetForeground(g_x11_state.display, g_x11_state.gc, 0x000000);
+    StartupQueries queries;
+    startup_send_queries(xc, root, XGContextFromGC(g_x11_state.gc), &queries);
     
     // default window size
-    g_x11_state.windowWidth = 300;
+    preview_init();
+    dirsizes_init();
+    git_status_init();
+    children_init();
+    g_x11_state.windowWidth = 300 + (g_preview.shown ? PREVIEW_WIDTH : 0);
     g_x11_state.windowHeight = 600;
 
+    // Local setup runs while the replies are on their way.
+    // Initial folder: argv[1] if it is a directory, else the current one. It is
+    // resolved and scanned on an I/O thread so a hung mount cannot block startup.
+    thumbs_init();
+    readahead_init();
+    g_x11_state.filterStart = 1;
+    snprintf(g_x11_state.dirpath, sizeof(g_x11_state.dirpath), "%s", argc >= 2 ? argv[1] : ".");
+    
+    init_wake_pipe();
+    counters_init();
+    event_log_open();
+    io_layer_init();
+    frame_scheduler_init();
+    if (g_apps_mode) navigate_to("", IO_APPS);
+    else if (g_recent_mode) navigate_to("", IO_RECENT);
+    else if (session_restore(argc, argv)) navigate_to(g_x11_state.dirpath, IO_REVALIDATE);
+    else navigate_to(argc >= 2 ? argv[1] : "", IO_PROBE_FIRST_ARG);
+
     // Determine work area using _NET_WORKAREA (if available) to avoid overlapping panels/taskbar
-    long work_x = 0, work_y = 0, work_w = DisplayWidth(g_x11_state.display, screen), work_h = DisplayHeight(g_x11_state.display, screen);
-    Atom netWorkarea = XInternAtom(g_x11_state.display, "_NET_WORKAREA", True);
-    if (netWorkarea != None) {
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        long *data = NULL;
-        if (XGetWindowProperty(g_x11_state.display, root, netWorkarea, 0, 4, False, XA_CARDINAL,
-                               &actual_type, &actual_format, &nitems, &bytes_after, (unsigned char**)&data) == Success && data && nitems >= 4) {
-            // data layout: x, y, width, height
-            work_x = data[0];
-            work_y = data[1];
-            work_w = data[2];
-            work_h = data[3];
-            XFree(data);
-        } else {
-            // fallback to full screen
-            work_x = 0;
-            work_y = 0;
-            work_w = DisplayWidth(g_x11_state.display, screen);
-            work_h = DisplayHeight(g_x11_state.display, screen);
-        }
-    } else {
-        work_x = 0;
-        work_y = 0;
-        work_w = DisplayWidth(g_x11_state.display, screen);
-        work_h = DisplayHeight(g_x11_state.display, screen);
-    }
+    const xcb_setup_t *setup = xcb_get_setup(xc);
+    xcb_screen_iterator_t it = xcb_setup_roots_iterator(setup);
+    for (int i = 0; i < screen && it.rem; i++) xcb_screen_next(&it);
+    long area[4];
+    startup_work_area(xc, &queries, root, it.data, area);
+    long work_x = area[0], work_y = area[1], work_w = area[2], work_h = area[3];
 
     // Compute initial position at cursor + 640 Y offset and clamp inside work area
-    Window returned_root, returned_child;
-    int root_x, root_y, win_x, win_y;
-    unsigned int mask;
-    XQueryPointer(g_x11_state.display, root, &returned_root, &returned_child,
-                  &root_x, &root_y, &win_x, &win_y, &mask);
+    int root_x = 0, root_y = 0;
+    xcb_query_pointer_reply_t *pointer = xcb_query_pointer_reply(xc, queries.pointer, NULL);
+    if (pointer) {
+        root_x = pointer->root_x;
+        root_y = pointer->root_y;
+        free(pointer);
+    }
+    g_x11_state.font = startup_font(xc, &queries);
 
     int createX = root_x;
     int createY = root_y - 640;  // Changed to -640 (above cursor)
@@ -1277,104 +12725,103 @@ int main_gui_function(int argc, char *argv[]) {
     // Set window title
     XStoreName(g_x11_state.display, g_x11_state.window, "Better-Toolbar");
 
-    // Create GC
-    g_x11_state.gc = XCreateGC(g_x11_state.display, g_x11_state.window, 0, NULL);
-    XSetBackground(g_x11_state.display, g_x11_state.gc, 0xFFFFFF);
-    XSetForeground(g_x11_state.display, g_x11_state.gc, 0x000000);
-
-    // Initialize directory path
-    g_x11_state.filterStart = 1;
-    
-    if (argc >= 2) {
-        char candidatePath[MAX_PATH_LEN];
-        
-        // Copy the argument
-        strncpy(candidatePath, argv[1], MAX_PATH_LEN - 1);
-        candidatePath[MAX_PATH_LEN - 1] = '\0';
-        remove_trailing_slash(candidatePath);
-
-        // Check if it's a directory
-        if (is_directory(candidatePath)) {
-            if (set_cur_dir(candidatePath)) {
-                getcwd(g_x11_state.dirpath, MAX_PATH_LEN);
-                remove_trailing_slash(g_x11_state.dirpath);
-                g_x11_state.filterStart = 2;
-            }
+    // Optional client-side renderer; the server no longer clears the window before each frame
+    const char *renderMode = getenv("BT_RENDER");
+    if (renderMode && strcmp(renderMode, "soft") == 0) {
+        if (soft_surface_create(g_x11_state.windowWidth, g_x11_state.windowHeight)) {
+            XSetWindowBackgroundPixmap(g_x11_state.display, g_x11_state.window, None);
+        } else {
+            fprintf(stderr, "BT_RENDER=soft needs a 24-bit TrueColor visual, using Xlib drawing\n");
         }
     }
     
-    // If not set, use current directory
-    if (strlen(g_x11_state.dirpath) == 0) {
-        getcwd(g_x11_state.dirpath, MAX_PATH_LEN);
-        remove_trailing_slash(g_x11_state.dirpath);
-    }
-    
-    // Scan directory
-    g_x11_state.fileCount = scan_directory(g_x11_state.dirpath, g_x11_state.files, argc, argv, g_x11_state.filterStart);
-    
     // Map window
     XMapWindow(g_x11_state.display, g_x11_state.window);
     XFlush(g_x11_state.display);
+    counters_add_us(&g_counters.startupUs, monotonic_seconds() - startupStart);
     
     // Event loop
     XEvent event;
     g_x11_state.quitFlag = 0;
     g_x11_state.buttonPressed = 0;
     
+    int xfd = ConnectionNumber(g_x11_state.display);
+    
     while (!g_x11_state.quitFlag) {
-        if (XPending(g_x11_state.display)) {
+        while (!g_x11_state.quitFlag && XPending(g_x11_state.display)) {
             XNextEvent(g_x11_state.display, &event);
             
-            switch (event.type) {
-                case Expose:
-                    if (event.xexpose.count == 0) {
-                        // refresh window content
-                        draw_window();
-                    }
-                    break;
-                
-                case ButtonPress:
-                    if (event.xbutton.button == 4) {
-                        handle_mouse_scroll(-1);
-                    } else if (event.xbutton.button == 5) {
-                        handle_mouse_scroll(1);
-                    } else if (event.xbutton.button == 1) {
-                        handle_mouse_press(event.xbutton.x, event.xbutton.y);
-                    }
-                    break;
-                
-                case ButtonRelease:
-                    if (event.xbutton.button == 1) {
-                        handle_mouse_release(event.xbutton.x, event.xbutton.y);
-                    }
-                    break;
-                
-                case MotionNotify:
-                    handle_mouse_move(event.xmotion.x, event.xmotion.y);
-                    break;
-                
-                case ConfigureNotify:
-                    g_x11_state.windowWidth = event.xconfigure.width;
-                    g_x11_state.windowHeight = event.xconfigure.height;
-                    draw_window();
-                    break;
-                
-                case KeyPress:
-                    if (event.xkey.keycode == 9) { // Escape key
-                        g_x11_state.quitFlag = 1;
-                    }
-                    break;
+            event_log_write(&event);
+            handle_x_event(&event);
+        }
+        if (g_x11_state.quitFlag) break;
 
-                case FocusOut:
-                    // quit when window loses focus/activation (behavior requested)
-                    g_x11_state.quitFlag = 1;
-                    break;
-            }
-        } else {
-            usleep(10000); // sleep for 10ms to reduce CPU usage
+        counters_poll_dump();
+
+        // A folder finished loading
+        IoRequest *done = io_take_result();
+        if (done) {
+            apply_io_result(done);
+        }
+
+        // Metadata and thumbnails that arrived for visible rows
+        int firstRow, lastRow;
+        visible_rows(&firstRow, &lastRow);
+        int changed = meta_apply_results(&g_x11_state.listing, firstRow, lastRow);
+        changed |= thumb_apply_results();
+        changed |= children_apply_results();
+        changed |= search_view_apply();
+        changed |= preview_apply_results();
+        changed |= dirsizes_progress();
+        changed |= git_status_progress();
+        changed |= file_ops_poll();
+        if (changed) {
+            request_frame();
+        }
+
+        // At most one repaint for everything that happened since the last frame
+        int timeout = run_frame_scheduler();
+
+        // Wake up when a pending folder load passes its deadline, to show it as not responding
+        double deadline;
+        int overdue;
+        if (io_pending(NULL, 0, &overdue, &deadline) && !overdue) {
+            int ms = (int)((deadline - monotonic_seconds()) * 1000.0) + 1;
+            if (ms < 1) ms = 1;
+            if (timeout < 0 || ms < timeout) timeout = ms;
+            g_frames.requested |= ms <= 1;
+        }
+
+        // Wake up when the pointer has rested on a file long enough to read it ahead
+        int dwell = readahead_tick();
+        if (dwell >= 0 && (timeout < 0 || dwell < timeout)) timeout = dwell;
+        dwell = preview_tick();
+        if (dwell >= 0 && (timeout < 0 || dwell < timeout)) timeout = dwell;
+
+        // Sleep until the X server or a worker thread has something for us, or the next frame is due
+        XFlush(g_x11_state.display);
+        struct pollfd fds[2] = { { xfd, POLLIN, 0 }, { g_wake_pipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, timeout) > 0 && (fds[1].revents & POLLIN)) {
+            drain_wake_pipe();
         }
+        __atomic_fetch_add(&g_counters.wakeups, 1, __ATOMIC_RELAXED);
     }
     
+    // Quitting (or losing focus) with file operations pending hides the window and lets
+    // them finish first
+    if (fileops_busy()) {
+        XUnmapWindow(g_x11_state.display, g_x11_state.window);
+        XFlush(g_x11_state.display);
+        fileops_drain();
+    }
+
+    if (g_frames.logStats) frame_stats_report(stderr);
+    if (g_readahead.logStats) readahead_report(stderr);
+    counters_save();
+    session_save(argc, argv);
+    dirsizes_save();
+    event_log_close();
+
     // Cleanup
     cleanup_x11();
     return 0;
@@ -1383,7 +12830,48 @@ int main_gui_function(int argc, char *argv[]) {
 int main(int argc, char *argv[]) {
     int result = 0;
 
-    if (IS_CLI() == 0) {
+    if (argc == 3 && strcmp(argv[1], "--bench-stat") == 0) {
+        return bench_stat(argv[2]);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--render-ppm") == 0) {
+        return render_ppm(argv[2], argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--bench-render") == 0) {
+        return bench_render(argc - 1, argv + 1);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--replay") == 0) {
+        return replay_events(argv[2], argc - 2, argv + 2);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--bench-grep") == 0) {
+        return bench_grep(argv[2], argc == 4 ? argv[3] : ".");
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--bench-archive") == 0) {
+        return bench_archive(argv[2], argc == 4 ? argv[3] : "");
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--bench-match") == 0) {
+        return bench_match(argc == 3 ? atoi(argv[2]) : 1000000);
+    }
+    if (argc == 2 && strcmp(argv[1], "--bench-apps") == 0) {
+        return bench_apps();
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--bench-dups") == 0) {
+        return bench_dups(argc == 3 ? argv[2] : ".");
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--bench-recent") == 0) {
+        return bench_recent(argc == 3 ? argv[2] : NULL);
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--bench-io") == 0) {
+        return bench_io(argc == 3 ? argv[2] : ".");
+    }
+
+    g_dedup_roots = take_flag_option(&argc, argv, "--dedup");
+    g_apps_mode = take_flag_option(&argc, argv, "--apps");
+    g_recent_mode = take_flag_option(&argc, argv, "--recent");
+    int listFormat = take_list_option(&argc, argv);
+
+    if (listFormat >= 0) {
+        result = main_list_function(argc, argv, listFormat);
+    } else if (IS_CLI() == 0) {
         result = main_cli_function(argc, argv);
     } else {
         result = main_gui_function(argc, argv);
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Render the first frame of a fixed folder with --render-ppm and compare it byte for
+# byte with the stored image. The folder lives at a fixed path because the path is
+# drawn above the list. After an intended change to the look, run with UPDATE=1 and
+# commit the new image.
+#
+# Usage: tests/render/check.sh [path/to/better-toolbar]
+
+bin=${1:-./better-toolbar}
+golden=$(dirname "$0")/first-frame.ppm
+tree=/tmp/bt-golden
+home=/tmp/bt-golden-home
+
+rm -rf "$tree" "$home" "$tree.ppm"
+mkdir -p "$tree/Документы" "$tree/src" "$home" || exit 1
+for f in README.md notes.txt отчёт.pdf build.sh video.mkv Zeta.LOG; do
+    : > "$tree/$f" || exit 1
+done
+truncate -s 1234 "$tree/README.md"
+truncate -s 53248 "$tree/отчёт.pdf"
+truncate -s 3221225472 "$tree/video.mkv"    # sparse, costs no disk
+truncate -s 700 "$tree/Zeta.LOG"
+chmod 644 "$tree"/*.* && chmod 755 "$tree/build.sh"
+
+# An empty HOME keeps caches and settings of the user out of the frame
+HOME=$home XDG_CACHE_HOME= XDG_CONFIG_HOME= XDG_STATE_HOME= BT_RENDER_SIZE=300x400 \
+    "$bin" --render-ppm "$tree.ppm" "$tree" || exit 1
+
+if [ -n "$UPDATE" ]; then
+    cp "$tree.ppm" "$golden"
+    echo "updated $golden"
+elif cmp -s "$tree.ppm" "$golden"; then
+    echo "render: ok"
+else
+    echo "render: $tree.ppm differs from $golden" >&2
+    exit 1
+fi
+rm -rf "$tree" "$home" "$tree.ppm"
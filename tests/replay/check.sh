@@ -0,0 +1,34 @@
+#!/bin/sh
+# Replay a recorded session against the synthetic folder and check two things: every
+# kind of event stays within the latency budget (p99, BT_REPLAY_BUDGET_US, 4000 us by
+# default), and the number of events and frames per kind matches session.expected.
+# Time is virtual, so the counts are the same on every machine; a change in them means
+# the handlers now draw more or fewer frames for the same input. After an intended
+# change, run with UPDATE=1 and commit the new counts.
+#
+# Usage: tests/replay/check.sh [path/to/better-toolbar]
+
+bin=${1:-./better-toolbar}
+here=$(dirname "$0")
+out=/tmp/bt-replay-check.txt
+
+BT_REPLAY_BUDGET_US=${BT_REPLAY_BUDGET_US:-4000} "$bin" --replay "$here/session.log" > "$out"
+status=$?
+cat "$out"
+[ $status -eq 0 ] || exit 1
+
+# Totals from the first line, then event, count and frames of each kind
+counts() {
+    awk 'NR == 1 { print $1, $2, $3, $4, $6, $7; next } NR > 2 { print $1, $2, $3 }' "$1"
+}
+if [ -n "$UPDATE" ]; then
+    counts "$out" > "$here/session.expected"
+    echo "updated $here/session.expected"
+elif counts "$out" | cmp -s - "$here/session.expected"; then
+    echo "replay: ok"
+else
+    echo "replay: counts differ from $here/session.expected:" >&2
+    counts "$out" | diff "$here/session.expected" - >&2
+    exit 1
+fi
+rm -f "$out"